@@ -0,0 +1,482 @@
+/** ***************************************************************************
+ * @file
+ * @brief Contains the reader and writers for the ascii (P3 and P2) formats
+ *
+ * Ascii images are about four times the size of their pixels and parsing
+ * or printing numbers is slow, so the work is split between threads.  The
+ * reader splits the text into one chunk per thread at whitespace, counts
+ * the numbers in each chunk to find where each chunk's pixels go, and
+ * then parses the chunks at the same time.  The writers print bands of
+ * rows into one buffer per thread and write the buffers in order.
+ *****************************************************************************/
+
+
+#include "netPBM.h"
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * checks if a character separates the numbers in an ascii image.
+ *
+ * @param[in]     ch - character to check.
+ *
+ * @returns true if ch is whitespace and false otherwise.
+ *
+ * @par Example
+ * @verbatim
+   isSeparator('\n'); // true
+   isSeparator('7');  // false
+   @endverbatim
+ *****************************************************************************/
+
+bool isSeparator(char ch)
+{
+    return ch == ' ' || ch == '\n' || ch == '\r' || ch == '\t' || ch == '\v'
+        || ch == '\f';
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * reads everything left in fin into text.  When fin can seek the size is
+ * found first so text is allocated only once.
+ *
+ * @param[in,out]     fin - stream to read.
+ * @param[out]        text - receives the rest of the stream.
+ *
+ * @returns true if the memory for text could be allocated.
+ *
+ * @par Example
+ * @verbatim
+   vector<char> text;
+   readRest(fin, text); // text holds the pixel values of a P3 image
+   @endverbatim
+ *****************************************************************************/
+
+bool readRest(istream& fin, vector<char>& text)
+{
+    size_t used = 0;
+    streamoff start;
+    streamoff end;
+
+    start = fin.tellg();
+    fin.seekg(0, ios::end);
+    end = fin.tellg();
+    fin.clear();
+    fin.seekg(start);
+
+    try
+    {
+        if (start >= 0 && end >= start)
+        {
+            text.resize(size_t(end - start));
+            fin.read(text.data(), text.size());
+            used = size_t(fin.gcount());
+        }
+        else
+        {
+            while (fin)
+            {
+                text.resize(used + PIPE_BLOCK);
+                fin.read(text.data() + used, PIPE_BLOCK);
+                used = used + size_t(fin.gcount());
+            }
+        }
+        text.resize(used);
+    }
+    catch (const bad_alloc&)
+    {
+        return false;
+    }
+
+    fin.clear();
+
+    return true;
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * reads the pixel values of a P3 image, whose header has already been
+ * read, into the planes of img.  The planes must already be allocated.
+ *
+ * @param[in,out]     fin - stream positioned at the first pixel value.
+ * @param[in,out]     img - structure with its size and planes set.
+ *
+ * @returns IMAGE_OK, IMAGE_READ_FAILED if there are too few values or a
+ *          value isn't a number, or IMAGE_NO_MEMORY.
+ *
+ * @par Example
+ * @verbatim
+   readHeader(fin, img);
+   allocImage(img, img.rows, img.cols);
+   readAscii(fin, img); // fills img from the text in fin
+   @endverbatim
+ *****************************************************************************/
+
+imageError readAscii(istream& fin, image& img)
+{
+    return sampleAscii(fin, img, img.rows, img.cols, 1);
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * reads every step-th pixel of every step-th row of a P3 image, whose
+ * header has already been read, into the planes of img.  The numbers of
+ * the pixels that aren't kept are skipped without being converted or
+ * checked.  With a step of 1 every pixel is read.
+ *
+ * @param[in,out]     fin - stream positioned at the first pixel value.
+ * @param[in,out]     img - structure with planes of (rows + step - 1) / step
+ *                          rows and (cols + step - 1) / step columns.
+ * @param[in]         rows - number of rows in the file.
+ * @param[in]         cols - number of columns in the file.
+ * @param[in]         step - distance between the rows and columns kept.
+ *
+ * @returns IMAGE_OK, IMAGE_READ_FAILED if there are too few values or a
+ *          value kept isn't a number, or IMAGE_NO_MEMORY.
+ *
+ * @par Example
+ * @verbatim
+   readHeader(fin, img);
+   rows = img.rows;
+   cols = img.cols;
+   allocImage(img, (rows + 3) / 4, (cols + 3) / 4);
+   sampleAscii(fin, img, rows, cols, 4); // a quarter of the width and height
+   @endverbatim
+ *****************************************************************************/
+
+imageError sampleAscii(istream& fin, image& img, int rows, int cols, int step)
+{
+    TRACE_SCOPE("readAscii");
+
+    vector<char> text;
+    vector<size_t> bounds;
+    vector<long long> first;
+    vector<char> bad;
+
+    long long size = 3LL * rows * cols;
+    long long total;
+    int threads;
+    int t;
+
+    if (!readRest(fin, text))
+    {
+        return IMAGE_NO_MEMORY;
+    }
+    countAlloc(text.capacity());
+
+    threads = threadCount(text.size());
+    bounds.resize(threads + 1);
+    first.assign(threads + 1, 0);
+    bad.assign(threads, 0);
+
+    bounds[0] = 0;
+    bounds[threads] = text.size();
+
+    for (t = 1; t < threads; t++)
+    {
+        bounds[t] = max(bounds[t - 1], text.size() * t / threads);
+
+        while (bounds[t] < text.size() && !isSeparator(text[bounds[t]]))
+        {
+            bounds[t]++;
+        }
+    }
+
+    // count the numbers in each chunk
+    runParallel(threads, [&](int part)
+    {
+        size_t pos;
+        long long count = 0;
+        bool inNumber = false;
+
+        for (pos = bounds[part]; pos < bounds[part + 1]; pos++)
+        {
+            if (isSeparator(text[pos]))
+            {
+                inNumber = false;
+            }
+            else if (!inNumber)
+            {
+                inNumber = true;
+                count++;
+            }
+        }
+        first[part + 1] = count;
+    });
+
+    for (t = 0; t < threads; t++)
+    {
+        first[t + 1] = first[t + 1] + first[t];
+    }
+    total = first[threads];
+
+    if (total < size)
+    {
+        countFree(text.capacity());
+        return IMAGE_READ_FAILED;
+    }
+
+    // parse each chunk into the pixels that start at first[part]
+    runParallel(threads, [&](int part)
+    {
+        pixel** planes[3] = { img.redGray, img.green, img.blue };
+        size_t pos = bounds[part];
+        long long index = first[part];
+        int channel = int(index % 3);
+        int col = int(index / 3 % cols);
+        int row = int(index / 3 / cols);
+        int value;
+        bool valid;
+
+        while (pos < bounds[part + 1] && index < size)
+        {
+            if (isSeparator(text[pos]))
+            {
+                pos++;
+                continue;
+            }
+
+            if (step > 1 && (row % step != 0 || col % step != 0))
+            {
+                while (pos < bounds[part + 1] && !isSeparator(text[pos]))
+                {
+                    pos++;
+                }
+            }
+            else
+            {
+                value = 0;
+                valid = true;
+
+                while (pos < bounds[part + 1] && !isSeparator(text[pos]))
+                {
+                    if (text[pos] >= '0' && text[pos] <= '9')
+                    {
+                        value = min(value * 10 + (text[pos] - '0'), 1000000);
+                    }
+                    else
+                    {
+                        valid = false;
+                    }
+                    pos++;
+                }
+
+                if (!valid)
+                {
+                    bad[part] = 1;
+                }
+
+                planes[channel][row / step][col / step] = pixel(value);
+            }
+            index++;
+            channel++;
+
+            if (channel == 3)
+            {
+                channel = 0;
+                col++;
+
+                if (col == cols)
+                {
+                    col = 0;
+                    row++;
+                }
+            }
+        }
+    });
+
+    countFree(text.capacity());
+
+    for (t = 0; t < threads; t++)
+    {
+        if (bad[t])
+        {
+            return IMAGE_READ_FAILED;
+        }
+    }
+
+    return IMAGE_OK;
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * adds the digits of a pixel value to the end of out.
+ *
+ * @param[in,out]     out - text the number is added to.
+ * @param[in]         value - pixel value.
+ *
+ * @par Example
+ * @verbatim
+   string out;
+   appendNumber(out, 42); // out is "42"
+   @endverbatim
+ *****************************************************************************/
+
+void appendNumber(string& out, pixel value)
+{
+    if (value >= 100)
+    {
+        out += char('0' + value / 100);
+    }
+    if (value >= 10)
+    {
+        out += char('0' + value / 10 % 10);
+    }
+    out += char('0' + value % 10);
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * returns the number of rows each thread prints at a time so that its
+ * buffer stays near ASCII_BAND bytes.
+ *
+ * @param[in]     cols - number of columns in the image.
+ * @param[in]     channels - 3 for P3 or 1 for P2.
+ *
+ * @returns number of rows in a band, at least 1.
+ *
+ * @par Example
+ * @verbatim
+   bandRows(640, 3); // 126 rows of at most 13 bytes a pixel
+   @endverbatim
+ *****************************************************************************/
+
+int bandRows(int cols, int channels)
+{
+    long long rowBytes = (4LL * channels + 1) * max(cols, 1);
+
+    return int(max(1LL, (long long) ASCII_BAND / rowBytes));
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * returns the most memory writeAscii uses for its buffers.
+ *
+ * @param[in]     rows - number of rows in the image.
+ * @param[in]     cols - number of columns in the image.
+ * @param[in]     channels - 3 for P3 or 1 for P2.
+ *
+ * @returns size of the buffers in bytes.
+ *
+ * @par Example
+ * @verbatim
+   asciiBufferBytes(480, 640, 3); // at most ASCII_BAND bytes per thread
+   @endverbatim
+ *****************************************************************************/
+
+long long asciiBufferBytes(int rows, int cols, int channels)
+{
+    long long band = min(rows, bandRows(cols, channels));
+
+    return threadCount(4LL * channels * rows * cols) * band * (4 * channels + 1) * cols;
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * writes the pixels of img as text, "r g b" on each line for P3 or three
+ * gray values to a line for P2.  The rows are printed in bands, one band
+ * per thread at a time, and the bands are written in order.
+ *
+ * @param[in,out]     fout - stream opened for output.
+ * @param[in]         img - structure containing data of a ppm image.
+ * @param[in]         channels - 3 to write P3 pixels, 1 to write P2 pixels
+ *                               from img.redGray.
+ *
+ * @par Example
+ * @verbatim
+   writeAscii(fout, img, 3); // the pixels of a P3 image
+   @endverbatim
+ *****************************************************************************/
+
+void writeAscii(ostream& fout, image& img, int channels)
+{
+    TRACE_SCOPE("writeAscii");
+
+    int threads;
+    int band;
+    int start;
+    int t;
+    long long bytes;
+
+    vector<string> buffers;
+
+    band = bandRows(img.cols, channels);
+    threads = threadCount(4LL * channels * img.rows * img.cols);
+    bytes = asciiBufferBytes(img.rows, img.cols, channels);
+
+    buffers.resize(threads);
+    countAlloc(bytes);
+
+    for (start = 0; start < img.rows; start += band * threads)
+    {
+        runParallel(threads, [&](int part)
+        {
+            string& out = buffers[part];
+            int first = start + part * band;
+            int last = min(first + band, img.rows);
+            int count = int(((long long) first * img.cols) % 3);
+            int i;
+            int j;
+
+            out.clear();
+            out.reserve(size_t(band) * img.cols * (4 * channels + 1));
+
+            for (i = first; i < last; i++)
+            {
+                for (j = 0; j < img.cols; j++)
+                {
+                    appendNumber(out, img.redGray[i][j]);
+
+                    if (channels == 1)
+                    {
+                        out += ' ';
+                        count++;
+
+                        if (count == 3)
+                        {
+                            count = 0;
+                            out += '\n';
+                        }
+                        continue;
+                    }
+
+                    out += ' ';
+                    appendNumber(out, img.green[i][j]);
+                    out += ' ';
+                    appendNumber(out, img.blue[i][j]);
+                    out += '\n';
+                }
+            }
+        });
+
+        for (t = 0; t < threads; t++)
+        {
+            fout.write(buffers[t].data(), buffers[t].size());
+        }
+    }
+
+    countFree(bytes);
+}
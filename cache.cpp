@@ -0,0 +1,1111 @@
+/** ***************************************************************************
+ * @file
+ * @brief Contains the on-disk cache of finished images
+ *
+ * A finished image is stored in the cache directory under a key made from
+ * a hash of the bytes of the input file and the list of operations and
+ * output type.  When the same input, operations and output type are asked
+ * for again, the stored image is copied to the output and the input isn't
+ * decoded at all.  The file index.txt in the directory records every
+ * image with its size and when it was last used, along with the number of
+ * hits and misses.  When the images grow past the size limit the ones
+ * used longest ago are deleted.  Several programs may share a cache, so
+ * the index is only read, changed and written while holding the lock
+ * file index.lock.
+ *****************************************************************************/
+
+
+#include "netPBM.h"
+
+#include <cerrno>
+#include <chrono>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#include <io.h>
+#include <process.h>
+#else
+#include <unistd.h>
+#include <dirent.h>
+#endif
+
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#endif
+
+
+/**
+ * @brief first prime used by the xxHash64 hash
+ */
+
+const unsigned long long HASH_PRIME1 = 11400714785074694791ULL;
+
+/**
+ * @brief second prime used by the xxHash64 hash
+ */
+
+const unsigned long long HASH_PRIME2 = 14029467366897019727ULL;
+
+/**
+ * @brief third prime used by the xxHash64 hash
+ */
+
+const unsigned long long HASH_PRIME3 = 1609587929392839161ULL;
+
+/**
+ * @brief fourth prime used by the xxHash64 hash
+ */
+
+const unsigned long long HASH_PRIME4 = 9650029242287828579ULL;
+
+/**
+ * @brief fifth prime used by the xxHash64 hash
+ */
+
+const unsigned long long HASH_PRIME5 = 2870177450012600261ULL;
+
+/**
+ * @brief seconds after which the lock of a cache is taken to be left over
+ *        from a program that was stopped while holding it
+ */
+
+const int CACHE_LOCK_STALE = 30;
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * rotates the bits of a 64 bit value to the left.
+ *
+ * @param[in]     value - value to rotate.
+ * @param[in]     bits - number of bits, from 1 to 63.
+ *
+ * @returns the rotated value.
+ *
+ * @par Example
+ * @verbatim
+   rotateBits(1, 4); // 16
+   @endverbatim
+ *****************************************************************************/
+
+unsigned long long rotateBits(unsigned long long value, int bits)
+{
+    return (value << bits) | (value >> (64 - bits));
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * mixes 8 bytes of input into one of the four xxHash64 accumulators.
+ *
+ * @param[in]     acc - accumulator.
+ * @param[in]     input - next 8 bytes of input.
+ *
+ * @returns the new accumulator.
+ *
+ * @par Example
+ * @verbatim
+   acc = hashRound(acc, word);
+   @endverbatim
+ *****************************************************************************/
+
+unsigned long long hashRound(unsigned long long acc, unsigned long long input)
+{
+    acc = acc + input * HASH_PRIME2;
+    acc = rotateBits(acc, 31);
+
+    return acc * HASH_PRIME1;
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * reads a little endian value of size bytes.
+ *
+ * @param[in]     data - bytes to read.
+ * @param[in]     size - 4 or 8.
+ *
+ * @returns the value.
+ *
+ * @par Example
+ * @verbatim
+   readWord(bytes, 8); // first 8 bytes as a number
+   @endverbatim
+ *****************************************************************************/
+
+unsigned long long readWord(const unsigned char* data, int size)
+{
+    unsigned long long value = 0;
+    int i;
+
+    for (i = size - 1; i >= 0; i--)
+    {
+        value = (value << 8) | data[i];
+    }
+
+    return value;
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * hashes a block of bytes with xxHash64, a fast hash that reads 32 bytes
+ * at a time.
+ *
+ * @param[in]     data - bytes to hash.
+ * @param[in]     size - number of bytes.
+ * @param[in]     seed - starting value, a different seed gives a
+ *                       different hash.
+ *
+ * @returns the 64 bit hash.
+ *
+ * @par Example
+ * @verbatim
+   hashBytes("abc", 3, 0); // 0x44bc2cf5ad770999
+   @endverbatim
+ *****************************************************************************/
+
+unsigned long long hashBytes(const void* data, size_t size, unsigned long long seed)
+{
+    const unsigned char* pos = (const unsigned char*) data;
+    const unsigned char* end = pos + size;
+    unsigned long long acc[4];
+    unsigned long long hash;
+    int i;
+
+    if (size >= 32)
+    {
+        acc[0] = seed + HASH_PRIME1 + HASH_PRIME2;
+        acc[1] = seed + HASH_PRIME2;
+        acc[2] = seed;
+        acc[3] = seed - HASH_PRIME1;
+
+        while (end - pos >= 32)
+        {
+            for (i = 0; i < 4; i++)
+            {
+                acc[i] = hashRound(acc[i], readWord(pos + 8 * i, 8));
+            }
+            pos = pos + 32;
+        }
+
+        hash = rotateBits(acc[0], 1) + rotateBits(acc[1], 7) + rotateBits(acc[2], 12)
+            + rotateBits(acc[3], 18);
+
+        for (i = 0; i < 4; i++)
+        {
+            hash = (hash ^ hashRound(0, acc[i])) * HASH_PRIME1 + HASH_PRIME4;
+        }
+    }
+    else
+    {
+        hash = seed + HASH_PRIME5;
+    }
+
+    hash = hash + size;
+
+    while (end - pos >= 8)
+    {
+        hash = hash ^ hashRound(0, readWord(pos, 8));
+        hash = rotateBits(hash, 27) * HASH_PRIME1 + HASH_PRIME4;
+        pos = pos + 8;
+    }
+
+    if (end - pos >= 4)
+    {
+        hash = hash ^ (readWord(pos, 4) * HASH_PRIME1);
+        hash = rotateBits(hash, 23) * HASH_PRIME2 + HASH_PRIME3;
+        pos = pos + 4;
+    }
+
+    while (pos < end)
+    {
+        hash = hash ^ (*pos * HASH_PRIME5);
+        hash = rotateBits(hash, 11) * HASH_PRIME1;
+        pos++;
+    }
+
+    hash = hash ^ (hash >> 33);
+    hash = hash * HASH_PRIME2;
+    hash = hash ^ (hash >> 29);
+    hash = hash * HASH_PRIME3;
+
+    return hash ^ (hash >> 32);
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * hashes the bytes of a file.  The file is read in blocks of PIPE_BLOCK
+ * bytes and the hash of each block is the seed of the next, so only one
+ * block is held in memory.
+ *
+ * @param[in]     name - name of the file.
+ * @param[out]    hash - hash of the file.
+ *
+ * @returns true if the file could be read and false otherwise.
+ *
+ * @par Example
+ * @verbatim
+   unsigned long long hash;
+   hashFile("balloon.ppm", hash);
+   @endverbatim
+ *****************************************************************************/
+
+bool hashFile(string name, unsigned long long& hash)
+{
+    TRACE_SCOPE("hashFile");
+
+    ifstream fin;
+    vector<char> block(PIPE_BLOCK);
+
+    fin.open(name, ios::in | ios::binary);
+
+    if (!fin.is_open())
+    {
+        return false;
+    }
+
+    hash = 0;
+
+    while (fin)
+    {
+        fin.read(block.data(), block.size());
+        hash = hashBytes(block.data(), size_t(fin.gcount()), hash);
+    }
+
+    return fin.eof();
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * makes the cache key for an input file and what is done to it.  The
+ * operations are written out in order with their parameters so that the
+ * same request always gives the same key.
+ *
+ * @param[in]     hash - hash of the input file.
+ * @param[in]     ops - operations given on the command line.
+ * @param[in]     last - LAST_GRAYSCALE or LAST_NONE.
+ * @param[in]     outputType - how the result is written.
+ *
+ * @returns the key as 16 hexadecimal digits.
+ *
+ * @par Example
+ * @verbatim
+   cacheKey(hash, ops, LAST_NONE, OUTPUT_BINARY); // "3f9a0c...", 16 digits
+   @endverbatim
+ *****************************************************************************/
+
+string cacheKey(unsigned long long hash, vector<operation>& ops, lastOption last,
+    outputFormat outputType)
+{
+    string request = to_string(outputType) + " " + to_string(last);
+    char digits[17];
+    size_t i;
+
+    for (i = 0; i < ops.size(); i++)
+    {
+        request = request + " " + ops[i].name + " " + ops[i].param;
+    }
+
+    hash = hashBytes(request.data(), request.size(), hash);
+    snprintf(digits, sizeof(digits), "%016llx", hash);
+
+    return digits;
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * returns the id of this process, used to give the temporary files of
+ * each program a name of its own.
+ *
+ * @returns the process id.
+ *
+ * @par Example
+ * @verbatim
+   to_string(processId()) + ".part"; // "4242.part"
+   @endverbatim
+ *****************************************************************************/
+
+int processId()
+{
+#ifdef _WIN32
+    return _getpid();
+#else
+    return int(getpid());
+#endif
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * finds the size and last change of a file.
+ *
+ * @param[in]     name - name of the file.
+ * @param[out]    bytes - size of the file.
+ * @param[out]    changed - time the file was last changed.
+ *
+ * @returns true if the file exists and false otherwise.
+ *
+ * @par Example
+ * @verbatim
+   long long bytes;
+   time_t changed;
+   fileStatus("cache/index.lock", bytes, changed);
+   @endverbatim
+ *****************************************************************************/
+
+bool fileStatus(string name, long long& bytes, time_t& changed)
+{
+#ifdef _WIN32
+    struct _stat64 info;
+
+    if (_stat64(name.c_str(), &info) != 0)
+    {
+        return false;
+    }
+#else
+    struct stat info;
+
+    if (stat(name.c_str(), &info) != 0)
+    {
+        return false;
+    }
+#endif
+
+    bytes = (long long) info.st_size;
+    changed = info.st_mtime;
+
+    return true;
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * lists the names of the files in a directory.
+ *
+ * @param[in]     dir - the directory.
+ * @param[out]    names - name of each file, without the directory.
+ *
+ * @par Example
+ * @verbatim
+   vector<string> names;
+   listDirectory("cache", names); // "index.txt", "3f9a0c0d11aa5e27.ppm" ...
+   @endverbatim
+ *****************************************************************************/
+
+void listDirectory(string dir, vector<string>& names)
+{
+    names.clear();
+
+#ifdef _WIN32
+    struct _finddata_t found;
+    intptr_t search = _findfirst((dir + "/*").c_str(), &found);
+
+    if (search == -1)
+    {
+        return;
+    }
+
+    do
+    {
+        names.push_back(found.name);
+    } while (_findnext(search, &found) == 0);
+
+    _findclose(search);
+#else
+    DIR* search = opendir(dir.c_str());
+    struct dirent* found;
+
+    if (search == nullptr)
+    {
+        return;
+    }
+
+    while ((found = readdir(search)) != nullptr)
+    {
+        names.push_back(found->d_name);
+    }
+
+    closedir(search);
+#endif
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * takes the lock of a cache so that only one program at a time reads,
+ * changes and writes its index.  The lock is the file index.lock, which
+ * only one program can make.  A program that finds it waits until it is
+ * gone, and removes it if it is older than CACHE_LOCK_STALE seconds since
+ * the program that made it must have been stopped.
+ *
+ * @param[in,out]     cache - the cache, its directory must be set.
+ *
+ * @returns true once the lock is held and false if it can't be made.
+ *
+ * @par Example
+ * @verbatim
+   lockCache(cache); // cache/index.lock now exists
+   @endverbatim
+ *****************************************************************************/
+
+bool lockCache(resultCache& cache)
+{
+    string name = cache.dir + "/index.lock";
+    long long bytes;
+    time_t changed;
+    int lock;
+
+    while (true)
+    {
+#ifdef _WIN32
+        lock = _open(name.c_str(), _O_CREAT | _O_EXCL | _O_WRONLY, _S_IREAD | _S_IWRITE);
+
+        if (lock >= 0)
+        {
+            _close(lock);
+            cache.locked = true;
+            return true;
+        }
+#else
+        lock = open(name.c_str(), O_CREAT | O_EXCL | O_WRONLY, 0666);
+
+        if (lock >= 0)
+        {
+            close(lock);
+            cache.locked = true;
+            return true;
+        }
+#endif
+
+        if (errno != EEXIST)
+        {
+            return false;
+        }
+
+        if (fileStatus(name, bytes, changed) && time(nullptr) - changed > CACHE_LOCK_STALE)
+        {
+            remove(name.c_str());
+        }
+        else
+        {
+            this_thread::sleep_for(chrono::milliseconds(10));
+        }
+    }
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * gives up the lock of a cache if this program holds it.
+ *
+ * @param[in,out]     cache - the cache.
+ *
+ * @par Example
+ * @verbatim
+   unlockCache(cache); // cache/index.lock is removed
+   @endverbatim
+ *****************************************************************************/
+
+void unlockCache(resultCache& cache)
+{
+    if (cache.locked)
+    {
+        remove((cache.dir + "/index.lock").c_str());
+        cache.locked = false;
+    }
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * deletes the images used longest ago until the images fit in the size
+ * limit of the cache.
+ *
+ * @param[in,out]     cache - the cache.
+ *
+ * @par Example
+ * @verbatim
+   trimCache(cache);
+   @endverbatim
+ *****************************************************************************/
+
+void trimCache(resultCache& cache)
+{
+    long long total = 0;
+    size_t i;
+    size_t oldest;
+
+    for (i = 0; i < cache.entries.size(); i++)
+    {
+        total = total + cache.entries[i].bytes;
+    }
+
+    while (total > cache.limit && !cache.entries.empty())
+    {
+        oldest = 0;
+
+        for (i = 1; i < cache.entries.size(); i++)
+        {
+            if (cache.entries[i].used < cache.entries[oldest].used)
+            {
+                oldest = i;
+            }
+        }
+
+        remove(entryFile(cache, cache.entries[oldest]).c_str());
+        total = total - cache.entries[oldest].bytes;
+        cache.entries.erase(cache.entries.begin() + oldest);
+    }
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * adds the images in the cache directory that are missing from the index,
+ * which a program stopped between storing an image and writing the index
+ * leaves behind.  They are taken as used longest ago.
+ *
+ * @param[in,out]     cache - the cache.
+ *
+ * @par Example
+ * @verbatim
+   findUnlisted(cache);
+   @endverbatim
+ *****************************************************************************/
+
+void findUnlisted(resultCache& cache)
+{
+    const char* extensions[6] = { ".ppm", ".pgm", ".pbm", ".pam", ".qoi", ".tpx" };
+    vector<string> names;
+    cacheEntry entry;
+    time_t changed;
+    size_t i;
+    size_t k;
+    bool listed;
+
+    listDirectory(cache.dir, names);
+
+    for (i = 0; i < names.size(); i++)
+    {
+        if (names[i].size() != 20 || names[i].find_first_not_of("0123456789abcdef") != 16
+            || find(begin(extensions), end(extensions), names[i].substr(16)) == end(extensions))
+        {
+            continue;
+        }
+
+        entry.key = names[i].substr(0, 16);
+        entry.extension = names[i].substr(16);
+        entry.used = 0;
+        listed = false;
+
+        for (k = 0; k < cache.entries.size(); k++)
+        {
+            listed = listed || cache.entries[k].key == entry.key;
+        }
+
+        if (!listed && fileStatus(entryFile(cache, entry), entry.bytes, changed))
+        {
+            cache.entries.push_back(entry);
+        }
+    }
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * opens the cache in a directory, making the directory if it doesn't
+ * exist, takes its lock and reads its index.  Images in the directory
+ * that the index is missing are added, and the oldest are deleted if the
+ * images don't fit in the limit.  The lock is held until saveCache, so
+ * a program that changes the cache opens it, changes it and saves it
+ * without any other program changing it in between.
+ *
+ * @param[out]    cache - the cache.
+ * @param[in]     dir - cache directory.
+ * @param[in]     limit - most bytes the stored images may use.
+ *
+ * @returns true if the directory can be used and false otherwise, in
+ *          which case the lock isn't held.
+ *
+ * @par Example
+ * @verbatim
+   resultCache cache;
+   openCache(cache, "cache", 1LL << 30); // up to 1 GB of images in cache/
+   @endverbatim
+ *****************************************************************************/
+
+bool openCache(resultCache& cache, string dir, long long limit)
+{
+    ifstream index;
+    ofstream test;
+    cacheEntry entry;
+
+#ifdef _WIN32
+    _mkdir(dir.c_str());
+#else
+    mkdir(dir.c_str(), 0777);
+#endif
+
+    cache.dir = dir;
+    cache.limit = limit;
+    cache.hits = 0;
+    cache.misses = 0;
+    cache.clock = 0;
+    cache.locked = false;
+    cache.entries.clear();
+
+    if (!lockCache(cache))
+    {
+        return false;
+    }
+
+    index.open(dir + "/index.txt");
+
+    if (index.is_open())
+    {
+        index >> cache.hits >> cache.misses;
+
+        while (index >> entry.key >> entry.extension >> entry.bytes >> entry.used)
+        {
+            cache.entries.push_back(entry);
+            cache.clock = max(cache.clock, entry.used);
+        }
+        index.close();
+    }
+    else
+    {
+        test.open(dir + "/index.txt", ios::out | ios::app);
+
+        if (!test.is_open())
+        {
+            unlockCache(cache);
+            return false;
+        }
+    }
+
+    findUnlisted(cache);
+    trimCache(cache);
+
+    return true;
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * writes the index of the cache and gives up its lock.  It is written to
+ * a new file named for this process that then replaces the old index, so
+ * a program stopped part way through never leaves half an index.
+ *
+ * @param[in,out]     cache - the cache.
+ *
+ * @returns true if the index was written and false otherwise.
+ *
+ * @par Example
+ * @verbatim
+   saveCache(cache);
+   @endverbatim
+ *****************************************************************************/
+
+bool saveCache(resultCache& cache)
+{
+    ofstream index;
+    string name = cache.dir + "/index.txt";
+    string temp = name + "." + to_string(processId()) + ".new";
+    bool saved;
+    size_t i;
+
+    index.open(temp, ios::out | ios::trunc);
+
+    if (!index.is_open())
+    {
+        unlockCache(cache);
+        return false;
+    }
+
+    index << cache.hits << " " << cache.misses << "\n";
+
+    for (i = 0; i < cache.entries.size(); i++)
+    {
+        index << cache.entries[i].key << " " << cache.entries[i].extension << " "
+            << cache.entries[i].bytes << " " << cache.entries[i].used << "\n";
+    }
+    index.close();
+
+#ifdef _WIN32
+    // rename doesn't replace a file on Windows
+    remove(name.c_str());
+#endif
+
+    saved = !index.fail() && rename(temp.c_str(), name.c_str()) == 0;
+    unlockCache(cache);
+
+    return saved;
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * finds the stored image for a key and marks it as just used.
+ *
+ * @param[in,out]     cache - the cache.
+ * @param[in]         key - key made by cacheKey.
+ *
+ * @returns the entry or nullptr if the key isn't in the cache.
+ *
+ * @par Example
+ * @verbatim
+   cacheEntry* entry = findEntry(cache, key);
+   @endverbatim
+ *****************************************************************************/
+
+cacheEntry* findEntry(resultCache& cache, string key)
+{
+    size_t i;
+
+    for (i = 0; i < cache.entries.size(); i++)
+    {
+        if (cache.entries[i].key == key)
+        {
+            cache.clock++;
+            cache.entries[i].used = cache.clock;
+            return &cache.entries[i];
+        }
+    }
+
+    return nullptr;
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * returns the name of the file that holds a stored image.
+ *
+ * @param[in]     cache - the cache.
+ * @param[in]     entry - the stored image.
+ *
+ * @returns the file name.
+ *
+ * @par Example
+ * @verbatim
+   entryFile(cache, *entry); // "cache/3f9a0c0d11aa5e27.ppm"
+   @endverbatim
+ *****************************************************************************/
+
+string entryFile(resultCache& cache, cacheEntry& entry)
+{
+    return cache.dir + "/" + entry.key + entry.extension;
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * adds an image to the cache.  The file must already be in the cache
+ * directory under its key.  Images used longest ago are then deleted
+ * until the images fit in the size limit, and an image bigger than the
+ * limit by itself isn't kept.
+ *
+ * @param[in,out]     cache - the cache.
+ * @param[in]         key - key made by cacheKey.
+ * @param[in]         extension - ".ppm", ".pgm" or ".qoi".
+ * @param[in]         bytes - size of the file.
+ *
+ * @par Example
+ * @verbatim
+   addEntry(cache, key, ".ppm", 921615);
+   @endverbatim
+ *****************************************************************************/
+
+void addEntry(resultCache& cache, string key, string extension, long long bytes)
+{
+    cacheEntry entry;
+    size_t i;
+
+    // two programs that miss on the same image both store it
+    for (i = 0; i < cache.entries.size(); i++)
+    {
+        if (cache.entries[i].key == key)
+        {
+            cache.entries.erase(cache.entries.begin() + i);
+            break;
+        }
+    }
+
+    cache.clock++;
+    entry.key = key;
+    entry.extension = extension;
+    entry.bytes = bytes;
+    entry.used = cache.clock;
+    cache.entries.push_back(entry);
+
+    trimCache(cache);
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * makes a copy of a file.  On Linux the copy is first tried as a reflink,
+ * which shares the data blocks with the original on file systems that
+ * allow it, so no data is copied.  Otherwise the bytes are copied in
+ * blocks.  A hard link isn't used since changing the output would then
+ * change the stored image too.
+ *
+ * @param[in]     from - file to copy.
+ * @param[in,out] out - stream to copy to, used when the reflink fails.
+ * @param[in]     to - name of the file out is open on, or empty if out
+ *                     isn't a file.
+ *
+ * @returns true if the copy was made and false otherwise.
+ *
+ * @par Example
+ * @verbatim
+   copyFile("cache/3f9a0c0d11aa5e27.ppm", fout, "balloonx.ppm");
+   @endverbatim
+ *****************************************************************************/
+
+bool copyFile(string from, ostream& out, string to)
+{
+    TRACE_SCOPE("copyFile");
+
+    ifstream fin;
+    vector<char> block(PIPE_BLOCK);
+
+#ifdef __linux__
+    int source;
+    int target;
+    bool cloned = false;
+
+    if (!to.empty())
+    {
+        source = open(from.c_str(), O_RDONLY);
+        target = open(to.c_str(), O_WRONLY);
+
+        if (source >= 0 && target >= 0)
+        {
+            cloned = ioctl(target, FICLONE, source) == 0;
+        }
+
+        if (source >= 0)
+        {
+            close(source);
+        }
+        if (target >= 0)
+        {
+            close(target);
+        }
+
+        if (cloned)
+        {
+            return true;
+        }
+    }
+#else
+    (void) to;
+#endif
+
+    fin.open(from, ios::in | ios::binary);
+
+    if (!fin.is_open())
+    {
+        return false;
+    }
+
+    while (fin)
+    {
+        fin.read(block.data(), block.size());
+        out.write(block.data(), fin.gcount());
+    }
+
+    return fin.eof() && out.good();
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * hashes the input file along with the file of every --overlay, since an
+ * overlay is part of the input and a new overlay must not find the old
+ * image in the cache.
+ *
+ * @param[in]     inName - name of the input file.
+ * @param[in]     ops - operations given on the command line.
+ * @param[out]    hash - hash of the input and every overlay.
+ *
+ * @returns true if the input could be read and false otherwise.
+ *
+ * @par Example
+ * @verbatim
+   unsigned long long hash;
+   hashInputs("balloon.ppm", ops, hash);
+   @endverbatim
+ *****************************************************************************/
+
+bool hashInputs(string inName, vector<operation>& ops, unsigned long long& hash)
+{
+    unsigned long long markHash;
+    overlay ov;
+    size_t i;
+
+    if (!hashFile(inName, hash))
+    {
+        return false;
+    }
+
+    for (i = 0; i < ops.size(); i++)
+    {
+        if (ops[i].name == "--overlay" && parseOverlay(ops[i].param, ov)
+            && hashFile(ov.file, markHash))
+        {
+            hash = hashBytes(&markHash, sizeof(markHash), hash);
+        }
+    }
+
+    return true;
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * Copies an image stored in the cache to the output.  The lock is given
+ * up if the image can't be copied, since the index isn't saved then.
+ *
+ * @param[in,out]     cache - the cache.
+ * @param[in]         entry - the stored image.
+ * @param[in]         outName - basename given on the command line.
+ *
+ * @returns IMAGE_OK if the image was copied and IMAGE_OPEN_FAILED if it
+ *          wasn't.
+ *
+ * @par Example
+ * @verbatim
+   copyFromCache(cache, *entry, "balloonx"); // writes balloonx.ppm
+   @endverbatim
+ *****************************************************************************/
+
+imageError copyFromCache(resultCache& cache, cacheEntry& entry, string outName)
+{
+    ofstream fout;
+    ostream* out;
+
+    out = openOutput(outName, entry.extension, fout);
+
+    if (out == nullptr || !copyFile(entryFile(cache, entry), *out,
+        outName == "-" ? "" : outName + entry.extension))
+    {
+        unlockCache(cache);
+        return IMAGE_OPEN_FAILED;
+    }
+    out->flush();
+    filecloseoutput(fout);
+
+    return IMAGE_OK;
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * Moves a newly written image into the cache, copies it to the output
+ * and saves the index.  The cache is opened again so that images other
+ * programs stored while this one was working are kept in the index.
+ *
+ * @param[in,out]     cache - the cache.
+ * @param[in]         key - key of the image.
+ * @param[in]         target - basename the image was written to.
+ * @param[in]         extension - extension of the image.
+ * @param[in]         outName - basename given on the command line.
+ *
+ * @returns IMAGE_OK if the image was stored and copied, IMAGE_OPEN_FAILED
+ *          if it couldn't be copied to the output and IMAGE_CACHE_FAILED
+ *          if the cache couldn't be used.
+ *
+ * @par Example
+ * @verbatim
+   storeInCache(cache, key, target, ".ppm", "balloonx");
+   @endverbatim
+ *****************************************************************************/
+
+imageError storeInCache(resultCache& cache, string key, string target, string extension,
+    string outName)
+{
+    ifstream stored;
+    cacheEntry entry = { key, extension, 0, 0 };
+    string name = cache.dir + "/" + key + extension;
+    imageError result;
+
+    if (!openCache(cache, cache.dir, cache.limit))
+    {
+        return IMAGE_CACHE_FAILED;
+    }
+
+#ifdef _WIN32
+    // rename doesn't replace a file on Windows
+    remove(name.c_str());
+#endif
+
+    if (rename((target + extension).c_str(), name.c_str()) != 0)
+    {
+        unlockCache(cache);
+        return IMAGE_CACHE_FAILED;
+    }
+
+    result = copyFromCache(cache, entry, outName);
+
+    if (result != IMAGE_OK)
+    {
+        return result;
+    }
+
+    stored.open(name, ios::in | ios::binary | ios::ate);
+    addEntry(cache, key, extension, (long long) stored.tellg());
+    stored.close();
+
+    return saveCache(cache) ? IMAGE_OK : IMAGE_CACHE_FAILED;
+}
@@ -0,0 +1,613 @@
+/** ***************************************************************************
+ * @file
+ * @brief Contains the conversions from RGB to the YCbCr, HSV and Lab color
+ * spaces and the writer for the resulting planes
+ *
+ * The image is already stored as three planes, so each conversion works
+ * in place: after it the red, green and blue planes hold the three planes
+ * of the new color space.  The kernels use integer arithmetic on whole
+ * rows so the compiler can vectorize them, and the rows are split between
+ * threads.
+ *****************************************************************************/
+
+
+#include "netPBM.h"
+
+
+/**
+ * @brief sRGB values with the gamma curve removed, from 0 to 1
+ */
+
+struct linearTable
+{
+    double value[256];    /**< linear light for each pixel value */
+};
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * reads a color space written as name[,option ...] from a command line
+ * parameter.  The name is ycbcr, hsv or lab.  The options are 601 or 709
+ * for the YCbCr matrix, 444 or 420 for full or half size Cb and Cr planes,
+ * and raw to write all of the planes to one file instead of one pgm file
+ * each.
+ *
+ * @param[in]     param - parameter given after --colorspace.
+ * @param[out]    space - the color space that was read.
+ *
+ * @returns true if param is a valid color space and false otherwise.
+ *
+ * @par Example
+ * @verbatim
+   colorSpace space;
+   parseColorSpace("ycbcr,709,420", space); // returns true
+   parseColorSpace("hsv,420", space);       // returns false
+   @endverbatim
+ *****************************************************************************/
+
+bool parseColorSpace(string param, colorSpace& space)
+{
+    size_t start = 0;
+    size_t comma;
+    string part;
+    bool first = true;
+
+    space.model = COLOR_YCBCR;
+    space.bt709 = false;
+    space.subsample = false;
+    space.raw = false;
+
+    while (start <= param.size())
+    {
+        comma = param.find(',', start);
+
+        if (comma == string::npos)
+        {
+            comma = param.size();
+        }
+        part = param.substr(start, comma - start);
+        start = comma + 1;
+
+        if (first)
+        {
+            if (part == "ycbcr")
+            {
+                space.model = COLOR_YCBCR;
+            }
+            else if (part == "hsv")
+            {
+                space.model = COLOR_HSV;
+            }
+            else if (part == "lab")
+            {
+                space.model = COLOR_LAB;
+            }
+            else
+            {
+                return false;
+            }
+            first = false;
+        }
+        else if (part == "raw")
+        {
+            space.raw = true;
+        }
+        else if (space.model != COLOR_YCBCR)
+        {
+            return false;
+        }
+        else if (part == "601" || part == "709")
+        {
+            space.bt709 = part == "709";
+        }
+        else if (part == "444" || part == "420")
+        {
+            space.subsample = part == "420";
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * finds the fixed point matrix that turns red, green and blue into full
+ * range Y, Cb and Cr, as used by JPEG.  Each coefficient is scaled by
+ * 65536.
+ *
+ * @param[in]     bt709 - true for the BT.709 matrix, false for BT.601.
+ * @param[out]    coeff - Y, Cb and Cr rows of the matrix.
+ *
+ * @par Example
+ * @verbatim
+   int coeff[9];
+   ycbcrMatrix(false, coeff); // coeff[0] is 19595, 0.299 * 65536
+   @endverbatim
+ *****************************************************************************/
+
+void ycbcrMatrix(bool bt709, int coeff[9])
+{
+    double kr = bt709 ? 0.2126 : 0.299;
+    double kb = bt709 ? 0.0722 : 0.114;
+    double kg = 1 - kr - kb;
+    double matrix[9] =
+    {
+        kr, kg, kb,
+        -kr / (2 * (1 - kb)), -kg / (2 * (1 - kb)), 0.5,
+        0.5, -kg / (2 * (1 - kr)), -kb / (2 * (1 - kr))
+    };
+    int i;
+
+    for (i = 0; i < 9; i++)
+    {
+        coeff[i] = int(lround(matrix[i] * 65536));
+    }
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * turns one row of red, green and blue into Y, Cb and Cr in place.
+ *
+ * @param[in,out]     red - red values, replaced by Y.
+ * @param[in,out]     green - green values, replaced by Cb.
+ * @param[in,out]     blue - blue values, replaced by Cr.
+ * @param[in]         cols - number of pixels in the row.
+ * @param[in]         coeff - matrix from ycbcrMatrix.
+ *
+ * @par Example
+ * @verbatim
+   ycbcrRow(img.redGray[i], img.green[i], img.blue[i], img.cols, coeff);
+   @endverbatim
+ *****************************************************************************/
+
+void ycbcrRow(pixel* red, pixel* green, pixel* blue, int cols, const int coeff[9])
+{
+    int j;
+    int r;
+    int g;
+    int b;
+
+    for (j = 0; j < cols; j++)
+    {
+        r = red[j];
+        g = green[j];
+        b = blue[j];
+
+        red[j] = clampPixel((coeff[0] * r + coeff[1] * g + coeff[2] * b + 32768) >> 16);
+        green[j] = clampPixel((coeff[3] * r + coeff[4] * g + coeff[5] * b
+            + (128 << 16) + 32768) >> 16);
+        blue[j] = clampPixel((coeff[6] * r + coeff[7] * g + coeff[8] * b
+            + (128 << 16) + 32768) >> 16);
+    }
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * turns one row of red, green and blue into hue, saturation and value in
+ * place.  The hue goes once around the color wheel from 0 to 255, so red
+ * is 0, green is 85 and blue is 171.
+ *
+ * @param[in,out]     red - red values, replaced by hue.
+ * @param[in,out]     green - green values, replaced by saturation.
+ * @param[in,out]     blue - blue values, replaced by value.
+ * @param[in]         cols - number of pixels in the row.
+ *
+ * @par Example
+ * @verbatim
+   hsvRow(img.redGray[i], img.green[i], img.blue[i], img.cols);
+   @endverbatim
+ *****************************************************************************/
+
+void hsvRow(pixel* red, pixel* green, pixel* blue, int cols)
+{
+    int j;
+    int r;
+    int g;
+    int b;
+    int high;
+    int low;
+    int range;
+    int turn;
+
+    for (j = 0; j < cols; j++)
+    {
+        r = red[j];
+        g = green[j];
+        b = blue[j];
+        high = max(r, max(g, b));
+        low = min(r, min(g, b));
+        range = high - low;
+
+        // turn is the hue in sixths of a circle times range
+        if (range == 0)
+        {
+            turn = 0;
+        }
+        else if (high == r)
+        {
+            turn = g - b + (g < b ? 6 * range : 0);
+        }
+        else if (high == g)
+        {
+            turn = b - r + 2 * range;
+        }
+        else
+        {
+            turn = r - g + 4 * range;
+        }
+
+        red[j] = pixel(range == 0 ? 0 : ((turn * 256 + 3 * range) / (6 * range)) & 255);
+        green[j] = pixel(high == 0 ? 0 : (range * 255 + high / 2) / high);
+        blue[j] = pixel(high);
+    }
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * builds the table that removes the sRGB gamma curve from a pixel value.
+ *
+ * @returns the table.
+ *
+ * @par Example
+ * @verbatim
+   linearTable table = makeLinearTable(); // table.value[255] is 1
+   @endverbatim
+ *****************************************************************************/
+
+linearTable makeLinearTable()
+{
+    linearTable table;
+    double c;
+    int i;
+
+    for (i = 0; i < 256; i++)
+    {
+        c = i / 255.0;
+        table.value[i] = c <= 0.04045 ? c / 12.92 : pow((c + 0.055) / 1.055, 2.4);
+    }
+
+    return table;
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * the curve CIE Lab applies to each of X, Y and Z.
+ *
+ * @param[in]     t - X, Y or Z divided by the white point.
+ *
+ * @returns the curved value.
+ *
+ * @par Example
+ * @verbatim
+   labCurve(1.0); // 1
+   @endverbatim
+ *****************************************************************************/
+
+double labCurve(double t)
+{
+    return t > 216.0 / 24389 ? cbrt(t) : (24389.0 / 27 * t + 16) / 116;
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * turns one row of sRGB into CIE Lab with a D65 white point in place.  L
+ * from 0 to 100 is stored as 0 to 255, and 128 is added to a and b.
+ *
+ * @param[in,out]     red - red values, replaced by L.
+ * @param[in,out]     green - green values, replaced by a.
+ * @param[in,out]     blue - blue values, replaced by b.
+ * @param[in]         cols - number of pixels in the row.
+ * @param[in]         table - table from makeLinearTable.
+ *
+ * @par Example
+ * @verbatim
+   labRow(img.redGray[i], img.green[i], img.blue[i], img.cols, table);
+   @endverbatim
+ *****************************************************************************/
+
+void labRow(pixel* red, pixel* green, pixel* blue, int cols, const linearTable& table)
+{
+    int j;
+    double r;
+    double g;
+    double b;
+    double fx;
+    double fy;
+    double fz;
+
+    for (j = 0; j < cols; j++)
+    {
+        r = table.value[red[j]];
+        g = table.value[green[j]];
+        b = table.value[blue[j]];
+
+        fx = labCurve((0.4124564 * r + 0.3575761 * g + 0.1804375 * b) / 0.95047);
+        fy = labCurve(0.2126729 * r + 0.7151522 * g + 0.0721750 * b);
+        fz = labCurve((0.0193339 * r + 0.1191920 * g + 0.9503041 * b) / 1.08883);
+
+        red[j] = clampPixel(int(lround((116 * fy - 16) * 255 / 100)));
+        green[j] = clampPixel(int(lround(500 * (fx - fy))) + 128);
+        blue[j] = clampPixel(int(lround(200 * (fy - fz))) + 128);
+    }
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * shrinks the second and third planes of img to half the width and height
+ * in place.  Each value is the rounded average of a 2x2 block, and an odd
+ * last row or column is repeated as in halveImage.  The values are moved
+ * to the top left corner of the planes, so the planes keep their memory.
+ *
+ * @param[in,out]     img - image whose green and blue planes are shrunk.
+ *
+ * @par Example
+ * @verbatim
+   subsampleChroma(img); // Cb and Cr are now (rows + 1) / 2 by (cols + 1) / 2
+   @endverbatim
+ *****************************************************************************/
+
+void subsampleChroma(image& img)
+{
+    TRACE_SCOPE("subsampleChroma");
+
+    int i;
+    int j;
+    int k;
+    int top;
+    int bottom;
+    int left;
+    int right;
+
+    pixel** plane;
+
+    for (k = 0; k < 2; k++)
+    {
+        plane = k == 0 ? img.green : img.blue;
+
+        // output row i only reads rows 2i and 2i + 1, which are not
+        // written until later
+        for (i = 0; i < (img.rows + 1) / 2; i++)
+        {
+            top = 2 * i;
+            bottom = min(2 * i + 1, img.rows - 1);
+
+            for (j = 0; j < (img.cols + 1) / 2; j++)
+            {
+                left = 2 * j;
+                right = min(2 * j + 1, img.cols - 1);
+
+                plane[i][j] = pixel((plane[top][left] + plane[top][right]
+                    + plane[bottom][left] + plane[bottom][right] + 2) / 4);
+            }
+        }
+    }
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * converts img from RGB to another color space in place.  The rows are
+ * split between threads.  With 4:2:0 YCbCr the Cb and Cr planes are then
+ * shrunk, see subsampleChroma.
+ *
+ * @param[in,out]     img - structure containing data of a ppm image.
+ * @param[in]         space - color space to convert to.
+ *
+ * @par Example
+ * @verbatim
+   colorSpace space;
+   parseColorSpace("lab", space);
+   convertColor(img, space); // img holds L, a and b
+   @endverbatim
+ *****************************************************************************/
+
+void convertColor(image& img, colorSpace space)
+{
+    TRACE_SCOPE("convertColor");
+
+    int coeff[9];
+    int threads = threadCount(3 * planeBytes(img.rows, img.cols));
+    int band = (img.rows + threads - 1) / threads;
+    static const linearTable table = makeLinearTable();
+
+    ycbcrMatrix(space.bt709, coeff);
+
+    runParallel(threads, [&](int t)
+    {
+        int i;
+
+        for (i = t * band; i < min(img.rows, (t + 1) * band); i++)
+        {
+            if (space.model == COLOR_YCBCR)
+            {
+                ycbcrRow(img.redGray[i], img.green[i], img.blue[i], img.cols, coeff);
+            }
+            else if (space.model == COLOR_HSV)
+            {
+                hsvRow(img.redGray[i], img.green[i], img.blue[i], img.cols);
+            }
+            else
+            {
+                labRow(img.redGray[i], img.green[i], img.blue[i], img.cols, table);
+            }
+        }
+    });
+
+    if (space.model == COLOR_YCBCR && space.subsample)
+    {
+        subsampleChroma(img);
+    }
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * writes one plane as a pgm image.
+ *
+ * @param[in,out]     fout - stream opened for output.
+ * @param[in]         plane - rows of the plane.
+ * @param[in]         rows - number of rows.
+ * @param[in]         cols - number of columns.
+ * @param[in]         outputType - OUTPUT_ASCII for P2, anything else for P5.
+ *
+ * @par Example
+ * @verbatim
+   writePlane(fout, img.green, img.rows, img.cols, OUTPUT_BINARY);
+   @endverbatim
+ *****************************************************************************/
+
+void writePlane(ostream& fout, pixel** plane, int rows, int cols, outputFormat outputType)
+{
+    int i;
+    image gray;
+
+    gray.magicNumber = outputType == OUTPUT_ASCII ? "P2" : "P5";
+    gray.rows = rows;
+    gray.cols = cols;
+    gray.redGray = plane;
+
+    writeHeader(fout, gray);
+
+    if (gray.magicNumber == "P2")
+    {
+        writeAscii(fout, gray, 1);
+    }
+    else
+    {
+        for (i = 0; i < rows; i++)
+        {
+            fout.write((char*) plane[i], cols);
+        }
+    }
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * writes the three planes of a converted image.  Each plane goes to its
+ * own pgm file named after the plane, such as photo_Cb.pgm, or with the
+ * raw option all of them go one after the other to name.raw with no
+ * header.  A name of - writes everything to standard output.
+ *
+ * @param[in,out]     img - image from convertColor, freed when the function
+ *                          returns.
+ * @param[in]         space - color space img was converted to.
+ * @param[in]         name - basename given on the command line.
+ * @param[in]         outputType - OUTPUT_ASCII for P2 planes, anything else
+ *                                 for P5.
+ *
+ * @returns IMAGE_OK, IMAGE_OPEN_FAILED or IMAGE_WRITE_FAILED.
+ *
+ * @par Example
+ * @verbatim
+   writeColorPlanes(img, space, "photo", OUTPUT_BINARY); // photo_Y.pgm,
+                                                      // photo_Cb.pgm and
+                                                      // photo_Cr.pgm
+   @endverbatim
+ *****************************************************************************/
+
+imageError writeColorPlanes(image& img, colorSpace space, string name, outputFormat outputType)
+{
+    TRACE_SCOPE("writeColorPlanes");
+
+    int i;
+    int k;
+    int rows;
+    int cols;
+
+    ofstream fout;
+    ostream* out = nullptr;
+    pixel** planes[3] = { img.redGray, img.green, img.blue };
+    const char* names[3][3] = { { "Y", "Cb", "Cr" }, { "H", "S", "V" }, { "L", "a", "b" } };
+    imageError result = IMAGE_OK;
+
+    for (k = 0; k < 3 && result == IMAGE_OK; k++)
+    {
+        rows = img.rows;
+        cols = img.cols;
+
+        if (k > 0 && space.model == COLOR_YCBCR && space.subsample)
+        {
+            rows = (rows + 1) / 2;
+            cols = (cols + 1) / 2;
+        }
+
+        if (!space.raw || k == 0)
+        {
+            if (space.raw || name == "-" || name == ":null")
+            {
+                out = openOutput(name, space.raw ? ".raw" : ".pgm", fout);
+            }
+            else
+            {
+                out = openOutput(name + "_" + names[space.model][k], ".pgm", fout);
+            }
+        }
+
+        if (out == nullptr)
+        {
+            result = IMAGE_OPEN_FAILED;
+            break;
+        }
+
+        if (space.raw)
+        {
+            for (i = 0; i < rows; i++)
+            {
+                out->write((char*) planes[k][i], cols);
+            }
+        }
+        else
+        {
+            writePlane(*out, planes[k], rows, cols, outputType);
+        }
+
+        if (!*out)
+        {
+            result = IMAGE_WRITE_FAILED;
+        }
+
+        if (!space.raw || k == 2)
+        {
+            out->flush();
+            filecloseoutput(fout);
+        }
+    }
+
+    freeImage(img);
+
+    return result;
+}
@@ -0,0 +1,397 @@
+/** ***************************************************************************
+ * @file
+ * @brief Contains the functions that measure how different two images are
+ *
+ * The differences are summed by several threads, each over its own band
+ * of rows, and the sums are added together at the end.  SSIM is found for
+ * every SSIM_WINDOW by SSIM_WINDOW window of the image.  The sums over a
+ * window are kept up to date as the window slides, by adding the column
+ * that enters and taking away the column that leaves, so the work for
+ * each window doesn't depend on the size of the window.
+ *****************************************************************************/
+
+
+#include "netPBM.h"
+
+
+/**
+ * @brief sums over one column of a window, for each of the 5 SSIM sums
+ */
+
+struct windowSums
+{
+    long long a;     /**< sum of the values of the first image */
+    long long b;     /**< sum of the values of the second image */
+    long long aa;    /**< sum of the squares of the first image */
+    long long bb;    /**< sum of the squares of the second image */
+    long long ab;    /**< sum of the products of the two images */
+};
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * adds or removes one pair of values from a set of window sums.
+ *
+ * @param[in,out]     sums - sums that are changed.
+ * @param[in]         a - value from the first image.
+ * @param[in]         b - value from the second image.
+ * @param[in]         sign - 1 to add the values or -1 to remove them.
+ *
+ * @par Example
+ * @verbatim
+   windowSums sums = {};
+   addToWindow(sums, 10, 12, 1); // sums.ab is 120
+   @endverbatim
+ *****************************************************************************/
+
+void addToWindow(windowSums& sums, int a, int b, int sign)
+{
+    sums.a += sign * a;
+    sums.b += sign * b;
+    sums.aa += sign * a * a;
+    sums.bb += sign * b * b;
+    sums.ab += sign * a * b;
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * finds the SSIM of one window from its sums.
+ *
+ * @param[in]     sums - sums over the window.
+ * @param[in]     count - number of pixels in the window.
+ *
+ * @returns SSIM of the window, 1 when the windows are equal.
+ *
+ * @par Example
+ * @verbatim
+   windowSsim(sums, 64); // SSIM of an 8x8 window
+   @endverbatim
+ *****************************************************************************/
+
+double windowSsim(const windowSums& sums, double count)
+{
+    const double c1 = (0.01 * 255) * (0.01 * 255);
+    const double c2 = (0.03 * 255) * (0.03 * 255);
+
+    double meanA = sums.a / count;
+    double meanB = sums.b / count;
+    double varA = sums.aa / count - meanA * meanA;
+    double varB = sums.bb / count - meanB * meanB;
+    double cov = sums.ab / count - meanA * meanB;
+
+    return ((2 * meanA * meanB + c1) * (2 * cov + c2))
+        / ((meanA * meanA + meanB * meanB + c1) * (varA + varB + c2));
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * adds up the SSIM of every window whose top row is in rows first to
+ * last - 1 for one color plane of two images of the same size.
+ *
+ * @param[in]     a - plane of the first image.
+ * @param[in]     b - plane of the second image.
+ * @param[in]     cols - number of columns in the planes.
+ * @param[in]     size - width and height of the window.
+ * @param[in]     first - top row of the first window.
+ * @param[in]     last - one past the top row of the last window.
+ *
+ * @returns the sum of the SSIM of the windows.
+ *
+ * @par Example
+ * @verbatim
+   double total = ssimRows(a.green, b.green, a.cols, 8, 0, a.rows - 7);
+   @endverbatim
+ *****************************************************************************/
+
+double ssimRows(pixel** a, pixel** b, int cols, int size, int first, int last)
+{
+    vector<windowSums> columns(cols);
+    windowSums window;
+    double total = 0;
+    double count = double(size) * size;
+    int i;
+    int j;
+
+    for (i = first; i < first + size; i++)
+    {
+        for (j = 0; j < cols; j++)
+        {
+            addToWindow(columns[j], a[i][j], b[i][j], 1);
+        }
+    }
+
+    for (i = first; i < last; i++)
+    {
+        if (i > first)
+        {
+            for (j = 0; j < cols; j++)
+            {
+                addToWindow(columns[j], a[i - 1][j], b[i - 1][j], -1);
+                addToWindow(columns[j], a[i + size - 1][j], b[i + size - 1][j], 1);
+            }
+        }
+
+        window = windowSums();
+
+        for (j = 0; j < cols; j++)
+        {
+            window.a += columns[j].a;
+            window.b += columns[j].b;
+            window.aa += columns[j].aa;
+            window.bb += columns[j].bb;
+            window.ab += columns[j].ab;
+
+            if (j >= size)
+            {
+                window.a -= columns[j - size].a;
+                window.b -= columns[j - size].b;
+                window.aa -= columns[j - size].aa;
+                window.bb -= columns[j - size].bb;
+                window.ab -= columns[j - size].ab;
+            }
+
+            if (j >= size - 1)
+            {
+                total += windowSsim(window, count);
+            }
+        }
+    }
+
+    return total;
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * compares two images of the same size.  For each color it finds the
+ * largest difference, the number of values that differ, the PSNR and the
+ * mean SSIM over SSIM_WINDOW by SSIM_WINDOW windows.  Entry 3 of each
+ * array is for all of the colors together.
+ *
+ * @param[in]     a - first image.
+ * @param[in]     b - second image.
+ * @param[out]    result - the measurements.
+ *
+ * @returns IMAGE_OK or IMAGE_BAD_PARAMETER if the sizes differ.
+ *
+ * @par Example
+ * @verbatim
+   comparison result;
+   compareImages(a, b, result); // result.psnr[3] is the PSNR of the image
+   @endverbatim
+ *****************************************************************************/
+
+imageError compareImages(image& a, image& b, comparison& result)
+{
+    TRACE_SCOPE("compareImages");
+
+    int threads;
+    int size;
+    int windows;
+    int c;
+    int t;
+
+    vector<long long> partial;
+    vector<double> ssim;
+    long long squares[4] = {};
+    double samples;
+
+    if (a.rows != b.rows || a.cols != b.cols)
+    {
+        return IMAGE_BAD_PARAMETER;
+    }
+
+    threads = min(a.rows, threadCount(6LL * a.rows * a.cols));
+    partial.assign(threads * 9, 0);
+
+    // largest difference, mismatches and sum of squares, per color
+    runParallel(threads, [&](int part)
+    {
+        pixel** planesA[3] = { a.redGray, a.green, a.blue };
+        pixel** planesB[3] = { b.redGray, b.green, b.blue };
+        long long* sums = &partial[part * 9];
+        int first = int((long long) a.rows * part / threads);
+        int last = int((long long) a.rows * (part + 1) / threads);
+        int largest;
+        int count;
+        long long square;
+        int diff;
+        int color;
+        int i;
+        int j;
+
+        for (color = 0; color < 3; color++)
+        {
+            for (i = first; i < last; i++)
+            {
+                const pixel* rowA = planesA[color][i];
+                const pixel* rowB = planesB[color][i];
+
+                largest = 0;
+                count = 0;
+                square = 0;
+
+                for (j = 0; j < a.cols; j++)
+                {
+                    diff = abs(rowA[j] - rowB[j]);
+                    largest = max(largest, diff);
+                    count += (diff != 0);
+                    square += diff * diff;
+                }
+
+                sums[color * 3] = max(sums[color * 3], (long long) largest);
+                sums[color * 3 + 1] += count;
+                sums[color * 3 + 2] += square;
+            }
+        }
+    });
+
+    samples = double(a.rows) * a.cols;
+    size = min(SSIM_WINDOW, min(a.rows, a.cols));
+    windows = a.rows - size + 1;
+    ssim.assign(threads * 3, 0);
+
+    runParallel(threads, [&](int part)
+    {
+        pixel** planesA[3] = { a.redGray, a.green, a.blue };
+        pixel** planesB[3] = { b.redGray, b.green, b.blue };
+        int first = int((long long) windows * part / threads);
+        int last = int((long long) windows * (part + 1) / threads);
+        int color;
+
+        for (color = 0; color < 3 && first < last; color++)
+        {
+            ssim[part * 3 + color] = ssimRows(planesA[color], planesB[color],
+                a.cols, size, first, last);
+        }
+    });
+
+    for (c = 0; c < 4; c++)
+    {
+        result.maxDiff[c] = 0;
+        result.mismatches[c] = 0;
+        result.ssim[c] = 0;
+    }
+
+    for (c = 0; c < 3; c++)
+    {
+        for (t = 0; t < threads; t++)
+        {
+            result.maxDiff[c] = max(result.maxDiff[c], int(partial[t * 9 + c * 3]));
+            result.mismatches[c] += partial[t * 9 + c * 3 + 1];
+            squares[c] += partial[t * 9 + c * 3 + 2];
+            result.ssim[c] += ssim[t * 3 + c];
+        }
+        result.ssim[c] = result.ssim[c] / (double(windows) * (a.cols - size + 1));
+
+        result.maxDiff[3] = max(result.maxDiff[3], result.maxDiff[c]);
+        result.mismatches[3] += result.mismatches[c];
+        squares[3] += squares[c];
+        result.ssim[3] += result.ssim[c] / 3;
+    }
+
+    for (c = 0; c < 4; c++)
+    {
+        if (squares[c] == 0)
+        {
+            result.psnr[c] = INFINITY;
+        }
+        else
+        {
+            result.psnr[c] = 10 * log10(255.0 * 255.0 * samples * (c == 3 ? 3 : 1)
+                / squares[c]);
+        }
+    }
+
+    return IMAGE_OK;
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * Reads two images and measures how different they are.
+ *
+ * @param[in]     first - name of the first image, - for standard input.
+ * @param[in]     second - name of the second image.
+ * @param[out]    result - the differences for each color and for all of
+ *                         them.
+ *
+ * @returns IMAGE_OK if both images were read and compared,
+ *          IMAGE_BAD_PARAMETER if they are different sizes and otherwise
+ *          the reason one couldn't be read.
+ *
+ * @par Example
+ * @verbatim
+   comparison result;
+   compareFiles("out.ppm", "reference.ppm", result);
+   @endverbatim
+ *****************************************************************************/
+
+imageError compareFiles(string first, string second, comparison& result)
+{
+    ifstream fin1;
+    ifstream fin2;
+    istream* in;
+    image a;
+    image b;
+    imageError error;
+
+    in = openInput(first, fin1);
+    error = (in == nullptr) ? IMAGE_OPEN_FAILED : readImage(*in, a);
+
+    if (error == IMAGE_OK)
+    {
+        in = openInput(second, fin2);
+        error = (in == nullptr) ? IMAGE_OPEN_FAILED : readImage(*in, b);
+    }
+
+    if (error == IMAGE_OK)
+    {
+        error = compareImages(a, b, result);
+    }
+
+    freeImage(a);
+    freeImage(b);
+
+    return error;
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * checks if two compared images are close enough, looking at the values
+ * for all of the colors together.
+ *
+ * @param[in]     result - the differences found by compareImages.
+ * @param[in]     limits - how close the images must be.
+ *
+ * @returns true if the images are within every limit and false otherwise.
+ *
+ * @par Example
+ * @verbatim
+   compareLimits limits;
+   limits.maxDiff = 255;
+   limits.minPsnr = 40;
+   withinLimits(result, limits); // true if the PSNR is 40 dB or more
+   @endverbatim
+ *****************************************************************************/
+
+bool withinLimits(comparison& result, compareLimits& limits)
+{
+    return result.maxDiff[3] <= limits.maxDiff && result.psnr[3] >= limits.minPsnr
+        && result.ssim[3] >= limits.minSsim;
+}
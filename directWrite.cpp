@@ -0,0 +1,418 @@
+/** ***************************************************************************
+ * @file
+ * @brief Contains the writer that lets every thread write its own rows of a
+ * binary image straight into the output file
+ *
+ * Once the header of a P6 or P5 image is known, the place of every pixel in
+ * the file is known too.  The file is made its full size first and then
+ * each thread takes bands of rows, joins them into its own buffer and
+ * writes the buffer at the band's offset, so no thread waits for another
+ * to finish writing.  P5 rows need no joining and are written straight
+ * from the gray plane.  Positioned writes are used rather than mapping the
+ * file, so a full disk is reported as a failed write instead of stopping
+ * the program.
+ *****************************************************************************/
+
+
+#include "netPBM.h"
+
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+
+#ifdef _WIN32
+
+/**
+ * @brief file opened for positioned writes
+ */
+
+typedef HANDLE directFile;
+
+/**
+ * @brief value of a directFile that couldn't be opened
+ */
+
+static const directFile NO_FILE = INVALID_HANDLE_VALUE;
+
+#else
+
+/**
+ * @brief file opened for positioned writes
+ */
+
+typedef int directFile;
+
+/**
+ * @brief value of a directFile that couldn't be opened
+ */
+
+static const directFile NO_FILE = -1;
+
+#endif
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * creates the file name, or empties it if it exists, and makes it size
+ * bytes long.  On Linux the disk space is reserved as well, so the
+ * threads don't each grow the file and it isn't left in pieces on disk.
+ *
+ * @param[in]     name - name of the file including its extension.
+ * @param[in]     size - size of the finished file in bytes.
+ *
+ * @returns the opened file or NO_FILE if it couldn't be made.
+ *
+ * @par Example
+ * @verbatim
+   directFile file = createDirect("balloonx.ppm", 921615);
+   @endverbatim
+ *****************************************************************************/
+
+static directFile createDirect(string name, long long size)
+{
+    directFile file;
+
+#ifdef _WIN32
+    LARGE_INTEGER end;
+
+    file = CreateFileA(name.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS,
+        FILE_ATTRIBUTE_NORMAL, nullptr);
+
+    if (file == NO_FILE)
+    {
+        return NO_FILE;
+    }
+
+    end.QuadPart = size;
+
+    if (!SetFilePointerEx(file, end, nullptr, FILE_BEGIN) || !SetEndOfFile(file))
+    {
+        CloseHandle(file);
+        return NO_FILE;
+    }
+#else
+    file = open(name.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+
+    if (file == NO_FILE)
+    {
+        return NO_FILE;
+    }
+
+#ifdef __linux__
+    if (fallocate(file, 0, 0, off_t(size)) == 0)
+    {
+        return file;
+    }
+#endif
+
+    if (ftruncate(file, off_t(size)) != 0)
+    {
+        close(file);
+        return NO_FILE;
+    }
+#endif
+
+    return file;
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * writes size bytes of data at offset in file.  Several threads may write
+ * to the same file at once as long as their bytes don't overlap.
+ *
+ * @param[in]     file - file made by createDirect.
+ * @param[in]     data - bytes to write.
+ * @param[in]     size - number of bytes.
+ * @param[in]     offset - place in the file of the first byte.
+ *
+ * @returns true if every byte was written and false otherwise.
+ *
+ * @par Example
+ * @verbatim
+   writeAt(file, header.data(), header.size(), 0); // the header goes first
+   @endverbatim
+ *****************************************************************************/
+
+static bool writeAt(directFile file, const pixel* data, long long size, long long offset)
+{
+#ifdef _WIN32
+    DWORD written;
+    OVERLAPPED place;
+
+    while (size > 0)
+    {
+        memset(&place, 0, sizeof(place));
+        place.Offset = DWORD(offset);
+        place.OffsetHigh = DWORD(offset >> 32);
+
+        if (!WriteFile(file, data, DWORD(min(size, 1LL << 30)), &written, &place)
+            || written == 0)
+        {
+            return false;
+        }
+        data += written;
+        size -= written;
+        offset += written;
+    }
+#else
+    ssize_t written;
+
+    while (size > 0)
+    {
+        written = pwrite(file, data, size_t(min(size, 1LL << 30)), off_t(offset));
+
+        if (written <= 0)
+        {
+            return false;
+        }
+        data += written;
+        size -= written;
+        offset += written;
+    }
+#endif
+
+    return true;
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * closes a file made by createDirect.
+ *
+ * @param[in]     file - file to close.
+ *
+ * @returns true if the file was closed without an error.
+ *
+ * @par Example
+ * @verbatim
+   closeDirect(file);
+   @endverbatim
+ *****************************************************************************/
+
+static bool closeDirect(directFile file)
+{
+#ifdef _WIN32
+    return CloseHandle(file) != 0;
+#else
+    return close(file) == 0;
+#endif
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * checks if name is a file writeDirect can write.  Standard output and
+ * the null sink can only be written in order.
+ *
+ * @param[in]     name - basename given on the command line.
+ *
+ * @returns true if name is a file and false otherwise.
+ *
+ * @par Example
+ * @verbatim
+   canWriteDirect("balloonx"); // true
+   canWriteDirect("-");        // false, standard output
+   @endverbatim
+ *****************************************************************************/
+
+bool canWriteDirect(string name)
+{
+    return name != "-" && name != ":null";
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * finds the number of rows each thread joins at a time, so that each
+ * buffer stays near PIPE_BLOCK bytes, and the number of threads
+ * writeDirect uses, which is never more than the number of bands.
+ *
+ * @param[in]     rows - number of rows in the image.
+ * @param[in]     cols - number of columns in the image.
+ * @param[in]     channels - 3 for P6 or 1 for P5.
+ * @param[out]    threads - number of threads.
+ * @param[out]    band - number of rows in a band, at least 1.
+ *
+ * @par Example
+ * @verbatim
+   directBands(480, 640, 3, threads, band); // one thread and one band of 480 rows
+   @endverbatim
+ *****************************************************************************/
+
+static void directBands(int rows, int cols, int channels, int& threads, int& band)
+{
+    long long bytes = (long long) channels * rows * cols;
+
+    band = int(max(1LL, min((long long) rows,
+        (long long) PIPE_BLOCK / ((long long) channels * max(cols, 1)))));
+    threads = min(threadCount(bytes), (rows + band - 1) / band);
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * returns the most memory writeDirect uses for its buffers when writing
+ * a P6 image.  P5 images are written without buffers.
+ *
+ * @param[in]     rows - number of rows in the image.
+ * @param[in]     cols - number of columns in the image.
+ *
+ * @returns size of the buffers in bytes.
+ *
+ * @par Example
+ * @verbatim
+   directBufferBytes(480, 640); // 921600, the whole image in one buffer
+   @endverbatim
+ *****************************************************************************/
+
+long long directBufferBytes(int rows, int cols)
+{
+    int threads;
+    int band;
+
+    directBands(rows, cols, 3, threads, band);
+
+    return 3LL * threads * band * cols;
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * writes img to the file name as a P6 image, or a P5 image of the gray
+ * values in img.redGray.  The header is written first and then the
+ * threads take bands of rows in turn, each writing its rows at their
+ * place in the file.
+ *
+ * @param[in]     name - name of the file including its extension.
+ * @param[in,out] img - image to write, its magic number is set to P6 or P5.
+ * @param[in]     channels - 3 to write P6 or 1 to write P5.
+ *
+ * @returns IMAGE_OK, IMAGE_NO_MEMORY if the buffers couldn't be allocated
+ *          or IMAGE_WRITE_FAILED if the file couldn't be written.
+ *
+ * @par Example
+ * @verbatim
+   writeDirect("balloonx.ppm", img, 3);
+   @endverbatim
+ *****************************************************************************/
+
+imageError writeDirect(string name, image& img, int channels)
+{
+    TRACE_SCOPE("writeDirect");
+
+    int threads;
+    int band;
+    int bands;
+    long long rowBytes = (long long) channels * img.cols;
+    long long bytes = 0;
+    long long start;
+    string header;
+    ostringstream text;
+    directFile file;
+    atomic<int> next(0);
+    atomic<bool> failed(false);
+
+    pixel* buffers = nullptr;
+
+    img.magicNumber = channels == 3 ? "P6" : "P5";
+    writeHeader(text, img);
+    header = text.str();
+    start = (long long) header.size();
+
+    directBands(img.rows, img.cols, channels, threads, band);
+    bands = (img.rows + band - 1) / band;
+
+    if (channels == 3)
+    {
+        bytes = directBufferBytes(img.rows, img.cols);
+        buffers = new(nothrow) pixel[size_t(bytes)];
+
+        if (buffers == nullptr)
+        {
+            return IMAGE_NO_MEMORY;
+        }
+        countAlloc(bytes);
+    }
+
+    file = createDirect(name, start + rowBytes * img.rows);
+
+    if (file == NO_FILE)
+    {
+        delete[] buffers;
+        countFree(bytes);
+        return IMAGE_WRITE_FAILED;
+    }
+
+    if (!writeAt(file, (const pixel*) header.data(), start, 0))
+    {
+        failed = true;
+    }
+
+    runParallel(threads, [&](int part)
+    {
+        pixel* out = buffers == nullptr ? nullptr : buffers + part * band * rowBytes;
+        int b;
+        int i;
+        int first;
+        int last;
+
+        for (b = next++; b < bands && !failed; b = next++)
+        {
+            first = b * band;
+            last = min(first + band, img.rows);
+
+            // the rows of a plane are one block, so gray rows need no copy
+            if (channels == 1)
+            {
+                if (!writeAt(file, img.redGray[first], (last - first) * rowBytes,
+                    start + first * rowBytes))
+                {
+                    failed = true;
+                }
+                continue;
+            }
+
+            for (i = first; i < last; i++)
+            {
+                kernels().joinRgb(img.redGray[i], img.green[i], img.blue[i],
+                    out + (i - first) * rowBytes, img.cols);
+            }
+
+            if (!writeAt(file, out, (last - first) * rowBytes, start + first * rowBytes))
+            {
+                failed = true;
+            }
+        }
+    });
+
+    if (!closeDirect(file))
+    {
+        failed = true;
+    }
+
+    delete[] buffers;
+    countFree(bytes);
+
+    return failed ? IMAGE_WRITE_FAILED : IMAGE_OK;
+}
@@ -0,0 +1,509 @@
+/** ***************************************************************************
+ * @file
+ * @brief Contains the functions that quantize an image to fewer levels per
+ * channel, with or without dithering, for low bit depth output
+ *
+ * A quantized image keeps 2 to 256 levels per channel and its maxval
+ * becomes the number of levels less one, so it is written as a smaller
+ * ppm or pgm image, or as a bitmap (P1 or P4) when a gray image has 2
+ * levels.  Ordered dithering adds a threshold from an 8x8 Bayer matrix
+ * and is done with lookup tables, one per position in the matrix, so
+ * every pixel is one table read with no branches.  Floyd-Steinberg and
+ * Atkinson push the error of each pixel on to the pixels right and below
+ * it.  A row only needs the row above it to be a few pixels ahead, so
+ * the rows run on several threads at once as a wavefront, each row
+ * following close behind the row above it.
+ *****************************************************************************/
+
+
+#include "netPBM.h"
+
+
+/**
+ * @brief the 8x8 Bayer matrix, the order pixels of a flat area turn on
+ */
+
+const int BAYER[8][8] =
+{
+    {  0, 32,  8, 40,  2, 34, 10, 42 },
+    { 48, 16, 56, 24, 50, 18, 58, 26 },
+    { 12, 44,  4, 36, 14, 46,  6, 38 },
+    { 60, 28, 52, 20, 62, 30, 54, 22 },
+    {  3, 35, 11, 43,  1, 33,  9, 41 },
+    { 51, 19, 59, 27, 49, 17, 57, 25 },
+    { 15, 47,  7, 39, 13, 45,  5, 37 },
+    { 63, 31, 55, 23, 61, 29, 53, 21 }
+};
+
+/**
+ * @brief columns a row of error diffusion publishes at a time, the row
+ * below waits on this
+ */
+
+const int DITHER_STEP = 32;
+
+/**
+ * @brief extra error values kept on each side of a row so the pixels at
+ * the edges can push error past them
+ */
+
+const int DITHER_PAD = 2;
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * reads a quantizer written as BITS[,method].  BITS is 1 to 8 bits per
+ * channel and method is none (the default), bayer, floyd or atkinson.
+ *
+ * @param[in]     param - parameter given after --bits.
+ * @param[out]    q - the quantizer.
+ *
+ * @returns true if param is a valid quantizer and false otherwise.
+ *
+ * @par Example
+ * @verbatim
+   quantizer q;
+   parseQuantizer("1,floyd", q); // black and white with Floyd-Steinberg
+   parseQuantizer("4", q);       // 16 levels, nearest level
+   @endverbatim
+ *****************************************************************************/
+
+bool parseQuantizer(string param, quantizer& q)
+{
+    size_t comma = param.find(',');
+    string method = comma == string::npos ? "none" : param.substr(comma + 1);
+    char extra;
+
+    if (sscanf(param.substr(0, comma).c_str(), "%d%c", &q.bits, &extra) != 1
+        || q.bits < 1 || q.bits > 8)
+    {
+        return false;
+    }
+
+    if (method == "none")
+    {
+        q.method = DITHER_NONE;
+    }
+    else if (method == "bayer")
+    {
+        q.method = DITHER_BAYER;
+    }
+    else if (method == "floyd")
+    {
+        q.method = DITHER_FLOYD;
+    }
+    else if (method == "atkinson")
+    {
+        q.method = DITHER_ATKINSON;
+    }
+    else
+    {
+        return false;
+    }
+
+    return true;
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * quantizes the first count planes with lookup tables.  Without dithering
+ * there is one table that rounds to the nearest level.  With ordered
+ * dithering there is a table for each of the 64 places in the Bayer
+ * matrix, which rounds down after adding that place's threshold, so a flat
+ * area between two levels becomes a pattern of both.
+ *
+ * @param[in,out]     img - structure containing data of a ppm image.
+ * @param[in]         count - number of planes to quantize, 1 or 3.
+ * @param[in]         top - largest level, the number of levels less one.
+ * @param[in]         ordered - true to use the Bayer matrix.
+ *
+ * @par Example
+ * @verbatim
+   orderedDither(img, 3, 3, true); // 4 levels per color, Bayer dithered
+   @endverbatim
+ *****************************************************************************/
+
+void orderedDither(image& img, int count, int top, bool ordered)
+{
+    TRACE_SCOPE("orderedDither");
+
+    int k;
+    int v;
+    int tables = ordered ? 64 : 1;
+    int threads;
+    int band;
+    long long maxval = img.maxval;
+
+    vector<pixel> levels(size_t(tables) * 256);
+    pixel** planes[3] = { img.redGray, img.green, img.blue };
+
+    countAlloc((long long) levels.size());
+
+    for (k = 0; k < tables; k++)
+    {
+        for (v = 0; v < 256; v++)
+        {
+            if (!ordered)
+            {
+                levels[v] = pixel((2 * min<long long>(v, maxval) * top + maxval) / (2 * maxval));
+            }
+            else
+            {
+                // floor(v * top / maxval + (k + 1/2) / 64), never above top
+                levels[k * 256 + v] = pixel((128 * min<long long>(v, maxval) * top
+                    + (2 * BAYER[k / 8][k % 8] + 1) * maxval) / (128 * maxval));
+            }
+        }
+    }
+
+    threads = threadCount((long long) count * img.rows * img.cols);
+    band = (img.rows + threads - 1) / threads;
+
+    runParallel(threads, [&](int t)
+    {
+        int i;
+        int j;
+        int p;
+        const pixel* row;
+        pixel* data;
+
+        for (i = t * band; i < min(img.rows, (t + 1) * band); i++)
+        {
+            row = &levels[ordered ? (i % 8) * 8 * 256 : 0];
+
+            for (p = 0; p < count; p++)
+            {
+                data = planes[p][i];
+
+                if (!ordered)
+                {
+                    for (j = 0; j < img.cols; j++)
+                    {
+                        data[j] = row[data[j]];
+                    }
+                    continue;
+                }
+
+                for (j = 0; j < img.cols; j++)
+                {
+                    data[j] = row[(j % 8) * 256 + data[j]];
+                }
+            }
+        }
+    });
+
+    countFree((long long) levels.size());
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * quantizes the first count planes with error diffusion.  Floyd-Steinberg
+ * gives 7/16 of the error of a pixel to the next pixel and 3/16, 5/16 and
+ * 1/16 to the three below it.  Atkinson gives 1/8 to each of the next
+ * two pixels, the three below and the one two rows down, and drops the
+ * rest, which keeps more contrast.
+ *
+ * The threads take rows in order.  Row i may work on column j once row
+ * i - 1 is done with column j + 2 (j + 3 for Atkinson), since after that
+ * row i - 1 no longer changes the error row i reads or adds to.  Each
+ * row publishes how far it has come every DITHER_STEP columns.  The error
+ * still to be added to each row is kept in a ring of rows, in sixteenths
+ * of a level, and a row waits for the rows that used the places it adds
+ * error to before to be done with them.
+ *
+ * @param[in,out]     img - structure containing data of a ppm image.
+ * @param[in]         count - number of planes to quantize, 1 or 3.
+ * @param[in]         top - largest level, the number of levels less one.
+ * @param[in]         method - DITHER_FLOYD or DITHER_ATKINSON.
+ *
+ * @returns IMAGE_OK or IMAGE_NO_MEMORY if the error rows can't be made.
+ *
+ * @par Example
+ * @verbatim
+   diffuseDither(img, 1, 1, DITHER_FLOYD); // black and white gray plane
+   @endverbatim
+ *****************************************************************************/
+
+imageError diffuseDither(image& img, int count, int top, ditherMethod method)
+{
+    TRACE_SCOPE("diffuseDither");
+
+    int i;
+    int threads;
+    int slots;
+    int width = img.cols + 2 * DITHER_PAD;
+    int limit = 16 * img.maxval;
+    long long bytes;
+
+    atomic<int> next(0);
+    vector<int> errors;
+    vector<atomic<int>> progress;
+    vector<int> levels;
+    vector<int> values;
+    pixel** planes[3] = { img.redGray, img.green, img.blue };
+
+    threads = min(img.rows, threadCount((long long) count * img.rows * img.cols));
+    slots = threads + 3;
+    bytes = (long long) slots * count * width * sizeof(int)
+        + (long long) img.rows * sizeof(atomic<int>)
+        + (long long) (limit + 1 + top + 1) * sizeof(int);
+
+    try
+    {
+        errors.assign(size_t(slots) * count * width, 0);
+        progress = vector<atomic<int>>(size_t(img.rows));
+        levels.resize(size_t(limit) + 1);
+        values.resize(size_t(top) + 1);
+    }
+    catch (const bad_alloc&)
+    {
+        return IMAGE_NO_MEMORY;
+    }
+    countAlloc(bytes);
+
+    for (i = 0; i < img.rows; i++)
+    {
+        progress[i].store(0, memory_order_relaxed);
+    }
+
+    // the nearest level of each value in sixteenths, and the value in
+    // sixteenths of each level, so no pixel needs a division
+    for (i = 0; i <= limit; i++)
+    {
+        levels[i] = int((2LL * i * top + limit) / (2LL * limit));
+    }
+
+    for (i = 0; i <= top; i++)
+    {
+        values[i] = int((2LL * i * limit + top) / (2LL * top));
+    }
+
+    runParallel(threads, [&](int t)
+    {
+        int i;
+        int j;
+        int p;
+        int q;
+        int e;
+        int d;
+        int need;
+        int ready;
+        int lead = method == DITHER_FLOYD ? 3 : 4;
+        int value;
+        int* cur[3];
+        int* below[3];
+        int* twice[3];
+        pixel* data[3];
+
+        (void) t;
+
+        auto slot = [&](int row, int plane)
+        {
+            return &errors[(size_t(row % slots) * count + plane) * width + DITHER_PAD];
+        };
+
+        auto waitFor = [&](int row, int columns)
+        {
+            int done = progress[row].load(memory_order_acquire);
+
+            while (done < columns)
+            {
+                this_thread::yield();
+                done = progress[row].load(memory_order_acquire);
+            }
+            return done;
+        };
+
+        for (i = next++; i < img.rows; i = next++)
+        {
+            // the rows that used the places of rows i + 1 and i + 2 last
+            // must be done before this row adds error to them
+            if (i + 1 - slots >= 0)
+            {
+                waitFor(i + 1 - slots, img.cols + 1);
+            }
+
+            if (i + 2 - slots >= 0)
+            {
+                waitFor(i + 2 - slots, img.cols + 1);
+            }
+
+            ready = i == 0 ? img.cols + 1 : 0;
+
+            for (p = 0; p < count; p++)
+            {
+                cur[p] = slot(i, p);
+                below[p] = slot(i + 1, p);
+                twice[p] = slot(i + 2, p);
+                data[p] = planes[p][i];
+            }
+
+            for (j = 0; j < img.cols; j++)
+            {
+                need = min(j + lead, img.cols);
+
+                if (ready < need)
+                {
+                    ready = waitFor(i - 1, need);
+                }
+
+                for (p = 0; p < count; p++)
+                {
+                    value = 16 * data[p][j] + cur[p][j];
+                    q = levels[min(max(value, 0), limit)];
+                    e = value - values[q];
+                    data[p][j] = pixel(q);
+
+                    if (method == DITHER_FLOYD)
+                    {
+                        d = e * 7 / 16;
+                        cur[p][j + 1] += d;
+                        below[p][j - 1] += e * 3 / 16;
+                        below[p][j] += e * 5 / 16;
+                        below[p][j + 1] += e - d - e * 3 / 16 - e * 5 / 16;
+                    }
+                    else
+                    {
+                        d = e / 8;
+                        cur[p][j + 1] += d;
+                        cur[p][j + 2] += d;
+                        below[p][j - 1] += d;
+                        below[p][j] += d;
+                        below[p][j + 1] += d;
+                        twice[p][j] += d;
+                    }
+                }
+
+                if ((j + 1) % DITHER_STEP == 0)
+                {
+                    progress[i].store(j + 1, memory_order_release);
+                }
+            }
+
+            // this row's place in the ring is clean for the row that
+            // uses it next
+            for (p = 0; p < count; p++)
+            {
+                fill(slot(i, p) - DITHER_PAD, slot(i, p) - DITHER_PAD + width, 0);
+            }
+            progress[i].store(img.cols + 1, memory_order_release);
+        }
+    });
+
+    countFree(bytes);
+
+    return IMAGE_OK;
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * quantizes the first count planes of img to 2 to the power of q.bits
+ * levels with the dithering in q.  The maxval of img becomes the number
+ * of levels less one.  An alpha plane is rounded to the same levels
+ * without dithering so it still fits under maxval.
+ *
+ * @param[in,out]     img - structure containing data of a ppm image.
+ * @param[in]         count - 1 to quantize only the gray values in
+ *                            redGray, 3 for red, green and blue.
+ * @param[in]         q - bits and dithering.
+ *
+ * @returns IMAGE_OK or IMAGE_NO_MEMORY.
+ *
+ * @par Example
+ * @verbatim
+   quantizer q = { 1, DITHER_ATKINSON };
+   grayPlane(img);
+   quantizeImage(img, 1, q); // img.maxval is 1, ready for writeGray
+   @endverbatim
+ *****************************************************************************/
+
+imageError quantizeImage(image& img, int count, quantizer q)
+{
+    TRACE_SCOPE("quantizeImage");
+
+    int top = (1 << q.bits) - 1;
+    image alpha;
+    imageError result = IMAGE_OK;
+
+    if (img.maxval <= 0 || img.rows == 0 || img.cols == 0)
+    {
+        img.maxval = top;
+        return IMAGE_OK;
+    }
+
+    if (q.method == DITHER_FLOYD || q.method == DITHER_ATKINSON)
+    {
+        result = diffuseDither(img, count, top, q.method);
+    }
+    else
+    {
+        orderedDither(img, count, top, q.method == DITHER_BAYER);
+    }
+
+    if (result == IMAGE_OK && img.alpha != nullptr)
+    {
+        alpha.rows = img.rows;
+        alpha.cols = img.cols;
+        alpha.maxval = img.maxval;
+        alpha.redGray = img.alpha;
+        orderedDither(alpha, 1, top, false);
+    }
+
+    img.maxval = top;
+
+    return result;
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * estimates the memory quantizeImage needs beyond the image itself.
+ * Error diffusion keeps a ring of error rows, how far each row has come
+ * and its tables for an image with a maxval of 255, and a bitmap written from the result needs a row of text.
+ *
+ * @param[in]     rows - rows of the image.
+ * @param[in]     cols - columns of the image.
+ * @param[in]     count - number of planes quantized, 1 or 3.
+ * @param[in]     q - bits and dithering.
+ *
+ * @returns estimated bytes.
+ *
+ * @par Example
+ * @verbatim
+   quantizer q = { 1, DITHER_FLOYD };
+   quantizeBytes(2000, 3000, 1, q); // about 40 KB on 4 threads
+   @endverbatim
+ *****************************************************************************/
+
+long long quantizeBytes(int rows, int cols, int count, quantizer q)
+{
+    long long threads = min(rows, threadCount((long long) count * rows * cols));
+    long long bytes = 64 * 256;
+
+    if (q.method == DITHER_FLOYD || q.method == DITHER_ATKINSON)
+    {
+        bytes = (threads + 3) * count * (cols + 2 * DITHER_PAD) * (long long) sizeof(int)
+            + (long long) rows * sizeof(atomic<int>)
+            + (16 * 255 + 1 + (1 << q.bits)) * (long long) sizeof(int);
+    }
+
+    if (q.bits == 1 && count == 1)
+    {
+        bytes = max(bytes, bitmapBufferBytes(cols));
+    }
+
+    return bytes;
+}
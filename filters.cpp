@@ -0,0 +1,874 @@
+/** ***************************************************************************
+ * @file
+ * @brief Contains the filters that remove noise, --median and --bilateral
+ *
+ * A median of radius 1 or 2 runs a sorting network that finds the middle
+ * of 9 or 25 values.  The network is applied to whole rows at a time, one
+ * row for each place in the window, so every compare and swap is one call
+ * of kernels().sortPairs over the row.  Larger radii use the histogram
+ * median of Perreault and Hebert.  Every column keeps a histogram of the
+ * 2R + 1 pixels above and below the current row, and the window's
+ * histogram moves one column right by adding the column that enters it
+ * and taking away the one that leaves, so each pixel costs the same
+ * whatever the radius.  The histograms have 16 coarse counts ahead of the
+ * 256 fine ones so the median is found in at most 32 steps.  The columns
+ * are split into strips, one for each thread.
+ *
+ * The bilateral filter uses a bilateral grid.  Each pixel is added to a
+ * cell of a coarse 3D grid by its row, column and value, the grid is
+ * blurred along all three axes, and each pixel reads its result back out
+ * of the grid between the eight cells around it.  A cell is S pixels wide
+ * and R levels deep, so the work hardly depends on the spread.
+ *
+ * Both filters work on the red, green and blue planes, pixels past the
+ * edges repeat the edge, and alpha is left as it is.
+ *****************************************************************************/
+
+
+#include "netPBM.h"
+
+
+/**
+ * @brief largest radius done with a sorting network instead of histograms
+ */
+
+const int MEDIAN_SMALL = 2;
+
+/**
+ * @brief the pairs compared to find the middle of 9 values, the smaller
+ * of each pair goes to the first place
+ */
+
+const int MEDIAN_NETWORK_3[19][2] =
+{
+    { 1, 2 }, { 4, 5 }, { 7, 8 }, { 0, 1 }, { 3, 4 }, { 6, 7 }, { 1, 2 },
+    { 4, 5 }, { 7, 8 }, { 0, 3 }, { 5, 8 }, { 4, 7 }, { 3, 6 }, { 1, 4 },
+    { 2, 5 }, { 4, 7 }, { 4, 2 }, { 6, 4 }, { 4, 2 }
+};
+
+/**
+ * @brief the pairs compared to find the middle of 25 values, Batcher's
+ * odd-even merge sort with the pairs the middle doesn't depend on removed
+ */
+
+const int MEDIAN_NETWORK_5[113][2] =
+{
+    { 0, 1 }, { 2, 3 }, { 4, 5 }, { 6, 7 }, { 8, 9 }, { 10, 11 }, { 12, 13 },
+    { 14, 15 }, { 16, 17 }, { 18, 19 }, { 20, 21 }, { 22, 23 }, { 0, 2 },
+    { 1, 3 }, { 4, 6 }, { 5, 7 }, { 8, 10 }, { 9, 11 }, { 12, 14 }, { 13, 15 },
+    { 16, 18 }, { 17, 19 }, { 20, 22 }, { 21, 23 }, { 1, 2 }, { 5, 6 },
+    { 9, 10 }, { 13, 14 }, { 17, 18 }, { 21, 22 }, { 0, 4 }, { 1, 5 },
+    { 2, 6 }, { 3, 7 }, { 8, 12 }, { 9, 13 }, { 10, 14 }, { 11, 15 },
+    { 16, 20 }, { 17, 21 }, { 18, 22 }, { 19, 23 }, { 2, 4 }, { 3, 5 },
+    { 10, 12 }, { 11, 13 }, { 18, 20 }, { 19, 21 }, { 1, 2 }, { 3, 4 },
+    { 5, 6 }, { 9, 10 }, { 11, 12 }, { 13, 14 }, { 17, 18 }, { 19, 20 },
+    { 21, 22 }, { 0, 8 }, { 1, 9 }, { 2, 10 }, { 3, 11 }, { 4, 12 }, { 5, 13 },
+    { 6, 14 }, { 7, 15 }, { 16, 24 }, { 4, 8 }, { 5, 9 }, { 6, 10 }, { 7, 11 },
+    { 20, 24 }, { 2, 4 }, { 3, 5 }, { 6, 8 }, { 7, 9 }, { 10, 12 }, { 11, 13 },
+    { 18, 20 }, { 19, 21 }, { 22, 24 }, { 1, 2 }, { 3, 4 }, { 5, 6 }, { 7, 8 },
+    { 9, 10 }, { 11, 12 }, { 13, 14 }, { 17, 18 }, { 19, 20 }, { 21, 22 },
+    { 23, 24 }, { 0, 16 }, { 1, 17 }, { 2, 18 }, { 3, 19 }, { 4, 20 },
+    { 5, 21 }, { 6, 22 }, { 7, 23 }, { 8, 24 }, { 8, 16 }, { 9, 17 },
+    { 10, 18 }, { 11, 19 }, { 12, 20 }, { 13, 21 }, { 6, 10 }, { 7, 11 },
+    { 12, 16 }, { 13, 17 }, { 10, 12 }, { 11, 13 }, { 11, 12 }
+};
+
+/**
+ * @brief empty cells kept on each side of every axis of the bilateral
+ * grid, as many as the blur reaches
+ */
+
+const int GRID_PAD = 2;
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * returns the row or column used for index k of a plane with size rows
+ * or columns, so the pixels past the edges repeat the edge.
+ *
+ * @param[in]     k - row or column, may be outside the plane.
+ * @param[in]     size - number of rows or columns.
+ *
+ * @returns k moved inside 0 to size - 1.
+ *
+ * @par Example
+ * @verbatim
+   edgeIndex(-2, 480);  // 0
+   edgeIndex(481, 480); // 479
+   @endverbatim
+ *****************************************************************************/
+
+static int edgeIndex(int k, int size)
+{
+    return k < 0 ? 0 : (k >= size ? size - 1 : k);
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * reads a bilateral filter written as S,R.  S is 1 to 64 pixels and R is
+ * 1 to 255 levels.
+ *
+ * @param[in]     param - parameter given after --bilateral.
+ * @param[out]    filter - the filter.
+ *
+ * @returns true if param is a valid filter and false otherwise.
+ *
+ * @par Example
+ * @verbatim
+   bilateral filter;
+   parseBilateral("8,20", filter); // smooths over 8 pixels, keeps steps of 20
+   parseBilateral("8", filter);    // returns false
+   @endverbatim
+ *****************************************************************************/
+
+bool parseBilateral(string param, bilateral& filter)
+{
+    char extra;
+
+    if (sscanf(param.c_str(), "%d,%d%c", &filter.spatial, &filter.range, &extra) != 2)
+    {
+        return false;
+    }
+
+    return filter.spatial >= 1 && filter.spatial <= 64 && filter.range >= 1
+        && filter.range <= 255;
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * finds the number of threads medianImage uses and the bytes each thread
+ * needs.  A sorting network needs a row for each place in the window.  A
+ * strip needs a histogram for each of its columns and the radius of
+ * columns on each side, so a strip is kept at least as wide as the window
+ * to keep those extra columns from costing more than the strip itself.
+ *
+ * @param[in]     rows - number of rows in the image.
+ * @param[in]     cols - number of columns in the image.
+ * @param[in]     radius - radius of the window.
+ * @param[out]    threads - number of threads.
+ * @param[out]    each - bytes each thread needs.
+ *
+ * @par Example
+ * @verbatim
+   medianLayout(2000, 3000, 10, threads, each); // 8 strips of 375 columns
+   @endverbatim
+ *****************************************************************************/
+
+static void medianLayout(int rows, int cols, int radius, int& threads, long long& each)
+{
+    int side = 2 * radius + 1;
+
+    threads = threadCount((long long) rows * cols);
+
+    if (radius <= MEDIAN_SMALL)
+    {
+        threads = max(1, min(threads, rows));
+        each = (long long) side * side * cols;
+        return;
+    }
+
+    threads = max(1, min(threads, cols / side));
+    each = ((cols + threads - 1) / threads + 2LL * radius) * MEDIAN_HIST
+        * (long long) sizeof(unsigned short);
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * finds the median of radius 1 or 2 of the rows first to last of a plane
+ * with a sorting network.  Each place in the window gets a copy of the
+ * row shifted by its offset, and the network sorts down the copies so the
+ * middle copy ends up holding the median of every pixel of the row.
+ *
+ * @param[in]     from - plane to filter.
+ * @param[out]    to - plane that receives the medians.
+ * @param[in]     rows - number of rows in the plane.
+ * @param[in]     cols - number of columns in the plane.
+ * @param[in]     radius - 1 or 2.
+ * @param[in]     first - first row to filter.
+ * @param[in]     last - one past the last row to filter.
+ * @param[in]     window - room for (2 * radius + 1) squared rows.
+ *
+ * @par Example
+ * @verbatim
+   medianNetwork(img.redGray, temp, img.rows, img.cols, 1, 0, img.rows, window);
+   @endverbatim
+ *****************************************************************************/
+
+static void medianNetwork(pixel** from, pixel** to, int rows, int cols, int radius,
+    int first, int last, pixel* window)
+{
+    int side = 2 * radius + 1;
+    int pairs = radius == 1 ? 19 : 113;
+    const int (*network)[2] = radius == 1 ? MEDIAN_NETWORK_3 : MEDIAN_NETWORK_5;
+    int i;
+    int j;
+    int k;
+    int dy;
+    int dx;
+    int offset;
+    int lo;
+    int hi;
+    pixel* src;
+    pixel* row;
+
+    for (i = first; i < last; i++)
+    {
+        for (dy = 0; dy < side; dy++)
+        {
+            src = from[edgeIndex(i + dy - radius, rows)];
+
+            for (dx = 0; dx < side; dx++)
+            {
+                row = window + (long long) (dy * side + dx) * cols;
+                offset = dx - radius;
+                lo = max(0, -offset);
+                hi = min(cols, cols - offset);
+
+                for (j = 0; j < min(lo, cols); j++)
+                {
+                    row[j] = src[0];
+                }
+
+                if (hi > lo)
+                {
+                    memcpy(row + lo, src + lo + offset, size_t(hi - lo));
+                }
+
+                for (j = max(lo, hi); j < cols; j++)
+                {
+                    row[j] = src[cols - 1];
+                }
+            }
+        }
+
+        for (k = 0; k < pairs; k++)
+        {
+            kernels().sortPairs(window + (long long) network[k][0] * cols,
+                window + (long long) network[k][1] * cols, cols);
+        }
+
+        memcpy(to[i], window + (long long) (side * side / 2) * cols, size_t(cols));
+    }
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * adds change to the count of value in a histogram, both its coarse and
+ * its fine count.
+ *
+ * @param[in,out] hist - histogram of MEDIAN_HIST counts.
+ * @param[in]     value - pixel value.
+ * @param[in]     change - 1 to add the pixel or -1 to take it away.
+ *
+ * @par Example
+ * @verbatim
+   countValue(columns, img.redGray[0][0], 1);
+   @endverbatim
+ *****************************************************************************/
+
+static void countValue(unsigned short* hist, pixel value, int change)
+{
+    hist[value >> 4] = (unsigned short) (hist[value >> 4] + change);
+    hist[16 + value] = (unsigned short) (hist[16 + value] + change);
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * finds the median of the columns left to right of a plane with
+ * histograms.  The column histograms move down one row at a time and the
+ * window moves right along each row, see the top of this file.
+ *
+ * @param[in]     from - plane to filter.
+ * @param[out]    to - plane that receives the medians.
+ * @param[in]     rows - number of rows in the plane.
+ * @param[in]     cols - number of columns in the plane.
+ * @param[in]     radius - radius of the window, 1 to MEDIAN_MAX.
+ * @param[in]     left - first column to filter.
+ * @param[in]     right - one past the last column to filter.
+ * @param[in]     columns - room for the histograms of right - left + 2 *
+ *                          radius columns.
+ *
+ * @par Example
+ * @verbatim
+   medianStrip(img.redGray, temp, img.rows, img.cols, 10, 0, 375, columns);
+   @endverbatim
+ *****************************************************************************/
+
+static void medianStrip(pixel** from, pixel** to, int rows, int cols, int radius,
+    int left, int right, unsigned short* columns)
+{
+    int lo = max(0, left - radius);
+    int hi = min(cols, right + radius);
+    int rank = (2 * radius + 1) * (2 * radius + 1) / 2;
+    int count;
+    int value;
+    int i;
+    int j;
+    int k;
+    int c;
+    pixel* leaving;
+    pixel* entering;
+    unsigned short* column;
+    unsigned short window[MEDIAN_HIST];
+
+    memset(columns, 0, size_t(hi - lo) * MEDIAN_HIST * sizeof(unsigned short));
+
+    for (k = -radius; k <= radius; k++)
+    {
+        entering = from[edgeIndex(k, rows)];
+
+        for (c = lo; c < hi; c++)
+        {
+            countValue(columns + (c - lo) * MEDIAN_HIST, entering[c], 1);
+        }
+    }
+
+    for (i = 0; i < rows; i++)
+    {
+        if (i > 0)
+        {
+            leaving = from[edgeIndex(i - 1 - radius, rows)];
+            entering = from[edgeIndex(i + radius, rows)];
+
+            for (c = lo; c < hi; c++)
+            {
+                column = columns + (c - lo) * MEDIAN_HIST;
+                countValue(column, leaving[c], -1);
+                countValue(column, entering[c], 1);
+            }
+        }
+
+        memset(window, 0, sizeof(window));
+
+        for (k = left - radius; k <= left + radius; k++)
+        {
+            column = columns + (edgeIndex(k, cols) - lo) * MEDIAN_HIST;
+
+            for (c = 0; c < MEDIAN_HIST; c++)
+            {
+                window[c] = (unsigned short) (window[c] + column[c]);
+            }
+        }
+
+        for (j = left; j < right; j++)
+        {
+            if (j > left)
+            {
+                kernels().histogramStep(window,
+                    columns + (edgeIndex(j + radius, cols) - lo) * MEDIAN_HIST,
+                    columns + (edgeIndex(j - 1 - radius, cols) - lo) * MEDIAN_HIST,
+                    MEDIAN_HIST);
+            }
+
+            count = 0;
+            value = 0;
+
+            while (count + window[value] <= rank)
+            {
+                count += window[value];
+                value++;
+            }
+
+            value = value * 16;
+
+            while (count + window[16 + value] <= rank)
+            {
+                count += window[16 + value];
+                value++;
+            }
+
+            to[i][j] = pixel(value);
+        }
+    }
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * replaces each red, green and blue value with the median of the square
+ * of radius radius around it.  Each plane is filtered into a spare plane
+ * and the two are swapped, so only one extra plane is ever held.
+ *
+ * @param[in,out]     img - structure containing data of a ppm image.
+ * @param[in]         radius - radius of the window, 1 to MEDIAN_MAX.
+ *
+ * @returns IMAGE_OK or IMAGE_NO_MEMORY, in which case img is unchanged.
+ *
+ * @par Example
+ * @verbatim
+   medianImage(img, 1); // removes single pixel specks
+   @endverbatim
+ *****************************************************************************/
+
+imageError medianImage(image& img, int radius)
+{
+    TRACE_SCOPE("medianImage");
+
+    int threads;
+    int p;
+    long long each;
+    pixel** planes[3] = { img.redGray, img.green, img.blue };
+    pixel** temp = nullptr;
+    pixel* windows = nullptr;
+    unsigned short* columns = nullptr;
+
+    if (img.rows == 0 || img.cols == 0)
+    {
+        return IMAGE_OK;
+    }
+
+    medianLayout(img.rows, img.cols, radius, threads, each);
+    alloc(temp, img.rows, img.cols);
+
+    if (radius <= MEDIAN_SMALL)
+    {
+        windows = new(nothrow) pixel[size_t(threads * each)];
+    }
+    else
+    {
+        columns = new(nothrow) unsigned short[size_t(threads * each) / sizeof(unsigned short)];
+    }
+
+    if (temp == nullptr || (windows == nullptr && columns == nullptr))
+    {
+        free2d(temp, img.rows);
+        delete[] windows;
+        delete[] columns;
+        return IMAGE_NO_MEMORY;
+    }
+    countAlloc(threads * each);
+
+    for (p = 0; p < 3; p++)
+    {
+        runParallel(threads, [&](int part)
+        {
+            if (radius <= MEDIAN_SMALL)
+            {
+                medianNetwork(planes[p], temp, img.rows, img.cols, radius,
+                    int((long long) img.rows * part / threads),
+                    int((long long) img.rows * (part + 1) / threads), windows + part * each);
+            }
+            else
+            {
+                medianStrip(planes[p], temp, img.rows, img.cols, radius,
+                    int((long long) img.cols * part / threads),
+                    int((long long) img.cols * (part + 1) / threads),
+                    columns + part * each / (long long) sizeof(unsigned short));
+            }
+        });
+
+        swap(planes[p], temp);
+    }
+
+    img.redGray = planes[0];
+    img.green = planes[1];
+    img.blue = planes[2];
+
+    free2d(temp, img.rows);
+    delete[] windows;
+    delete[] columns;
+    countFree(threads * each);
+
+    return IMAGE_OK;
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * estimates the memory medianImage needs beyond the image itself.
+ *
+ * @param[in]     rows - rows of the image.
+ * @param[in]     cols - columns of the image.
+ * @param[in]     radius - radius of the window.
+ *
+ * @returns estimated bytes.
+ *
+ * @par Example
+ * @verbatim
+   medianBytes(2000, 3000, 10); // a spare plane of about 6 MB and the histograms
+   @endverbatim
+ *****************************************************************************/
+
+long long medianBytes(int rows, int cols, int radius)
+{
+    int threads;
+    long long each;
+
+    if (rows == 0 || cols == 0)
+    {
+        return 0;
+    }
+
+    medianLayout(rows, cols, radius, threads, each);
+
+    return planeBytes(rows, cols) + threads * each;
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * finds the size of the bilateral grid of an image.  Every axis has
+ * GRID_PAD empty cells on each side.
+ *
+ * @param[in]     rows - rows of the image.
+ * @param[in]     cols - columns of the image.
+ * @param[in]     filter - the filter.
+ * @param[out]    height - cells down the grid.
+ * @param[out]    width - cells across the grid.
+ * @param[out]    depth - cells through the grid, one for each R levels.
+ *
+ * @par Example
+ * @verbatim
+   bilateral filter = { 8, 20 };
+   gridSize(480, 640, filter, height, width, depth); // 65 by 85 by 18
+   @endverbatim
+ *****************************************************************************/
+
+static void gridSize(int rows, int cols, bilateral filter, int& height, int& width,
+    int& depth)
+{
+    height = (rows - 1 + filter.spatial / 2) / filter.spatial + 1 + 2 * GRID_PAD;
+    width = (cols - 1 + filter.spatial / 2) / filter.spatial + 1 + 2 * GRID_PAD;
+    depth = (255 + filter.range / 2) / filter.range + 1 + 2 * GRID_PAD;
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * blurs one line of the bilateral grid with the weights 1 4 6 4 1, which
+ * is close to a gaussian one cell wide.  Each cell holds a sum of values
+ * and a weight and both are blurred.
+ *
+ * @param[in,out] grid - first cell of the line.
+ * @param[in]     step - cells from one cell of the line to the next.
+ * @param[in]     length - cells in the line.
+ * @param[in]     line - room for 2 * length values.
+ *
+ * @par Example
+ * @verbatim
+   blurLine(grid + 2 * cell, 1, depth, line); // along the values of one cell
+   @endverbatim
+ *****************************************************************************/
+
+static void blurLine(float* grid, long long step, int length, float* line)
+{
+    const float weights[5] = { 1, 4, 6, 4, 1 };
+    int k;
+    int t;
+    int at;
+    float sum;
+    float weight;
+
+    for (k = 0; k < length; k++)
+    {
+        line[2 * k] = grid[2 * k * step];
+        line[2 * k + 1] = grid[2 * k * step + 1];
+    }
+
+    for (k = 0; k < length; k++)
+    {
+        sum = 0;
+        weight = 0;
+
+        for (t = 0; t < 5; t++)
+        {
+            at = k + t - 2;
+
+            if (at >= 0 && at < length)
+            {
+                sum += weights[t] * line[2 * at];
+                weight += weights[t] * line[2 * at + 1];
+            }
+        }
+
+        grid[2 * k * step] = sum / 16;
+        grid[2 * k * step + 1] = weight / 16;
+    }
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * applies the bilateral filter to one plane.  The grid rows are split
+ * between threads when the pixels are added, so each cell is only ever
+ * added to by one thread, in the same order however many threads there
+ * are.
+ *
+ * @param[in,out] plane - plane to filter.
+ * @param[in]     rows - number of rows in the plane.
+ * @param[in]     cols - number of columns in the plane.
+ * @param[in]     filter - the filter.
+ * @param[in]     grid - room for the grid, two values per cell.
+ * @param[in]     lines - room for 2 * the longest axis values per thread.
+ * @param[in]     threads - number of threads.
+ *
+ * @par Example
+ * @verbatim
+   bilateralPlane(img.redGray, img.rows, img.cols, filter, grid, lines, 8);
+   @endverbatim
+ *****************************************************************************/
+
+static void bilateralPlane(pixel** plane, int rows, int cols, bilateral filter,
+    float* grid, float* lines, int threads)
+{
+    int height;
+    int width;
+    int depth;
+    int longest;
+    long long cells;
+
+    gridSize(rows, cols, filter, height, width, depth);
+    longest = max(height, max(width, depth));
+    cells = (long long) height * width * depth;
+
+    memset(grid, 0, size_t(cells) * 2 * sizeof(float));
+
+    // add each pixel to its nearest cell, each thread owning some grid rows
+    runParallel(threads, [&](int part)
+    {
+        int data = height - 2 * GRID_PAD;
+        int top = int((long long) data * part / threads);
+        int bottom = int((long long) data * (part + 1) / threads);
+        int first = max(0, top * filter.spatial - filter.spatial / 2);
+        int last = min(rows, bottom * filter.spatial - filter.spatial / 2);
+        int i;
+        int j;
+        long long cell;
+
+        for (i = first; i < last; i++)
+        {
+            for (j = 0; j < cols; j++)
+            {
+                cell = ((long long) ((i + filter.spatial / 2) / filter.spatial + GRID_PAD)
+                    * width + (j + filter.spatial / 2) / filter.spatial + GRID_PAD) * depth
+                    + (plane[i][j] + filter.range / 2) / filter.range + GRID_PAD;
+                grid[2 * cell] += plane[i][j];
+                grid[2 * cell + 1] += 1;
+            }
+        }
+    });
+
+    // blur through the values and across, each thread taking grid rows
+    runParallel(threads, [&](int part)
+    {
+        float* line = lines + 2LL * longest * part;
+        int y;
+        int x;
+        int z;
+
+        for (y = height * part / threads; y < height * (part + 1) / threads; y++)
+        {
+            for (x = 0; x < width; x++)
+            {
+                blurLine(grid + 2 * ((long long) y * width + x) * depth, 1, depth, line);
+            }
+
+            for (z = 0; z < depth; z++)
+            {
+                blurLine(grid + 2 * ((long long) y * width * depth + z), depth, width, line);
+            }
+        }
+    });
+
+    // blur down, each thread taking grid columns
+    runParallel(threads, [&](int part)
+    {
+        float* line = lines + 2LL * longest * part;
+        int x;
+        int z;
+
+        for (x = width * part / threads; x < width * (part + 1) / threads; x++)
+        {
+            for (z = 0; z < depth; z++)
+            {
+                blurLine(grid + 2 * ((long long) x * depth + z), (long long) width * depth,
+                    height, line);
+            }
+        }
+    });
+
+    // read each pixel back from the eight cells around it
+    runParallel(threads, [&](int part)
+    {
+        int i;
+        int j;
+        int k;
+        int y;
+        int x;
+        int z;
+        double fy;
+        double fx;
+        double fz;
+        double w;
+        double sum;
+        double weight;
+        long long cell;
+
+        for (i = rows * part / threads; i < rows * (part + 1) / threads; i++)
+        {
+            fy = double(i) / filter.spatial + GRID_PAD;
+            y = int(fy);
+            fy -= y;
+
+            for (j = 0; j < cols; j++)
+            {
+                fx = double(j) / filter.spatial + GRID_PAD;
+                x = int(fx);
+                fx -= x;
+                fz = double(plane[i][j]) / filter.range + GRID_PAD;
+                z = int(fz);
+                fz -= z;
+                sum = 0;
+                weight = 0;
+
+                for (k = 0; k < 8; k++)
+                {
+                    cell = ((long long) (y + (k >> 2)) * width + x + ((k >> 1) & 1)) * depth
+                        + z + (k & 1);
+                    w = ((k >> 2) ? fy : 1 - fy) * (((k >> 1) & 1) ? fx : 1 - fx)
+                        * ((k & 1) ? fz : 1 - fz);
+                    sum += w * grid[2 * cell];
+                    weight += w * grid[2 * cell + 1];
+                }
+
+                if (weight > 0)
+                {
+                    plane[i][j] = pixel(crop(sum / weight) + 0.5);
+                }
+            }
+        }
+    });
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * smooths the red, green and blue planes of img with a bilateral filter,
+ * which averages each pixel with the pixels near it that have a value
+ * close to its own, so noise is smoothed but edges stay sharp.
+ *
+ * @param[in,out]     img - structure containing data of a ppm image.
+ * @param[in]         filter - the filter.
+ *
+ * @returns IMAGE_OK or IMAGE_NO_MEMORY, in which case img is unchanged.
+ *
+ * @par Example
+ * @verbatim
+   bilateral filter = { 8, 20 };
+   bilateralImage(img, filter); // smooths a noisy scan
+   @endverbatim
+ *****************************************************************************/
+
+imageError bilateralImage(image& img, bilateral filter)
+{
+    TRACE_SCOPE("bilateralImage");
+
+    int height;
+    int width;
+    int depth;
+    int threads;
+    long long cells;
+    long long bytes;
+    float* grid;
+    float* lines;
+
+    if (img.rows == 0 || img.cols == 0)
+    {
+        return IMAGE_OK;
+    }
+
+    gridSize(img.rows, img.cols, filter, height, width, depth);
+    threads = min(threadCount((long long) img.rows * img.cols), height - 2 * GRID_PAD);
+    cells = (long long) height * width * depth;
+    bytes = bilateralBytes(img.rows, img.cols, filter);
+
+    grid = new(nothrow) float[size_t(cells) * 2];
+    lines = new(nothrow) float[size_t(threads) * 2 * max(height, max(width, depth))];
+
+    if (grid == nullptr || lines == nullptr)
+    {
+        delete[] grid;
+        delete[] lines;
+        return IMAGE_NO_MEMORY;
+    }
+    countAlloc(bytes);
+
+    bilateralPlane(img.redGray, img.rows, img.cols, filter, grid, lines, threads);
+    bilateralPlane(img.green, img.rows, img.cols, filter, grid, lines, threads);
+    bilateralPlane(img.blue, img.rows, img.cols, filter, grid, lines, threads);
+
+    delete[] grid;
+    delete[] lines;
+    countFree(bytes);
+
+    return IMAGE_OK;
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * estimates the memory bilateralImage needs beyond the image itself, the
+ * grid and a line of it for each thread.
+ *
+ * @param[in]     rows - rows of the image.
+ * @param[in]     cols - columns of the image.
+ * @param[in]     filter - the filter.
+ *
+ * @returns estimated bytes.
+ *
+ * @par Example
+ * @verbatim
+   bilateral filter = { 16, 20 };
+   bilateralBytes(2000, 3000, filter); // about 4 MB of grid
+   @endverbatim
+ *****************************************************************************/
+
+long long bilateralBytes(int rows, int cols, bilateral filter)
+{
+    int height;
+    int width;
+    int depth;
+    long long threads;
+
+    if (rows == 0 || cols == 0)
+    {
+        return 0;
+    }
+
+    gridSize(rows, cols, filter, height, width, depth);
+    threads = min(threadCount((long long) rows * cols), height - 2 * GRID_PAD);
+
+    return ((long long) height * width * depth + threads * max(height, max(width, depth)))
+        * 2 * (long long) sizeof(float);
+}
@@ -15,22 +15,25 @@
    * @param[in]    name - name of the ppm file
    *
    *
-   * @par Example
+   * @returns true if the file was opened and false otherwise.
+  *
+  * @par Example
    * @verbatim
      fileopeninput( fin , balloonA.ppm);  // opens balloonA.ppm file for input
      fileopeninput ( fin , booloonB.ppm); // opens balloonb.ppm file for input
      @endverbatim
    *****************************************************************************/
 
-void fileopeninput(ifstream &fin , string name)
+bool fileopeninput(ifstream &fin , string name)
 {
     fin.open(name,ios :: in | ios :: binary);
 
     if (!fin.is_open())
     {
-        cout << "Unable to open file: " << name << endl;
-        exit(0);
+        return false;
     }
+
+    return true;
 }
 
 /** ***************************************************************************
@@ -43,6 +46,8 @@ void fileopeninput(ifstream &fin , string name)
   * @param[in]    name - name of the ppm file
   *
   *
+  * @returns true if the file was opened and false otherwise.
+  *
   * @par Example
   * @verbatim
     fileopenoutput( fout , balloonx);  // opens balloonx.ppm file for output
@@ -50,15 +55,16 @@ void fileopeninput(ifstream &fin , string name)
     @endverbatim
   *****************************************************************************/
 
-void fileopenoutput(ofstream &fout , string name)
+bool fileopenoutput(ofstream &fout , string name)
 {
     fout.open(name + ".ppm", ios::out | ios::binary | ios::trunc);
 
     if (!fout.is_open())
     {
-        cout << "Unable to open file: " << name << endl;
-        exit(0);
+        return false;
     }
+
+    return true;
 }
 
 
@@ -72,6 +78,8 @@ void fileopenoutput(ofstream &fout , string name)
   * @param[in]    name - name of the pgm file
   *
   *
+  * @returns true if the file was opened and false otherwise.
+  *
   * @par Example
   * @verbatim
     outputgray( foutgray , balloonx);  // opens balloonx.ppm file for output
@@ -79,15 +87,51 @@ void fileopenoutput(ofstream &fout , string name)
   *****************************************************************************/
 
 
-void outputgray (ofstream& fout, string name)
+bool outputgray (ofstream& fout, string name)
 {
     fout.open(name + ".pgm", ios::out | ios::binary | ios::trunc);
 
     if (!fout.is_open())
     {
-        cout << "Unable to open file: " << name << endl;
-        exit(0);
+        return false;
+    }
+
+    return true;
+}
+
+
+/** ***************************************************************************
+  * @author Aryan Raval
+  *
+  * @par Description
+  * Opens file for output in binary mode with the given extension, for the
+  * formats that have no helper of their own such as qoi, tpx, raw, pam
+  * and pbm.
+  *
+  * @param[in]    name - name of the file without its extension
+  * @param[in]    extension - extension of the file, including the dot
+  * @param[in,out]     fout - ofstream file opened for output
+  *
+  *
+  * @returns true if the file was opened and false otherwise.
+  *
+  * @par Example
+  * @verbatim
+    openOutputFile( balloonx , ".qoi" , fout );  // opens balloonx.qoi file for output
+    @endverbatim
+  *****************************************************************************/
+
+
+bool openOutputFile (string name, string extension, ofstream& fout)
+{
+    fout.open(name + extension, ios::out | ios::binary | ios::trunc);
+
+    if (!fout.is_open())
+    {
+        return false;
     }
+
+    return true;
 }
 
 
@@ -137,43 +181,32 @@ void filecloseoutput(ofstream& file)
   * @author Aryan Raval
   *
   * @par Description
-  * reads data from ifstream file and stores it in structure image.
+  * reads the magic number, comments, size and maximum pixel value of a
+  * ppm file and leaves fin at the first byte of pixel data.
   *
   * @param[in,out]     fin - file opened for input conataining data for ppm file.
-  * @param[in,out]    img - a struture that contains data for ppm image.
+  * @param[in,out]    img - a struture that receives the header of the image.
   *
-  * @returns true if memmory allocation is successful and false otherwise.
+  * @returns IMAGE_OK or IMAGE_BAD_FORMAT if fin does not hold a ppm image.
   *
   * @par Example
   * @verbatim
-    bool ans;
-    Image img;
+    image img;
     ifstream fin;
-    ans = readimage (fin , img) ; // reads data from fin and stores it in struct img
+    readHeader(fin, img); // img.rows and img.cols now hold the image size
     @endverbatim
   *****************************************************************************/
 
 
-bool readImage(ifstream& fin, image& img)
+imageError readHeader(istream& fin, image& img)
 {
     string temp;
-    size_t pos;
-
-    int i;
-    int j;
-    int count = 0;
-    int size;
-
-    int* storage = nullptr;
-    pixel* storageb = nullptr;
 
     getline(fin, img.magicNumber);
 
     if (img.magicNumber != "P3" && img.magicNumber != "P6")
     {
-        cout << "Not a valid netpbm image." << endl;
-        filecloseinput(fin);
-        exit(0);
+        return IMAGE_BAD_FORMAT;
     }
 
  
@@ -182,85 +215,170 @@ bool readImage(ifstream& fin, image& img)
         img.comment = img.comment + temp + "\n";
     }
 
-    pos = temp.find(" ");
-    img.cols = stoi(temp.substr(0, pos));
-    img.rows = stoi(temp.substr(pos + 1, string::npos ) );
+    if (sscanf(temp.c_str(), "%d %d", &img.cols, &img.rows) != 2
+        || img.cols <= 0 || img.rows <= 0)
+    {
+        return IMAGE_BAD_FORMAT;
+    }
+
+    getline(fin, temp);
+    img.maxval = atoi(temp.c_str());
+
+    if (img.maxval <= 0 || img.maxval > 255)
+    {
+        return IMAGE_BAD_FORMAT;
+    }
+
+    return IMAGE_OK;
+}
+
+
+/** ***************************************************************************
+  * @author Aryan Raval
+  *
+  * @par Description
+  * returns the number of rows of a P6 image read at a time, so that the
+  * buffer stays near PIPE_BLOCK bytes.
+  *
+  * @param[in]    rows - number of rows in the image.
+  * @param[in]    cols - number of columns in the image.
+  *
+  * @returns number of rows in a band, at least 1 and at most rows.
+  *
+  * @par Example
+  * @verbatim
+    binaryBandRows(480, 640); // 480, the whole image fits in one band
+    @endverbatim
+  *****************************************************************************/
+
+
+int binaryBandRows(int rows, int cols)
+{
+    long long band = (long long) PIPE_BLOCK / (3LL * max(cols, 1));
+
+    return int(max(1LL, min((long long) rows, band)));
+}
+
+
+/** ***************************************************************************
+  * @author Aryan Raval
+  *
+  * @par Description
+  * reads data from ifstream file and stores it in structure image.  QOI,
+  * tiled and PAM images are recognized by their magic number and read with
+  * readQoi, readTiled and readPam.
+  *
+  * @param[in,out]     fin - file opened for input conataining data for ppm file.
+  * @param[in,out]    img - a struture that contains data for ppm image.
+  *
+  * @returns IMAGE_OK if the image was read, otherwise the reason it
+  *          wasn't.  img holds no memory when the read fails.
+  *
+  * @par Example
+  * @verbatim
+    imageError ans;
+    Image img;
+    ifstream fin;
+    ans = readimage (fin , img) ; // reads data from fin and stores it in struct img
+    @endverbatim
+  *****************************************************************************/
+
+
+imageError readImage(istream& fin, image& img)
+{
+    TRACE_SCOPE("readImage");
 
-    getline(fin, maxpix);
+    int i;
+    int k;
+    int count = 0;
+    int band;
+    long long size;
+    imageError result;
 
-    alloc(img.redGray, img.rows, img.cols);
-    alloc(img.green, img.rows, img.cols);
-    alloc(img.blue, img.rows, img.cols);
+    pixel* storageb = nullptr;
+    region whole = { 0, 0, 0, 0 };
 
-    if (img.redGray == nullptr || img.green == nullptr || img.blue == nullptr)
+    if (fin.peek() == 'q')
     {
-        return false;
+        return readQoi(fin, img);
+    }
+
+    if (fin.peek() == 't')
+    {
+        return readTiled(fin, img, whole, 0);
+    }
+
+    if (isPam(fin))
+    {
+        return readPam(fin, img);
     }
 
-    size = img.rows * img.cols * 3;
+    result = readHeader(fin, img);
 
-    if (img.magicNumber == "P3")
+    if (result != IMAGE_OK)
     {
-        storage = new(nothrow) int[size];
+        return result;
+    }
 
-        if (storage == nullptr)
-        {
-            cout << "Unable to allocate memory for storage." << endl;
-            exit(0);
-        }
+    if (!allocImage(img, img.rows, img.cols))
+    {
+        return IMAGE_NO_MEMORY;
+    }
 
-        while (count < size && fin >> storage[count])
-        {
-            count++;
-        }
+    band = binaryBandRows(img.rows, img.cols);
+    size = 3LL * band * img.cols;
 
-        count = 0;
+    if (img.magicNumber == "P3")
+    {
+        result = readAscii(fin, img);
 
-        for (i = 0; i < img.rows; i++)
+        if (result != IMAGE_OK)
         {
-            for (j = 0; j < img.cols; j++)
-            {
-                img.redGray[i][j] = pixel(storage[count]);
-                count++;
-                img.green[i][j] = pixel(storage[count]);
-                count++;
-                img.blue[i][j] = pixel(storage[count]);
-                count++;
-            }
+            freeImage(img);
+            return result;
         }
-        delete[] storage;
     }
     
     else if (img.magicNumber == "P6")
     {
-        storageb = new(nothrow)  pixel[size];
+        storageb = new(nothrow)  pixel[size_t(size)];
 
         if (storageb == nullptr)
         {
-            cout << "Unable to allocate memory for storage." << endl;
-            exit(0);
+            freeImage(img);
+            return IMAGE_NO_MEMORY;
         }
+        countAlloc(size * (long long) sizeof(pixel));
 
-        fin.read((char*) storageb, sizeof(pixel) * size);
+        // the pixels are read a band of rows at a time so the buffer stays
+        // small next to the planes
+        for (k = 0; k < img.rows; k += band)
+        {
+            size = 3LL * min(band, img.rows - k) * img.cols;
+            fin.read((char*) storageb, sizeof(pixel) * size);
 
-        count = 0;
+            if (fin.gcount() < size)
+            {
+                delete[] storageb;
+                countFree(3LL * band * img.cols * (long long) sizeof(pixel));
+                freeImage(img);
+                return IMAGE_READ_FAILED;
+            }
 
-        for (i = 0; i < img.rows; i++)
-        {
-            for (j = 0; j < img.cols; j++)
+            count = 0;
+
+            for (i = k; i < min(k + band, img.rows); i++)
             {
-                img.redGray[i][j] = (storageb[count]);
-                count++;
-                img.green[i][j] = (storageb[count]);
-                count++;
-                img.blue[i][j] = (storageb[count]);
-                count++;
+                kernels().splitRgb(storageb + count, img.redGray[i], img.green[i],
+                    img.blue[i], img.cols);
+                count += 3 * img.cols;
             }
         }
         delete[] storageb;
+        countFree(3LL * band * img.cols * (long long) sizeof(pixel));
     }
 
-   return true;
+   return IMAGE_OK;
 }
 
 
@@ -268,67 +386,885 @@ bool readImage(ifstream& fin, image& img)
   * @author Aryan Raval
   *
   * @par Description
-  * writes output to a file using data from the structure image.
+  * reads only a rectangular region of a ppm file into the structure image.
+  * For binary files each row of the region is read directly from its
+  * position in the file so the rest of the image is never read.  For ascii
+  * files the numbers before the region have to be read but only the region
+  * is stored, and reading stops after the last row of the region.  QOI
+  * and PAM images are read in full and then cropped.
+  * Tiled images read only the tiles the region overlaps.
   *
-  * @param[in,out]     fout - ofstream file opened for output.
-  * @param[in,out]    img - structure conatining data about ppm image.
+  * @param[in,out]     fin - file opened for input conataining data for ppm file.
+  * @param[in,out]    img - a struture that contains data for ppm image.
+  * @param[in]        roi - region to read, it is cut down to fit the image.
   *
+  * @returns IMAGE_OK if the region was read, otherwise the reason it
+  *          wasn't.
   *
   * @par Example
   * @verbatim
-    ofstream foutl
-    Image img;
-    ofstream( fout , img); // outputs data in fout file using data from img
+    image img;
+    ifstream fin;
+    region roi = { 10, 20, 64, 48 };
+    readImageRegion(fin, img, roi); // img is the 64x48 block at (10, 20)
     @endverbatim
   *****************************************************************************/
 
 
-void writeImage(ofstream& fout, image& img)
+imageError readImageRegion(istream& fin, image& img, region roi)
 {
+    TRACE_SCOPE("readImageRegion");
+
     int i;
     int j;
-   
-    fout << img.magicNumber << "\n";
-    fout << img.comment;
+    int k;
+    int value[3];
+    int fileRows;
+    int fileCols;
+    imageError result;
 
-    fout << img.cols;
-    fout << " ";
-    fout << img.rows << "\n";
+    streamoff start;
+    pixel* row = nullptr;
+
+    if (fin.peek() == 'q' || isPam(fin))
+    {
+        result = fin.peek() == 'q' ? readQoi(fin, img) : readPam(fin, img);
+
+        if (result == IMAGE_OK)
+        {
+            result = cropImage(img, roi, OUTPUT_SAME);
+        }
+        return result;
+    }
+
+    if (fin.peek() == 't')
+    {
+        return readTiled(fin, img, roi, 0);
+    }
+
+    result = readHeader(fin, img);
+
+    if (result != IMAGE_OK)
+    {
+        return result;
+    }
+
+    fileRows = img.rows;
+    fileCols = img.cols;
+
+    if (roi.x < 0 || roi.y < 0 || roi.x >= fileCols || roi.y >= fileRows
+        || roi.w <= 0 || roi.h <= 0)
+    {
+        return IMAGE_BAD_REGION;
+    }
+
+    img.cols = min(roi.w, fileCols - roi.x);
+    img.rows = min(roi.h, fileRows - roi.y);
 
-    fout << maxpix << "\n";
+    if (!allocImage(img, img.rows, img.cols))
+    {
+        return IMAGE_NO_MEMORY;
+    }
 
     if (img.magicNumber == "P3")
     {
-        for (i = 0; i < img.rows; i++)
+        for (i = 0; i < roi.y + img.rows; i++)
         {
-            for (j = 0; j < img.cols; j++)
+            for (j = 0; j < fileCols; j++)
             {
-                fout << int(img.redGray[i][j]);
-                fout << " ";
-                fout << int(img.green[i][j]);
-                fout << " ";
-                fout << int(img.blue[i][j]);
-                fout << "\n";
+                for (k = 0; k < 3; k++)
+                {
+                    fin >> value[k];
+                }
+
+                if (i >= roi.y && j >= roi.x && j < roi.x + img.cols)
+                {
+                    img.redGray[i - roi.y][j - roi.x] = pixel(value[0]);
+                    img.green[i - roi.y][j - roi.x] = pixel(value[1]);
+                    img.blue[i - roi.y][j - roi.x] = pixel(value[2]);
+                }
             }
         }
     }
 
     else if (img.magicNumber == "P6")
     {
+        row = new(nothrow) pixel[img.cols * 3];
+
+        if (row == nullptr)
+        {
+            freeImage(img);
+            return IMAGE_NO_MEMORY;
+        }
+        countAlloc(img.cols * 3);
+
+        start = fin.tellg();
+
         for (i = 0; i < img.rows; i++)
         {
-            for (j = 0; j < img.cols; j++)
-            {
-                fout.write((char*) &img.redGray[i][j] , sizeof(pixel));
-               
-                fout.write((char*) &img.green[i][j], sizeof(pixel));
-                
-                fout.write((char*) &img.blue[i][j], sizeof(pixel));
-            }
+            fin.seekg(start + (streamoff(roi.y + i) * fileCols + roi.x) * 3);
+            fin.read((char*) row, sizeof(pixel) * img.cols * 3);
+            kernels().splitRgb(row, img.redGray[i], img.green[i], img.blue[i], img.cols);
+        }
+        delete[] row;
+        countFree(img.cols * 3);
+    }
+
+    if (!fin)
+    {
+        freeImage(img);
+        return IMAGE_READ_FAILED;
+    }
+
+    return IMAGE_OK;
+}
+
+
+/** ***************************************************************************
+  * @author Aryan Raval
+  *
+  * @par Description
+  * finds the magic number and size of the image in fin without reading the
+  * pixel data.  fin is moved back to the start of the file afterwards so
+  * the image can then be read normally.
+  *
+  * @param[in,out]     fin - file opened for input conataining data for ppm file.
+  * @param[in,out]    img - a struture that receives the header of the image.
+  *
+  * @returns IMAGE_OK or IMAGE_BAD_FORMAT if fin does not hold an image.
+  *
+  * @par Example
+  * @verbatim
+    image img;
+    peekHeader(fin, img); // img.rows and img.cols hold the size
+    readImage(fin, img);  // reads the image from the start
+    @endverbatim
+  *****************************************************************************/
+
+
+imageError peekHeader(istream& fin, image& img)
+{
+    unsigned char header[24];
+    int depth;
+    imageError result = IMAGE_OK;
+
+    if (fin.peek() == 'q')
+    {
+        fin.read((char*) header, 14);
+        img.magicNumber = "qoif";
+        img.cols = (header[4] << 24) | (header[5] << 16) | (header[6] << 8) | header[7];
+        img.rows = (header[8] << 24) | (header[9] << 16) | (header[10] << 8) | header[11];
+
+        if (!fin)
+        {
+            result = IMAGE_BAD_FORMAT;
+        }
+    }
+    else if (fin.peek() == 't')
+    {
+        fin.read((char*) header, 24);
+        img.magicNumber = "tpix";
+        img.cols = (header[12] << 24) | (header[13] << 16) | (header[14] << 8) | header[15];
+        img.rows = (header[16] << 24) | (header[17] << 16) | (header[18] << 8) | header[19];
+
+        if (!fin)
+        {
+            result = IMAGE_BAD_FORMAT;
+        }
+    }
+    else if (isPam(fin))
+    {
+        result = readPamHeader(fin, img, depth);
+        img.comment = "";
+    }
+    else
+    {
+        result = readHeader(fin, img);
+        img.comment = "";
+    }
+
+    fin.clear();
+    fin.seekg(0);
+
+    return result;
+}
+
+
+/** ***************************************************************************
+  * @author Aryan Raval
+  *
+  * @par Description
+  * reads the next row of pixels from fin into the first row of img.  The
+  * header must already have been read.
+  *
+  * @param[in,out]     fin - file opened for input conataining data for ppm file.
+  * @param[in,out]    img - structure with at least one row of img.cols pixels.
+  * @param[in]        magicNumber - format of the file, P3 or P6.
+  * @param[in,out]    buffer - img.cols * 3 bytes used to read a P6 row.
+  *
+  * @par Example
+  * @verbatim
+    image row;   // one row image
+    readRow(fin, row, "P6", buffer); // reads the next row of the file
+    @endverbatim
+  *****************************************************************************/
+
+
+void readRow(istream& fin, image& img, string magicNumber, pixel* buffer)
+{
+    int j;
+    int value[3];
+
+    if (magicNumber == "P3")
+    {
+        for (j = 0; j < img.cols; j++)
+        {
+            fin >> value[0] >> value[1] >> value[2];
+            img.redGray[0][j] = pixel(value[0]);
+            img.green[0][j] = pixel(value[1]);
+            img.blue[0][j] = pixel(value[2]);
+        }
+    }
+
+    else if (magicNumber == "P6")
+    {
+        fin.read((char*) buffer, sizeof(pixel) * img.cols * 3);
+        kernels().splitRgb(buffer, img.redGray[0], img.green[0], img.blue[0], img.cols);
+    }
+}
+
+
+/** ***************************************************************************
+  * @author Aryan Raval
+  *
+  * @par Description
+  * writes the magic number, comments, size and maximum pixel value.
+  *
+  * @param[in,out]     fout - ofstream file opened for output.
+  * @param[in]    img - structure conatining data about ppm image.
+  *
+  * @par Example
+  * @verbatim
+    writeHeader(fout, img); // writes the header of img to fout
+    @endverbatim
+  *****************************************************************************/
+
+
+void writeHeader(ostream& fout, image& img)
+{
+    fout << img.magicNumber << "\n";
+    fout << img.comment;
+
+    fout << img.cols;
+    fout << " ";
+    fout << img.rows << "\n";
+
+    fout << img.maxval << "\n";
+}
+
+
+/** ***************************************************************************
+  * @author Aryan Raval
+  *
+  * @par Description
+  * writes the pixels of img in the format given by its magic number
+  * without a header.  P6 pixels are joined a row at a time in a buffer
+  * of 3 * img.cols bytes.
+  *
+  * @param[in,out]     fout - ofstream file opened for output.
+  * @param[in]    img - structure conatining data about ppm image.
+  *
+  * @par Example
+  * @verbatim
+    writePixels(fout, row); // appends the pixels of row to fout
+    @endverbatim
+  *****************************************************************************/
+
+
+void writePixels(ostream& fout, image& img)
+{
+    int i;
+    int j;
+    long long size = 3LL * img.cols;
+
+    pixel* row;
+
+    if (img.magicNumber == "P3")
+    {
+        writeAscii(fout, img, 3);
+    }
+
+    else if (img.magicNumber == "P6")
+    {
+        row = new(nothrow) pixel[size_t(size)];
+
+        // without a buffer the pixels are written one value at a time
+        for (i = 0; i < img.rows && row == nullptr; i++)
+        {
+            for (j = 0; j < img.cols; j++)
+            {
+                fout.write((char*) &img.redGray[i][j] , sizeof(pixel));
+               
+                fout.write((char*) &img.green[i][j], sizeof(pixel));
+                
+                fout.write((char*) &img.blue[i][j], sizeof(pixel));
+            }
+        }
+
+        if (row == nullptr)
+        {
+            return;
+        }
+        countAlloc(size);
+
+        for (i = 0; i < img.rows; i++)
+        {
+            kernels().joinRgb(img.redGray[i], img.green[i], img.blue[i], row, img.cols);
+            fout.write((char*) row, size);
+        }
+
+        delete[] row;
+        countFree(size);
+    }
+}
+
+
+/** ***************************************************************************
+  * @author Aryan Raval
+  *
+  * @par Description
+  * writes the gray values in the red plane of img as a bitmap, P1 as
+  * text or P4 with eight pixels to a byte and each row starting on a new
+  * byte.  img must have a maxval of 1.  In a bitmap 1 is black, so a gray
+  * value of 0 is written as 1.  P1 lines are kept to 70 characters.
+  *
+  * @param[in,out]     fout - ofstream file opened for output.
+  * @param[in]    img - structure with a magic number of P1 or P4.
+  *
+  * @returns IMAGE_OK, IMAGE_NO_MEMORY or IMAGE_WRITE_FAILED if fout could
+  *          not be written.
+  *
+  * @par Example
+  * @verbatim
+    img.magicNumber = "P4";
+    writeBitmap(fout, img); // 640x480 takes 38400 bytes
+    @endverbatim
+  *****************************************************************************/
+
+imageError writeBitmap(ostream& fout, image& img)
+{
+    TRACE_SCOPE("writeBitmap");
+
+    int i;
+    int j;
+    int k;
+    long long size = bitmapBufferBytes(img.cols);
+    bool text = img.magicNumber == "P1";
+
+    char* row;
+
+    row = new(nothrow) char[size_t(size)];
+
+    if (row == nullptr)
+    {
+        return IMAGE_NO_MEMORY;
+    }
+    countAlloc(size);
+
+    fout << img.magicNumber << "\n";
+    fout << img.comment;
+    fout << img.cols << " " << img.rows << "\n";
+
+    for (i = 0; i < img.rows; i++)
+    {
+        k = 0;
+
+        if (text)
+        {
+            for (j = 0; j < img.cols; j++)
+            {
+                row[k++] = img.redGray[i][j] == 0 ? '1' : '0';
+
+                if ((j + 1) % 70 == 0 || j + 1 == img.cols)
+                {
+                    row[k++] = '\n';
+                }
+            }
+        }
+        else
+        {
+            memset(row, 0, size_t((img.cols + 7) / 8));
+
+            for (j = 0; j < img.cols; j++)
+            {
+                row[j / 8] |= char((img.redGray[i][j] == 0) << (7 - j % 8));
+            }
+            k = (img.cols + 7) / 8;
+        }
+
+        fout.write(row, k);
+    }
+
+    delete[] row;
+    countFree(size);
+
+    return fout ? IMAGE_OK : IMAGE_WRITE_FAILED;
+}
+
+
+/** ***************************************************************************
+  * @author Aryan Raval
+  *
+  * @par Description
+  * returns the size of the row buffer writeBitmap uses, which holds a row
+  * of P1 text.
+  *
+  * @param[in]    cols - columns of the image.
+  *
+  * @returns bytes in the buffer.
+  *
+  * @par Example
+  * @verbatim
+    bitmapBufferBytes(700); // 711, room for 700 digits and their line ends
+    @endverbatim
+  *****************************************************************************/
+
+long long bitmapBufferBytes(int cols)
+{
+    return (long long) cols + cols / 70 + 1;
+}
+
+
+/** ***************************************************************************
+  * @author Aryan Raval
+  *
+  * @par Description
+  * writes output to a file using data from the structure image.
+  *
+  * @param[in,out]     fout - ofstream file opened for output.
+  * @param[in,out]    img - structure conatining data about ppm image, it is
+  *                         freed after it is written.
+  *
+  * @returns IMAGE_OK or IMAGE_WRITE_FAILED if fout could not be written.
+  *
+  * @par Example
+  * @verbatim
+    ofstream foutl
+    Image img;
+    ofstream( fout , img); // outputs data in fout file using data from img
+    @endverbatim
+  *****************************************************************************/
+
+
+imageError writeImage(ostream& fout, image& img)
+{
+    TRACE_SCOPE("writeImage");
+
+    writeHeader(fout, img);
+    writePixels(fout, img);
+
+    freeImage(img);
+
+    return fout ? IMAGE_OK : IMAGE_WRITE_FAILED;
+}
+
+
+/** ***************************************************************************
+  * @author Aryan Raval
+  *
+  * @par Description
+  * writes rows as the next rows of one level of a pyramid, in the format
+  * of the output type.
+  *
+  * @param[in,out]     level - level the rows belong to.
+  * @param[in]         rows - the rows, as wide as the level.
+  * @param[in]         outputType - aschii, binary, qoi or pam format type.
+  *
+  * @returns IMAGE_OK or IMAGE_NO_MEMORY.
+  *
+  * @par Example
+  * @verbatim
+    writeLevelRows(levels[0], row, OUTPUT_BINARY); // next row of basename.ppm
+    @endverbatim
+  *****************************************************************************/
+
+imageError writeLevelRows(pyramidLevel& level, image& rows, outputFormat outputType)
+{
+    if (outputType == OUTPUT_QOI)
+    {
+        encodeQoiRows(*level.out, level.qoi, rows);
+        return IMAGE_OK;
+    }
+
+    if (outputType == OUTPUT_PAM)
+    {
+        return writePamPixels(*level.out, rows, false);
+    }
+
+    rows.magicNumber = level.header.magicNumber;
+    writePixels(*level.out, rows);
+
+    return IMAGE_OK;
+}
+
+
+/** ***************************************************************************
+  * @author Aryan Raval
+  *
+  * @par Description
+  * copies the first row of from into the first row of to, which is as
+  * wide.
+  *
+  * @param[in]     from - image holding the row.
+  * @param[out]    to - image receiving the row.
+  *
+  * @par Example
+  * @verbatim
+    copyRow(row, level.pending);
+    @endverbatim
+  *****************************************************************************/
+
+void copyRow(image& from, image& to)
+{
+    memcpy(to.redGray[0], from.redGray[0], from.cols);
+    memcpy(to.green[0], from.green[0], from.cols);
+    memcpy(to.blue[0], from.blue[0], from.cols);
+
+    if (from.alpha != nullptr)
+    {
+        memcpy(to.alpha[0], from.alpha[0], from.cols);
+    }
+}
+
+
+/** ***************************************************************************
+  * @author Aryan Raval
+  *
+  * @par Description
+  * halves the first rows of two images into the first row of half, which
+  * is half as wide.  top and bottom may be the same image.
+  *
+  * @param[in]     top - image holding the upper row.
+  * @param[in]     bottom - image holding the lower row.
+  * @param[out]    half - image receiving the row.
+  *
+  * @par Example
+  * @verbatim
+    halveRows(level.pending, row, level.made);
+    @endverbatim
+  *****************************************************************************/
+
+void halveRows(image& top, image& bottom, image& half)
+{
+    halveRow(top.redGray[0], bottom.redGray[0], half.redGray[0], top.cols);
+    halveRow(top.green[0], bottom.green[0], half.green[0], top.cols);
+    halveRow(top.blue[0], bottom.blue[0], half.blue[0], top.cols);
+
+    if (top.alpha != nullptr)
+    {
+        halveRow(top.alpha[0], bottom.alpha[0], half.alpha[0], top.cols);
+    }
+}
+
+
+/** ***************************************************************************
+  * @author Aryan Raval
+  *
+  * @par Description
+  * writes a row of level k of a pyramid and passes it down to the levels
+  * below.  Each level keeps the first row of every pair it is given, and
+  * when the second arrives the two are halved into a row of that level,
+  * which is written and passed down in turn.
+  *
+  * @param[in,out]     levels - every level of the pyramid.
+  * @param[in]         k - level the row belongs to.
+  * @param[in]         row - one row as wide as level k.
+  * @param[in]         outputType - aschii, binary, qoi or pam format type.
+  *
+  * @returns IMAGE_OK or IMAGE_NO_MEMORY.
+  *
+  * @par Example
+  * @verbatim
+    cascadeRow(levels, 0, row, OUTPUT_BINARY); // row i of the full size image
+    @endverbatim
+  *****************************************************************************/
+
+imageError cascadeRow(vector<pyramidLevel>& levels, int k, image& row, outputFormat outputType)
+{
+    image* next = &row;
+    imageError result;
+
+    while (true)
+    {
+        result = writeLevelRows(levels[k], *next, outputType);
+        k++;
+
+        if (result != IMAGE_OK || k == int(levels.size()))
+        {
+            return result;
+        }
+
+        pyramidLevel& below = levels[k];
+
+        if (!below.waiting)
+        {
+            copyRow(*next, below.pending);
+            below.waiting = true;
+            return IMAGE_OK;
+        }
+
+        halveRows(below.pending, *next, below.made);
+        below.waiting = false;
+        next = &below.made;
+    }
+}
+
+
+/** ***************************************************************************
+  * @author Aryan Raval
+  *
+  * @par Description
+  * writes img and then every smaller level of its pyramid down to a single
+  * pixel, all in one pass over the rows of img.  Every level is open at
+  * once.  As each row of img is written it is passed down the levels,
+  * and each level only keeps the row waiting for its pair and the row made
+  * from them, so the smaller levels take only a few rows of memory.
+  *
+  * @param[in,out]     img - structure conatining data about ppm image, it is
+  *                          freed when the function returns.
+  * @param[in]    name - basename, level n is written to name_n.ppm.  When
+  *                      name is - every level is written to standard output
+  *                      one after the other, so the smaller levels are
+  *                      kept in memory until the full size image is out.
+  * @param[in]    outputType - aschii, binary, qoi, pam or tiled format type.  A
+  *                            tiled image holds every level itself so it
+  *                            is written as one file.
+  *
+  * @returns IMAGE_OK once every level is written, otherwise the reason the
+  *          pyramid stopped.
+  *
+  * @par Example
+  * @verbatim
+    image img;  // 800x600 image
+    writePyramid(img, "photo", OUTPUT_BINARY); // photo.ppm, photo_1.ppm (400x300)
+                                            // ... photo_10.ppm (1x1)
+    @endverbatim
+  *****************************************************************************/
+
+imageError writePyramid(image& img, string name, outputFormat outputType)
+{
+    TRACE_SCOPE("writePyramid");
+
+    int i;
+    int k;
+    int begun = 0;
+    int count = 1;
+    int rows = img.rows;
+    int cols = img.cols;
+
+    ofstream fout;
+    ostream* out;
+    image row;
+    string levelName;
+    string extension = ".ppm";
+    imageError written;
+    imageError result = IMAGE_OK;
+
+    if (outputType == OUTPUT_TILED)
+    {
+        out = openOutput(name, ".tpx", fout);
+
+        if (out == nullptr)
+        {
+            freeImage(img);
+            return IMAGE_OPEN_FAILED;
+        }
+
+        result = writeTiled(*out, img);
+        out->flush();
+        filecloseoutput(fout);
+
+        return result;
+    }
+
+    if (outputType == OUTPUT_ASCII)
+    {
+        img.magicNumber = "P3";
+    }
+
+    else if (outputType == OUTPUT_BINARY)
+    {
+        img.magicNumber = "P6";
+    }
+
+    if (outputType == OUTPUT_QOI)
+    {
+        extension = ".qoi";
+    }
+    else if (outputType == OUTPUT_PAM)
+    {
+        extension = ".pam";
+    }
+
+    while (rows > 1 || cols > 1)
+    {
+        rows = (rows + 1) / 2;
+        cols = (cols + 1) / 2;
+        count++;
+    }
+
+    vector<pyramidLevel> levels(count);
+
+    for (k = 0; k < count && result == IMAGE_OK; k++)
+    {
+        pyramidLevel& level = levels[k];
+
+        level.header = img;
+        level.waiting = false;
+        level.out = nullptr;
+
+        if (k > 0)
+        {
+            level.header.rows = (levels[k - 1].header.rows + 1) / 2;
+            level.header.cols = (levels[k - 1].header.cols + 1) / 2;
+
+            if (!allocImage(level.pending, 1, levels[k - 1].header.cols)
+                || !allocImage(level.made, 1, level.header.cols)
+                || (img.alpha != nullptr
+                    && (!allocAlpha(level.pending) || !allocAlpha(level.made))))
+            {
+                result = IMAGE_NO_MEMORY;
+                break;
+            }
+        }
+
+        levelName = name;
+
+        if (k > 0 && name != "-" && name != ":null")
+        {
+            levelName = name + "_" + to_string(k);
+        }
+
+        level.out = (k > 0 && name == "-") ? &level.held
+            : openOutput(levelName, extension, level.file);
+
+        if (level.out == nullptr)
+        {
+            result = IMAGE_OPEN_FAILED;
+        }
+    }
+
+    for (k = 0; k < count && result == IMAGE_OK; k++)
+    {
+        if (outputType == OUTPUT_QOI)
+        {
+            startQoi(levels[k].qoi, levels[k].header);
+        }
+        else if (outputType == OUTPUT_PAM)
+        {
+            writePamHeader(*levels[k].out, levels[k].header, false);
+        }
+        else
+        {
+            writeHeader(*levels[k].out, levels[k].header);
+        }
+        begun++;
+    }
+
+    // row borrows one row of img at a time
+    row = img;
+    row.rows = 1;
+    row.borrowed = true;
+
+    for (i = 0; i < img.rows && result == IMAGE_OK; i++)
+    {
+        row.redGray = img.redGray + i;
+        row.green = img.green + i;
+        row.blue = img.blue + i;
+        row.alpha = img.alpha == nullptr ? nullptr : img.alpha + i;
+
+        result = cascadeRow(levels, 0, row, outputType);
+    }
+
+    // a level given an odd number of rows repeats the last one
+    for (k = 1; k < count && result == IMAGE_OK; k++)
+    {
+        if (levels[k].waiting)
+        {
+            halveRows(levels[k].pending, levels[k].pending, levels[k].made);
+            levels[k].waiting = false;
+            result = cascadeRow(levels, k, levels[k].made, outputType);
+        }
+    }
+
+    for (k = 0; k < count; k++)
+    {
+        if (k < begun && outputType == OUTPUT_QOI)
+        {
+            written = finishQoi(*levels[k].out, levels[k].qoi);
+            result = result == IMAGE_OK ? written : result;
+        }
+
+        if (result == IMAGE_OK && k > 0 && name == "-")
+        {
+            *levels[0].out << levels[k].held.str();
+        }
+
+        if (result == IMAGE_OK && !levels[k].out->flush())
+        {
+            result = IMAGE_WRITE_FAILED;
+        }
+        filecloseoutput(levels[k].file);
+        freeImage(levels[k].pending);
+        freeImage(levels[k].made);
+    }
+
+    freeImage(img);
+
+    return result;
+}
+
+/** ***************************************************************************
+  * @author Aryan Raval
+  *
+  * @par Description
+  * returns the most memory writePyramid uses beyond the image: the two
+  * rows each smaller level keeps, a QOI buffer for every level and the
+  * buffer used to write one row.
+  *
+  * @param[in]     rows - number of rows in the image.
+  * @param[in]     cols - number of columns in the image.
+  * @param[in]     planes - 3, or 4 when the image has alpha.
+  * @param[in]     outputType - OUTPUT_ASCII, OUTPUT_BINARY, OUTPUT_QOI or OUTPUT_PAM.
+  *
+  * @returns size of the buffers in bytes.
+  *
+  * @par Example
+  * @verbatim
+    pyramidBytes(600, 800, 3, OUTPUT_BINARY); // a few rows of each level
+    @endverbatim
+  *****************************************************************************/
+
+long long pyramidBytes(int rows, int cols, int planes, outputFormat outputType)
+{
+    long long bytes = 0;
+
+    if (outputType == OUTPUT_QOI)
+    {
+        bytes += qoiBufferBytes(cols);
+    }
+
+    while (rows > 1 || cols > 1)
+    {
+        bytes += planes * (planeBytes(1, cols) + planeBytes(1, (cols + 1) / 2));
+        rows = (rows + 1) / 2;
+        cols = (cols + 1) / 2;
+
+        if (outputType == OUTPUT_QOI)
+        {
+            bytes += qoiBufferBytes(cols);
         }
     }
 
-    free2d(img.redGray, img.rows);
-    free2d(img.green, img.rows);
-    free2d(img.blue, img.rows);
+    return bytes;
 }
\ No newline at end of file
@@ -0,0 +1,1462 @@
+/** ***************************************************************************
+ * @file
+ * @brief Contains the parts of the image library that tie the readers,
+ * operations and writers together
+ *
+ * Nothing in the library prints or exits.  Every function that can fail
+ * returns an imageError and leaves it to the caller to decide what to do,
+ * so the library can be used from other programs and from more than one
+ * thread at a time as long as each thread works on its own image.
+ *****************************************************************************/
+
+
+#include "netPBM.h"
+
+
+/**
+ * @brief the output types in the order of outputFormat
+ */
+
+static const char* outputNames[6] = { "--outputtype", "--ascii", "--binary", "--qoi",
+    "--tiled", "--pam" };
+
+/**
+ * @brief the options that must come last in the order of lastOption,
+ * from LAST_GRAYSCALE on
+ */
+
+static const char* lastNames[3] = { "--grayscale", "--pyramid", "--colorspace" };
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * Returns the message for an error code.
+ *
+ * @param[in]     error - error code returned by a library function.
+ *
+ * @returns a message that can be shown to the user.
+ *
+ * @par Example
+ * @verbatim
+   cout << errorMessage(IMAGE_NO_MEMORY) << endl;
+                                    // Unable to allocate memory for storage.
+   @endverbatim
+ *****************************************************************************/
+
+const char* errorMessage(imageError error)
+{
+    switch (error)
+    {
+    case IMAGE_OK:
+        return "No error.";
+    case IMAGE_OPEN_FAILED:
+        return "Unable to open file.";
+    case IMAGE_BAD_FORMAT:
+        return "Not a valid netpbm image.";
+    case IMAGE_READ_FAILED:
+        return "The image is missing pixels or has a pixel value that isn't a number.";
+    case IMAGE_WRITE_FAILED:
+        return "Unable to write the image.";
+    case IMAGE_NO_MEMORY:
+        return "Unable to allocate memory for storage.";
+    case IMAGE_BAD_REGION:
+        return "Region is outside of the image.";
+    case IMAGE_BAD_PARAMETER:
+        return "Invalid parameter given.";
+    case IMAGE_CACHE_FAILED:
+        return "Unable to use the cache.";
+    case IMAGE_INDEX_FAILED:
+        return "Unable to use the index.";
+    case IMAGE_NO_PLAN:
+        return "No way of running fits in the memory allowed.";
+    }
+
+    return "Unknown error.";
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * Reads a region written as x,y,w,h from a command line parameter.
+ *
+ * @param[in]     param - parameter given after --roi.
+ * @param[out]    roi - region that was read.
+ *
+ * @returns true if param holds four numbers with a positive size and false
+ *          otherwise.
+ *
+ * @par Example
+ * @verbatim
+   region roi;
+   parseRegion("10,20,64,48", roi); // returns true
+   parseRegion("10,20", roi);       // returns false
+   @endverbatim
+ *****************************************************************************/
+
+bool parseRegion(string param, region& roi)
+{
+    char extra;
+
+    if (sscanf(param.c_str(), "%d,%d,%d,%d%c", &roi.x, &roi.y, &roi.w,
+        &roi.h, &extra) != 4)
+    {
+        return false;
+    }
+
+    return roi.x >= 0 && roi.y >= 0 && roi.w > 0 && roi.h > 0;
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * Reads a whole number from a command line parameter.  Anything after the
+ * number, or a number too big for an int, makes it invalid.
+ *
+ * @param[in]     text - parameter to read.
+ * @param[out]    value - number that was read.
+ *
+ * @returns true if text holds only a whole number and false otherwise.
+ *
+ * @par Example
+ * @verbatim
+   int value;
+   parseInteger("-40", value);  // returns true, value is -40
+   parseInteger("12.5", value); // returns false
+   parseInteger("", value);     // returns false
+   @endverbatim
+ *****************************************************************************/
+
+bool parseInteger(string text, int& value)
+{
+    char* end;
+    long number;
+
+    number = strtol(text.c_str(), &end, 10);
+
+    if (end == text.c_str() || *end != '\0' || number < INT_MIN
+        || number > INT_MAX)
+    {
+        return false;
+    }
+
+    value = int(number);
+
+    return true;
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * Checks that the parameter given to an option is a number in the range
+ * the option accepts.  Only options that take no parameter may have an
+ * empty one.
+ *
+ * @param[in]     op - operation with its parameter.
+ *
+ * @returns true if the parameter is valid and false otherwise.
+ *
+ * @par Example
+ * @verbatim
+   operation op = { "--gamma", "0" };
+   validParam(op); // returns false, gamma must be greater than 0
+   @endverbatim
+ *****************************************************************************/
+
+bool validParam(operation op)
+{
+    char* end;
+    double value;
+    region roi;
+    rotation rot;
+    colorSpace space;
+    overlay ov;
+    quantizer q;
+    isaLevel isa;
+    previewMode view;
+    bilateral filter;
+    string file;
+    int distance;
+    int number;
+    long long bytes;
+
+    if (op.param.empty())
+    {
+        return op.name == "--flipX" || op.name == "--flipY"
+            || op.name == "--rotateCW" || op.name == "--rotateCCW"
+            || op.name == "--grayscale" || op.name == "--sepia"
+            || op.name == "--invert" || op.name == "--pyramid"
+            || op.name == "--in-place";
+    }
+
+    if (op.name == "--roi")
+    {
+        return parseRegion(op.param, roi);
+    }
+
+    if (op.name == "--rotate")
+    {
+        return parseRotation(op.param, rot);
+    }
+
+    if (op.name == "--colorspace")
+    {
+        return parseColorSpace(op.param, space);
+    }
+
+    if (op.name == "--overlay")
+    {
+        return parseOverlay(op.param, ov);
+    }
+
+    if (op.name == "--bits")
+    {
+        return parseQuantizer(op.param, q);
+    }
+
+    if (op.name == "--isa")
+    {
+        return parseIsa(op.param, isa);
+    }
+
+    if (op.name == "--preview")
+    {
+        return parsePreview(op.param, view);
+    }
+
+    if (op.name == "--bilateral")
+    {
+        return parseBilateral(op.param, filter);
+    }
+
+    if (op.name == "--skip-near")
+    {
+        return parseNearIndex(op.param, file, distance);
+    }
+
+    if (op.name == "--max-memory" || op.name == "--cache-size")
+    {
+        return parseSize(op.param, bytes);
+    }
+
+    if (op.name == "--cache" || op.name == "--trace")
+    {
+        return true;
+    }
+
+    if (op.name == "--gamma")
+    {
+        value = strtod(op.param.c_str(), &end);
+
+        return *end == '\0' && value > 0;
+    }
+
+    if (!parseInteger(op.param, number))
+    {
+        return false;
+    }
+
+    if (op.name == "--posterize")
+    {
+        return number >= 2 && number <= 256;
+    }
+
+    if (op.name == "--level")
+    {
+        return number >= 0 && number < 64;
+    }
+
+    if (op.name == "--median")
+    {
+        return number >= 1 && number <= MEDIAN_MAX;
+    }
+
+    return number >= -255 && number <= 255;
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * reads an output type given on the command line: --outputtype, --ascii,
+ * --binary, --qoi, --tiled or --pam.
+ *
+ * @param[in]     name - the output type.
+ * @param[out]    outputType - how the result is written.
+ *
+ * @returns true if name is an output type and false otherwise.
+ *
+ * @par Example
+ * @verbatim
+   outputFormat outputType;
+   parseOutputType("--qoi", outputType);   // returns true, OUTPUT_QOI
+   parseOutputType("--flipX", outputType); // returns false
+   @endverbatim
+ *****************************************************************************/
+
+bool parseOutputType(string name, outputFormat& outputType)
+{
+    int i;
+
+    for (i = 0; i < 6; i++)
+    {
+        if (name == outputNames[i])
+        {
+            outputType = outputFormat(i);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * reads an option that must come last: --grayscale, --pyramid or
+ * --colorspace.
+ *
+ * @param[in]     name - the option.
+ * @param[out]    last - the option that must come last.
+ *
+ * @returns true if name is one of them and false otherwise.
+ *
+ * @par Example
+ * @verbatim
+   lastOption last;
+   parseLastOption("--pyramid", last); // returns true, LAST_PYRAMID
+   parseLastOption("--sepia", last);   // returns false
+   @endverbatim
+ *****************************************************************************/
+
+bool parseLastOption(string name, lastOption& last)
+{
+    int i;
+
+    for (i = 0; i < 3; i++)
+    {
+        if (name == lastNames[i])
+        {
+            last = lastOption(i + 1);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * checks if an output type can write what the last option and --bits
+ * leave.  QOI and tiled images are always color and PAM can't hold the
+ * planes of another color space.
+ *
+ * @param[in]     last - option that must come last, LAST_NONE if none.
+ * @param[in]     bits - levels given to --bits, 0 bits for none.
+ * @param[in]     outputType - how the result is written.
+ *
+ * @returns true if the output type can be used and false otherwise.
+ *
+ * @par Example
+ * @verbatim
+   quantizer bits = { 0, DITHER_NONE };
+   fitsOutput(LAST_GRAYSCALE, bits, OUTPUT_QOI);    // returns false
+   fitsOutput(LAST_GRAYSCALE, bits, OUTPUT_BINARY); // returns true
+   @endverbatim
+ *****************************************************************************/
+
+bool fitsOutput(lastOption last, quantizer bits, outputFormat outputType)
+{
+    return !(((last == LAST_GRAYSCALE || last == LAST_COLORSPACE || bits.bits > 0)
+        && (outputType == OUTPUT_QOI || outputType == OUTPUT_TILED))
+        || (last == LAST_COLORSPACE && outputType == OUTPUT_PAM));
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * Applies the list of operations to the image from left to right.  Point
+ * operations next to each other are combined into one lookup table so
+ * the image is only visited once for all of them.  Grayscale is not
+ * applied here since it writes its own output.  --rotateCW and
+ * --rotateCCW with the parameter "in-place" use rotateInPlace.
+ *
+ * @param[in,out]     img - structure containing data of a ppm image.
+ * @param[in]         ops - operations given on the command line.
+ * @param[in]         outputType - aschii or binary format type.
+ *
+ * @returns IMAGE_OK if every operation succeeded, otherwise the error of
+ *          the operation that failed.
+ *
+ * @par Example
+ * @verbatim
+   image img;
+   vector<operation> ops = { { "--invert", "" }, { "--flipX", "" } };
+   runOperations(img, ops, OUTPUT_BINARY); // inverts and then flips img
+   @endverbatim
+ *****************************************************************************/
+
+imageError runOperations(image& img, vector<operation>& ops, outputFormat outputType)
+{
+    size_t i;
+    bool pending = false;
+    region roi;
+    rotation rot;
+    overlay ov;
+    bilateral filter;
+    int radius;
+    imageError result = IMAGE_OK;
+
+    lookupTable table = identityLut;
+    lookupTable next;
+
+    for (i = 0; i < ops.size(); i++)
+    {
+        if (buildTable(next, ops[i].name, ops[i].param))
+        {
+            composeTable(table, next);
+            pending = true;
+            continue;
+        }
+
+        if (pending)
+        {
+            applyTable(img, table, outputType);
+            table = identityLut;
+            pending = false;
+        }
+
+        if (ops[i].name == "--flipX")
+        {
+            flipX(img, outputType);
+        }
+
+        if (ops[i].name == "--flipY")
+        {
+            flipY(img, outputType);
+        }
+
+        if (ops[i].name == "--rotateCW")
+        {
+            result = ops[i].param == "in-place" ? rotateInPlace(img, true, outputType)
+                : rotateCW(img, outputType);
+        }
+
+        if (ops[i].name == "--rotateCCW")
+        {
+            result = ops[i].param == "in-place" ? rotateInPlace(img, false, outputType)
+                : rotateCCW(img, outputType);
+        }
+
+        if (ops[i].name == "--rotate")
+        {
+            if (!parseRotation(ops[i].param, rot))
+            {
+                return IMAGE_BAD_PARAMETER;
+            }
+            result = rotateImage(img, rot, outputType);
+        }
+
+        if (ops[i].name == "--sepia")
+        {
+            sepia(img, outputType);
+        }
+
+        if (ops[i].name == "--roi")
+        {
+            if (!parseRegion(ops[i].param, roi))
+            {
+                return IMAGE_BAD_PARAMETER;
+            }
+            result = cropImage(img, roi, outputType);
+        }
+
+        if (ops[i].name == "--overlay")
+        {
+            if (!parseOverlay(ops[i].param, ov))
+            {
+                return IMAGE_BAD_PARAMETER;
+            }
+            result = overlayImage(img, ov, outputType);
+        }
+
+        if (ops[i].name == "--median")
+        {
+            radius = atoi(ops[i].param.c_str());
+
+            if (radius < 1 || radius > MEDIAN_MAX)
+            {
+                return IMAGE_BAD_PARAMETER;
+            }
+            result = medianImage(img, radius);
+        }
+
+        if (ops[i].name == "--bilateral")
+        {
+            if (!parseBilateral(ops[i].param, filter))
+            {
+                return IMAGE_BAD_PARAMETER;
+            }
+            result = bilateralImage(img, filter);
+        }
+
+        if (result != IMAGE_OK)
+        {
+            return result;
+        }
+    }
+
+    if (pending)
+    {
+        applyTable(img, table, outputType);
+    }
+
+    return IMAGE_OK;
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * Reads, changes and writes the image one row at a time so only a single
+ * row is ever held in memory.  Only operations that change each row on
+ * its own may be used, see canStream.
+ *
+ * @param[in,out]     fin - stream opened for input conataining data for ppm file.
+ * @param[in,out]     fout - stream opened for output.
+ * @param[in]         ops - operations given on the command line.
+ * @param[in]         outputType - aschii or binary format type.
+ *
+ * @returns IMAGE_OK if the image was copied, otherwise the reason it
+ *          stopped.
+ *
+ * @par Example
+ * @verbatim
+   vector<operation> ops = { { "--sepia", "" } };
+   streamImage(fin, fout, ops, OUTPUT_BINARY); // sepia image, one row at a time
+   @endverbatim
+ *****************************************************************************/
+
+imageError streamImage(istream& fin, ostream& fout, vector<operation>& ops,
+    outputFormat outputType)
+{
+    TRACE_SCOPE("streamImage");
+
+    int i;
+
+    image header;
+    image row;
+    pixel* buffer;
+    string format;
+    imageError result;
+
+    result = readHeader(fin, header);
+
+    if (result != IMAGE_OK)
+    {
+        return result;
+    }
+
+    row = header;
+    row.rows = 1;
+    format = header.magicNumber;
+
+    if (outputType == OUTPUT_ASCII)
+    {
+        header.magicNumber = "P3";
+    }
+
+    else if (outputType == OUTPUT_BINARY)
+    {
+        header.magicNumber = "P6";
+    }
+
+    writeHeader(fout, header);
+
+    if (!allocImage(row, 1, row.cols))
+    {
+        return IMAGE_NO_MEMORY;
+    }
+
+    buffer = new(nothrow) pixel[row.cols * 3];
+
+    if (buffer == nullptr)
+    {
+        freeImage(row);
+        return IMAGE_NO_MEMORY;
+    }
+    countAlloc(row.cols * 3);
+
+    for (i = 0; i < header.rows && result == IMAGE_OK; i++)
+    {
+        readRow(fin, row, format, buffer);
+
+        if (!fin)
+        {
+            result = IMAGE_READ_FAILED;
+            break;
+        }
+        result = runOperations(row, ops, outputType);
+
+        row.magicNumber = header.magicNumber;
+        writePixels(fout, row);
+    }
+
+    if (result == IMAGE_OK && !fout)
+    {
+        result = IMAGE_WRITE_FAILED;
+    }
+
+    delete[] buffer;
+    countFree(row.cols * 3);
+
+    freeImage(row);
+
+    return result;
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * Finds the region of the image as it was read that becomes a region of
+ * the image after the flips and quarter turns in ops.  Every other
+ * operation of the tiled plan changes each pixel on its own, so it has no
+ * effect on where a pixel comes from.
+ *
+ * @param[in]     ops - operations given on the command line.
+ * @param[in]     rows - rows of the image as it was read.
+ * @param[in]     cols - columns of the image as it was read.
+ * @param[in]     roi - region of the finished image.
+ *
+ * @returns the region of the image as it was read.
+ *
+ * @par Example
+ * @verbatim
+   vector<operation> ops = { { "--rotateCW", "" } };
+   region roi = { 0, 0, 480, 10 };
+   sourceRegion(ops, 480, 640, roi); // { 0, 0, 10, 480 }, the first 10
+                                     // columns become the top 10 rows
+   @endverbatim
+ *****************************************************************************/
+
+region sourceRegion(vector<operation>& ops, int rows, int cols, region roi)
+{
+    int i;
+    region next;
+
+    // the size of the image before the last operation
+    for (i = 0; i < int(ops.size()); i++)
+    {
+        if (ops[i].name == "--rotateCW" || ops[i].name == "--rotateCCW")
+        {
+            swap(rows, cols);
+        }
+    }
+
+    for (i = int(ops.size()) - 1; i >= 0; i--)
+    {
+        next = roi;
+
+        if (ops[i].name == "--rotateCW" || ops[i].name == "--rotateCCW")
+        {
+            swap(rows, cols);
+        }
+
+        if (ops[i].name == "--flipX")
+        {
+            next.y = rows - roi.y - roi.h;
+        }
+        else if (ops[i].name == "--flipY")
+        {
+            next.x = cols - roi.x - roi.w;
+        }
+        else if (ops[i].name == "--rotateCW")
+        {
+            next = { roi.y, rows - roi.x - roi.w, roi.h, roi.w };
+        }
+        else if (ops[i].name == "--rotateCCW")
+        {
+            next = { cols - roi.y - roi.h, roi.x, roi.h, roi.w };
+        }
+        roi = next;
+    }
+
+    return roi;
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * Runs the image through a tiled copy of itself when it is too big to be
+ * held and an operation such as a quarter turn needs pixels from all over
+ * it.  The image is first copied into the tiled file spool a row of tiles
+ * at a time.  The output is then made TILE_SIZE rows at a time: the
+ * region of the image those rows come from is read from spool, the
+ * operations are run on it and the rows are written.  spool is removed
+ * at the end.  Only the operations canTile accepts may be used.
+ *
+ * @param[in,out]     fin - stream opened for input conataining data for ppm file.
+ * @param[in,out]     fout - stream opened for output.
+ * @param[in]         ops - operations given on the command line.
+ * @param[in]         outputType - aschii or binary format type.
+ * @param[in]         spool - name of the tiled file to use.
+ *
+ * @returns IMAGE_OK if the image was copied, otherwise the reason it
+ *          stopped.
+ *
+ * @par Example
+ * @verbatim
+   vector<operation> ops = { { "--rotateCW", "" } };
+   tileImage(fin, fout, ops, OUTPUT_BINARY, spoolName("big"));
+   @endverbatim
+ *****************************************************************************/
+
+imageError tileImage(istream& fin, ostream& fout, vector<operation>& ops,
+    outputFormat outputType, string spool)
+{
+    TRACE_SCOPE("tileImage");
+
+    int top;
+    size_t i;
+
+    image header;
+    image done;
+    image band;
+    region roi;
+    fstream file;
+    imageError result;
+
+    result = readHeader(fin, header);
+
+    if (result != IMAGE_OK)
+    {
+        return result;
+    }
+
+    file.open(spool, ios::in | ios::out | ios::binary | ios::trunc);
+
+    if (!file)
+    {
+        return IMAGE_OPEN_FAILED;
+    }
+
+    result = spoolTiled(fin, file, header);
+    file.flush();
+
+    done = header;
+
+    for (i = 0; i < ops.size(); i++)
+    {
+        if (ops[i].name == "--rotateCW" || ops[i].name == "--rotateCCW")
+        {
+            swap(done.rows, done.cols);
+        }
+    }
+
+    if (outputType == OUTPUT_ASCII)
+    {
+        done.magicNumber = "P3";
+    }
+
+    else if (outputType == OUTPUT_BINARY)
+    {
+        done.magicNumber = "P6";
+    }
+
+    if (result == IMAGE_OK)
+    {
+        writeHeader(fout, done);
+    }
+
+    for (top = 0; top < done.rows && result == IMAGE_OK; top += TILE_SIZE)
+    {
+        roi = sourceRegion(ops, header.rows, header.cols,
+            { 0, top, done.cols, min(TILE_SIZE, done.rows - top) });
+        result = readTiled(file, band, roi, 0);
+
+        if (result != IMAGE_OK)
+        {
+            break;
+        }
+        result = runOperations(band, ops, outputType);
+
+        if (result == IMAGE_OK)
+        {
+            band.magicNumber = done.magicNumber;
+            writePixels(fout, band);
+        }
+        freeImage(band);
+    }
+
+    file.close();
+    remove(spool.c_str());
+
+    if (result == IMAGE_OK && !fout)
+    {
+        result = IMAGE_WRITE_FAILED;
+    }
+
+    return result;
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * Finishes an image whose operations have been applied and writes it.
+ * --grayscale and --bits are applied here, and --colorspace and
+ * --pyramid write their own files.  Otherwise the output type, or the
+ * format of the input for --outputtype, picks the writer and binary ppm
+ * and pgm files are written by every thread at once.  img is freed.
+ *
+ * @param[in,out]     img - structure containing data of a ppm image.
+ * @param[in]         last - option that must come last, LAST_NONE if none.
+ * @param[in]         space - color space given to --colorspace.
+ * @param[in]         bits - levels given to --bits, 0 bits for none.
+ * @param[in]         outputType - how the result is written.
+ * @param[in]         name - basename of the output.
+ * @param[out]        extension - extension added to name, empty for
+ *                                --colorspace and --pyramid.
+ *
+ * @returns IMAGE_OK if the image was written, IMAGE_OPEN_FAILED if the
+ *          output couldn't be opened, otherwise the reason it wasn't.
+ *
+ * @par Example
+ * @verbatim
+   quantizer bits = { 0, DITHER_NONE };
+   writeResult(img, LAST_GRAYSCALE, space, bits, OUTPUT_BINARY, "balloon", extension);
+                                    // writes balloon.pgm as a P5 image
+   @endverbatim
+ *****************************************************************************/
+
+imageError writeResult(image& img, lastOption last, colorSpace space, quantizer bits,
+    outputFormat outputType, string name, string& extension)
+{
+    ofstream fout;
+    ostream* out;
+    bool direct;
+    imageError result = IMAGE_OK;
+
+    extension.clear();
+
+    if (outputType == OUTPUT_SAME && img.magicNumber == "qoif")
+    {
+        outputType = last == LAST_GRAYSCALE ? OUTPUT_BINARY : OUTPUT_QOI;
+    }
+
+    if (outputType == OUTPUT_SAME && img.magicNumber == "tpix")
+    {
+        outputType = last == LAST_GRAYSCALE ? OUTPUT_BINARY : OUTPUT_TILED;
+    }
+
+    if (outputType == OUTPUT_SAME && img.magicNumber == "P7" && last != LAST_COLORSPACE)
+    {
+        outputType = OUTPUT_PAM;
+    }
+
+    if (last == LAST_GRAYSCALE)
+    {
+        grayPlane(img);
+    }
+
+    if (bits.bits > 0)
+    {
+        result = quantizeImage(img, last == LAST_GRAYSCALE ? 1 : 3, bits);
+
+        if (result != IMAGE_OK)
+        {
+            freeImage(img);
+            return result;
+        }
+    }
+
+    if (last == LAST_COLORSPACE)
+    {
+        if (outputType == OUTPUT_SAME && img.magicNumber == "P3")
+        {
+            outputType = OUTPUT_ASCII;
+        }
+        convertColor(img, space);
+        result = writeColorPlanes(img, space, name, outputType);
+        freeImage(img);
+        return result;
+    }
+
+    if (last == LAST_PYRAMID)
+    {
+        return writePyramid(img, name, outputType);
+    }
+
+    if (outputType == OUTPUT_PAM)
+    {
+        extension = ".pam";
+    }
+    else if (last == LAST_GRAYSCALE && img.maxval == 1
+        && (outputType == OUTPUT_ASCII || outputType == OUTPUT_BINARY))
+    {
+        extension = ".pbm";
+    }
+    else if (last == LAST_GRAYSCALE)
+    {
+        extension = ".pgm";
+    }
+    else if (outputType == OUTPUT_QOI)
+    {
+        extension = ".qoi";
+    }
+    else if (outputType == OUTPUT_TILED)
+    {
+        extension = ".tpx";
+    }
+    else
+    {
+        extension = ".ppm";
+    }
+
+    // binary images written to a file are written by every thread at once
+    direct = canWriteDirect(name) && (extension == ".ppm" || extension == ".pgm")
+        && (outputType == OUTPUT_BINARY || (outputType == OUTPUT_SAME
+        && img.magicNumber == "P6" && last == LAST_NONE));
+
+    if (direct)
+    {
+        result = writeDirect(name + extension, img, last == LAST_GRAYSCALE ? 1 : 3);
+        freeImage(img);
+        return result;
+    }
+
+    out = openOutput(name, extension, fout);
+
+    if (out == nullptr)
+    {
+        freeImage(img);
+        return IMAGE_OPEN_FAILED;
+    }
+
+    if (last == LAST_GRAYSCALE)
+    {
+        result = writeGray(*out, img, outputType);
+        freeImage(img);
+    }
+    else if (outputType == OUTPUT_QOI)
+    {
+        result = writeQoi(*out, img);
+    }
+    else if (outputType == OUTPUT_TILED)
+    {
+        result = writeTiled(*out, img);
+    }
+    else if (outputType == OUTPUT_PAM)
+    {
+        result = writePam(*out, img, img.gray);
+    }
+    else
+    {
+        if (outputType == OUTPUT_ASCII)
+        {
+            img.magicNumber = "P3";
+        }
+
+        if (outputType == OUTPUT_BINARY)
+        {
+            img.magicNumber = "P6";
+        }
+
+        result = writeImage(*out, img);
+    }
+
+    out->flush();
+    filecloseoutput(fout);
+
+    return result;
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * Makes one output of --fanout from an image that has already been read.
+ * The image is shared by every rendition and is never changed.  A
+ * rendition that only writes the image borrows its planes, and one that
+ * changes the pixels first copies them on its own thread, so each copy is
+ * only made where it is needed and the copies are made at the same time.
+ *
+ * @param[in]         source - the image that was read, shared and unchanged.
+ * @param[in,out]     target - operations, output type and name of the output.
+ *
+ * @returns IMAGE_OK if the output was written, otherwise the reason it
+ *          wasn't.
+ *
+ * @par Example
+ * @verbatim
+   rendition gray;
+   gray.last = LAST_GRAYSCALE;
+   gray.bits = { 0, DITHER_NONE };
+   gray.outputType = OUTPUT_BINARY;
+   gray.name = "balloon_gray";
+   runRendition(img, gray); // writes balloon_gray.pgm, img is unchanged
+   @endverbatim
+ *****************************************************************************/
+
+imageError runRendition(image& source, rendition& target)
+{
+    TRACE_SCOPE("runRendition");
+
+    image img;
+    string extension;
+    imageError result = IMAGE_OK;
+
+    if (target.ops.empty() && target.last == LAST_NONE && target.bits.bits == 0)
+    {
+        img = source;
+        img.borrowed = true;
+    }
+    else if (!copyImage(source, img))
+    {
+        return IMAGE_NO_MEMORY;
+    }
+
+    result = runOperations(img, target.ops, target.outputType);
+
+    if (result == IMAGE_OK)
+    {
+        return writeResult(img, target.last, target.space, target.bits, target.outputType,
+            target.name, extension);
+    }
+
+    freeImage(img);
+
+    return result;
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * Checks whether two outputs of --fanout could write the same file.  They
+ * do if they have the same basename and the same output type, and
+ * OUTPUT_ASCII, OUTPUT_BINARY and OUTPUT_SAME all count as one type since
+ * each of them may write basename.ppm.  :null writes no file, so it never
+ * clashes.
+ *
+ * @param[in]     first - an output.
+ * @param[in]     second - another output.
+ *
+ * @returns true if the outputs could write the same file and false
+ *          otherwise.
+ *
+ * @par Example
+ * @verbatim
+   first.name = "out";  first.outputType = OUTPUT_BINARY;
+   second.name = "out"; second.outputType = OUTPUT_ASCII;
+   sameOutput(first, second); // returns true, both write out.ppm
+   @endverbatim
+ *****************************************************************************/
+
+bool sameOutput(rendition& first, rendition& second)
+{
+    bool firstNetpbm = first.outputType == OUTPUT_ASCII || first.outputType == OUTPUT_BINARY
+        || first.outputType == OUTPUT_SAME;
+    bool secondNetpbm = second.outputType == OUTPUT_ASCII
+        || second.outputType == OUTPUT_BINARY || second.outputType == OUTPUT_SAME;
+
+    if (first.name != second.name || first.name == ":null")
+    {
+        return false;
+    }
+
+    return first.outputType == second.outputType || (firstNetpbm && secondNetpbm);
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * Reads an image once and makes every rendition of it at the same time.
+ * The result of each rendition is kept in results, so one that fails
+ * doesn't stop the others.
+ *
+ * @param[in]         inName - image name, - for standard input.
+ * @param[in,out]     targets - the outputs to make.
+ * @param[out]        results - IMAGE_OK or the reason each output wasn't
+ *                              written, in the order of targets.
+ *
+ * @returns IMAGE_OK if the image was read, otherwise the reason it
+ *          wasn't and no output is made.
+ *
+ * @par Example
+ * @verbatim
+   vector<imageError> results;
+   runFanout("balloon.ppm", targets, results); // one result per target
+   @endverbatim
+ *****************************************************************************/
+
+imageError runFanout(string inName, vector<rendition>& targets, vector<imageError>& results)
+{
+    ifstream fin;
+    istream* in;
+    image source;
+    imageError result;
+
+    in = openInput(inName, fin);
+    result = (in == nullptr) ? IMAGE_OPEN_FAILED : readImage(*in, source);
+
+    if (result != IMAGE_OK)
+    {
+        return result;
+    }
+
+    results.assign(targets.size(), IMAGE_OK);
+
+    runParallel(int(targets.size()), [&](int t)
+    {
+        results[t] = runRendition(source, targets[t]);
+    });
+
+    freeImage(source);
+    filecloseinput(fin);
+
+    return IMAGE_OK;
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * Reads the image of a job the way its options ask.  --preview reads
+ * only every few rows and columns, --level reads a smaller level of a
+ * tiled image and a first --roi reads only the region.  The options used
+ * here are taken out of ops, along with --bits, which is done by
+ * writeResult.
+ *
+ * @param[in]         work - the job.
+ * @param[in,out]     fin - the opened image.
+ * @param[in,out]     ops - operations of the job, left with the ones
+ *                          still to be run.
+ * @param[out]        img - the image that was read.
+ *
+ * @returns IMAGE_OK if the image was read, otherwise the reason it
+ *          wasn't.
+ *
+ * @par Example
+ * @verbatim
+   vector<operation> ops = { { "--roi", "0,0,64,64" }, { "--sepia", "" } };
+   readJobImage(work, fin, ops, img); // the top left 64x64, ops is --sepia
+   @endverbatim
+ *****************************************************************************/
+
+static imageError readJobImage(job& work, istream& fin, vector<operation>& ops, image& img)
+{
+    region roi = { 0, 0, 0, 0 };
+    int level = 0;
+    size_t i;
+    imageError result;
+
+    for (i = 0; i < ops.size(); i++)
+    {
+        if (ops[i].name == "--level")
+        {
+            parseInteger(ops[i].param, level);
+            ops.erase(ops.begin() + i);
+            i--;
+        }
+        else if (ops[i].name == "--bits" || ops[i].name == "--preview")
+        {
+            ops.erase(ops.begin() + i);
+            i--;
+        }
+    }
+
+    if (level > 0 && fin.peek() != 't')
+    {
+        return IMAGE_BAD_FORMAT;
+    }
+
+    if (work.view.step > 0 && level > 0)
+    {
+        result = readTiled(fin, img, roi, level);
+
+        if (result == IMAGE_OK)
+        {
+            result = shrinkImage(img, work.view);
+        }
+
+        return result;
+    }
+
+    if (work.view.step > 0)
+    {
+        return readPreview(fin, img, work.view);
+    }
+
+    if (!ops.empty() && ops[0].name == "--roi")
+    {
+        parseRegion(ops[0].param, roi);
+        ops.erase(ops.begin());
+
+        return level > 0 ? readTiled(fin, img, roi, level) : readImageRegion(fin, img, roi);
+    }
+
+    if (level > 0)
+    {
+        return readTiled(fin, img, roi, level);
+    }
+
+    return readImage(fin, img);
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * Reads an image, runs the operations of a job on it and writes the
+ * result.  With a cache the result is copied from the cache when the
+ * same image and options were made before, and is stored there when they
+ * weren't.  With a memory budget the fastest way of running that fits is
+ * used, which may stream or tile the image instead of reading it whole.
+ * With an index the image is written only if no image in the index is
+ * near it, and is then added to the index.  What happened is left in
+ * report for the caller to show.
+ *
+ * @param[in]         work - what to read, what to do and how to write it.
+ * @param[in,out]     fin - the opened image.
+ * @param[out]        report - the plans weighed, the cache counts and the
+ *                             name of what failed.
+ *
+ * @returns IMAGE_OK if the result was written or the image was skipped,
+ *          otherwise the reason it wasn't.
+ *
+ * @par Example
+ * @verbatim
+   job work;
+   jobReport report;
+   work.inName = "balloon.ppm";
+   work.outName = "balloonx";
+   work.ops = { { "--sepia", "" } };
+   work.outputType = OUTPUT_BINARY;
+   runJob(work, fin, report); // writes balloonx.ppm
+   @endverbatim
+ *****************************************************************************/
+
+imageError runJob(job& work, istream& fin, jobReport& report)
+{
+    ofstream fout;
+    ostream* out;
+    image img;
+    image header;
+    imageHash fingerprint;
+    vector<hashMatch> matches;
+    vector<operation> ops = work.ops;
+    resultCache cache;
+    cacheEntry* entry;
+    unsigned long long hash;
+    long long fileSize;
+    string target = work.outName;
+    string extension;
+    string key;
+    size_t i;
+    imageError result;
+
+    report = jobReport();
+
+    if (!work.cacheDir.empty() && work.inName != "-" && work.outName != ":null"
+        && work.last != LAST_PYRAMID && work.last != LAST_COLORSPACE)
+    {
+        report.cached = true;
+        report.failed = work.cacheDir;
+
+        if (!hashInputs(work.inName, ops, hash)
+            || !openCache(cache, work.cacheDir, work.cacheLimit))
+        {
+            return IMAGE_CACHE_FAILED;
+        }
+
+        key = cacheKey(hash, ops, work.last, work.outputType);
+        entry = findEntry(cache, key);
+
+        if (entry != nullptr)
+        {
+            cache.hits++;
+            report.hit = true;
+            report.hits = cache.hits;
+            report.misses = cache.misses;
+            result = copyFromCache(cache, *entry, work.outName);
+
+            if (result != IMAGE_OK)
+            {
+                report.failed = work.outName;
+                return result;
+            }
+
+            return saveCache(cache) ? IMAGE_OK : IMAGE_CACHE_FAILED;
+        }
+
+        // the lock isn't held while the image is made
+        cache.misses++;
+
+        if (!saveCache(cache))
+        {
+            return IMAGE_CACHE_FAILED;
+        }
+        report.failed.clear();
+        target = work.cacheDir + "/" + key + "." + to_string(processId()) + ".part";
+    }
+
+    if (work.budget > 0)
+    {
+        result = peekHeader(fin, header);
+
+        if (result != IMAGE_OK)
+        {
+            return result;
+        }
+
+        fin.seekg(0, ios::end);
+        fileSize = fin.tellg();
+        fin.clear();
+        fin.seekg(0);
+
+        if (fileSize < 0)
+        {
+            fileSize = 4LL * header.rows * header.cols + 22;
+        }
+        report.plans = makePlans(header, ops, work.last, work.outputType, fileSize);
+
+        // the image has to be whole to be hashed
+        for (i = 0; i < report.plans.size(); i++)
+        {
+            if ((report.plans[i].name == "streaming" || report.plans[i].name == "tiled")
+                && !work.nearIndex.empty())
+            {
+                report.plans[i].possible = false;
+            }
+        }
+
+        if (!choosePlan(report.plans, work.budget, report.choice))
+        {
+            return IMAGE_NO_PLAN;
+        }
+
+        if (report.choice.name == "in-place")
+        {
+            markInPlace(ops);
+        }
+    }
+
+    if (report.choice.name == "streaming" || report.choice.name == "tiled")
+    {
+        extension = ".ppm";
+        out = openOutput(target, extension, fout);
+
+        if (out == nullptr)
+        {
+            report.failed = target;
+            return IMAGE_OPEN_FAILED;
+        }
+
+        if (report.choice.name == "streaming")
+        {
+            result = streamImage(fin, *out, ops, work.outputType);
+        }
+        else
+        {
+            result = tileImage(fin, *out, ops, work.outputType, spoolName(target));
+        }
+        out->flush();
+        filecloseoutput(fout);
+    }
+    else
+    {
+        result = readJobImage(work, fin, ops, img);
+
+        if (result != IMAGE_OK)
+        {
+            return result;
+        }
+
+        if (!work.nearIndex.empty())
+        {
+            hashImage(img, fingerprint);
+
+            if (!findNear(work.nearIndex, fingerprint.dct, work.nearDistance, matches))
+            {
+                freeImage(img);
+                report.failed = work.nearIndex;
+                return IMAGE_INDEX_FAILED;
+            }
+
+            if (!matches.empty())
+            {
+                report.nearest = matches[0];
+                freeImage(img);
+                return IMAGE_OK;
+            }
+        }
+
+        result = runOperations(img, ops, work.outputType);
+
+        if (result != IMAGE_OK)
+        {
+            freeImage(img);
+            return result;
+        }
+
+        result = writeResult(img, work.last, work.space, work.bits, work.outputType, target,
+            extension);
+
+        if (result == IMAGE_OPEN_FAILED
+            && (work.last == LAST_NONE || work.last == LAST_GRAYSCALE))
+        {
+            report.failed = target;
+        }
+    }
+
+    if (result != IMAGE_OK)
+    {
+        return result;
+    }
+
+    if (target != work.outName)
+    {
+        result = storeInCache(cache, key, target, extension, work.outName);
+        report.hits = cache.hits;
+        report.misses = cache.misses;
+
+        if (result != IMAGE_OK)
+        {
+            report.failed = result == IMAGE_OPEN_FAILED ? work.outName : work.cacheDir;
+            return result;
+        }
+    }
+
+    report.indexed = !work.nearIndex.empty()
+        && addToIndex(work.nearIndex, fingerprint.dct, work.inName);
+
+    return IMAGE_OK;
+}
@@ -11,12 +11,14 @@
   * @author Aryan Raval
   *
   * @par Description
-  * applies grayscale filter to a ppm image and outputs the data
+  * applies grayscale filter to a ppm image and outputs the data.  A pam
+  * output type writes a GRAYSCALE or GRAYSCALE_ALPHA PAM image.
   *
   * @param[in,out]     fout - ofstream file opened for output
   * @param[in,out]    img - structure containing data of a ppm image
   * @param[in]  outputType - aschii or binary format type
   *
+  * @returns IMAGE_OK or IMAGE_WRITE_FAILED if fout could not be written.
   *
   * @par Example
   * @verbatim
@@ -27,25 +29,95 @@
     @endverbatim
   *****************************************************************************/
 
-void grayScale(ofstream &fout, image& img, string outputType)
+imageError grayScale(ostream& fout, image& img, outputFormat outputType)
 {
+    TRACE_SCOPE("grayScale");
+
+    grayPlane(img);
+
+    return writeGray(fout, img, outputType);
+}
+
+
+ /** ***************************************************************************
+  * @author Aryan Raval
+  *
+  * @par Description
+  * stores the gray value of every pixel in the red plane of img, the
+  * green and blue planes are left as they are.
+  *
+  * @param[in,out]    img - structure containing data of a ppm image
+  *
+  * @par Example
+  * @verbatim
+    grayPlane(img);
+    quantizeImage(img, 1, q); // quantizes the gray values
+    @endverbatim
+  *****************************************************************************/
+
+void grayPlane(image& img)
+{
+    TRACE_SCOPE("grayPlane");
+
     int i;
-    int j;
 
-    int count = 0;
+    for (i = 0; i < img.rows; i++)
+    {
+        kernels().grayRow(img.redGray[i], img.green[i], img.blue[i], img.redGray[i], img.cols);
+    }
+}
+
+
+ /** ***************************************************************************
+  * @author Aryan Raval
+  *
+  * @par Description
+  * writes the gray values in the red plane of img as a pgm image.  An
+  * image with a maxval of 1 is written as a bitmap instead, P1 for ascii
+  * and P4 for binary.  A pam output type writes a GRAYSCALE or
+  * GRAYSCALE_ALPHA PAM image.
+  *
+  * @param[in,out]     fout - ofstream file opened for output
+  * @param[in,out]    img - structure containing the gray values in redGray
+  * @param[in]  outputType - aschii or binary format type
+  *
+  * @returns IMAGE_OK or IMAGE_WRITE_FAILED if fout could not be written.
+  *
+  * @par Example
+  * @verbatim
+    grayPlane(img);
+    writeGray(fout, img, OUTPUT_BINARY); // a P5 image
+    @endverbatim
+  *****************************************************************************/
+
+imageError writeGray(ostream& fout, image& img, outputFormat outputType)
+{
+    TRACE_SCOPE("writeGray");
 
-    int r, g, b;
+    int i;
+    int j;
 
-    if (outputType == "--ascii")
+    if (outputType == OUTPUT_PAM)
+    {
+        return writePam(fout, img, true);
+    }
+
+    if (outputType == OUTPUT_ASCII)
     {
         img.magicNumber = "P2";
     }
 
-    if (outputType == "--binary")
+    if (outputType == OUTPUT_BINARY)
     {
         img.magicNumber = "P5";
     }
 
+    if (img.maxval == 1 && (img.magicNumber == "P2" || img.magicNumber == "P5"))
+    {
+        img.magicNumber = img.magicNumber == "P2" ? "P1" : "P4";
+        return writeBitmap(fout, img);
+    }
+
     fout << img.magicNumber << "\n";
     fout << img.comment;
 
@@ -53,45 +125,11 @@ void grayScale(ofstream &fout, image& img, string outputType)
     fout << " ";
     fout << img.rows << "\n";
 
-    fout << maxpix << "\n";
-
-    for (i = 0; i < img.rows; i++)
-    {
-        for (j = 0; j < img.cols; j++)
-        {
-            r = (img.redGray[i][j]);
-            g = (img.green[i][j]);
-            b = (img.blue[i][j]);
-
-            img.redGray[i][j] = pixel(round(0.3 * r + 0.6 * g + 0.1 * b));
-        }
-    }
+    fout << img.maxval << "\n";
 
     if (img.magicNumber == "P2" )
     {
-        for (i = 0; i < img.rows; i++)
-        {
-            for (i = 0; i < img.rows; i++)
-            {
-                for (i = 0; i < img.rows; i++)
-                {
-                    for (j = 0; j < img.cols; j++)
-                    {
-                        fout << int(img.redGray[i][j]);
-                        fout << " ";
-                        count++;
-
-                        if (count == 3)
-                        {
-                            count = 0;
-                            fout << "\n";
-                        }
-                    }
-                }
-
-            }
-
-        }
+        writeAscii(fout, img, 1);
     }
     
     else if (img.magicNumber == "P5")
@@ -104,7 +142,8 @@ void grayScale(ofstream &fout, image& img, string outputType)
             }
         }
     }
-   
+
+    return fout ? IMAGE_OK : IMAGE_WRITE_FAILED;
 }
 
 /** ***************************************************************************
@@ -127,8 +166,10 @@ void grayScale(ofstream &fout, image& img, string outputType)
  *****************************************************************************/
 
 
-void flipX(image& img,string outputType)
+void flipX(image& img,outputFormat outputType)
 {
+    TRACE_SCOPE("flipX");
+
     int i;
     int j;
 
@@ -142,12 +183,20 @@ void flipX(image& img,string outputType)
         }
     }
 
-    if (outputType == "--ascii")
+    if (img.alpha != nullptr)
+    {
+        for (i = 0; i < img.rows / 2; i++)
+        {
+            swap_ranges(img.alpha[i], img.alpha[i] + img.cols, img.alpha[img.rows - i - 1]);
+        }
+    }
+
+    if (outputType == OUTPUT_ASCII)
     {
         img.magicNumber = "P3";
     }
 
-    else if (outputType == "--binary")
+    else if (outputType == OUTPUT_BINARY)
     {
         img.magicNumber = "P6";
     }
@@ -171,8 +220,10 @@ void flipX(image& img,string outputType)
  *****************************************************************************/
 
 
-void flipY(image& img, string outputType)
+void flipY(image& img, outputFormat outputType)
 {
+    TRACE_SCOPE("flipY");
+
     int i;
     int j;
 
@@ -186,12 +237,20 @@ void flipY(image& img, string outputType)
         }
     }
 
-    if (outputType == "--ascii")
+    if (img.alpha != nullptr)
+    {
+        for (i = 0; i < img.rows; i++)
+        {
+            reverse(img.alpha[i], img.alpha[i] + img.cols);
+        }
+    }
+
+    if (outputType == OUTPUT_ASCII)
     {
         img.magicNumber = "P3";
     }
 
-    else if (outputType == "--binary")
+    else if (outputType == OUTPUT_BINARY)
     {
         img.magicNumber = "P6";
     }
@@ -206,6 +265,8 @@ void flipY(image& img, string outputType)
  * @param[in,out]     img - structure containing data of a ppm image.
  * @param[in]     outputType - aschii or binary format type.
  * 
+ * @returns IMAGE_OK or IMAGE_NO_MEMORY if the rotated image doesn't fit.
+ *
  * @par Example
  * @verbatim
    image img;
@@ -214,69 +275,66 @@ void flipY(image& img, string outputType)
    @endverbatim
  *****************************************************************************/
 
-void rotateCW(image& img, string outputType)
+imageError rotateCW(image& img, outputFormat outputType)
 {
-    int i;
-    int j;
+    TRACE_SCOPE("rotateCW");
+
+    image temp;
 
     pixel** tempRed;
     pixel** tempBlue;
     pixel** tempGreen;
 
 
-    alloc(tempRed, img.cols, img.rows); 
-    alloc(tempBlue, img.cols, img.rows);
-    alloc(tempGreen, img.cols, img.rows);
-
-    if (tempRed == nullptr || tempBlue == nullptr || tempGreen == nullptr)
+    if (!allocImage(temp, img.cols, img.rows))
     {
-        cout << "Unable to allocate memory for storage." << endl;
-        exit(1);
+        return IMAGE_NO_MEMORY;
     }
 
-    for (j = 0; j < img.cols; j++)   //   700 
+    if (img.alpha != nullptr && !allocAlpha(temp))
     {
-        for (i = 0; i < img.rows; i++)   //  400
-        {
-            (tempRed[j][i] = img.redGray[img.rows - i - 1][j]);
-            (tempBlue[j][i] =  img.blue[img.rows - i - 1][j]);
-            (tempGreen[j][i] = img.green[img.rows - i -1][j]);
-        }
+        freeImage(temp);
+        return IMAGE_NO_MEMORY;
     }
 
-    free2d(img.redGray, img.rows);
-    free2d(img.green, img.rows);
-    free2d(img.blue, img.rows);
-
-    alloc(img.redGray, img.cols, img.rows);
-    alloc(img.blue, img.cols, img.rows);
-    alloc(img.green, img.cols, img.rows);
+    tempRed = temp.redGray;
+    tempBlue = temp.blue;
+    tempGreen = temp.green;
 
-    swap(img.cols, img.rows);
+    // the last row becomes the first column
+    kernels().transpose(img.redGray[img.rows - 1], -img.cols, tempRed[0], img.rows,
+        img.rows, img.cols);
+    kernels().transpose(img.blue[img.rows - 1], -img.cols, tempBlue[0], img.rows,
+        img.rows, img.cols);
+    kernels().transpose(img.green[img.rows - 1], -img.cols, tempGreen[0], img.rows,
+        img.rows, img.cols);
 
-    for (i = 0; i < img.rows; i++)
+    if (img.alpha != nullptr)
     {
-        for (j = 0; j < img.cols; j++)
-        {
-            img.redGray[i][j] = tempRed[i][j];
-            img.blue[i][j] = tempBlue[i][j];
-            img.green[i][j] = tempGreen[i][j];
-        }
+        kernels().transpose(img.alpha[img.rows - 1], -img.cols, temp.alpha[0], img.rows,
+            img.rows, img.cols);
     }
 
-    free2d(tempRed, img.rows);
-    free2d(tempBlue, img.rows);
-    free2d(tempGreen, img.rows);
+    freeImage(img);
 
-    if (outputType == "--ascii")
+    img.redGray = tempRed;
+    img.blue = tempBlue;
+    img.green = tempGreen;
+    img.alpha = temp.alpha;
+
+    swap(img.cols, img.rows);
+
+    if (outputType == OUTPUT_ASCII)
     {
         img.magicNumber = "P3";
     }
 
-    else if (outputType == "--binary")
+    else if (outputType == OUTPUT_BINARY)
     {
         img.magicNumber = "P6";
     }
+
+    return IMAGE_OK;
 }
 
 
@@ -289,6 +347,7 @@ void rotateCW(image& img, string outputType)
  * @param[in,out]     img - structure containing data of a ppm image.
  * @param[in]     outputType - aschii or binary format type.
  * 
+ * @returns IMAGE_OK or IMAGE_NO_MEMORY if the rotated image doesn't fit.
  *
  * @par Example
  * @verbatim
@@ -299,70 +358,327 @@ void rotateCW(image& img, string outputType)
  *****************************************************************************/
 
 
-void rotateCCW(image& img, string outputType)
+imageError rotateCCW(image& img, outputFormat outputType)
 {
-    int i;
-    int j;
+    TRACE_SCOPE("rotateCCW");
+
+    image temp;
 
     pixel** tempRed;
     pixel** tempBlue;
     pixel** tempGreen;
 
 
-    alloc(tempRed, img.cols, img.rows);
-    alloc(tempBlue, img.cols, img.rows);
-    alloc(tempGreen, img.cols, img.rows);
+    if (!allocImage(temp, img.cols, img.rows))
+    {
+        return IMAGE_NO_MEMORY;
+    }
+
+    if (img.alpha != nullptr && !allocAlpha(temp))
+    {
+        freeImage(temp);
+        return IMAGE_NO_MEMORY;
+    }
+
+    tempRed = temp.redGray;
+    tempBlue = temp.blue;
+    tempGreen = temp.green;
+
+    // the last column becomes the first row
+    kernels().transpose(img.redGray[0], img.cols, tempRed[img.cols - 1], -img.rows,
+        img.rows, img.cols);
+    kernels().transpose(img.blue[0], img.cols, tempBlue[img.cols - 1], -img.rows,
+        img.rows, img.cols);
+    kernels().transpose(img.green[0], img.cols, tempGreen[img.cols - 1], -img.rows,
+        img.rows, img.cols);
+
+    if (img.alpha != nullptr)
+    {
+        kernels().transpose(img.alpha[0], img.cols, temp.alpha[img.cols - 1], -img.rows,
+            img.rows, img.cols);
+    }
+
+
+    freeImage(img);
+
+    img.redGray = tempRed;
+    img.blue = tempBlue;
+    img.green = tempGreen;
+    img.alpha = temp.alpha;
+
+    swap(img.cols, img.rows);
 
-    if (tempRed == nullptr || tempBlue == nullptr || tempGreen == nullptr)
+    if (outputType == OUTPUT_ASCII)
     {
-        cout << "Unable to allocate memory for storage." << endl;
-        exit(1);
+        img.magicNumber = "P3";
     }
 
-    for (j = 0; j < img.cols; j++)   //   700 
+    else if (outputType == OUTPUT_BINARY)
     {
-        for (i = 0; i < img.rows; i++)   //  400
+        img.magicNumber = "P6";
+    }
+
+    return IMAGE_OK;
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * rotates a square plane a quarter turn in place.  Each pixel in the top
+ * left quarter is swapped around with the three pixels it trades places
+ * with, and the quarter is visited in 64x64 tiles so the four rows being
+ * read stay in the cache.
+ *
+ * @param[in,out]     plane - n by n plane.
+ * @param[in]         n - number of rows and columns.
+ * @param[in]         clockwise - true for clockwise, false for counter
+ *                                clockwise.
+ *
+ * @par Example
+ * @verbatim
+   rotateSquare(img.redGray, img.rows, true);
+   @endverbatim
+ *****************************************************************************/
+
+void rotateSquare(pixel** plane, int n, bool clockwise)
+{
+    int i;
+    int j;
+    int top;
+    int left;
+    int tile = 64;
+
+    pixel temp;
+
+    for (top = 0; top < n / 2; top += tile)
+    {
+        for (left = 0; left < (n + 1) / 2; left += tile)
         {
-            (tempRed[img.cols - j - 1][img.rows - i -1] = img.redGray[img.rows - i - 1][j]);
-            (tempBlue[img.cols - j - 1][img.rows - i -1] = img.blue[img.rows - i - 1][j]);
-            (tempGreen[img.cols - j - 1][img.rows - i -1] = img.green[img.rows - i - 1][j]);
+            for (i = top; i < min(top + tile, n / 2); i++)
+            {
+                for (j = left; j < min(left + tile, (n + 1) / 2); j++)
+                {
+                    temp = plane[i][j];
+
+                    if (clockwise)
+                    {
+                        plane[i][j] = plane[n - 1 - j][i];
+                        plane[n - 1 - j][i] = plane[n - 1 - i][n - 1 - j];
+                        plane[n - 1 - i][n - 1 - j] = plane[j][n - 1 - i];
+                        plane[j][n - 1 - i] = temp;
+                    }
+                    else
+                    {
+                        plane[i][j] = plane[j][n - 1 - i];
+                        plane[j][n - 1 - i] = plane[n - 1 - i][n - 1 - j];
+                        plane[n - 1 - i][n - 1 - j] = plane[n - 1 - j][i];
+                        plane[n - 1 - j][i] = temp;
+                    }
+                }
+            }
         }
     }
+}
 
 
-    free2d(img.redGray, img.rows);
-    free2d(img.green, img.rows);
-    free2d(img.blue, img.rows);
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * transposes a rows by cols block of pixels in place, so it becomes cols
+ * by rows.  The pixel at position k moves to k * rows modulo
+ * rows * cols - 1, and the moves form cycles.  Each cycle is followed
+ * from its first pixel, and moved marks the pixels already placed so
+ * every cycle is followed only once.
+ *
+ * @param[in,out]     data - the pixels, one row after another.
+ * @param[in]         rows - number of rows.
+ * @param[in]         cols - number of columns.
+ * @param[in,out]     moved - rows * cols flags, all false.  They are left
+ *                            set.
+ *
+ * @par Example
+ * @verbatim
+   vector<bool> moved(size_t(img.rows) * img.cols);
+   transposePlane(img.redGray[0], img.rows, img.cols, moved);
+   @endverbatim
+ *****************************************************************************/
 
-    alloc(img.redGray, img.cols, img.rows);
-    alloc(img.blue, img.cols, img.rows);
-    alloc(img.green, img.cols, img.rows);
+void transposePlane(pixel* data, int rows, int cols, vector<bool>& moved)
+{
+    unsigned long long size = (unsigned long long) rows * cols;
+    unsigned long long start;
+    unsigned long long next;
 
-    swap(img.cols, img.rows);
+    pixel carried;
 
-    for (i = 0; i < img.rows; i++)
+    if (size < 3)
+    {
+        return;
+    }
+
+    for (start = 1; start < size - 1; start++)
+    {
+        if (moved[size_t(start)])
+        {
+            continue;
+        }
+
+        carried = data[start];
+        next = start;
+
+        do
+        {
+            next = next * rows % (size - 1);
+            swap(carried, data[next]);
+            moved[size_t(next)] = true;
+        } while (next != start);
+    }
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * rotates img a quarter turn without a second copy of the image.  Square
+ * images are rotated with rotateSquare.  Other images are flipped and
+ * then transposed with transposePlane, which needs one flag per pixel,
+ * an eighth of a plane.  The peak memory is a little over one image
+ * instead of two, but the pixels are visited in a slower order than
+ * rotateCW and rotateCCW use.
+ *
+ * @param[in,out]     img - structure containing data of a ppm image.
+ * @param[in]         clockwise - true for clockwise, false for counter
+ *                                clockwise.
+ * @param[in]         outputType - aschii or binary format type.
+ *
+ * @returns IMAGE_OK or IMAGE_NO_MEMORY if the flags or the new row
+ *          pointers don't fit.
+ *
+ * @par Example
+ * @verbatim
+   image img;
+   rotateInPlace(img, true, OUTPUT_BINARY); // same image as rotateCW
+   @endverbatim
+ *****************************************************************************/
+
+imageError rotateInPlace(image& img, bool clockwise, outputFormat outputType)
+{
+    TRACE_SCOPE("rotateInPlace");
+
+    int i;
+    int k;
+    int rows = img.rows;
+    int cols = img.cols;
+    int count = img.alpha != nullptr ? 4 : 3;
+    int threads = min(count, threadCount(count * planeBytes(rows, cols)));
+
+    pixel** planes[4] = { img.redGray, img.green, img.blue, img.alpha };
+    pixel** turned[4] = { nullptr, nullptr, nullptr, nullptr };
+    vector<bool> moved;
+
+    for (k = 0; k < count; k++)
     {
-        for (j = 0; j < img.cols; j++)
+        turned[k] = new(nothrow) pixel*[cols + 1];
+
+        if (turned[k] == nullptr)
         {
-            img.redGray[i][j] = tempRed[i][j];
-            img.blue[i][j] = tempBlue[i][j];
-            img.green[i][j] = tempGreen[i][j];
+            for (k = 0; k < count; k++)
+            {
+                delete[] turned[k];
+            }
+            return IMAGE_NO_MEMORY;
         }
     }
+    countAlloc((long long) count * (cols + 1) * sizeof(pixel*));
 
-    free2d(tempRed, img.rows);
-    free2d(tempBlue, img.rows);
-    free2d(tempGreen, img.rows);
+    if (rows == cols)
+    {
+        runParallel(threads, [&](int t)
+        {
+            int p;
 
-    if (outputType == "--ascii")
+            for (p = t; p < count; p += threads)
+            {
+                rotateSquare(planes[p], rows, clockwise);
+            }
+        });
+    }
+    else
+    {
+        try
+        {
+            moved.resize(size_t(rows) * cols);
+        }
+        catch (const bad_alloc&)
+        {
+            for (k = 0; k < count; k++)
+            {
+                delete[] turned[k];
+            }
+            countFree((long long) count * (cols + 1) * sizeof(pixel*));
+            return IMAGE_NO_MEMORY;
+        }
+        countAlloc((long long) rows * cols / 8);
+
+        for (k = 0; k < count; k++)
+        {
+            // clockwise is the rows in reverse order transposed, counter
+            // clockwise is each row reversed transposed
+            for (i = 0; i < rows; i++)
+            {
+                if (clockwise && i < rows / 2)
+                {
+                    swap_ranges(planes[k][i], planes[k][i] + cols, planes[k][rows - 1 - i]);
+                }
+                else if (!clockwise)
+                {
+                    reverse(planes[k][i], planes[k][i] + cols);
+                }
+            }
+
+            transposePlane(planes[k][0], rows, cols, moved);
+
+            if (k < count - 1)
+            {
+                fill(moved.begin(), moved.end(), false);
+            }
+        }
+
+        countFree((long long) rows * cols / 8);
+    }
+
+    for (k = 0; k < count; k++)
+    {
+        for (i = 0; i <= cols; i++)
+        {
+            turned[k][i] = planes[k][0] + size_t(i) * rows;
+        }
+        delete[] planes[k];
+    }
+    countFree((long long) count * (rows + 1) * sizeof(pixel*));
+
+    img.redGray = turned[0];
+    img.green = turned[1];
+    img.blue = turned[2];
+    img.alpha = turned[3];
+
+    swap(img.cols, img.rows);
+
+    if (outputType == OUTPUT_ASCII)
     {
         img.magicNumber = "P3";
     }
 
-    else if (outputType == "--binary")
+    else if (outputType == OUTPUT_BINARY)
     {
         img.magicNumber = "P6";
     }
+
+    return IMAGE_OK;
 }
 
 
@@ -385,42 +701,24 @@ void rotateCCW(image& img, string outputType)
  *****************************************************************************/
 
 
-void sepia(image& img, string outputType)
+void sepia(image& img, outputFormat outputType)
 {
+    TRACE_SCOPE("sepia");
 
     int i;
-    int j;
-    
-    pixel red;
-    pixel green;
-    pixel blue;
 
     for (i = 0; i < img.rows; i++)
     {
-        for (j = 0; j < img.cols; j++)
-        {
-            red = pixel(crop(round(0.393 * (img.redGray[i][j])
-                + 0.769 * (img.green[i][j]) + 0.189 * (img.blue[i][j]))));
-
-            green = pixel(crop(round(0.349 * (img.redGray[i][j])
-                + 0.686 * (img.green[i][j]) + 0.168 * (img.blue[i][j]))));
-
-            blue = pixel(crop(round(0.272 * (img.redGray[i][j])
-                + 0.534 * (img.green[i][j]) + 0.131 * (img.blue[i][j]))));
-
-            img.redGray[i][j] = red;
-            img.blue[i][j] = blue;
-            img.green[i][j] = green;
-
-        }
+        kernels().sepiaRow(img.redGray[i], img.green[i], img.blue[i], img.cols);
     }
+    img.gray = false;
 
-    if (outputType == "--ascii")
+    if (outputType == OUTPUT_ASCII)
     {
         img.magicNumber = "P3";
     }
 
-    else if (outputType == "--binary")
+    else if (outputType == OUTPUT_BINARY)
     {
         img.magicNumber = "P6";
     }
@@ -455,4 +753,197 @@ double crop(double value)
         return 255;
     }
     else return value;
+}
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * keeps only a rectangular region of the image and frees the rest.  The
+ * region is cut down to fit inside the image.
+ *
+ * @param[in,out]     img - structure containing data of a ppm image.
+ * @param[in]     roi - region of the image that is kept.
+ * @param[in]     outputType - aschii or binary format type.
+ *
+ * @returns IMAGE_OK, IMAGE_BAD_REGION if the region is outside of the
+ *          image or IMAGE_NO_MEMORY.
+ *
+ * @par Example
+ * @verbatim
+   image img;
+   region roi = { 0, 0, 100, 50 };
+   cropImage(img, roi, OUTPUT_BINARY); // keeps the top left 100x50 pixels
+   @endverbatim
+ *****************************************************************************/
+
+
+imageError cropImage(image& img, region roi, outputFormat outputType)
+{
+    TRACE_SCOPE("cropImage");
+
+    int i;
+    int j;
+    int rows;
+    int cols;
+
+    image temp;
+
+    if (roi.x < 0 || roi.y < 0 || roi.x >= img.cols || roi.y >= img.rows
+        || roi.w <= 0 || roi.h <= 0)
+    {
+        return IMAGE_BAD_REGION;
+    }
+
+    cols = min(roi.w, img.cols - roi.x);
+    rows = min(roi.h, img.rows - roi.y);
+
+    if (!allocImage(temp, rows, cols))
+    {
+        return IMAGE_NO_MEMORY;
+    }
+
+    if (img.alpha != nullptr && !allocAlpha(temp))
+    {
+        freeImage(temp);
+        return IMAGE_NO_MEMORY;
+    }
+
+    for (i = 0; i < rows; i++)
+    {
+        for (j = 0; j < cols; j++)
+        {
+            temp.redGray[i][j] = img.redGray[roi.y + i][roi.x + j];
+            temp.green[i][j] = img.green[roi.y + i][roi.x + j];
+            temp.blue[i][j] = img.blue[roi.y + i][roi.x + j];
+        }
+
+        if (img.alpha != nullptr)
+        {
+            memcpy(temp.alpha[i], img.alpha[roi.y + i] + roi.x, cols);
+        }
+    }
+
+    freeImage(img);
+
+    img.redGray = temp.redGray;
+    img.green = temp.green;
+    img.blue = temp.blue;
+    img.alpha = temp.alpha;
+    img.rows = rows;
+    img.cols = cols;
+
+    if (outputType == OUTPUT_ASCII)
+    {
+        img.magicNumber = "P3";
+    }
+
+    else if (outputType == OUTPUT_BINARY)
+    {
+        img.magicNumber = "P6";
+    }
+
+    return IMAGE_OK;
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * makes one row of a plane half the width of two rows, where every value
+ * is the rounded average of a 2x2 block.  When cols is odd the last
+ * column is repeated to fill the block.
+ *
+ * @param[in]     top - upper row of cols values.
+ * @param[in]     bottom - lower row of cols values, may be the same as top.
+ * @param[out]    half - (cols + 1) / 2 values.
+ * @param[in]     cols - number of values in top and bottom.
+ *
+ * @par Example
+ * @verbatim
+   halveRow(img.redGray[0], img.redGray[1], half.redGray[0], img.cols);
+   @endverbatim
+ *****************************************************************************/
+
+void halveRow(const pixel* top, const pixel* bottom, pixel* half, int cols)
+{
+    int j;
+    int left;
+    int right;
+
+    for (j = 0; j < (cols + 1) / 2; j++)
+    {
+        left = 2 * j;
+        right = min(2 * j + 1, cols - 1);
+
+        half[j] = pixel((top[left] + top[right] + bottom[left] + bottom[right] + 2) / 4);
+    }
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * produces an image half the width and height of img where every pixel is
+ * the rounded average of a 2x2 block.  When img has an odd number of rows
+ * or columns the last row or column is repeated to fill the block.
+ *
+ * @param[in]     img - structure containing data of a ppm image.
+ * @param[out]    half - structure that receives the smaller image.
+ *
+ * @returns IMAGE_OK or IMAGE_NO_MEMORY.
+ *
+ * @par Example
+ * @verbatim
+   image img;   // 640x480 image
+   image half;
+   halveImage(img, half); // half is 320x240
+   @endverbatim
+ *****************************************************************************/
+
+
+imageError halveImage(image& img, image& half)
+{
+    TRACE_SCOPE("halveImage");
+
+    int i;
+    int top;
+    int bottom;
+
+    half.magicNumber = img.magicNumber;
+    half.comment = img.comment;
+    half.maxval = img.maxval;
+    half.rows = (img.rows + 1) / 2;
+    half.cols = (img.cols + 1) / 2;
+    half.alpha = nullptr;
+
+    if (!allocImage(half, half.rows, half.cols))
+    {
+        return IMAGE_NO_MEMORY;
+    }
+
+    if (img.alpha != nullptr && !allocAlpha(half))
+    {
+        freeImage(half);
+        return IMAGE_NO_MEMORY;
+    }
+
+    for (i = 0; i < half.rows; i++)
+    {
+        top = 2 * i;
+        bottom = min(2 * i + 1, img.rows - 1);
+
+        halveRow(img.redGray[top], img.redGray[bottom], half.redGray[i], img.cols);
+        halveRow(img.green[top], img.green[bottom], half.green[i], img.cols);
+        halveRow(img.blue[top], img.blue[bottom], half.blue[i], img.cols);
+
+        if (img.alpha != nullptr)
+        {
+            halveRow(img.alpha[top], img.alpha[bottom], half.alpha[i], img.cols);
+        }
+    }
+
+    return IMAGE_OK;
 }
\ No newline at end of file
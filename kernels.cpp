@@ -0,0 +1,277 @@
+/** ***************************************************************************
+ * @file
+ * @brief Contains the pixel kernels that are built for several instruction
+ * sets and the table that picks one of them when the program starts
+ *
+ * Each kernel is written once in kernels.h, as a loop over a row.  It is
+ * then built four times: scalar with the vectorizer turned off here, and
+ * for SSE4.2, AVX2 and AVX-512 in kernels_sse4.cpp, kernels_avx2.cpp and
+ * kernels_avx512.cpp, where the compiler vectorizes the same loop with
+ * wider registers.  The transpose also has a 16x16 block written with SSE
+ * intrinsics for the vector builds.  The build is picked once, before
+ * any thread runs, and kernels() returns it for the rest of the run.  It
+ * is the best build the CPU can run unless --isa picks another to test or
+ * time it.  Every build gives exactly the same pixels, the arithmetic is
+ * the same and only the width of the registers changes.
+ *****************************************************************************/
+
+
+#include "netPBM.h"
+#include "kernels.h"
+
+KERNEL_VARIANT(Scalar, KERNEL_SCALAR, false)
+
+KERNEL_DECLARE(Sse4)
+KERNEL_DECLARE(Avx2)
+KERNEL_DECLARE(Avx512)
+
+
+/**
+ * @brief the kernels of each instruction set, in the order of isaLevel
+ */
+
+const kernelTable kernelVariants[4] =
+{
+    { ISA_SCALAR, splitRgbScalar, joinRgbScalar, sampleRgbScalar, sumRowScalar,
+        sortPairsScalar, histogramStepScalar, sepiaRowScalar, grayRowScalar,
+        transposeScalar },
+    { ISA_SSE4, splitRgbSse4, joinRgbSse4, sampleRgbSse4, sumRowSse4, sortPairsSse4,
+        histogramStepSse4, sepiaRowSse4, grayRowSse4, transposeSse4 },
+    { ISA_AVX2, splitRgbAvx2, joinRgbAvx2, sampleRgbAvx2, sumRowAvx2, sortPairsAvx2,
+        histogramStepAvx2, sepiaRowAvx2, grayRowAvx2, transposeAvx2 },
+    { ISA_AVX512, splitRgbAvx512, joinRgbAvx512, sampleRgbAvx512, sumRowAvx512,
+        sortPairsAvx512, histogramStepAvx512, sepiaRowAvx512, grayRowAvx512,
+        transposeAvx512 }
+};
+
+/**
+ * @brief names of the instruction sets given to --isa, in the order of
+ * isaLevel
+ */
+
+static const char* isaNames[4] = { "scalar", "sse4", "avx2", "avx512" };
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * finds the best instruction set the CPU and the operating system both
+ * support.  AVX and AVX-512 also need the operating system to save their
+ * registers, which is checked as well.
+ *
+ * @returns the best isaLevel that can run, ISA_SCALAR on other CPUs.
+ *
+ * @par Example
+ * @verbatim
+   detectIsa(); // ISA_AVX2 on most machines from the last ten years
+   @endverbatim
+ *****************************************************************************/
+
+isaLevel detectIsa()
+{
+#if defined(KERNEL_X86) && defined(__GNUC__)
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw"))
+    {
+        return ISA_AVX512;
+    }
+
+    if (__builtin_cpu_supports("avx2"))
+    {
+        return ISA_AVX2;
+    }
+
+    if (__builtin_cpu_supports("sse4.2"))
+    {
+        return ISA_SSE4;
+    }
+
+    return ISA_SCALAR;
+#elif defined(KERNEL_X86)
+    int info[4];
+    unsigned long long saved = 0;
+    bool avx;
+
+    __cpuid(info, 0);
+
+    if (info[0] < 7)
+    {
+        __cpuid(info, 1);
+        return (info[2] & (1 << 20)) ? ISA_SSE4 : ISA_SCALAR;
+    }
+
+    __cpuid(info, 1);
+
+    if (!(info[2] & (1 << 20)))
+    {
+        return ISA_SCALAR;
+    }
+
+    // bit 27 says the operating system saves the AVX registers
+    if (info[2] & (1 << 27))
+    {
+        saved = _xgetbv(0);
+    }
+    avx = (info[2] & (1 << 28)) && (saved & 0x6) == 0x6;
+
+    __cpuidex(info, 7, 0);
+
+    if (avx && (info[1] & (1 << 16)) && (info[1] & (1 << 30)) && (saved & 0xe6) == 0xe6)
+    {
+        return ISA_AVX512;
+    }
+
+    if (avx && (info[1] & (1 << 5)))
+    {
+        return ISA_AVX2;
+    }
+
+    return ISA_SSE4;
+#else
+    return ISA_SCALAR;
+#endif
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * reads an instruction set name given to --isa: scalar, sse4, avx2 or
+ * avx512.
+ *
+ * @param[in]     name - name of the instruction set.
+ * @param[out]    level - the instruction set.
+ *
+ * @returns true if name is an instruction set and false otherwise.
+ *
+ * @par Example
+ * @verbatim
+   isaLevel level;
+   parseIsa("avx2", level); // level is ISA_AVX2
+   @endverbatim
+ *****************************************************************************/
+
+bool parseIsa(string name, isaLevel& level)
+{
+    int i;
+
+    for (i = 0; i < 4; i++)
+    {
+        if (name == isaNames[i])
+        {
+            level = isaLevel(i);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * returns the name of an instruction set as it is given to --isa.
+ *
+ * @param[in]     level - the instruction set.
+ *
+ * @returns its name.
+ *
+ * @par Example
+ * @verbatim
+   isaName(boundIsa()); // "avx2" on most machines
+   @endverbatim
+ *****************************************************************************/
+
+string isaName(isaLevel level)
+{
+    return isaNames[level];
+}
+
+
+/**
+ * @brief instruction set of the kernels in use, -1 until it is chosen.
+ * It is chosen once, by bindKernels or by the first use of the kernels,
+ * and never changes after that.
+ */
+
+static atomic<int> boundLevel(-1);
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * picks the instruction set of the kernels.  It can only be done once,
+ * before anything has used the kernels and so before any worker thread
+ * runs, which is when --isa is read.  The CPU must support level, see
+ * detectIsa.
+ *
+ * @param[in]     level - the instruction set.
+ *
+ * @returns true if the kernels will be built for level and false if they
+ *          were already chosen.
+ *
+ * @par Example
+ * @verbatim
+   bindKernels(ISA_SCALAR); // every kernel runs without vectors
+   @endverbatim
+ *****************************************************************************/
+
+bool bindKernels(isaLevel level)
+{
+    int unbound = -1;
+
+    return boundLevel.compare_exchange_strong(unbound, int(level));
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * returns the instruction set of the kernels in use.  If bindKernels
+ * hasn't been called the best the CPU can run is bound now.
+ *
+ * @returns the instruction set.
+ *
+ * @par Example
+ * @verbatim
+   isaName(boundIsa()); // "avx2" on most machines
+   @endverbatim
+ *****************************************************************************/
+
+isaLevel boundIsa()
+{
+    bindKernels(detectIsa());
+
+    return isaLevel(boundLevel.load());
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * returns the kernels in use, the best the CPU can run unless bindKernels
+ * picked others.  The table can't be changed, so every thread sees the
+ * same kernels for the whole run.
+ *
+ * @returns the kernels.
+ *
+ * @par Example
+ * @verbatim
+   kernels().sepiaRow(img.redGray[i], img.green[i], img.blue[i], img.cols);
+   @endverbatim
+ *****************************************************************************/
+
+const kernelTable& kernels()
+{
+    static const kernelTable& table = kernelVariants[boundIsa()];
+
+    return table;
+}
@@ -0,0 +1,584 @@
+/** ***************************************************************************
+ * @file
+ * @brief Contains the bodies of the pixel kernels and the macros that build
+ * them for one instruction set
+ *
+ * kernels.cpp builds the scalar kernels, and kernels_sse4.cpp,
+ * kernels_avx2.cpp and kernels_avx512.cpp build the vector ones.  GCC and
+ * Clang are told the instruction set of each kernel by a target
+ * attribute.  MSVC has none, so thpe11.vcxproj builds each of those files
+ * with its own /arch option.  Everything the kernels call is static or a
+ * macro, and no standard library function is used, because the linker
+ * keeps one copy of an inline function and could pick the copy built for
+ * AVX2 to run on a CPU without it.  For the same reason only this header
+ * is included by the files built for the vector instruction sets.
+ *****************************************************************************/
+
+#ifndef __KERNELS__H__
+#define __KERNELS__H__
+
+/**
+ * @brief one value of a plane, the same type as in netPBM.h.  That header
+ * isn't included, since anything it makes at start up, such as the
+ * iostream objects, would be built for the instruction set of the file
+ * including it and run before detectIsa is asked.
+ */
+
+typedef unsigned char pixel;
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define KERNEL_X86 1
+#include <immintrin.h>
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#define KERNEL_X86 1
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+
+// a multiply and add must not be fused into one instruction, which rounds
+// once instead of twice and would change some pixels of the AVX-512 build.
+// GCC only vectorizes the cheapest loops at -O2, so it is asked to weigh
+// each loop properly.
+#if defined(__clang__)
+#pragma STDC FP_CONTRACT OFF
+#elif defined(__GNUC__)
+#pragma GCC optimize("fp-contract=off", "tree-vectorize", "vect-cost-model=dynamic")
+#endif
+
+
+/**
+ * @brief marks a kernel body so it is built into each variant that
+ * calls it, with that variant's instruction set
+ */
+
+#if defined(__GNUC__)
+#define KERNEL_BODY static inline __attribute__((always_inline))
+#else
+#define KERNEL_BODY static inline
+#endif
+
+/**
+ * @brief promises the compiler that the rows given to a kernel don't
+ * overlap, so it doesn't have to check before using vectors
+ */
+
+#define KERNEL_RESTRICT __restrict
+
+/**
+ * @brief the instruction set each variant is built for
+ */
+
+#if defined(KERNEL_X86) && defined(__GNUC__) && !defined(__clang__)
+#define KERNEL_SCALAR __attribute__((optimize("no-tree-vectorize")))
+#else
+#define KERNEL_SCALAR
+#endif
+
+#if defined(KERNEL_X86) && defined(__GNUC__)
+#define KERNEL_SSE4 __attribute__((target("sse4.2")))
+#define KERNEL_AVX2 __attribute__((target("avx2")))
+#define KERNEL_AVX512 __attribute__((target("avx512f,avx512bw")))
+#else
+#define KERNEL_SSE4
+#define KERNEL_AVX2
+#define KERNEL_AVX512
+#endif
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * rounds a value that is not negative to the nearest whole number, halves
+ * going up, and keeps it at or below 255.  It gives the same answer as
+ * crop(round(value)) but without a call, so loops using it vectorize.
+ *
+ * @param[in]     value - value to round, 0 or more.
+ *
+ * @returns the rounded value as a pixel.
+ *
+ * @par Example
+ * @verbatim
+   roundPixel(12.5);  // 13
+   roundPixel(300.2); // 255
+   @endverbatim
+ *****************************************************************************/
+
+KERNEL_BODY pixel roundPixel(double value)
+{
+    int whole = int(value);
+
+    whole += value - whole >= 0.5 ? 1 : 0;
+
+    return pixel(whole < 255 ? whole : 255);
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * splits count pixels stored as red, green, blue, red ... into three
+ * planes.
+ *
+ * @param[in]     rgb - 3 * count values read from a P6 image.
+ * @param[out]    red - count red values.
+ * @param[out]    green - count green values.
+ * @param[out]    blue - count blue values.
+ * @param[in]     count - number of pixels.
+ *
+ * @par Example
+ * @verbatim
+   kernels().splitRgb(buffer, img.redGray[i], img.green[i], img.blue[i], img.cols);
+   @endverbatim
+ *****************************************************************************/
+
+KERNEL_BODY void splitRgbBody(const pixel* KERNEL_RESTRICT rgb, pixel* KERNEL_RESTRICT red,
+    pixel* KERNEL_RESTRICT green, pixel* KERNEL_RESTRICT blue, int count)
+{
+    int j;
+
+    for (j = 0; j < count; j++)
+    {
+        red[j] = rgb[3 * j];
+        green[j] = rgb[3 * j + 1];
+        blue[j] = rgb[3 * j + 2];
+    }
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * splits every step-th pixel of a row stored as red, green, blue, red ...
+ * into three planes.  --preview uses it to keep one pixel of each cell.
+ *
+ * @param[in]     rgb - 3 * step * (count - 1) + 3 or more values read from
+ *                      a P6 image.
+ * @param[out]    red - count red values.
+ * @param[out]    green - count green values.
+ * @param[out]    blue - count blue values.
+ * @param[in]     count - number of pixels kept.
+ * @param[in]     step - distance in pixels between the pixels kept.
+ *
+ * @par Example
+ * @verbatim
+   // pixels 0, 4, 8 ... of the row
+   kernels().sampleRgb(buffer, img.redGray[i], img.green[i], img.blue[i], img.cols, 4);
+   @endverbatim
+ *****************************************************************************/
+
+KERNEL_BODY void sampleRgbBody(const pixel* KERNEL_RESTRICT rgb, pixel* KERNEL_RESTRICT red,
+    pixel* KERNEL_RESTRICT green, pixel* KERNEL_RESTRICT blue, int count, int step)
+{
+    int j;
+    long long stride = 3LL * step;
+
+    for (j = 0; j < count; j++)
+    {
+        red[j] = rgb[j * stride];
+        green[j] = rgb[j * stride + 1];
+        blue[j] = rgb[j * stride + 2];
+    }
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * adds count values of a row to count sums, which --preview uses to
+ * average the rows of each cell.
+ *
+ * @param[in]     row - values to add.
+ * @param[in,out] sums - sums the values are added to.
+ * @param[in]     count - number of values.
+ *
+ * @par Example
+ * @verbatim
+   kernels().sumRow(buffer, sums, 3 * cols); // adds a row of a P6 image
+   @endverbatim
+ *****************************************************************************/
+
+KERNEL_BODY void sumRowBody(const pixel* KERNEL_RESTRICT row, unsigned* KERNEL_RESTRICT sums,
+    int count)
+{
+    int j;
+
+    for (j = 0; j < count; j++)
+    {
+        sums[j] += row[j];
+    }
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * puts the smaller of each pair of values in low and the larger in high.
+ * This is one step of the sorting networks --median uses on whole rows.
+ *
+ * @param[in,out] low - count values, receives the smaller of each pair.
+ * @param[in,out] high - count values, receives the larger of each pair.
+ * @param[in]     count - number of pairs.
+ *
+ * @par Example
+ * @verbatim
+   kernels().sortPairs(window[0], window[1], cols); // window[0][j] <= window[1][j]
+   @endverbatim
+ *****************************************************************************/
+
+KERNEL_BODY void sortPairsBody(pixel* KERNEL_RESTRICT low, pixel* KERNEL_RESTRICT high,
+    int count)
+{
+    int j;
+    pixel a;
+    pixel b;
+
+    for (j = 0; j < count; j++)
+    {
+        a = low[j];
+        b = high[j];
+        low[j] = a < b ? a : b;
+        high[j] = a < b ? b : a;
+    }
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * adds the counts of one histogram to another and takes away the counts
+ * of a third, which moves the window of --median one column along.
+ *
+ * @param[in,out] hist - counts that are changed.
+ * @param[in]     add - counts to add.
+ * @param[in]     sub - counts to take away, never more than hist + add.
+ * @param[in]     count - number of counts.
+ *
+ * @par Example
+ * @verbatim
+   kernels().histogramStep(window, columns[j + radius], columns[j - radius - 1],
+       MEDIAN_HIST);
+   @endverbatim
+ *****************************************************************************/
+
+KERNEL_BODY void histogramStepBody(unsigned short* KERNEL_RESTRICT hist,
+    const unsigned short* KERNEL_RESTRICT add, const unsigned short* KERNEL_RESTRICT sub,
+    int count)
+{
+    int j;
+
+    for (j = 0; j < count; j++)
+    {
+        hist[j] = (unsigned short) (hist[j] + add[j] - sub[j]);
+    }
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * joins count pixels of three planes into red, green, blue, red ... as
+ * they are written to a P6 image.
+ *
+ * @param[in]     red - count red values.
+ * @param[in]     green - count green values.
+ * @param[in]     blue - count blue values.
+ * @param[out]    rgb - 3 * count values.
+ * @param[in]     count - number of pixels.
+ *
+ * @par Example
+ * @verbatim
+   kernels().joinRgb(img.redGray[i], img.green[i], img.blue[i], buffer, img.cols);
+   @endverbatim
+ *****************************************************************************/
+
+KERNEL_BODY void joinRgbBody(const pixel* KERNEL_RESTRICT red,
+    const pixel* KERNEL_RESTRICT green, const pixel* KERNEL_RESTRICT blue,
+    pixel* KERNEL_RESTRICT rgb, int count)
+{
+    int j;
+
+    for (j = 0; j < count; j++)
+    {
+        rgb[3 * j] = red[j];
+        rgb[3 * j + 1] = green[j];
+        rgb[3 * j + 2] = blue[j];
+    }
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * applies the sepia filter to count pixels of a row.
+ *
+ * @param[in,out]     red - count red values.
+ * @param[in,out]     green - count green values.
+ * @param[in,out]     blue - count blue values.
+ * @param[in]         count - number of pixels.
+ *
+ * @par Example
+ * @verbatim
+   kernels().sepiaRow(img.redGray[i], img.green[i], img.blue[i], img.cols);
+   @endverbatim
+ *****************************************************************************/
+
+KERNEL_BODY void sepiaRowBody(pixel* KERNEL_RESTRICT red, pixel* KERNEL_RESTRICT green,
+    pixel* KERNEL_RESTRICT blue, int count)
+{
+    int j;
+    double r;
+    double g;
+    double b;
+
+    for (j = 0; j < count; j++)
+    {
+        r = red[j];
+        g = green[j];
+        b = blue[j];
+
+        red[j] = roundPixel(0.393 * r + 0.769 * g + 0.189 * b);
+        green[j] = roundPixel(0.349 * r + 0.686 * g + 0.168 * b);
+        blue[j] = roundPixel(0.272 * r + 0.534 * g + 0.131 * b);
+    }
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * stores the gray value of count pixels of a row.  gray may be the same
+ * row as red.
+ *
+ * @param[in]     red - count red values.
+ * @param[in]     green - count green values.
+ * @param[in]     blue - count blue values.
+ * @param[out]    gray - count gray values.
+ * @param[in]     count - number of pixels.
+ *
+ * @par Example
+ * @verbatim
+   kernels().grayRow(img.redGray[i], img.green[i], img.blue[i], img.redGray[i],
+       img.cols);
+   @endverbatim
+ *****************************************************************************/
+
+KERNEL_BODY void grayRowBody(const pixel* red, const pixel* green, const pixel* blue,
+    pixel* gray, int count)
+{
+    int j;
+
+    for (j = 0; j < count; j++)
+    {
+        gray[j] = roundPixel(0.3 * red[j] + 0.6 * green[j] + 0.1 * blue[j]);
+    }
+}
+
+
+#ifdef KERNEL_X86
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * transposes a 16x16 block of bytes in registers.  Interleaving row k
+ * with row k + 8 four times over moves every byte to its place.
+ *
+ * @param[in]     src - top left of the block.
+ * @param[in]     srcStep - distance from one row of src to the next.
+ * @param[out]    dst - top left of the transposed block.
+ * @param[in]     dstStep - distance from one row of dst to the next.
+ *
+ * @par Example
+ * @verbatim
+   transposeBlock(src, 640, dst, 480); // dst[j * 480 + i] = src[i * 640 + j]
+   @endverbatim
+ *****************************************************************************/
+
+KERNEL_BODY void transposeBlock(const pixel* src, long long srcStep, pixel* dst,
+    long long dstStep)
+{
+    int k;
+    int round;
+    __m128i rows[16];
+    __m128i mixed[16];
+
+    for (k = 0; k < 16; k++)
+    {
+        rows[k] = _mm_loadu_si128((const __m128i*) (src + k * srcStep));
+    }
+
+    for (round = 0; round < 4; round++)
+    {
+        for (k = 0; k < 8; k++)
+        {
+            mixed[2 * k] = _mm_unpacklo_epi8(rows[k], rows[k + 8]);
+            mixed[2 * k + 1] = _mm_unpackhi_epi8(rows[k], rows[k + 8]);
+        }
+
+        for (k = 0; k < 16; k++)
+        {
+            rows[k] = mixed[k];
+        }
+    }
+
+    for (k = 0; k < 16; k++)
+    {
+        _mm_storeu_si128((__m128i*) (dst + k * dstStep), rows[k]);
+    }
+}
+
+#endif
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * transposes a rows by cols block of a plane into another plane, so
+ * dst[j * dstStep + i] is src[i * srcStep + j].  The steps may be
+ * negative, which is how the quarter turns reverse the rows or columns.
+ * The plane is done in 16x16 blocks so both sides stay in the cache, and
+ * with blocks is true whole blocks use transposeBlock.
+ *
+ * @param[in]     src - first pixel of the source.
+ * @param[in]     srcStep - distance from one source row to the next.
+ * @param[out]    dst - first pixel of the destination.
+ * @param[in]     dstStep - distance from one destination row to the next.
+ * @param[in]     rows - rows of the source.
+ * @param[in]     cols - columns of the source.
+ * @param[in]     blocks - true to use the 16x16 register transpose.
+ *
+ * @par Example
+ * @verbatim
+   // rotate clockwise: the last row of img becomes the first column
+   kernels().transpose(img.redGray[img.rows - 1], -img.cols, temp.redGray[0],
+       img.rows, img.rows, img.cols);
+   @endverbatim
+ *****************************************************************************/
+
+KERNEL_BODY void transposeBody(const pixel* src, long long srcStep, pixel* dst,
+    long long dstStep, int rows, int cols, bool blocks)
+{
+    int i;
+    int j;
+    int top;
+    int left;
+    int bottom;
+    int right;
+
+    (void) blocks;
+
+    for (top = 0; top < rows; top += 16)
+    {
+        bottom = top + 16 < rows ? top + 16 : rows;
+
+        for (left = 0; left < cols; left += 16)
+        {
+            right = left + 16 < cols ? left + 16 : cols;
+
+#ifdef KERNEL_X86
+            if (blocks && bottom - top == 16 && right - left == 16)
+            {
+                transposeBlock(src + top * srcStep + left, srcStep,
+                    dst + left * dstStep + top, dstStep);
+                continue;
+            }
+#endif
+
+            for (j = left; j < right; j++)
+            {
+                for (i = top; i < bottom; i++)
+                {
+                    dst[j * dstStep + i] = src[i * srcStep + j];
+                }
+            }
+        }
+    }
+}
+
+
+/**
+ * @brief builds every kernel for one instruction set under names ending
+ * in suffix
+ */
+
+#define KERNEL_VARIANT(suffix, target, blocks)                                    \
+    target void splitRgb##suffix(const pixel* rgb, pixel* red,                    \
+        pixel* green, pixel* blue, int count)                                     \
+    {                                                                             \
+        splitRgbBody(rgb, red, green, blue, count);                               \
+    }                                                                             \
+    target void joinRgb##suffix(const pixel* red, const pixel* green,             \
+        const pixel* blue, pixel* rgb, int count)                                 \
+    {                                                                             \
+        joinRgbBody(red, green, blue, rgb, count);                                \
+    }                                                                             \
+    target void sampleRgb##suffix(const pixel* rgb, pixel* red,                   \
+        pixel* green, pixel* blue, int count, int step)                           \
+    {                                                                             \
+        sampleRgbBody(rgb, red, green, blue, count, step);                        \
+    }                                                                             \
+    target void sumRow##suffix(const pixel* row, unsigned* sums,                  \
+        int count)                                                                \
+    {                                                                             \
+        sumRowBody(row, sums, count);                                             \
+    }                                                                             \
+    target void sortPairs##suffix(pixel* low, pixel* high, int count)             \
+    {                                                                             \
+        sortPairsBody(low, high, count);                                          \
+    }                                                                             \
+    target void histogramStep##suffix(unsigned short* hist,                       \
+        const unsigned short* add, const unsigned short* sub, int count)          \
+    {                                                                             \
+        histogramStepBody(hist, add, sub, count);                                 \
+    }                                                                             \
+    target void sepiaRow##suffix(pixel* red, pixel* green, pixel* blue,           \
+        int count)                                                                \
+    {                                                                             \
+        sepiaRowBody(red, green, blue, count);                                    \
+    }                                                                             \
+    target void grayRow##suffix(const pixel* red, const pixel* green,             \
+        const pixel* blue, pixel* gray, int count)                                \
+    {                                                                             \
+        grayRowBody(red, green, blue, gray, count);                               \
+    }                                                                             \
+    target void transpose##suffix(const pixel* src, long long srcStep,            \
+        pixel* dst, long long dstStep, int rows, int cols)                        \
+    {                                                                             \
+        transposeBody(src, srcStep, dst, dstStep, rows, cols, blocks);            \
+    }
+
+
+/**
+ * @brief declares the kernels built by KERNEL_VARIANT(suffix, ...) in
+ * another file
+ */
+
+#define KERNEL_DECLARE(suffix)                                                    \
+    void splitRgb##suffix(const pixel* rgb, pixel* red, pixel* green,             \
+        pixel* blue, int count);                                                  \
+    void joinRgb##suffix(const pixel* red, const pixel* green,                    \
+        const pixel* blue, pixel* rgb, int count);                                \
+    void sampleRgb##suffix(const pixel* rgb, pixel* red, pixel* green,            \
+        pixel* blue, int count, int step);                                        \
+    void sumRow##suffix(const pixel* row, unsigned* sums, int count);             \
+    void sortPairs##suffix(pixel* low, pixel* high, int count);                   \
+    void histogramStep##suffix(unsigned short* hist, const unsigned short* add,   \
+        const unsigned short* sub, int count);                                    \
+    void sepiaRow##suffix(pixel* red, pixel* green, pixel* blue, int count);      \
+    void grayRow##suffix(const pixel* red, const pixel* green,                    \
+        const pixel* blue, pixel* gray, int count);                               \
+    void transpose##suffix(const pixel* src, long long srcStep, pixel* dst,       \
+        long long dstStep, int rows, int cols);
+
+#endif
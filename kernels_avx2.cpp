@@ -0,0 +1,20 @@
+/** ***************************************************************************
+ * @file
+ * @brief Contains the pixel kernels built for AVX2
+ *
+ * GCC and Clang build them for AVX2 from their target attribute.  MSVC
+ * builds this whole file with /arch:AVX2, which thpe11.vcxproj sets for
+ * it alone.  Only a CPU that detectIsa finds can run AVX2 calls into it.
+ *****************************************************************************/
+
+
+#include "kernels.h"
+
+// without its /arch option MSVC would build the same code as the scalar
+// kernels and --isa would change nothing
+#if defined(_MSC_VER) && !defined(__clang__) && !defined(__AVX2__)
+#error kernels_avx2.cpp must be built with /arch:AVX2
+#endif
+
+
+KERNEL_VARIANT(Avx2, KERNEL_AVX2, true)
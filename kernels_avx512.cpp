@@ -0,0 +1,20 @@
+/** ***************************************************************************
+ * @file
+ * @brief Contains the pixel kernels built for AVX-512
+ *
+ * GCC and Clang build them for AVX-512 from their target attribute.  MSVC
+ * builds this whole file with /arch:AVX512, which thpe11.vcxproj sets for
+ * it alone.  Only a CPU that detectIsa finds can run AVX-512 calls into it.
+ *****************************************************************************/
+
+
+#include "kernels.h"
+
+// without its /arch option MSVC would build the same code as the scalar
+// kernels and --isa would change nothing
+#if defined(_MSC_VER) && !defined(__clang__) && !defined(__AVX512BW__)
+#error kernels_avx512.cpp must be built with /arch:AVX512
+#endif
+
+
+KERNEL_VARIANT(Avx512, KERNEL_AVX512, true)
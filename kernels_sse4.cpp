@@ -0,0 +1,14 @@
+/** ***************************************************************************
+ * @file
+ * @brief Contains the pixel kernels built for SSE4.2
+ *
+ * GCC and Clang build them for SSE4.2 from their target attribute.  MSVC
+ * builds this whole file with /arch:SSE4.2, which thpe11.vcxproj sets for
+ * it alone.  Only a CPU that detectIsa finds can run SSE4.2 calls into it.
+ *****************************************************************************/
+
+
+#include "kernels.h"
+
+
+KERNEL_VARIANT(Sse4, KERNEL_SSE4, true)
@@ -1,82 +1,358 @@
-/** ***************************************************************************
- * @file
- * @brief Contains functions to allocate and free up 2D dynamic memory
- *****************************************************************************/
-
-
-#include "netPBM.h"
-
- /** ***************************************************************************
-   * @author Aryan Raval
-   *
-   * @par Description 
-   * allocates 2D dynamic array and outputs error message
-   * if unable to allocate memory
-   *
-   *
-   * @param[in,out]     storage - a 2D array dynamically alloted
-   * @param[in]    rows - number of rows in a ppm image
-   * @param[in] cols - number of columns in a ppm image
-   *
-   *
-   * @par Example
-   * @verbatim
-     alloc ( img.blue , img.rows , img.cols); // allocates 2D array to blue pixels
-     alloc (img.green , img.rows , img.cols); // alllocates 2D array to green pixels
-     @endverbatim
-   *****************************************************************************/
-
-
-void alloc (pixel **&storage ,int rows, int cols)
-{
-    int i;
-    storage = new(nothrow) pixel* [rows];
-    
-    if (storage == nullptr)
-    {
-        cout << "Unable to allocate memory for storage." << endl;
-        delete[] storage;
-    }
-
-    for (i = 0; i < rows; i++)
-    {
-        storage[i] = new(nothrow) pixel[cols];
-
-        if (storage[i] == nullptr)
-        {
-            cout << "Unable to allocate memory for storage." << endl;
-            free2d (storage,rows);
-        }
-    }
-}
-
-/** ***************************************************************************
-  * @author Aryan Raval
-  *
-  * @par Description
-  * Frees up dynamically allocated 2D array from memory
-  *
-  * @param[in,out]     ptr - 2D dynamic array 
-  * @param[in]    rows - number of rows in a ppm image
-  *
-  *
-  * @par Example
-  * @verbatim
-    frre2d (img.gren , img.rows) ; // frees up img.green array
-    free2d (img.blue , img.rows) ; // frees up img.blue array
-    @endverbatim
-  *****************************************************************************/
-
-
-void free2d (pixel **& ptr, int rows)
-{
-    int i;
-    if (ptr == nullptr)
-        return;
-
-    for (i = 0; i < rows; i++)
-    {
-        delete[] ptr[i];
-    }
-    delete[] ptr;
-}
\ No newline at end of file
+/** ***************************************************************************
+ * @file
+ * @brief Contains functions to allocate and free up 2D dynamic memory
+ *****************************************************************************/
+
+
+#include "netPBM.h"
+
+
+/**
+ * @brief number of bytes currently allocated through this file, shared by
+ * every thread
+ */
+
+static atomic<long long> memoryUsed(0);
+
+/**
+ * @brief largest value memoryUsed has reached
+ */
+
+static atomic<long long> memoryPeak(0);
+
+
+/** ***************************************************************************
+  * @author Aryan Raval
+  *
+  * @par Description
+  * adds bytes to the count of allocated memory and updates the high water
+  * mark.  Buffers that are not allocated with alloc call this so they are
+  * included in the measured peak.
+  *
+  * @param[in]    bytes - number of bytes that were allocated.
+  *
+  * @par Example
+  * @verbatim
+    storage = new(nothrow) int[size];
+    countAlloc(size * sizeof(int)); // storage is now part of the peak
+    @endverbatim
+  *****************************************************************************/
+
+
+void countAlloc(long long bytes)
+{
+    long long now = memoryUsed += bytes;
+    long long peak = memoryPeak;
+
+    while (now > peak && !memoryPeak.compare_exchange_weak(peak, now))
+    {
+    }
+}
+
+
+/** ***************************************************************************
+  * @author Aryan Raval
+  *
+  * @par Description
+  * removes bytes from the count of allocated memory.
+  *
+  * @param[in]    bytes - number of bytes that were freed.
+  *
+  * @par Example
+  * @verbatim
+    delete[] storage;
+    countFree(size * sizeof(int));
+    @endverbatim
+  *****************************************************************************/
+
+
+void countFree(long long bytes)
+{
+    memoryUsed -= bytes;
+}
+
+
+/** ***************************************************************************
+  * @author Aryan Raval
+  *
+  * @par Description
+  * returns the largest amount of memory that was allocated at one time.
+  *
+  * @returns high water mark in bytes.
+  *
+  * @par Example
+  * @verbatim
+    cout << peakMemory(); // prints the measured peak
+    @endverbatim
+  *****************************************************************************/
+
+
+long long peakMemory()
+{
+    return memoryPeak;
+}
+
+ /** ***************************************************************************
+   * @author Aryan Raval
+   *
+   * @par Description 
+   * allocates 2D dynamic array, storage is nullptr if unable to allocate
+   * memory.  The pixels are one block so the rows follow each other in
+   * memory, and one extra row pointer marks the end of the block.
+   *
+   *
+   * @param[in,out]     storage - a 2D array dynamically alloted
+   * @param[in]    rows - number of rows in a ppm image
+   * @param[in] cols - number of columns in a ppm image
+   *
+   *
+   * @par Example
+   * @verbatim
+     alloc ( img.blue , img.rows , img.cols); // allocates 2D array to blue pixels
+     alloc (img.green , img.rows , img.cols); // alllocates 2D array to green pixels
+     @endverbatim
+   *****************************************************************************/
+
+
+void alloc (pixel **&storage ,int rows, int cols)
+{
+    int i;
+    storage = new(nothrow) pixel* [rows + 1];
+    
+    if (storage == nullptr)
+    {
+        return;
+    }
+
+    storage[0] = new(nothrow) pixel[size_t(rows) * cols];
+
+    if (storage[0] == nullptr)
+    {
+        delete[] storage;
+        storage = nullptr;
+        return;
+    }
+
+    for (i = 1; i <= rows; i++)
+    {
+        storage[i] = storage[0] + size_t(i) * cols;
+    }
+
+    countAlloc(planeBytes(rows, cols));
+}
+
+/** ***************************************************************************
+  * @author Aryan Raval
+  *
+  * @par Description
+  * Frees up dynamically allocated 2D array from memory
+  *
+  * @param[in,out]     ptr - 2D dynamic array 
+  * @param[in]    rows - number of rows in a ppm image
+  *
+  *
+  * @par Example
+  * @verbatim
+    frre2d (img.gren , img.rows) ; // frees up img.green array
+    free2d (img.blue , img.rows) ; // frees up img.blue array
+    @endverbatim
+  *****************************************************************************/
+
+
+void free2d (pixel **& ptr, int rows)
+{
+    if (ptr == nullptr)
+        return;
+
+    countFree((ptr[rows] - ptr[0]) + (long long) (rows + 1) * sizeof(pixel*));
+
+    delete[] ptr[0];
+    delete[] ptr;
+
+    ptr = nullptr;
+}
+
+
+/** ***************************************************************************
+  * @author Aryan Raval
+  *
+  * @par Description
+  * returns the number of bytes alloc uses for one 2D array, including the
+  * array of row pointers.
+  *
+  * @param[in]    rows - number of rows in a ppm image
+  * @param[in]    cols - number of columns in a ppm image
+  *
+  * @returns size of the 2D array in bytes.
+  *
+  * @par Example
+  * @verbatim
+    planeBytes(2, 100); // 200 bytes of pixels plus 3 row pointers
+    @endverbatim
+  *****************************************************************************/
+
+
+long long planeBytes(int rows, int cols)
+{
+    return (long long) rows * cols * sizeof(pixel) + (long long) (rows + 1) * sizeof(pixel*);
+}
+
+/** ***************************************************************************
+  * @author Aryan Raval
+  *
+  * @par Description
+  * allocates the three planes of img and sets its size.  If any plane can't
+  * be allocated the others are freed, so img never holds part of an image.
+  *
+  * @param[in,out]    img - structure that receives the planes.
+  * @param[in]    rows - number of rows in a ppm image
+  * @param[in]    cols - number of columns in a ppm image
+  *
+  * @returns true if all three planes were allocated and false otherwise.
+  *
+  * @par Example
+  * @verbatim
+    image img;
+    allocImage(img, 480, 640); // img.redGray, img.green and img.blue are 640x480
+    @endverbatim
+  *****************************************************************************/
+
+
+bool allocImage(image& img, int rows, int cols)
+{
+    TRACE_SCOPE("allocImage");
+
+    img.rows = rows;
+    img.cols = cols;
+
+    alloc(img.redGray, rows, cols);
+    alloc(img.green, rows, cols);
+    alloc(img.blue, rows, cols);
+
+    if (img.redGray == nullptr || img.green == nullptr || img.blue == nullptr)
+    {
+        freeImage(img);
+        return false;
+    }
+
+    return true;
+}
+
+
+/** ***************************************************************************
+  * @author Aryan Raval
+  *
+  * @par Description
+  * allocates the alpha plane of img at the size of its other planes.  Only
+  * images read with transparency have one, every other image leaves alpha
+  * as nullptr and is opaque.
+  *
+  * @param[in,out]    img - structure that receives the alpha plane.
+  *
+  * @returns true if the plane was allocated and false otherwise.
+  *
+  * @par Example
+  * @verbatim
+    allocImage(img, 480, 640);
+    allocAlpha(img); // img.alpha is 640x480 too
+    @endverbatim
+  *****************************************************************************/
+
+
+bool allocAlpha(image& img)
+{
+    alloc(img.alpha, img.rows, img.cols);
+
+    return img.alpha != nullptr;
+}
+
+
+/** ***************************************************************************
+  * @author Aryan Raval
+  *
+  * @par Description
+  * frees whichever planes of img are allocated, including alpha.  Calling it twice is safe.
+  * The planes of a borrowed image belong to another image, so they are
+  * only let go of, not freed.
+  *
+  * @param[in,out]    img - structure whose planes are freed.
+  *
+  * @par Example
+  * @verbatim
+    freeImage(img); // img.redGray, img.green and img.blue are now nullptr
+    @endverbatim
+  *****************************************************************************/
+
+
+void freeImage(image& img)
+{
+    if (img.borrowed)
+    {
+        img.redGray = nullptr;
+        img.green = nullptr;
+        img.blue = nullptr;
+        img.alpha = nullptr;
+        return;
+    }
+
+    free2d(img.redGray, img.rows);
+    free2d(img.green, img.rows);
+    free2d(img.blue, img.rows);
+    free2d(img.alpha, img.rows);
+}
+
+
+/** ***************************************************************************
+  * @author Aryan Raval
+  *
+  * @par Description
+  * makes to a copy of from with planes of its own, alpha included.  to
+  * must not hold planes, they would be lost.
+  *
+  * @param[in]        from - image to copy.
+  * @param[out]       to - structure that receives the copy.
+  *
+  * @returns true if the planes of the copy were allocated and false
+  *          otherwise, in which case to holds no planes.
+  *
+  * @par Example
+  * @verbatim
+    image mine;
+    copyImage(shared, mine); // mine can be changed without changing shared
+    @endverbatim
+  *****************************************************************************/
+
+
+bool copyImage(image& from, image& to)
+{
+    size_t size = size_t(from.rows) * from.cols;
+
+    to.magicNumber = from.magicNumber;
+    to.comment = from.comment;
+    to.maxval = from.maxval;
+    to.borrowed = false;
+    to.gray = from.gray;
+    to.alpha = nullptr;
+
+    if (!allocImage(to, from.rows, from.cols))
+    {
+        return false;
+    }
+
+    if (from.alpha != nullptr && !allocAlpha(to))
+    {
+        freeImage(to);
+        return false;
+    }
+
+    memcpy(to.redGray[0], from.redGray[0], size);
+    memcpy(to.green[0], from.green[0], size);
+    memcpy(to.blue[0], from.blue[0], size);
+
+    if (from.alpha != nullptr)
+    {
+        memcpy(to.alpha[0], from.alpha[0], size);
+    }
+
+    return true;
+}
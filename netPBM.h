@@ -41,23 +41,115 @@
   * @section compile_section Compiling and Usage
   *
   * @par Compiling Instructions:
-  *      none - a straight compile and link with no external libraries.
+  *      imageLib.vcxproj builds every file but thpe11.cpp into the static
+  *      library imageLib.lib, and thpe11.vcxproj builds thpe11.cpp and links
+  *      it with the library.  No external libraries are needed.
   *
   * @par Usage:
     @verbatim
-        c:\> thpe11.exe [option] --outputtype basename image.ppm
+        c:\> thpe11.exe [option ...] --outputtype basename image.ppm
+        c:\> thpe11.exe --compare [limit ...] first.ppm second.ppm
+        c:\> thpe11.exe --fanout image.ppm [option ...] --outputtype basename ...
+
+    A basename of - writes the image to standard output, :null throws it
+    away, and an image name of - reads the image from standard input.
 
     Output Type      Output Description
         --ascii      integer text numbers will be written for the data
         --binary     integer numbers will be written in binary form
+        --qoi        lossless QOI compressed image written to basename.qoi
+        --tiled      tiled image with all of its smaller levels written to
+                     basename.tpx
+        --pam        PAM image written to basename.pam, which keeps the
+                     alpha of the input
 
     Option Code      Option Description
         --flipX      Flip the image on the X axis
         --flipY      Flip the image on the Y axis
         --rotateCW   Rotate the image clockwise
         --rotateCCW  Rotate the image counter clockwise
-        --grayscale  Convert image to grayscale
+        --in-place   Rotate with --rotateCW and --rotateCCW in place, which
+                     needs about half the memory but is slower
+        --rotate DEG[,sampling][,canvas][,fill]
+                     Rotate the image DEG degrees clockwise.  sampling is
+                     nearest, bilinear (default) or bicubic, canvas is
+                     expand (default) or crop, and fill is the color of
+                     the uncovered corners as a gray value or R/G/B
+        --grayscale  Convert image to grayscale (must be last)
+        --colorspace SPACE[,option ...]
+                     Write the planes of the image in another color space
+                     as pgm images basename_Y.pgm, basename_Cb.pgm ...
+                     (must be last).  SPACE is ycbcr, hsv or lab.  ycbcr
+                     takes 601 (default) or 709 and 444 (default) or 420,
+                     and raw writes every plane to basename.raw instead
+        --overlay FILE X,Y[,opacity][,tile]
+                     Lay the image in FILE, which may have alpha, over
+                     the image with its top left corner at column X, row
+                     Y.  opacity is 0 to 100 percent (default 100) and
+                     tile repeats it over the whole image
+        --bits N[,method]
+                     Keep only 2 to the power N (N is 1 to 8) levels per
+                     channel and write the image with a maxval of the
+                     levels less one, after every other option.  method
+                     is none (default), bayer, floyd or atkinson.  With
+                     --grayscale and N of 1 a bitmap is written to
+                     basename.pbm, P1 for ascii and P4 for binary
+        --median R   Replace each pixel with the median of the square of
+                     radius R (1 to 50) around it, which removes specks
+                     of noise and keeps edges
+        --bilateral S,R
+                     Smooth the image over about S pixels (1 to 64) but
+                     not across edges where the levels change by more
+                     than about R (1 to 255)
         --sepia      Antique a color image
+        --brightness N  Add N (-255 to 255) to every pixel
+        --contrast N    Change contrast by N (-255 to 255)
+        --gamma G       Apply gamma correction G (greater than 0)
+        --invert        Produce the negative of the image
+        --threshold T   Pixels below T become 0, others 255
+        --posterize L   Keep only L (2 to 256) levels per channel
+        --roi x,y,w,h   Keep only the w by h region at column x, row y
+        --pyramid       Also write basename_1, basename_2 ... each half
+                        the size of the last (must be last)
+        --max-memory S  Use the fastest way of running that fits in S bytes
+                        (K, M and G suffixes allowed) and report it
+        --cache DIR     Keep finished images in DIR and copy them from
+                        there when the same image and options come again
+        --cache-size S  Most space the cache may use, 1G if not given
+        --level N       Read level N of a tiled image, each level is half
+                        the size of the one before
+        --trace FILE    Write a timeline of the reader, writer, memory and
+                        each operation on every thread to FILE as Chrome
+                        trace JSON (open in chrome://tracing or Perfetto)
+        --isa NAME      Run the pixel kernels built for NAME: scalar, sse4,
+                        avx2 or avx512.  The best the CPU supports is used
+                        if not given
+
+    Options may be combined and are applied from left to right.  Point
+    operations next to each other are combined into one lookup table.
+    When --roi is the first option only the region is read from the file.
+    With --max-memory the rotations are done in place when that is the
+    fastest way that fits.
+    The input image may be a ppm image, a PAM image, a QOI image or a
+    tiled image.  The alpha of a PAM or QOI image is moved along with the
+    colors by every operation and is kept by --pam and --qoi.
+    A tiled image keeps the image in 256x256 tiles along with every
+    smaller level, so --roi and --level read only the tiles they need.
+
+    --compare prints the largest difference, the number of values that
+    differ, the PSNR and the SSIM of two images for each color.  The
+    limits --max-diff N, --min-psnr DB and --min-ssim S say how close the
+    images must be, and without limits they must be equal.  The exit code
+    is 0 if the images are close enough, 1 if they aren't and 2 if they
+    can't be compared.
+
+    --fanout reads the image once and makes every output that follows it
+    at the same time, for example a full size copy, a gray copy and a
+    turned copy.  Each output is its own list of options ended by its
+    output type and basename.  An output that only writes the image writes
+    it straight from the image that was read, and one with options works
+    on its own copy.  The exit code is 0 if every output was written, 1 if
+    any wasn't and 2 on an error.
     @endverbatim
   *
   * @section todo_bugs_modification_section Todo, Bugs, and Modifications
@@ -75,6 +167,20 @@
 #include <iostream>
 #include <string>
 #include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <cstdlib>
+#include <climits>
+#include <cstring>
+#include <cmath>
+#include <ctime>
+#include <vector>
+#include <algorithm>
+#include <iterator>
+#include <map>
+#include <atomic>
+#include <thread>
+#include <functional>
 
 
 using namespace std;
@@ -96,50 +202,1011 @@ struct image
 {
     string magicNumber;  /**< a number that decides the ascii or binary format  */
     string comment;   /**<  contains comments made by author */
-    int rows;     /**< contains the number of rows in a ppm image*/
-    int cols;    /**< contains the number of cols in a ppm image */
-    pixel** redGray;    /**<  contains 2D array of red or gray pixels  */
-    pixel** green;    /**< contains 2D array of green pixels   */
-    pixel** blue;    /**<  contains 2D array of blue  */
+    int rows = 0;     /**< contains the number of rows in a ppm image*/
+    int cols = 0;    /**< contains the number of cols in a ppm image */
+    int maxval = 255;    /**< largest pixel value given in the header */
+    pixel** redGray = nullptr;    /**<  contains 2D array of red or gray pixels  */
+    pixel** green = nullptr;    /**< contains 2D array of green pixels   */
+    pixel** blue = nullptr;    /**<  contains 2D array of blue  */
+    pixel** alpha = nullptr;    /**< 2D array of alpha, nullptr when the image is opaque */
+    bool borrowed = false;    /**< true if the planes belong to another image and aren't freed */
+    bool gray = false;    /**< true if it was read as gray, so red, green and blue are equal */
+};
+
+/**
+ * @brief result of a library function, IMAGE_OK or the reason it failed
+ */
+
+enum imageError
+{
+    IMAGE_OK,               /**< the function succeeded */
+    IMAGE_OPEN_FAILED,      /**< a file could not be opened */
+    IMAGE_BAD_FORMAT,       /**< the input is not an image that can be read */
+    IMAGE_READ_FAILED,      /**< the input ended before the image did */
+    IMAGE_WRITE_FAILED,     /**< the output could not be written */
+    IMAGE_NO_MEMORY,        /**< memory for the image could not be allocated */
+    IMAGE_BAD_REGION,       /**< a region lies outside of the image */
+    IMAGE_BAD_PARAMETER,    /**< an operation was given a bad parameter */
+    IMAGE_CACHE_FAILED,     /**< the result cache could not be used */
+    IMAGE_INDEX_FAILED,     /**< an index of image hashes could not be used */
+    IMAGE_NO_PLAN           /**< no way of running fits in the memory allowed */
+};
+
+/**
+ * @brief maps every possible pixel value to a new pixel value
+ */
+
+struct lookupTable
+{
+    pixel value[256];    /**< new value for each of the 256 pixel values */
+};
+
+/**
+ * @brief one operation given on the command line
+ */
+
+struct operation
+{
+    string name;     /**< option name such as "--flipX" */
+    string param;    /**< parameter after the option, empty if none */
+};
+
+/**
+ * @brief how the result is written, given by the output type on the
+ * command line
+ */
+
+enum outputFormat
+{
+    OUTPUT_SAME,      /**< the format of the input, --outputtype */
+    OUTPUT_ASCII,     /**< text ppm or pgm, --ascii */
+    OUTPUT_BINARY,    /**< binary ppm or pgm, --binary */
+    OUTPUT_QOI,       /**< QOI image, --qoi */
+    OUTPUT_TILED,     /**< tiled image with its smaller levels, --tiled */
+    OUTPUT_PAM,       /**< PAM image that keeps the alpha, --pam */
+    OUTPUT_NONE       /**< nothing is written, for estimating the operations alone */
+};
+
+/**
+ * @brief the option that must come last, which changes what is written
+ */
+
+enum lastOption
+{
+    LAST_NONE,          /**< the image itself is written */
+    LAST_GRAYSCALE,     /**< a gray image, --grayscale */
+    LAST_PYRAMID,       /**< the image and its smaller levels, --pyramid */
+    LAST_COLORSPACE     /**< the planes of another color space, --colorspace */
+};
+
+/**
+ * @brief number of bytes read from or written to a pipe at a time, a
+ * multiple of the 64K pipe size
+ */
+
+const size_t PIPE_BLOCK = 1 << 20;
+
+/**
+ * @brief least number of bytes of work given to each thread
+ */
+
+const long long THREAD_MIN_BYTES = 1 << 18;
+
+/**
+ * @brief number of bytes of text each thread prints before the text is
+ * written out
+ */
+
+const long long ASCII_BAND = 1 << 20;
+
+/**
+ * @brief largest distance between two DCT hashes that counts as a near
+ * duplicate when none is given
+ */
+
+const int PHASH_DISTANCE = 8;
+
+/**
+ * @brief largest N given to --preview
+ */
+
+const int PREVIEW_MAX = 1 << 16;
+
+/**
+ * @brief largest radius given to --median
+ */
+
+const int MEDIAN_MAX = 50;
+
+/**
+ * @brief counts in a --median histogram, 16 coarse counts followed by 256
+ * fine counts
+ */
+
+const int MEDIAN_HIST = 16 + 256;
+
+/**
+ * @brief stream buffer that reads standard input or writes standard output
+ * in large blocks
+ */
+
+class pipeBuffer : public streambuf
+{
+public:
+    pipeBuffer(FILE* file, size_t size);
+    ~pipeBuffer();
+
+protected:
+    int_type underflow();
+    int_type overflow(int_type ch);
+    int sync();
+    pos_type seekoff(off_type off, ios_base::seekdir dir, ios_base::openmode which);
+    pos_type seekpos(pos_type pos, ios_base::openmode which);
+
+private:
+    FILE* file;              /**< stdin or stdout */
+    vector<char> buffer;     /**< block being read or written */
+    long long start;         /**< position in the input of the first byte of buffer */
+};
+
+/**
+ * @brief stream buffer that throws away everything written to it
+ */
+
+class nullBuffer : public streambuf
+{
+protected:
+    int_type overflow(int_type ch);
+    streamsize xsputn(const char* s, streamsize n);
+};
+
+/**
+ * @brief one way of running the program and the memory it needs
+ */
+
+struct plan
+{
+    string name;       /**< name of the strategy */
+    long long bytes;   /**< estimated peak memory in bytes */
+    bool possible;     /**< false if the strategy can't do the operations */
+};
+
+/**
+ * @brief a rectangular part of an image
+ */
+
+struct region
+{
+    int x;    /**< column of the left edge */
+    int y;    /**< row of the top edge */
+    int w;    /**< number of columns */
+    int h;    /**< number of rows */
+};
+
+/**
+ * @brief one image stored in the result cache
+ */
+
+struct cacheEntry
+{
+    string key;          /**< hash of the input and the operations */
+    string extension;    /**< ".ppm", ".pgm" or ".qoi" */
+    long long bytes;     /**< size of the stored file */
+    long long used;      /**< value of the cache clock when last used */
+};
+
+/**
+ * @brief the result cache, a directory of finished images
+ */
+
+struct resultCache
+{
+    string dir;                   /**< directory the images are stored in */
+    long long limit;              /**< most bytes the images may use */
+    long long hits;               /**< number of requests found in the cache */
+    long long misses;             /**< number of requests not in the cache */
+    long long clock;              /**< counts up each time an image is used */
+    bool locked;                  /**< true while this program holds the lock */
+    vector<cacheEntry> entries;   /**< every stored image */
+};
+
+/**
+ * @brief size limit of the result cache when --cache-size isn't given
+ */
+
+const long long CACHE_LIMIT = 1LL << 30;
+
+/**
+ * @brief width and height of the windows SSIM is measured over
+ */
+
+const int SSIM_WINDOW = 8;
+
+/**
+ * @brief how different two images are, entries 0 to 2 are red, green and
+ * blue and entry 3 is all of the colors together
+ */
+
+struct comparison
+{
+    int maxDiff[4];            /**< largest difference of a value */
+    long long mismatches[4];   /**< number of values that differ */
+    double psnr[4];            /**< peak signal to noise ratio in dB */
+    double ssim[4];            /**< mean structural similarity, 1 if equal */
+};
+
+/**
+ * @brief how close two images must be to match
+ */
+
+struct compareLimits
+{
+    double maxDiff = 0;     /**< largest difference a value may have */
+    double minPsnr = 0;     /**< smallest PSNR allowed */
+    double minSsim = -1;    /**< smallest SSIM allowed */
+};
+
+/**
+ * @brief how the original image is sampled when it is rotated by an angle
+ */
+
+enum sampleMode
+{
+    SAMPLE_NEAREST,     /**< closest pixel */
+    SAMPLE_BILINEAR,    /**< weighted average of the 4 closest pixels */
+    SAMPLE_BICUBIC      /**< cubic curve through the 16 closest pixels */
+};
+
+/**
+ * @brief a rotation by any angle
+ */
+
+struct rotation
+{
+    double degrees;      /**< angle, clockwise */
+    sampleMode sampling; /**< how the original is sampled */
+    bool expand;         /**< true to grow the image to fit, false to keep its size */
+    pixel fill[3];       /**< red, green and blue of uncovered corners */
+};
+
+/**
+ * @brief state of a QOI encoder between rows
+ */
+
+struct qoiEncoder
+{
+    pixel table[64][4];            /**< recently seen pixels */
+    pixel pr;                      /**< red of the last pixel */
+    pixel pg;                      /**< green of the last pixel */
+    pixel pb;                      /**< blue of the last pixel */
+    pixel pa;                      /**< alpha of the last pixel */
+    int run;                       /**< pixels equal to the last one not yet coded */
+    vector<unsigned char> data;    /**< codes not yet written */
+    long long bytes;               /**< size of the buffer counted as used */
+};
+
+/**
+ * @brief one level of a pyramid as it is written a row at a time
+ */
+
+struct pyramidLevel
+{
+    image header;         /**< size and format of the level */
+    image pending;        /**< first row of a pair from the level above */
+    image made;           /**< row made from the last pair */
+    bool waiting;         /**< true when pending holds a row */
+    ofstream file;        /**< file the level is written to */
+    ostringstream held;   /**< the level when it waits for standard output */
+    ostream* out;         /**< where the level is written */
+    qoiEncoder qoi;       /**< encoder of a --qoi level */
+};
+
+/**
+ * @brief width and height of the tiles in a tiled image
+ */
+
+const int TILE_SIZE = 256;
+
+/**
+ * @brief where one tile of a tiled image is stored
+ */
+
+struct tileEntry
+{
+    long long offset;    /**< position of the tile in the file */
+    int bytes;           /**< size of the stored tile */
+    int method;          /**< TILE_QOI or TILE_RAW */
+};
+
+/**
+ * @brief one level of the pyramid in a tiled image
+ */
+
+struct tileLevel
+{
+    int rows;                   /**< number of rows in the level */
+    int cols;                   /**< number of columns in the level */
+    vector<tileEntry> tiles;    /**< tiles from left to right, top to bottom */
+};
+
+/**
+ * @brief the index of a tiled image
+ */
+
+struct tiledIndex
+{
+    int tileSize;                /**< width and height of the tiles */
+    vector<tileLevel> levels;    /**< level 0 is the full size image */
+};
+
+/**
+ * @brief color spaces an image can be converted to
+ */
+
+enum colorModel
+{
+    COLOR_YCBCR,    /**< luma and two color differences */
+    COLOR_HSV,      /**< hue, saturation and value */
+    COLOR_LAB       /**< CIE L*a*b* with a D65 white point */
+};
+
+/**
+ * @brief a color space and how its planes are written
+ */
+
+struct colorSpace
+{
+    colorModel model;    /**< color space of the planes */
+    bool bt709;          /**< BT.709 instead of BT.601 YCbCr */
+    bool subsample;      /**< 4:2:0 instead of 4:4:4 YCbCr */
+    bool raw;            /**< all planes in one file with no header */
+};
+
+/**
+ * @brief an image laid over another, such as a watermark
+ */
+
+struct overlay
+{
+    string file;     /**< name of the image laid on top */
+    int x;           /**< column of its left edge, may be negative */
+    int y;           /**< row of its top edge, may be negative */
+    int opacity;     /**< 0 to 100 percent */
+    bool tile;       /**< true to repeat it across and down the whole image */
+};
+
+/**
+ * @brief how --bits spreads the error of rounding a pixel to a level
+ */
+
+enum ditherMethod
+{
+    DITHER_NONE,        /**< every pixel goes to its nearest level */
+    DITHER_BAYER,       /**< ordered dithering with an 8x8 Bayer matrix */
+    DITHER_FLOYD,       /**< Floyd-Steinberg error diffusion */
+    DITHER_ATKINSON     /**< Atkinson error diffusion */
+};
+
+/**
+ * @brief the number of levels and dithering given to --bits
+ */
+
+struct quantizer
+{
+    int bits;               /**< 1 to 8 bits for each channel */
+    ditherMethod method;    /**< how the levels are picked */
+};
+
+/**
+ * @brief the perceptual hashes of an image, see hashImage
+ */
+
+struct imageHash
+{
+    unsigned long long average;       /**< 8x8 cells compared with their mean */
+    unsigned long long difference;    /**< 9x8 cells compared with their neighbour */
+    unsigned long long dct;           /**< 8x8 lowest frequencies compared with their median */
+};
+
+/**
+ * @brief an image found in a hash index
+ */
+
+struct hashMatch
+{
+    string name;     /**< name the image was added with */
+    int distance;    /**< number of bits its hash differs by */
+};
+
+/**
+ * @brief the spread of the bilateral filter given to --bilateral
+ */
+
+struct bilateral
+{
+    int spatial;    /**< distance in pixels, also the size of a grid cell */
+    int range;      /**< difference in levels, also the depth of a grid cell */
+};
+
+/**
+ * @brief how --preview reads a smaller image
+ */
+
+struct previewMode
+{
+    int step;    /**< every step-th row and column is kept, 0 for no preview */
+    bool box;    /**< true to average each step by step cell */
+};
+
+/**
+ * @brief one output of --fanout, the operations applied to the shared
+ * image and how the result is written
+ */
+
+struct rendition
+{
+    vector<operation> ops;    /**< operations applied from left to right */
+    lastOption last;          /**< option that must come last, LAST_NONE if none */
+    colorSpace space;         /**< color space given to --colorspace */
+    quantizer bits;           /**< levels given to --bits, 0 bits for none */
+    outputFormat outputType;  /**< how the result is written */
+    string name;              /**< basename of the output */
+};
+
+/**
+ * @brief everything given on the command line for one image, from how it
+ * is read to how the result is written
+ */
+
+struct job
+{
+    string inName;                           /**< image name, - for standard input */
+    string outName;                          /**< basename, - for standard output */
+    vector<operation> ops;                   /**< operations applied from left to right */
+    lastOption last = LAST_NONE;             /**< option that must come last */
+    colorSpace space;                        /**< color space given to --colorspace */
+    quantizer bits = { 0, DITHER_NONE };     /**< levels given to --bits */
+    previewMode view = { 0, false };         /**< step given to --preview, 0 for none */
+    outputFormat outputType = OUTPUT_SAME;   /**< how the result is written */
+    long long budget = 0;                    /**< bytes given to --max-memory, 0 for none */
+    string cacheDir;                         /**< directory given to --cache, empty for none */
+    long long cacheLimit = CACHE_LIMIT;      /**< size given to --cache-size */
+    string nearIndex;                        /**< index given to --skip-near, empty for none */
+    int nearDistance = PHASH_DISTANCE;       /**< bits given to --skip-near */
+};
+
+/**
+ * @brief what happened while a job ran, for the caller to report
+ */
+
+struct jobReport
+{
+    vector<plan> plans;         /**< ways of running weighed for --max-memory */
+    plan choice;                /**< way of running chosen, empty name if none */
+    bool cached = false;        /**< the result went through the cache */
+    bool hit = false;           /**< the result was copied from the cache */
+    long long hits = 0;         /**< hits counted by the cache */
+    long long misses = 0;       /**< misses counted by the cache */
+    hashMatch nearest;          /**< image it was skipped for, empty name if none */
+    bool indexed = false;       /**< the image was added to the --skip-near index */
+    string failed;              /**< file, cache or index that couldn't be used */
+};
+
+/**
+ * @brief instruction sets the pixel kernels are built for, from the
+ * oldest to the newest
+ */
+
+enum isaLevel
+{
+    ISA_SCALAR,     /**< no vector instructions */
+    ISA_SSE4,       /**< SSE4.2, 16 byte registers */
+    ISA_AVX2,       /**< AVX2, 32 byte registers */
+    ISA_AVX512      /**< AVX-512, 64 byte registers */
+};
+
+/**
+ * @brief the pixel kernels of one instruction set
+ */
+
+struct kernelTable
+{
+    isaLevel level;    /**< instruction set the kernels are built for */
+
+    /** splits red, green, blue ... into three planes */
+    void (*splitRgb)(const pixel* rgb, pixel* red, pixel* green, pixel* blue, int count);
+
+    /** joins three planes into red, green, blue ... */
+    void (*joinRgb)(const pixel* red, const pixel* green, const pixel* blue, pixel* rgb,
+        int count);
+
+    /** splits every step-th pixel of a row into three planes */
+    void (*sampleRgb)(const pixel* rgb, pixel* red, pixel* green, pixel* blue, int count,
+        int step);
+
+    /** adds a row to a row of sums */
+    void (*sumRow)(const pixel* row, unsigned* sums, int count);
+
+    /** puts the smaller of each pair in low and the larger in high */
+    void (*sortPairs)(pixel* low, pixel* high, int count);
+
+    /** adds one histogram to another and takes a third away */
+    void (*histogramStep)(unsigned short* hist, const unsigned short* add,
+        const unsigned short* sub, int count);
+
+    /** applies sepia to a row */
+    void (*sepiaRow)(pixel* red, pixel* green, pixel* blue, int count);
+
+    /** finds the gray values of a row */
+    void (*grayRow)(const pixel* red, const pixel* green, const pixel* blue, pixel* gray,
+        int count);
+
+    /** transposes a block of a plane, used by the quarter turns */
+    void (*transpose)(const pixel* src, long long srcStep, pixel* dst, long long dstStep,
+        int rows, int cols);
+};
+
+/**
+ * @brief the kernels of each instruction set, in the order of isaLevel
+ */
+
+extern const kernelTable kernelVariants[4];
+
+
+/**
+ * @brief 1 to build the trace markers into the program, 0 to leave them
+ * out so they cost nothing
+ */
+
+#ifndef IMAGE_TRACE
+#define IMAGE_TRACE 1
+#endif
+
+/**
+ * @brief most events kept for each thread, older events are overwritten
+ */
+
+const int TRACE_EVENTS = 1 << 16;
+
+/**
+ * @brief times the block of code it is declared in for --trace
+ */
+
+class traceScope
+{
+public:
+    traceScope(const char* name);
+    ~traceScope();
+
+private:
+    const char* name;    /**< name of the block */
+    long long start;     /**< start time, -1 when tracing is off */
 };
 
+#if IMAGE_TRACE
+/**
+ * @brief marks the rest of the enclosing block as an event named name
+ */
+#define TRACE_SCOPE(name) traceScope traceMarker(name)
+#else
+#define TRACE_SCOPE(name)
+#endif
+
+/**
+ * @brief limits an integer to the range of a pixel
+ */
+
+constexpr pixel clampPixel(int value)
+{
+    return pixel(value < 0 ? 0 : (value > 255 ? 255 : value));
+}
+
+/**
+ * @brief builds the table that leaves every pixel unchanged
+ */
+
+constexpr lookupTable makeIdentityTable()
+{
+    lookupTable table = {};
+    int i = 0;
+
+    for (i = 0; i < 256; i++)
+    {
+        table.value[i] = pixel(i);
+    }
+    return table;
+}
+
 /**
- * @brief a string that contains constant maxpixel value
+ * @brief builds the table that produces the negative of a pixel
  */
 
-static string maxpix = "255";
+constexpr lookupTable makeInvertTable()
+{
+    lookupTable table = {};
+    int i = 0;
+
+    for (i = 0; i < 256; i++)
+    {
+        table.value[i] = pixel(255 - i);
+    }
+    return table;
+}
 
-void fileopeninput(ifstream& fin, string name);
+/**
+ * @brief lookup table that leaves every pixel unchanged, built at compile time
+ */
 
-void fileopenoutput(ofstream& fout, string name);
+constexpr lookupTable identityLut = makeIdentityTable();
+
+/**
+ * @brief lookup table for --invert, built at compile time
+ */
+
+constexpr lookupTable invertLut = makeInvertTable();
+
+bool fileopeninput(ifstream& fin, string name);
+
+bool fileopenoutput(ofstream& fout, string name);
 
 void filecloseinput(ifstream& file);
 
 void filecloseoutput(ofstream& file);
 
-bool readImage(ifstream& fin, image& img);
+istream* openInput(string name, ifstream& fin);
+
+ostream* openOutput(string name, string extension, ofstream& fout);
+
+string spoolName(string target);
+
+imageError readHeader(istream& fin, image& img);
+
+int binaryBandRows(int rows, int cols);
+
+imageError readImage(istream& fin, image& img);
+
+imageError readImageRegion(istream& fin, image& img, region roi);
+
+imageError writeImage(ostream& fout, image& img);
+
+imageError peekHeader(istream& fin, image& img);
+
+void readRow(istream& fin, image& img, string magicNumber, pixel* buffer);
+
+void writeHeader(ostream& fout, image& img);
+
+void writePixels(ostream& fout, image& img);
+
+imageError writeBitmap(ostream& fout, image& img);
+
+long long bitmapBufferBytes(int cols);
+
+imageError writeLevelRows(pyramidLevel& level, image& rows, outputFormat outputType);
+
+void copyRow(image& from, image& to);
 
-void writeImage(ofstream& fout, image& img);
+void halveRows(image& top, image& bottom, image& half);
+
+imageError cascadeRow(vector<pyramidLevel>& levels, int k, image& row,
+    outputFormat outputType);
+
+imageError writePyramid(image& img, string name, outputFormat outputType);
+
+long long pyramidBytes(int rows, int cols, int planes, outputFormat outputType);
 
 void alloc (pixel **& storage, int rows, int cols);
 
 void free2d (pixel **& ptr, int rows);
 
-void grayScale(ofstream& fout, image& img, string outputType);
+bool allocImage(image& img, int rows, int cols);
+
+bool allocAlpha(image& img);
+
+void freeImage(image& img);
+
+bool copyImage(image& from, image& to);
+
+void countAlloc(long long bytes);
+
+void countFree(long long bytes);
+
+long long peakMemory();
+
+long long planeBytes(int rows, int cols);
+
+imageError grayScale(ostream& fout, image& img, outputFormat outputType);
+
+void grayPlane(image& img);
+
+imageError writeGray(ostream& fout, image& img, outputFormat outputType);
+
+void flipX(image& img, outputFormat outputType);
+
+void flipY(image& img, outputFormat outputType);
 
-void flipX(image& img, string outputType);
+imageError rotateCW(image& img, outputFormat outputType);
 
-void flipY(image& img, string outputType);
+imageError rotateCCW(image& img, outputFormat outputType);
 
-void rotateCW(image& img, string outputType);
+void rotateSquare(pixel** plane, int n, bool clockwise);
 
-void rotateCCW(image& img, string outputType);
+void transposePlane(pixel* data, int rows, int cols, vector<bool>& moved);
 
-void sepia(image& img, string outputType);
+imageError rotateInPlace(image& img, bool clockwise, outputFormat outputType);
+
+void sepia(image& img, outputFormat outputType);
 
 double crop(double value);
 
-void outputgray(ofstream& fout, string name);
+imageError cropImage(image& img, region roi, outputFormat outputType);
+
+bool parseRotation(string param, rotation& rot);
+
+void rotatedSize(int rows, int cols, rotation rot, int& newRows, int& newCols);
+
+imageError rotateImage(image& img, rotation rot, outputFormat outputType);
+
+void halveRow(const pixel* top, const pixel* bottom, pixel* half, int cols);
+
+imageError halveImage(image& img, image& half);
+
+bool parseOverlay(string param, overlay& ov);
+
+void blendRow(pixel* dst, const unsigned short* pre, const pixel* alpha, int count);
+
+imageError prepareOverlay(image& mark, int opacity, vector<unsigned short>& pre,
+    vector<pixel>& blocks);
+
+imageError overlayImage(image& img, overlay ov, outputFormat outputType);
+
+long long overlayBytes(string param);
+
+bool parseQuantizer(string param, quantizer& q);
+
+void orderedDither(image& img, int count, int top, bool ordered);
+
+imageError diffuseDither(image& img, int count, int top, ditherMethod method);
+
+imageError quantizeImage(image& img, int count, quantizer q);
+
+long long quantizeBytes(int rows, int cols, int count, quantizer q);
+
+bool parseBilateral(string param, bilateral& filter);
+
+imageError medianImage(image& img, int radius);
+
+long long medianBytes(int rows, int cols, int radius);
+
+imageError bilateralImage(image& img, bilateral filter);
+
+long long bilateralBytes(int rows, int cols, bilateral filter);
+
+bool parsePreview(string param, previewMode& view);
+
+imageError shrinkImage(image& img, previewMode view);
+
+imageError readPreview(istream& fin, image& img, previewMode view);
+
+void hashImage(image& img, imageHash& hash);
+
+int hashDistance(unsigned long long a, unsigned long long b);
+
+bool parseNearIndex(string param, string& file, int& distance);
+
+bool findNear(string file, unsigned long long hash, int distance,
+    vector<hashMatch>& matches);
+
+bool addToIndex(string file, unsigned long long hash, string name);
+
+imageError hashImageFile(string name, imageHash& hash);
+
+isaLevel detectIsa();
+
+bool parseIsa(string name, isaLevel& level);
+
+string isaName(isaLevel level);
+
+bool bindKernels(isaLevel level);
+
+isaLevel boundIsa();
+
+const kernelTable& kernels();
+
+bool outputgray(ofstream& fout, string name);
+
+bool openOutputFile(string name, string extension, ofstream& fout);
+
+imageError readQoi(istream& fin, image& img);
+
+void startQoi(qoiEncoder& enc, image& header);
+
+void encodeQoiRows(ostream& fout, qoiEncoder& enc, image& img);
+
+imageError finishQoi(ostream& fout, qoiEncoder& enc);
+
+imageError writeQoi(ostream& fout, image& img);
+
+long long qoiBufferBytes(int cols);
+
+bool isPam(istream& fin);
+
+imageError readPamHeader(istream& fin, image& img, int& depth);
+
+imageError readPam(istream& fin, image& img);
+
+void writePamHeader(ostream& fout, image& img, bool gray);
+
+imageError writePamPixels(ostream& fout, image& img, bool gray);
+
+imageError writePam(ostream& fout, image& img, bool gray);
+
+void putNumber(string& data, unsigned long long value, int bytes);
+
+unsigned long long getNumber(const unsigned char* data, int bytes);
+
+void writeTiledHeader(ostream& fout, int rows, int cols, int levels);
+
+void writeTileRow(ostream& fout, image& img, int top, string& index, long long& offset);
+
+imageError writeTiled(ostream& fout, image& img);
+
+imageError spoolTiled(istream& fin, ostream& fout, image& header);
+
+imageError readTiledIndex(istream& fin, tiledIndex& index);
+
+imageError readTiled(istream& fin, image& img, region roi, int level);
+
+long long tiledBufferBytes(int cols);
+
+bool parseSize(string text, long long& bytes);
+
+bool markInPlace(vector<operation>& ops);
+
+long long estimateInMemory(image& header, vector<operation>& ops, lastOption last,
+    outputFormat outputType, long long fileSize);
+
+bool canStream(image& header, vector<operation>& ops, lastOption last,
+    outputFormat outputType);
+
+bool canTile(image& header, vector<operation>& ops, lastOption last,
+    outputFormat outputType);
+
+long long estimateTiled(image& header, vector<operation>& ops, outputFormat outputType);
+
+vector<plan> makePlans(image& header, vector<operation>& ops, lastOption last,
+    outputFormat outputType, long long fileSize);
+
+bool choosePlan(vector<plan>& plans, long long budget, plan& choice);
+
+void brightnessTable(lookupTable& table, int amount);
+
+void contrastTable(lookupTable& table, int amount);
+
+void gammaTable(lookupTable& table, double gamma);
+
+void thresholdTable(lookupTable& table, int level);
+
+void posterizeTable(lookupTable& table, int levels);
+
+void composeTable(lookupTable& first, const lookupTable& second);
+
+bool buildTable(lookupTable& table, string name, string param);
+
+void applyTable(image& img, const lookupTable& table, outputFormat outputType);
+
+int threadCount(long long bytes);
+
+void runParallel(int count, const function<void(int)>& task);
+
+bool readRest(istream& fin, vector<char>& text);
+
+imageError readAscii(istream& fin, image& img);
+
+imageError sampleAscii(istream& fin, image& img, int rows, int cols, int step);
+
+void writeAscii(ostream& fout, image& img, int channels);
+
+bool canWriteDirect(string name);
+
+long long directBufferBytes(int rows, int cols);
+
+imageError writeDirect(string name, image& img, int channels);
+
+long long asciiBufferBytes(int rows, int cols, int channels);
+
+imageError compareImages(image& a, image& b, comparison& result);
+
+imageError compareFiles(string first, string second, comparison& result);
+
+bool withinLimits(comparison& result, compareLimits& limits);
+
+unsigned long long hashBytes(const void* data, size_t size, unsigned long long seed);
+
+bool hashFile(string name, unsigned long long& hash);
+
+string cacheKey(unsigned long long hash, vector<operation>& ops, lastOption last,
+    outputFormat outputType);
+
+int processId();
+
+bool fileStatus(string name, long long& bytes, time_t& changed);
+
+void listDirectory(string dir, vector<string>& names);
+
+bool lockCache(resultCache& cache);
+
+void unlockCache(resultCache& cache);
+
+void trimCache(resultCache& cache);
+
+void findUnlisted(resultCache& cache);
+
+bool openCache(resultCache& cache, string dir, long long limit);
+
+bool saveCache(resultCache& cache);
+
+cacheEntry* findEntry(resultCache& cache, string key);
+
+string entryFile(resultCache& cache, cacheEntry& entry);
+
+void addEntry(resultCache& cache, string key, string extension, long long bytes);
+
+bool copyFile(string from, ostream& out, string to);
+
+bool hashInputs(string inName, vector<operation>& ops, unsigned long long& hash);
+
+imageError copyFromCache(resultCache& cache, cacheEntry& entry, string outName);
+
+imageError storeInCache(resultCache& cache, string key, string target, string extension,
+    string outName);
+
+bool parseColorSpace(string param, colorSpace& space);
+
+void convertColor(image& img, colorSpace space);
+
+imageError writeColorPlanes(image& img, colorSpace space, string name,
+    outputFormat outputType);
+
+void startTrace(string file);
+
+bool writeTrace(ostream& fout);
+
+bool finishTrace();
+
+const char* errorMessage(imageError error);
+
+bool parseRegion(string param, region& roi);
+
+bool parseInteger(string text, int& value);
+
+bool validParam(operation op);
+
+bool parseOutputType(string name, outputFormat& outputType);
+
+bool parseLastOption(string name, lastOption& last);
+
+bool fitsOutput(lastOption last, quantizer bits, outputFormat outputType);
+
+imageError runOperations(image& img, vector<operation>& ops, outputFormat outputType);
+
+imageError streamImage(istream& fin, ostream& fout, vector<operation>& ops,
+    outputFormat outputType);
+
+region sourceRegion(vector<operation>& ops, int rows, int cols, region roi);
+
+imageError tileImage(istream& fin, ostream& fout, vector<operation>& ops,
+    outputFormat outputType, string spool);
+
+imageError writeResult(image& img, lastOption last, colorSpace space, quantizer bits,
+    outputFormat outputType, string name, string& extension);
+
+imageError runRendition(image& source, rendition& target);
+
+bool sameOutput(rendition& first, rendition& second);
+
+imageError runFanout(string inName, vector<rendition>& targets, vector<imageError>& results);
+
+imageError runJob(job& work, istream& fin, jobReport& report);
 
 
 #endif
\ No newline at end of file
@@ -0,0 +1,454 @@
+/** ***************************************************************************
+ * @file
+ * @brief Contains the functions that lay a smaller image with alpha, such
+ * as a watermark, over the image
+ *
+ * The overlay is prepared once: its alpha is scaled by the opacity and
+ * each color is multiplied by its alpha, so blending a pixel is one
+ * multiply, one add and an exact rounded division by 255 done with shifts.
+ * The loops work on whole rows of 8 and 16 bit values so the compiler
+ * turns them into vector instructions.  The overlay is also split into
+ * blocks, and blocks that are fully transparent are skipped while blocks
+ * that are fully opaque are copied.
+ *****************************************************************************/
+
+
+#include "netPBM.h"
+
+
+/**
+ * @brief width and height of the blocks of the overlay that are checked
+ * for being fully transparent or fully opaque
+ */
+
+const int OVERLAY_BLOCK = 64;
+
+/**
+ * @brief flag of a block of the overlay with an alpha above 0, a block
+ * without it is skipped
+ */
+
+const pixel BLOCK_VISIBLE = 1;
+
+/**
+ * @brief flag of a block of the overlay with an alpha below 255, a block
+ * without it is copied instead of blended
+ */
+
+const pixel BLOCK_CLEAR = 2;
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * reads an overlay written as FILE X,Y[,opacity][,tile].  X and Y are the
+ * column and row of the top left corner of the overlay and may be
+ * negative.  opacity is 0 to 100 percent and is 100 if not given.  tile
+ * repeats the overlay across and down the whole image, lined up with
+ * X,Y.  FILE and the placement are separated by the last space.
+ *
+ * @param[in]     param - file name and placement given after --overlay.
+ * @param[out]    ov - the overlay.
+ *
+ * @returns true if param is a valid overlay and false otherwise.
+ *
+ * @par Example
+ * @verbatim
+   overlay ov;
+   parseOverlay("logo.pam 20,20", ov);          // opaque logo at (20, 20)
+   parseOverlay("mark.pam 0,0,30,tile", ov);   // faint mark over everything
+   parseOverlay("mark.pam 0,0,150", ov);       // returns false
+   @endverbatim
+ *****************************************************************************/
+
+bool parseOverlay(string param, overlay& ov)
+{
+    size_t space = param.rfind(' ');
+    size_t start;
+    size_t end;
+    string placement;
+    string word;
+    int value;
+    char extra;
+
+    if (space == string::npos || space == 0)
+    {
+        return false;
+    }
+
+    ov.file = param.substr(0, space);
+    placement = param.substr(space + 1);
+    ov.opacity = 100;
+    ov.tile = false;
+
+    if (sscanf(placement.c_str(), "%d,%d", &ov.x, &ov.y) != 2)
+    {
+        return false;
+    }
+
+    // skip the two numbers already read
+    start = placement.find(',') + 1;
+    start = placement.find(',', start);
+
+    while (start != string::npos)
+    {
+        start++;
+        end = placement.find(',', start);
+        word = placement.substr(start, end == string::npos ? string::npos : end - start);
+        start = end;
+
+        if (word == "tile")
+        {
+            ov.tile = true;
+        }
+        else if (sscanf(word.c_str(), "%d%c", &value, &extra) == 1 && value >= 0
+            && value <= 100)
+        {
+            ov.opacity = value;
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * blends count values of one plane with a row of the overlay.  Each value
+ * becomes (pre + dst * (255 - alpha)) / 255 rounded to the nearest
+ * integer, which is exact for every input.
+ *
+ * @param[in,out]     dst - values of the image.
+ * @param[in]         pre - overlay values already multiplied by alpha.
+ * @param[in]         alpha - alpha of the overlay.
+ * @param[in]         count - number of values.
+ *
+ * @par Example
+ * @verbatim
+   blendRow(img.redGray[i] + left, pre + m, alpha + m, n);
+   @endverbatim
+ *****************************************************************************/
+
+void blendRow(pixel* dst, const unsigned short* pre, const pixel* alpha, int count)
+{
+    int j;
+    int value;
+
+    for (j = 0; j < count; j++)
+    {
+        value = pre[j] + dst[j] * (255 - alpha[j]) + 128;
+        dst[j] = pixel((value + (value >> 8)) >> 8);
+    }
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * scales the alpha of the overlay by the opacity, multiplies the colors
+ * by the alpha and flags each block with BLOCK_VISIBLE and BLOCK_CLEAR.  The
+ * overlay gets an alpha plane if it had none.
+ *
+ * @param[in,out]     mark - the overlay image.
+ * @param[in]         opacity - 0 to 100 percent.
+ * @param[out]        pre - red, green, blue and alpha planes of the
+ *                          overlay, each multiplied by alpha.
+ * @param[out]        blocks - flags of each block, left to right and top to
+ *                             bottom.
+ *
+ * @returns IMAGE_OK or IMAGE_NO_MEMORY.
+ *
+ * @par Example
+ * @verbatim
+   vector<unsigned short> pre;
+   vector<pixel> blocks;
+   prepareOverlay(mark, 50, pre, blocks);
+   @endverbatim
+ *****************************************************************************/
+
+imageError prepareOverlay(image& mark, int opacity, vector<unsigned short>& pre,
+    vector<pixel>& blocks)
+{
+    int i;
+    int j;
+    int c;
+    int value;
+    int low;
+    int high;
+    int scale = (opacity * 255 + 50) / 100;
+    int across = (mark.cols + OVERLAY_BLOCK - 1) / OVERLAY_BLOCK;
+    int down = (mark.rows + OVERLAY_BLOCK - 1) / OVERLAY_BLOCK;
+    size_t size = size_t(mark.rows) * mark.cols;
+    size_t k;
+
+    pixel* red;
+    pixel* green;
+    pixel* blue;
+    pixel* alpha;
+    unsigned short* preRed;
+    unsigned short* preGreen;
+    unsigned short* preBlue;
+    unsigned short* preAlpha;
+
+    if (mark.alpha == nullptr)
+    {
+        if (!allocAlpha(mark))
+        {
+            return IMAGE_NO_MEMORY;
+        }
+        memset(mark.alpha[0], 255, size);
+    }
+
+    try
+    {
+        pre.resize(4 * size);
+        blocks.assign(size_t(across) * down, 0);
+    }
+    catch (const bad_alloc&)
+    {
+        return IMAGE_NO_MEMORY;
+    }
+    countAlloc((long long) (4 * size * sizeof(unsigned short) + blocks.size()));
+
+    red = mark.redGray[0];
+    green = mark.green[0];
+    blue = mark.blue[0];
+    alpha = mark.alpha[0];
+    preRed = pre.data();
+    preGreen = preRed + size;
+    preBlue = preGreen + size;
+    preAlpha = preBlue + size;
+
+    for (k = 0; k < size; k++)
+    {
+        value = alpha[k] * scale + 128;
+        alpha[k] = pixel((value + (value >> 8)) >> 8);
+
+        preRed[k] = (unsigned short) (red[k] * alpha[k]);
+        preGreen[k] = (unsigned short) (green[k] * alpha[k]);
+        preBlue[k] = (unsigned short) (blue[k] * alpha[k]);
+        preAlpha[k] = (unsigned short) (255 * alpha[k]);
+    }
+
+    for (i = 0; i < mark.rows; i++)
+    {
+        for (c = 0; c < mark.cols; c += OVERLAY_BLOCK)
+        {
+            low = 255;
+            high = 0;
+
+            for (j = c; j < min(mark.cols, c + OVERLAY_BLOCK); j++)
+            {
+                low = min(low, int(mark.alpha[i][j]));
+                high = max(high, int(mark.alpha[i][j]));
+            }
+
+            blocks[size_t(i / OVERLAY_BLOCK) * across + c / OVERLAY_BLOCK] |=
+                (high > 0 ? BLOCK_VISIBLE : 0) | (low < 255 ? BLOCK_CLEAR : 0);
+        }
+    }
+
+    return IMAGE_OK;
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * lays the image in ov.file over img at ov.x, ov.y, or over all of img
+ * when ov.tile is set.  The overlay may have alpha, and an overlay without
+ * alpha is opaque.  The colors of img are blended as if img were opaque,
+ * and when img has alpha the overlay is added to it.  The rows of img are
+ * split between threads.
+ *
+ * @param[in,out]     img - structure containing data of a ppm image.
+ * @param[in]         ov - the overlay, see parseOverlay.
+ * @param[in]         outputType - aschii or binary format type.
+ *
+ * @returns IMAGE_OK, or the reason the overlay could not be read or
+ *          prepared.
+ *
+ * @par Example
+ * @verbatim
+   overlay ov;
+   parseOverlay("logo.pam 20,20,80", ov);
+   overlayImage(img, ov, OUTPUT_BINARY); // logo at 80% in the top left corner
+   @endverbatim
+ *****************************************************************************/
+
+imageError overlayImage(image& img, overlay ov, outputFormat outputType)
+{
+    TRACE_SCOPE("overlayImage");
+
+    int top;
+    int bottom;
+    int first;
+    int band;
+    int threads;
+    int across;
+    size_t size;
+    imageError result;
+
+    ifstream fin;
+    image mark;
+    vector<unsigned short> pre;
+    vector<pixel> blocks;
+
+    if (!fileopeninput(fin, ov.file))
+    {
+        return IMAGE_OPEN_FAILED;
+    }
+
+    result = readImage(fin, mark);
+    filecloseinput(fin);
+
+    if (result == IMAGE_OK)
+    {
+        result = prepareOverlay(mark, ov.opacity, pre, blocks);
+    }
+
+    if (result != IMAGE_OK)
+    {
+        freeImage(mark);
+        return result;
+    }
+
+    top = ov.tile ? 0 : max(0, ov.y);
+    bottom = ov.tile ? img.rows : min(img.rows, ov.y + mark.rows);
+    across = (mark.cols + OVERLAY_BLOCK - 1) / OVERLAY_BLOCK;
+    size = size_t(mark.rows) * mark.cols;
+
+    // left edge of the first copy that reaches into img
+    first = ov.x;
+
+    if (ov.tile)
+    {
+        first = ov.x % mark.cols;
+        first = first > 0 ? first - mark.cols : first;
+    }
+
+    threads = threadCount(3LL * max(0, bottom - top) * min(img.cols, ov.tile ? img.cols : mark.cols));
+    band = (max(0, bottom - top) + threads - 1) / threads;
+
+    runParallel(threads, [&](int t)
+    {
+        int i;
+        int r;
+        int c;
+        int n;
+        int m;
+        int k;
+        int left;
+        int right;
+        int start;
+        pixel kind;
+        pixel** planes[4] = { img.redGray, img.green, img.blue, img.alpha };
+        pixel** marks[4] = { mark.redGray, mark.green, mark.blue, mark.alpha };
+
+        for (i = top + t * band; i < min(bottom, top + (t + 1) * band); i++)
+        {
+            r = ((i - ov.y) % mark.rows + mark.rows) % mark.rows;
+
+            for (start = first; start < img.cols; start += mark.cols)
+            {
+                for (c = 0; c < mark.cols; c += OVERLAY_BLOCK)
+                {
+                    left = max(0, start + c);
+                    right = min(img.cols, start + min(mark.cols, c + OVERLAY_BLOCK));
+                    kind = blocks[size_t(r / OVERLAY_BLOCK) * across + c / OVERLAY_BLOCK];
+
+                    if (left >= right || !(kind & BLOCK_VISIBLE))
+                    {
+                        continue;
+                    }
+
+                    n = right - left;
+                    m = left - start;
+
+                    for (k = 0; k < 4 && planes[k] != nullptr; k++)
+                    {
+                        if (!(kind & BLOCK_CLEAR))
+                        {
+                            memcpy(planes[k][i] + left, marks[k][r] + m, n);
+                        }
+                        else
+                        {
+                            blendRow(planes[k][i] + left, &pre[k * size + size_t(r) * mark.cols + m],
+                                marks[3][r] + m, n);
+                        }
+                    }
+                }
+
+                if (!ov.tile)
+                {
+                    break;
+                }
+            }
+        }
+    });
+
+    countFree((long long) (4 * size * sizeof(unsigned short) + blocks.size()));
+    img.gray = img.gray && mark.gray;
+    freeImage(mark);
+
+    if (outputType == OUTPUT_ASCII)
+    {
+        img.magicNumber = "P3";
+    }
+
+    else if (outputType == OUTPUT_BINARY)
+    {
+        img.magicNumber = "P6";
+    }
+
+    return IMAGE_OK;
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * estimates the memory overlayImage needs beyond the image itself, from
+ * the size of the overlay.  The size of the overlay file is included for
+ * the buffer it may be read through.
+ *
+ * @param[in]     param - parameter given after --overlay.
+ *
+ * @returns estimated bytes, or 0 if the overlay can't be read.
+ *
+ * @par Example
+ * @verbatim
+   overlayBytes("logo.pam 20,20"); // about 12 bytes for each logo pixel
+                                   // plus the file
+   @endverbatim
+ *****************************************************************************/
+
+long long overlayBytes(string param)
+{
+    overlay ov;
+    image header;
+    ifstream fin;
+    long long fileSize;
+
+    if (!parseOverlay(param, ov) || !fileopeninput(fin, ov.file)
+        || peekHeader(fin, header) != IMAGE_OK)
+    {
+        return 0;
+    }
+
+    fin.seekg(0, ios::end);
+    fileSize = fin.tellg();
+
+    return 4 * planeBytes(header.rows, header.cols)
+        + 8LL * header.rows * header.cols + fileSize;
+}
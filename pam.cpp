@@ -0,0 +1,395 @@
+/** ***************************************************************************
+ * @file
+ * @brief Contains functions to read and write images in the PAM format
+ *
+ * PAM (magic number P7) is the netpbm format for images with any number
+ * of channels.  The header is a list of lines such as "WIDTH 640" ending
+ * with "ENDHDR", followed by the channels of each pixel one byte apiece.
+ * Images with a DEPTH of 1 or 3 are gray or color, and a DEPTH of 2 or 4
+ * adds an alpha channel, which is kept in the alpha plane of the image.
+ *****************************************************************************/
+
+
+#include "netPBM.h"
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * checks if fin holds a PAM image by looking at its first two bytes.  fin
+ * is left where it was.
+ *
+ * @param[in,out]     fin - stream opened for input.
+ *
+ * @returns true if the image starts with P7 and false otherwise.
+ *
+ * @par Example
+ * @verbatim
+   if (isPam(fin))
+   {
+       readPam(fin, img);
+   }
+   @endverbatim
+ *****************************************************************************/
+
+bool isPam(istream& fin)
+{
+    bool pam;
+
+    if (fin.peek() != 'P')
+    {
+        return false;
+    }
+
+    fin.get();
+    pam = fin.peek() == '7';
+    fin.unget();
+
+    return pam;
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * reads the header of a PAM image and leaves fin at the first byte of
+ * pixel data.  The TUPLTYPE line is only a name, the layout of a pixel is
+ * decided by DEPTH: 1 is gray, 2 gray and alpha, 3 red, green and blue and
+ * 4 red, green, blue and alpha.
+ *
+ * @param[in,out]     fin - stream opened for input containing a PAM image.
+ * @param[in,out]     img - structure that receives the header of the image.
+ * @param[out]        depth - number of channels of each pixel.
+ *
+ * @returns IMAGE_OK or IMAGE_BAD_FORMAT if fin does not hold a PAM image
+ *          that can be read.
+ *
+ * @par Example
+ * @verbatim
+   image img;
+   int depth;
+   readPamHeader(fin, img, depth); // depth is 4 for an RGB_ALPHA image
+   @endverbatim
+ *****************************************************************************/
+
+imageError readPamHeader(istream& fin, image& img, int& depth)
+{
+    string line;
+    string key;
+    bool ended = false;
+
+    getline(fin, line);
+
+    if (line != "P7")
+    {
+        return IMAGE_BAD_FORMAT;
+    }
+
+    img.magicNumber = "P7";
+    img.comment = "";
+    img.cols = 0;
+    img.rows = 0;
+    img.maxval = 0;
+    depth = 0;
+
+    while (!ended && getline(fin, line))
+    {
+        istringstream words(line);
+
+        if (!line.empty() && line[0] == '#')
+        {
+            img.comment = img.comment + line + "\n";
+            continue;
+        }
+
+        key = "";
+        words >> key;
+
+        if (key == "WIDTH")
+        {
+            words >> img.cols;
+        }
+        else if (key == "HEIGHT")
+        {
+            words >> img.rows;
+        }
+        else if (key == "DEPTH")
+        {
+            words >> depth;
+        }
+        else if (key == "MAXVAL")
+        {
+            words >> img.maxval;
+        }
+        else if (key == "ENDHDR")
+        {
+            ended = true;
+        }
+    }
+
+    if (!ended || img.cols <= 0 || img.rows <= 0 || depth < 1 || depth > 4
+        || img.maxval <= 0 || img.maxval > 255)
+    {
+        return IMAGE_BAD_FORMAT;
+    }
+
+    return IMAGE_OK;
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * reads a PAM image from fin and stores it in structure image.  Gray
+ * images are stored with equal red, green and blue, and images with alpha
+ * get an alpha plane.
+ *
+ * @param[in,out]     fin - stream opened for input containing a PAM image.
+ * @param[in,out]     img - a struture that contains data for ppm image.
+ *
+ * @returns IMAGE_OK if the image was read, otherwise the reason it
+ *          wasn't.  img holds no memory when the read fails.
+ *
+ * @par Example
+ * @verbatim
+   image img;
+   ifstream fin;
+   readPam(fin, img); // reads the PAM image in fin into img
+   @endverbatim
+ *****************************************************************************/
+
+imageError readPam(istream& fin, image& img)
+{
+    TRACE_SCOPE("readPam");
+
+    int i;
+    int j;
+    int depth;
+    long long size;
+    imageError result;
+
+    pixel* row;
+
+    result = readPamHeader(fin, img, depth);
+
+    if (result != IMAGE_OK)
+    {
+        return result;
+    }
+
+    if (!allocImage(img, img.rows, img.cols))
+    {
+        return IMAGE_NO_MEMORY;
+    }
+
+    // a gray image stays gray when written back as a PAM image
+    img.gray = depth <= 2;
+
+    if ((depth == 2 || depth == 4) && !allocAlpha(img))
+    {
+        freeImage(img);
+        return IMAGE_NO_MEMORY;
+    }
+
+    size = (long long) depth * img.cols;
+    row = new(nothrow) pixel[size_t(size)];
+
+    if (row == nullptr)
+    {
+        freeImage(img);
+        return IMAGE_NO_MEMORY;
+    }
+    countAlloc(size);
+
+    for (i = 0; i < img.rows; i++)
+    {
+        fin.read((char*) row, size);
+
+        if (fin.gcount() < size)
+        {
+            delete[] row;
+            countFree(size);
+            freeImage(img);
+            return IMAGE_READ_FAILED;
+        }
+
+        for (j = 0; j < img.cols; j++)
+        {
+            if (depth <= 2)
+            {
+                img.redGray[i][j] = row[j * depth];
+                img.green[i][j] = row[j * depth];
+                img.blue[i][j] = row[j * depth];
+            }
+            else
+            {
+                img.redGray[i][j] = row[j * depth];
+                img.green[i][j] = row[j * depth + 1];
+                img.blue[i][j] = row[j * depth + 2];
+            }
+
+            if (img.alpha != nullptr)
+            {
+                img.alpha[i][j] = row[j * depth + depth - 1];
+            }
+        }
+    }
+
+    delete[] row;
+    countFree(size);
+
+    return IMAGE_OK;
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * writes the header of a PAM image.  The image is written as RGB, or as
+ * RGB_ALPHA when it has an alpha plane.  A gray image is written as
+ * GRAYSCALE or GRAYSCALE_ALPHA, or BLACKANDWHITE when its maxval is 1.
+ *
+ * @param[in,out]     fout - stream opened for output.
+ * @param[in]         img - size, maxval and comment of the image and
+ *                          whether it has alpha.
+ * @param[in]         gray - true to write only the gray values.
+ *
+ * @par Example
+ * @verbatim
+   writePamHeader(fout, img, false); // P7, WIDTH ... ENDHDR
+   @endverbatim
+ *****************************************************************************/
+
+void writePamHeader(ostream& fout, image& img, bool gray)
+{
+    int depth = (gray ? 1 : 3) + (img.alpha != nullptr ? 1 : 0);
+
+    const char* tuple[5] = { "", "GRAYSCALE", "GRAYSCALE_ALPHA", "RGB", "RGB_ALPHA" };
+    const char* bitmap[3] = { "", "BLACKANDWHITE", "BLACKANDWHITE_ALPHA" };
+
+    fout << "P7\n";
+    fout << img.comment;
+    fout << "WIDTH " << img.cols << "\n";
+    fout << "HEIGHT " << img.rows << "\n";
+    fout << "DEPTH " << depth << "\n";
+    fout << "MAXVAL " << img.maxval << "\n";
+    fout << "TUPLTYPE " << (gray && img.maxval == 1 ? bitmap[depth] : tuple[depth]) << "\n";
+    fout << "ENDHDR\n";
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * writes the pixels of img as the rows of a PAM image without a header.
+ * Each row is put together in a buffer of one row of tuples.
+ *
+ * @param[in,out]     fout - stream opened for output.
+ * @param[in]         img - structure conatining data about ppm image.
+ * @param[in]         gray - true to write only the gray values in redGray.
+ *
+ * @returns IMAGE_OK or IMAGE_NO_MEMORY.
+ *
+ * @par Example
+ * @verbatim
+   writePamPixels(fout, img, false); // the tuples of every row of img
+   @endverbatim
+ *****************************************************************************/
+
+imageError writePamPixels(ostream& fout, image& img, bool gray)
+{
+    int i;
+    int j;
+    int k;
+    int depth = (gray ? 1 : 3) + (img.alpha != nullptr ? 1 : 0);
+    long long size = (long long) depth * img.cols;
+
+    pixel* row;
+
+    row = new(nothrow) pixel[size_t(size)];
+
+    if (row == nullptr)
+    {
+        return IMAGE_NO_MEMORY;
+    }
+    countAlloc(size);
+
+    for (i = 0; i < img.rows; i++)
+    {
+        k = 0;
+
+        for (j = 0; j < img.cols; j++)
+        {
+            row[k++] = img.redGray[i][j];
+
+            if (!gray)
+            {
+                row[k++] = img.green[i][j];
+                row[k++] = img.blue[i][j];
+            }
+
+            if (img.alpha != nullptr)
+            {
+                row[k++] = img.alpha[i][j];
+            }
+        }
+
+        fout.write((char*) row, size);
+    }
+
+    delete[] row;
+    countFree(size);
+
+    return IMAGE_OK;
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * writes the structure image to fout as a PAM image.  The image is written
+ * as RGB, or as RGB_ALPHA when it has an alpha plane.  A gray image uses
+ * the red plane for its gray values and is written as GRAYSCALE or
+ * GRAYSCALE_ALPHA, or BLACKANDWHITE when its maxval is 1.
+ *
+ * @param[in,out]     fout - stream opened for output.
+ * @param[in,out]     img - structure conatining data about ppm image, it is
+ *                          freed after it is written.
+ * @param[in]         gray - true to write only the gray values in redGray.
+ *
+ * @returns IMAGE_OK, IMAGE_NO_MEMORY or IMAGE_WRITE_FAILED if fout could
+ *          not be written.
+ *
+ * @par Example
+ * @verbatim
+   image img;
+   ofstream fout;
+   openOutputFile("logo", ".pam", fout);
+   writePam(fout, img, false); // writes img to logo.pam
+   @endverbatim
+ *****************************************************************************/
+
+imageError writePam(ostream& fout, image& img, bool gray)
+{
+    TRACE_SCOPE("writePam");
+
+    imageError result;
+
+    writePamHeader(fout, img, gray);
+    result = writePamPixels(fout, img, gray);
+
+    freeImage(img);
+
+    if (result != IMAGE_OK)
+    {
+        return result;
+    }
+
+    return fout ? IMAGE_OK : IMAGE_WRITE_FAILED;
+}
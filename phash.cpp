@@ -0,0 +1,623 @@
+/** ***************************************************************************
+ * @file
+ * @brief Contains the perceptual hashes used to find near duplicate images
+ * and the index file they are kept in
+ *
+ * Each hash is 64 bits found from a tiny gray copy of the image, so images
+ * that look alike have hashes that differ in few bits.  The gray copy is
+ * made straight from the planes by averaging the pixels of each cell.
+ * The average hash compares each cell of an 8x8 copy with the mean, the
+ * difference hash compares each cell of a 9x8 copy with the cell to its
+ * left and the DCT hash compares the 8x8 lowest frequencies of a 32x32
+ * copy with their median.  The DCT hash changes least when an image is
+ * scaled, compressed or slightly recolored, so it is the one kept in the
+ * index.
+ *
+ * The index is a BK-tree kept in one file.  Every node is a record of
+ * PHASH_RECORD bytes followed by the image name, and links to other nodes
+ * are their positions in the file.  A node's children are each at a
+ * different distance from it, and the triangle inequality means a search
+ * for hashes within D of a hash h only has to visit children whose
+ * distance is within D of the distance to h.  Only the nodes visited are
+ * read, and adding an image appends one node and changes one link, so the
+ * index is never read or written in full.
+ *
+ * @verbatim
+   offset  bytes  contents
+   0       4      "phix"
+   4       8      number of images
+   12             first node, the root of the tree
+
+   node:   8      DCT hash
+           8      position of the first child, 0 for none
+           8      position of the next child of the same parent, 0 for none
+           1      distance from the parent
+           2      length of the name, then the name
+   @endverbatim
+ * Numbers are stored most significant byte first, as in tiled images.
+ *****************************************************************************/
+
+
+#include "netPBM.h"
+#include <bitset>
+
+
+/**
+ * @brief width and height of the gray copy the DCT hash is found from
+ */
+
+const int PHASH_GRID = 32;
+
+/**
+ * @brief size of the header of an index file
+ */
+
+const int PHASH_HEADER = 12;
+
+/**
+ * @brief size of a node of an index file before its name
+ */
+
+const int PHASH_RECORD = 27;
+
+
+/**
+ * @brief the fixed part of a node of an index file
+ */
+
+struct hashNode
+{
+    unsigned long long hash;       /**< DCT hash of the image */
+    unsigned long long child;      /**< position of the first child */
+    unsigned long long sibling;    /**< position of the next sibling */
+    int distance;                  /**< distance from the parent */
+    int nameLength;                /**< length of the name that follows */
+};
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * averages the brightness of the image over a grid of cells.  The cells
+ * split the rows and columns as evenly as they can, and an image smaller
+ * than the grid repeats its pixels.  Each thread fills its own rows of
+ * cells.
+ *
+ * @param[in]     img - image to shrink.
+ * @param[in]     gridRows - number of rows of cells.
+ * @param[in]     gridCols - number of columns of cells.
+ * @param[out]    cells - gridRows * gridCols brightness values, row by row.
+ *
+ * @par Example
+ * @verbatim
+   vector<double> cells;
+   grayGrid(img, 8, 9, cells); // the 9x8 copy used by the difference hash
+   @endverbatim
+ *****************************************************************************/
+
+static void grayGrid(image& img, int gridRows, int gridCols, vector<double>& cells)
+{
+    int threads = min(gridRows, threadCount(3 * planeBytes(img.rows, img.cols)));
+
+    cells.assign(size_t(gridRows) * gridCols, 0);
+
+    runParallel(threads, [&](int part)
+    {
+        int first = gridRows * part / threads;
+        int last = gridRows * (part + 1) / threads;
+        int top;
+        int bottom;
+        int left;
+        int right;
+        int cell;
+        int c;
+        int i;
+        int j;
+        long long sums[3];
+
+        for (cell = first; cell < last; cell++)
+        {
+            top = int((long long) img.rows * cell / gridRows);
+            bottom = max(top + 1, int((long long) img.rows * (cell + 1) / gridRows));
+
+            for (c = 0; c < gridCols; c++)
+            {
+                left = int((long long) img.cols * c / gridCols);
+                right = max(left + 1, int((long long) img.cols * (c + 1) / gridCols));
+                sums[0] = 0;
+                sums[1] = 0;
+                sums[2] = 0;
+
+                for (i = top; i < bottom; i++)
+                {
+                    for (j = left; j < right; j++)
+                    {
+                        sums[0] += img.redGray[i][j];
+                        sums[1] += img.green[i][j];
+                        sums[2] += img.blue[i][j];
+                    }
+                }
+
+                // the same weights as --grayscale
+                cells[size_t(cell) * gridCols + c] = (0.3 * sums[0] + 0.6 * sums[1]
+                    + 0.1 * sums[2]) / (double(bottom - top) * (right - left));
+            }
+        }
+    });
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * finds the average, difference and DCT hashes of an image.  The first
+ * cell of each copy gives the most significant bit.
+ *
+ * @param[in]     img - image to hash.
+ * @param[out]    hash - the three hashes.
+ *
+ * @par Example
+ * @verbatim
+   imageHash hash;
+   hashImage(img, hash);
+   hashDistance(hash.dct, other.dct); // 0 to 64, under 10 looks alike
+   @endverbatim
+ *****************************************************************************/
+
+void hashImage(image& img, imageHash& hash)
+{
+    TRACE_SCOPE("hashImage");
+
+    int u;
+    int v;
+    int x;
+    int y;
+    int k;
+    double mean = 0;
+    double median;
+    double coeff[8][PHASH_GRID];
+    double rows[8][PHASH_GRID];
+    double low[64];
+    double sorted[64];
+    vector<double> grid;
+    vector<double> wide;
+    const double pi = 3.14159265358979323846;
+
+    grayGrid(img, PHASH_GRID, PHASH_GRID, grid);
+    grayGrid(img, 8, 9, wide);
+
+    hash.average = 0;
+    hash.difference = 0;
+    hash.dct = 0;
+
+    // the 8x8 copy is each 4x4 block of the 32x32 copy
+    for (k = 0; k < 64; k++)
+    {
+        low[k] = 0;
+
+        for (y = 0; y < 4; y++)
+        {
+            for (x = 0; x < 4; x++)
+            {
+                low[k] += grid[(k / 8 * 4 + y) * PHASH_GRID + k % 8 * 4 + x];
+            }
+        }
+        mean += low[k] / 64;
+    }
+
+    for (k = 0; k < 64; k++)
+    {
+        hash.average = (hash.average << 1) | (low[k] > mean ? 1 : 0);
+        hash.difference = (hash.difference << 1)
+            | (wide[k / 8 * 9 + k % 8 + 1] > wide[k / 8 * 9 + k % 8] ? 1 : 0);
+    }
+
+    // only the 8 lowest frequencies of the DCT are needed in each direction
+    for (u = 0; u < 8; u++)
+    {
+        for (x = 0; x < PHASH_GRID; x++)
+        {
+            coeff[u][x] = cos((2 * x + 1) * u * pi / (2 * PHASH_GRID));
+        }
+    }
+
+    for (u = 0; u < 8; u++)
+    {
+        for (x = 0; x < PHASH_GRID; x++)
+        {
+            rows[u][x] = 0;
+
+            for (y = 0; y < PHASH_GRID; y++)
+            {
+                rows[u][x] += coeff[u][y] * grid[y * PHASH_GRID + x];
+            }
+        }
+    }
+
+    for (u = 0; u < 8; u++)
+    {
+        for (v = 0; v < 8; v++)
+        {
+            low[u * 8 + v] = 0;
+
+            for (x = 0; x < PHASH_GRID; x++)
+            {
+                low[u * 8 + v] += coeff[v][x] * rows[u][x];
+            }
+            sorted[u * 8 + v] = low[u * 8 + v];
+        }
+    }
+
+    sort(sorted, sorted + 64);
+    median = (sorted[31] + sorted[32]) / 2;
+
+    for (k = 0; k < 64; k++)
+    {
+        hash.dct = (hash.dct << 1) | (low[k] > median ? 1 : 0);
+    }
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * returns the number of bits that differ between two hashes.
+ *
+ * @param[in]     a - first hash.
+ * @param[in]     b - second hash.
+ *
+ * @returns the Hamming distance, 0 to 64.
+ *
+ * @par Example
+ * @verbatim
+   hashDistance(0xff, 0x0f); // 4
+   @endverbatim
+ *****************************************************************************/
+
+int hashDistance(unsigned long long a, unsigned long long b)
+{
+    return int(bitset<64>(a ^ b).count());
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * reads an index written as FILE[,D], where D is the largest distance that
+ * counts as a near duplicate, PHASH_DISTANCE if not given.
+ *
+ * @param[in]     param - parameter given after --skip-near.
+ * @param[out]    file - name of the index file.
+ * @param[out]    distance - largest distance of a near duplicate.
+ *
+ * @returns true if param is valid and false otherwise.
+ *
+ * @par Example
+ * @verbatim
+   parseNearIndex("seen.phix,6", file, distance); // seen.phix and 6
+   @endverbatim
+ *****************************************************************************/
+
+bool parseNearIndex(string param, string& file, int& distance)
+{
+    size_t comma = param.rfind(',');
+    char extra;
+
+    file = param;
+    distance = PHASH_DISTANCE;
+
+    if (comma != string::npos)
+    {
+        file = param.substr(0, comma);
+
+        if (sscanf(param.substr(comma + 1).c_str(), "%d%c", &distance, &extra) != 1
+            || distance < 0 || distance > 64)
+        {
+            return false;
+        }
+    }
+
+    return !file.empty();
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * reads the fixed part of the node at position at of an index file.
+ *
+ * @param[in,out]     fin - index file.
+ * @param[in]         at - position of the node.
+ * @param[out]        node - the node.
+ *
+ * @returns true if the node was read and false otherwise.
+ *
+ * @par Example
+ * @verbatim
+   readNode(fin, PHASH_HEADER, node); // the root
+   @endverbatim
+ *****************************************************************************/
+
+static bool readNode(istream& fin, unsigned long long at, hashNode& node)
+{
+    unsigned char data[PHASH_RECORD];
+
+    fin.seekg(streamoff(at));
+    fin.read((char*) data, PHASH_RECORD);
+
+    if (fin.gcount() != PHASH_RECORD)
+    {
+        return false;
+    }
+
+    node.hash = getNumber(data, 8);
+    node.child = getNumber(data + 8, 8);
+    node.sibling = getNumber(data + 16, 8);
+    node.distance = int(data[24]);
+    node.nameLength = int(getNumber(data + 25, 2));
+
+    return true;
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * finds every image in an index whose DCT hash is within distance of
+ * hash, closest first.  A missing index holds no images.
+ *
+ * @param[in]     file - name of the index file.
+ * @param[in]     hash - DCT hash to look for.
+ * @param[in]     distance - largest distance of a match.
+ * @param[out]    matches - the images found.
+ *
+ * @returns true if the index could be read and false otherwise.
+ *
+ * @par Example
+ * @verbatim
+   vector<hashMatch> matches;
+   findNear("seen.phix", hash.dct, 8, matches); // matches[0] is the closest
+   @endverbatim
+ *****************************************************************************/
+
+bool findNear(string file, unsigned long long hash, int distance,
+    vector<hashMatch>& matches)
+{
+    TRACE_SCOPE("findNear");
+
+    ifstream fin;
+    unsigned char header[PHASH_HEADER];
+    vector<unsigned long long> todo;
+    unsigned long long at;
+    hashNode node;
+    hashNode child;
+    hashMatch match;
+    int d;
+
+    matches.clear();
+    fin.open(file, ios::in | ios::binary);
+
+    if (!fin.is_open())
+    {
+        return true;
+    }
+
+    fin.read((char*) header, PHASH_HEADER);
+
+    if (fin.gcount() != PHASH_HEADER || memcmp(header, "phix", 4) != 0)
+    {
+        return false;
+    }
+
+    if (getNumber(header + 4, 8) == 0)
+    {
+        return true;
+    }
+
+    todo.push_back(PHASH_HEADER);
+
+    while (!todo.empty())
+    {
+        at = todo.back();
+        todo.pop_back();
+
+        if (!readNode(fin, at, node))
+        {
+            return false;
+        }
+        d = hashDistance(hash, node.hash);
+
+        if (d <= distance)
+        {
+            match.name.resize(node.nameLength);
+            fin.read(&match.name[0], node.nameLength);
+            match.distance = d;
+            matches.push_back(match);
+        }
+
+        for (at = node.child; at != 0; at = child.sibling)
+        {
+            if (!readNode(fin, at, child))
+            {
+                return false;
+            }
+
+            if (abs(child.distance - d) <= distance)
+            {
+                todo.push_back(at);
+            }
+        }
+    }
+
+    stable_sort(matches.begin(), matches.end(),
+        [](const hashMatch& a, const hashMatch& b) { return a.distance < b.distance; });
+
+    return true;
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * adds an image to an index, making the index if it doesn't exist.  The
+ * tree is walked down from the root to the node with no child at the new
+ * image's distance, the new node is added at the end of the file and that
+ * one link is changed to point at it.
+ *
+ * @param[in]     file - name of the index file.
+ * @param[in]     hash - DCT hash of the image.
+ * @param[in]     name - name stored for the image.
+ *
+ * @returns true if the image was added and false otherwise.
+ *
+ * @par Example
+ * @verbatim
+   addToIndex("seen.phix", hash.dct, "balloon.ppm");
+   @endverbatim
+ *****************************************************************************/
+
+bool addToIndex(string file, unsigned long long hash, string name)
+{
+    TRACE_SCOPE("addToIndex");
+
+    fstream index;
+    string data;
+    unsigned char header[PHASH_HEADER];
+    unsigned long long at = PHASH_HEADER;
+    unsigned long long link = 0;
+    unsigned long long end;
+    hashNode node;
+    int d = 0;
+
+    name = name.substr(0, 0xffff);
+    index.open(file, ios::in | ios::out | ios::binary);
+
+    if (!index.is_open())
+    {
+        index.clear();
+        index.open(file, ios::in | ios::out | ios::binary | ios::trunc);
+        data = "phix";
+        putNumber(data, 0, 8);
+        index.write(data.data(), data.size());
+    }
+
+    index.seekg(0);
+    index.read((char*) header, PHASH_HEADER);
+
+    if (!index || memcmp(header, "phix", 4) != 0)
+    {
+        return false;
+    }
+
+    index.seekg(0, ios::end);
+    end = (unsigned long long) index.tellg();
+
+    // find the link the new node hangs from, none for the first node
+    while (end > PHASH_HEADER)
+    {
+        if (!readNode(index, at, node))
+        {
+            return false;
+        }
+        d = hashDistance(hash, node.hash);
+        link = at + 8;
+        at = node.child;
+
+        while (at != 0)
+        {
+            if (!readNode(index, at, node))
+            {
+                return false;
+            }
+
+            if (node.distance == d)
+            {
+                break;
+            }
+            link = at + 16;
+            at = node.sibling;
+        }
+
+        if (at == 0)
+        {
+            break;
+        }
+    }
+
+    data.clear();
+    putNumber(data, hash, 8);
+    putNumber(data, 0, 8);
+    putNumber(data, 0, 8);
+    putNumber(data, (unsigned long long) d, 1);
+    putNumber(data, name.size(), 2);
+    data += name;
+
+    index.clear();
+    index.seekp(streamoff(end));
+    index.write(data.data(), data.size());
+
+    if (link != 0)
+    {
+        data.clear();
+        putNumber(data, end, 8);
+        index.seekp(streamoff(link));
+        index.write(data.data(), data.size());
+    }
+
+    data.clear();
+    putNumber(data, getNumber(header + 4, 8) + 1, 8);
+    index.seekp(4);
+    index.write(data.data(), data.size());
+
+    index.close();
+
+    return !index.fail();
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * reads an image and finds its average, difference and DCT hashes.
+ *
+ * @param[in]     name - name of the image, - for standard input.
+ * @param[out]    hash - the three hashes.
+ *
+ * @returns IMAGE_OK if the image was read, otherwise the reason it
+ *          wasn't.
+ *
+ * @par Example
+ * @verbatim
+   imageHash hash;
+   hashImageFile("balloon.ppm", hash);
+   @endverbatim
+ *****************************************************************************/
+
+imageError hashImageFile(string name, imageHash& hash)
+{
+    ifstream fin;
+    istream* in;
+    image img;
+    imageError error;
+
+    in = openInput(name, fin);
+    error = (in == nullptr) ? IMAGE_OPEN_FAILED : readImage(*in, img);
+
+    if (error != IMAGE_OK)
+    {
+        return error;
+    }
+
+    hashImage(img, hash);
+    freeImage(img);
+
+    return IMAGE_OK;
+}
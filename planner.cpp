@@ -0,0 +1,579 @@
+/** ***************************************************************************
+ * @file
+ * @brief Contains functions that estimate the memory each way of running
+ * the program needs and pick one that fits in a memory budget
+ *****************************************************************************/
+
+
+#include "netPBM.h"
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * reads a memory size such as 512K, 64M or 2G.  The suffixes are powers
+ * of 1024 and a number without a suffix is in bytes.
+ *
+ * @param[in]     text - memory size to read.
+ * @param[out]    bytes - the size in bytes.
+ *
+ * @returns true if text is a valid size greater than 0 and false otherwise.
+ *
+ * @par Example
+ * @verbatim
+   long long bytes;
+   parseSize("64M", bytes); // bytes is 67108864
+   parseSize("big", bytes); // returns false
+   @endverbatim
+ *****************************************************************************/
+
+bool parseSize(string text, long long& bytes)
+{
+    char* end;
+    double value;
+
+    value = strtod(text.c_str(), &end);
+
+    if (end == text.c_str() || value <= 0)
+    {
+        return false;
+    }
+
+    if (*end == 'K' || *end == 'k')
+    {
+        value = value * 1024;
+        end++;
+    }
+    else if (*end == 'M' || *end == 'm')
+    {
+        value = value * 1024 * 1024;
+        end++;
+    }
+    else if (*end == 'G' || *end == 'g')
+    {
+        value = value * 1024 * 1024 * 1024;
+        end++;
+    }
+
+    bytes = (long long) value;
+
+    return *end == '\0';
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * marks every --rotateCW and --rotateCCW so it is done in place, see
+ * rotateInPlace.
+ *
+ * @param[in,out]     ops - operations given on the command line.
+ *
+ * @returns true if there was a rotation to mark and false otherwise.
+ *
+ * @par Example
+ * @verbatim
+   vector<operation> ops = { { "--rotateCW", "" } };
+   markInPlace(ops); // ops[0].param is "in-place"
+   @endverbatim
+ *****************************************************************************/
+
+bool markInPlace(vector<operation>& ops)
+{
+    size_t i;
+    bool found = false;
+
+    for (i = 0; i < ops.size(); i++)
+    {
+        if (ops[i].name == "--rotateCW" || ops[i].name == "--rotateCCW")
+        {
+            ops[i].param = "in-place";
+            found = true;
+        }
+    }
+
+    return found;
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * estimates the most memory the program uses when the whole image is
+ * read into memory before the operations are applied.  The estimate
+ * follows the same steps as readImage, each operation and the writer.
+ *
+ * @param[in]     header - magic number and size of the input image.
+ * @param[in]     ops - operations given on the command line.
+ * @param[in]     last - option that must come last, LAST_NONE if none.
+ * @param[in]     outputType - how the result is written.
+ * @param[in]     fileSize - size of the input file in bytes.
+ *
+ * @returns estimated peak memory in bytes.
+ *
+ * @par Example
+ * @verbatim
+   estimateInMemory(header, ops, LAST_NONE, OUTPUT_BINARY, 921615); // 640x480 P6 image
+                                                         // about 1.8 MB
+   @endverbatim
+ *****************************************************************************/
+
+long long estimateInMemory(image& header, vector<operation>& ops, lastOption last,
+    outputFormat outputType, long long fileSize)
+{
+    size_t i;
+    int rows = header.rows;
+    int cols = header.cols;
+    long long peak;
+    long long planes;
+    long long count = header.magicNumber == "P7" ? 4 : 3;
+    region roi;
+    rotation rot;
+    quantizer bits;
+    previewMode view;
+    bilateral filter;
+    long long small;
+
+    if (header.magicNumber == "qoif")
+    {
+        peak = count * planeBytes(rows, cols) + fileSize;
+    }
+    else if (header.magicNumber == "P7")
+    {
+        peak = count * planeBytes(rows, cols) + 4LL * cols;
+    }
+    else if (!ops.empty() && ops[0].name == "--roi")
+    {
+        sscanf(ops[0].param.c_str(), "%d,%d,%d,%d", &roi.x, &roi.y, &roi.w, &roi.h);
+        cols = max(0, min(roi.w, cols - roi.x));
+        rows = max(0, min(roi.h, rows - roi.y));
+        peak = count * planeBytes(rows, cols);
+
+        if (header.magicNumber == "P6")
+        {
+            peak += 3LL * cols;
+        }
+
+        if (header.magicNumber == "tpix")
+        {
+            peak += tiledBufferBytes(cols);
+        }
+    }
+    else if (header.magicNumber == "tpix")
+    {
+        peak = count * planeBytes(rows, cols) + tiledBufferBytes(cols);
+    }
+    else if (header.magicNumber == "P3")
+    {
+        peak = count * planeBytes(rows, cols) + fileSize;
+    }
+    else
+    {
+        peak = count * planeBytes(rows, cols) + 3LL * binaryBandRows(rows, cols) * cols;
+    }
+
+    // --preview is always first.  P6 and most P3 previews are read straight
+    // into the small planes, anything else is read in full and then shrunk.
+    if (!ops.empty() && ops[0].name == "--preview" && parsePreview(ops[0].param, view))
+    {
+        small = count * planeBytes((rows + view.step - 1) / view.step,
+            (cols + view.step - 1) / view.step);
+
+        if (header.magicNumber == "P6" && view.box)
+        {
+            peak = small + 3LL * cols * (1 + (long long) sizeof(unsigned));
+        }
+        else if (header.magicNumber == "P6")
+        {
+            peak = small + 3LL * view.step * ((cols - 1) / view.step) + 3;
+        }
+        else if (header.magicNumber == "P3" && !view.box)
+        {
+            peak = small + fileSize;
+        }
+        else
+        {
+            peak = max(peak, count * planeBytes(rows, cols) + small);
+        }
+        rows = (rows + view.step - 1) / view.step;
+        cols = (cols + view.step - 1) / view.step;
+    }
+
+    for (i = 0; i < ops.size(); i++)
+    {
+        planes = count * planeBytes(rows, cols);
+
+        if ((ops[i].name == "--rotateCW" || ops[i].name == "--rotateCCW")
+            && ops[i].param == "in-place")
+        {
+            peak = max(peak, planes + count * (cols + 1) * (long long) sizeof(pixel*)
+                + (rows == cols ? 0 : (long long) rows * cols / 8));
+            swap(rows, cols);
+        }
+        else if (ops[i].name == "--rotateCW" || ops[i].name == "--rotateCCW")
+        {
+            peak = max(peak, planes + count * planeBytes(cols, rows));
+            swap(rows, cols);
+        }
+
+        if (ops[i].name == "--rotate" && parseRotation(ops[i].param, rot))
+        {
+            rotatedSize(rows, cols, rot, rows, cols);
+            peak = max(peak, planes + count * planeBytes(rows, cols));
+        }
+
+        if (ops[i].name == "--overlay")
+        {
+            peak = max(peak, planes + overlayBytes(ops[i].param));
+        }
+
+        if (ops[i].name == "--median")
+        {
+            peak = max(peak, planes + medianBytes(rows, cols, atoi(ops[i].param.c_str())));
+        }
+
+        if (ops[i].name == "--bilateral" && parseBilateral(ops[i].param, filter))
+        {
+            peak = max(peak, planes + bilateralBytes(rows, cols, filter));
+        }
+
+        if (ops[i].name == "--roi" && (i > 0 || header.magicNumber == "qoif"
+            || header.magicNumber == "P7"))
+        {
+            sscanf(ops[i].param.c_str(), "%d,%d,%d,%d", &roi.x, &roi.y, &roi.w, &roi.h);
+            cols = max(0, min(roi.w, cols - roi.x));
+            rows = max(0, min(roi.h, rows - roi.y));
+            peak = max(peak, planes + count * planeBytes(rows, cols));
+        }
+    }
+
+    planes = count * planeBytes(rows, cols);
+
+    // --bits is applied after every other operation
+    for (i = 0; i < ops.size(); i++)
+    {
+        if (ops[i].name == "--bits" && parseQuantizer(ops[i].param, bits))
+        {
+            peak = max(peak, planes + quantizeBytes(rows, cols,
+                last == LAST_GRAYSCALE ? 1 : 3, bits));
+        }
+    }
+
+    // a pyramid other than a tiled one is written a row at a time
+    if (last == LAST_PYRAMID && outputType != OUTPUT_TILED && !(outputType == OUTPUT_SAME
+        && header.magicNumber == "tpix"))
+    {
+        if (outputType == OUTPUT_SAME)
+        {
+            outputType = header.magicNumber == "P3" ? OUTPUT_ASCII
+                : header.magicNumber == "qoif" ? OUTPUT_QOI
+                : header.magicNumber == "P7" ? OUTPUT_PAM : OUTPUT_BINARY;
+        }
+        peak = max(peak, planes + pyramidBytes(rows, cols, int(count), outputType)
+            + (outputType == OUTPUT_ASCII ? asciiBufferBytes(1, cols, 3) : count * cols));
+
+        return max(peak, planes);
+    }
+
+    // writeTiled makes each level from the whole of the one before
+    if (last == LAST_PYRAMID)
+    {
+        peak = max(peak, planes + count * planeBytes((rows + 1) / 2, (cols + 1) / 2));
+    }
+
+    if (outputType == OUTPUT_ASCII || (outputType == OUTPUT_SAME
+        && header.magicNumber == "P3"))
+    {
+        peak = max(peak, planes + asciiBufferBytes(rows, cols,
+            last == LAST_GRAYSCALE || last == LAST_COLORSPACE ? 1 : 3));
+    }
+
+    if (outputType == OUTPUT_BINARY || (outputType == OUTPUT_SAME
+        && header.magicNumber == "P6"))
+    {
+        peak = max(peak, planes
+            + (last == LAST_NONE ? directBufferBytes(rows, cols) : 3LL * cols));
+    }
+
+    if (outputType == OUTPUT_QOI || (outputType == OUTPUT_SAME
+        && header.magicNumber == "qoif"))
+    {
+        peak = max(peak, planes + qoiBufferBytes(cols));
+    }
+
+    if (outputType == OUTPUT_PAM || (outputType == OUTPUT_SAME
+        && header.magicNumber == "P7"))
+    {
+        peak = max(peak, planes + 4LL * cols);
+    }
+
+    if (outputType == OUTPUT_TILED || (outputType == OUTPUT_SAME
+        && header.magicNumber == "tpix"))
+    {
+        peak = max(peak, planes + count * planeBytes((rows + 1) / 2, (cols + 1) / 2)
+            + tiledBufferBytes(cols));
+    }
+
+    return max(peak, planes);
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * checks if the image can be processed one row at a time.  This is only
+ * possible for ppm input and output when every operation changes each row
+ * on its own, that is the point operations, --sepia and --flipY.
+ *
+ * @param[in]     header - magic number and size of the input image.
+ * @param[in]     ops - operations given on the command line.
+ * @param[in]     last - option that must come last, LAST_NONE if none.
+ * @param[in]     outputType - how the result is written.
+ *
+ * @returns true if the image can be streamed and false otherwise.
+ *
+ * @par Example
+ * @verbatim
+   canStream(header, ops, LAST_NONE, OUTPUT_BINARY); // true for --sepia --flipY
+   @endverbatim
+ *****************************************************************************/
+
+bool canStream(image& header, vector<operation>& ops, lastOption last, outputFormat outputType)
+{
+    size_t i;
+    lookupTable table;
+
+    if (header.magicNumber == "qoif" || header.magicNumber == "tpix"
+        || header.magicNumber == "P7" || outputType == OUTPUT_QOI || outputType == OUTPUT_TILED
+        || outputType == OUTPUT_PAM || last != LAST_NONE)
+    {
+        return false;
+    }
+
+    for (i = 0; i < ops.size(); i++)
+    {
+        if (ops[i].name != "--sepia" && ops[i].name != "--flipY"
+            && !buildTable(table, ops[i].name, ops[i].param))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * checks if the image can be processed through a tiled copy of itself.
+ * This takes the same inputs, outputs and operations as streaming, and
+ * also --flipX, --rotateCW and --rotateCCW, which move pixels between
+ * rows.
+ *
+ * @param[in]     header - magic number and size of the input image.
+ * @param[in]     ops - operations given on the command line.
+ * @param[in]     last - option that must come last, LAST_NONE if none.
+ * @param[in]     outputType - how the result is written.
+ *
+ * @returns true if the tiled plan can run and false otherwise.
+ *
+ * @par Example
+ * @verbatim
+   canTile(header, ops, LAST_NONE, OUTPUT_BINARY); // true for --rotateCW --sepia
+   @endverbatim
+ *****************************************************************************/
+
+bool canTile(image& header, vector<operation>& ops, lastOption last, outputFormat outputType)
+{
+    size_t i;
+    vector<operation> rest;
+
+    for (i = 0; i < ops.size(); i++)
+    {
+        if (ops[i].name != "--flipX" && ops[i].name != "--rotateCW"
+            && ops[i].name != "--rotateCCW")
+        {
+            rest.push_back(ops[i]);
+        }
+    }
+
+    return canStream(header, rest, last, outputType);
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * estimates the peak memory of the tiled plan.  Copying the image into
+ * tiles holds TILE_SIZE rows and the tiles made from them.  Making the
+ * output holds the region TILE_SIZE rows of it come from, the buffers
+ * used to read that region and whatever the operations and the writer
+ * need on top.
+ *
+ * @param[in]     header - magic number and size of the input image.
+ * @param[in]     ops - operations given on the command line.
+ * @param[in]     outputType - how the result is written.
+ *
+ * @returns the estimated peak in bytes.
+ *
+ * @par Example
+ * @verbatim
+   estimateTiled(header, ops, OUTPUT_BINARY); // a few MB for a 20000 pixel wide image
+   @endverbatim
+ *****************************************************************************/
+
+long long estimateTiled(image& header, vector<operation>& ops, outputFormat outputType)
+{
+    size_t i;
+    int band;
+    bool turned = false;
+    long long peak;
+    image part;
+
+    for (i = 0; i < ops.size(); i++)
+    {
+        if (ops[i].name == "--rotateCW" || ops[i].name == "--rotateCCW")
+        {
+            turned = !turned;
+        }
+    }
+
+    peak = 3 * planeBytes(min(TILE_SIZE, header.rows), header.cols) + 3LL * header.cols
+        + tiledBufferBytes(header.cols);
+
+    // the region read for each band of output, as if it were a tiled image
+    band = min(TILE_SIZE, turned ? header.cols : header.rows);
+    part.magicNumber = "tpix";
+    part.rows = turned ? header.rows : band;
+    part.cols = turned ? band : header.cols;
+    peak = max(peak, estimateInMemory(part, ops, LAST_NONE, OUTPUT_NONE, 0));
+
+    part.rows = band;
+    part.cols = turned ? header.rows : header.cols;
+
+    if (outputType == OUTPUT_ASCII || (outputType == OUTPUT_SAME
+        && header.magicNumber == "P3"))
+    {
+        peak = max(peak, 3 * planeBytes(part.rows, part.cols)
+            + asciiBufferBytes(part.rows, part.cols, 3));
+    }
+    else
+    {
+        peak = max(peak, 3 * planeBytes(part.rows, part.cols) + 3LL * part.cols);
+    }
+
+    return peak;
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * lists every way the program can run with its estimated peak memory, from
+ * the fastest to the slowest.  The in-place plan is the in-memory plan
+ * with the quarter turns done in place.  The tiled plan goes through a
+ * tiled copy of the image on disk, so it needs the least memory of the
+ * plans that can turn the image but is the slowest.
+ *
+ * @param[in]     header - magic number and size of the input image.
+ * @param[in]     ops - operations given on the command line.
+ * @param[in]     last - option that must come last, LAST_NONE if none.
+ * @param[in]     outputType - how the result is written.
+ * @param[in]     fileSize - size of the input file in bytes.
+ *
+ * @returns the list of plans.
+ *
+ * @par Example
+ * @verbatim
+   vector<plan> plans;
+   plans = makePlans(header, ops, LAST_NONE, OUTPUT_BINARY, 921615);
+   @endverbatim
+ *****************************************************************************/
+
+vector<plan> makePlans(image& header, vector<operation>& ops, lastOption last,
+    outputFormat outputType, long long fileSize)
+{
+    vector<plan> plans;
+    vector<operation> inPlace = ops;
+    plan next;
+
+    next.name = "in-memory";
+    next.bytes = estimateInMemory(header, ops, last, outputType, fileSize);
+    next.possible = true;
+    plans.push_back(next);
+
+    next.name = "in-place";
+    next.possible = markInPlace(inPlace);
+    next.bytes = estimateInMemory(header, inPlace, last, outputType, fileSize);
+    plans.push_back(next);
+
+    next.name = "streaming";
+    next.bytes = 3 * planeBytes(1, header.cols) + 3LL * header.cols;
+    if (outputType == OUTPUT_BINARY || (outputType == OUTPUT_SAME
+        && header.magicNumber == "P6"))
+    {
+        next.bytes += 3LL * header.cols;
+    }
+
+    // writeAscii formats each streamed row in its own text buffer
+    else if (outputType == OUTPUT_ASCII || (outputType == OUTPUT_SAME
+        && header.magicNumber == "P3"))
+    {
+        next.bytes += asciiBufferBytes(1, header.cols, 3);
+    }
+    next.possible = canStream(header, ops, last, outputType);
+    plans.push_back(next);
+
+    next.name = "tiled";
+    next.bytes = estimateTiled(header, ops, outputType);
+    next.possible = canTile(header, ops, last, outputType);
+    plans.push_back(next);
+
+    return plans;
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * picks the first plan that is possible and fits in the budget.  Since the
+ * plans are listed from fastest to slowest this is the fastest plan that
+ * fits.
+ *
+ * @param[in]     plans - list made by makePlans.
+ * @param[in]     budget - most memory the program may use, in bytes.
+ * @param[out]    choice - the plan that was picked.
+ *
+ * @returns true if a plan fits and false otherwise.
+ *
+ * @par Example
+ * @verbatim
+   plan choice;
+   choosePlan(plans, 64 * 1024 * 1024, choice); // choice.name is "in-memory"
+   @endverbatim
+ *****************************************************************************/
+
+bool choosePlan(vector<plan>& plans, long long budget, plan& choice)
+{
+    size_t i;
+
+    for (i = 0; i < plans.size(); i++)
+    {
+        if (plans[i].possible && plans[i].bytes <= budget)
+        {
+            choice = plans[i];
+            return true;
+        }
+    }
+
+    return false;
+}
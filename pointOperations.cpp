@@ -0,0 +1,334 @@
+/** ***************************************************************************
+ * @file
+ * @brief Contains the lookup table based point operations
+ *****************************************************************************/
+
+
+#include "netPBM.h"
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * builds a lookup table that adds a constant to every pixel value.
+ *
+ * @param[out]    table - lookup table that is filled in.
+ * @param[in]     amount - value added to each pixel, may be negative.
+ *
+ * @par Example
+ * @verbatim
+   lookupTable table;
+   brightnessTable(table, 40); // table[100] is 140, table[250] is 255
+   @endverbatim
+ *****************************************************************************/
+
+void brightnessTable(lookupTable& table, int amount)
+{
+    int i;
+
+    for (i = 0; i < 256; i++)
+    {
+        table.value[i] = clampPixel(i + amount);
+    }
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * builds a lookup table that stretches or squeezes pixel values around
+ * the middle gray level 128.
+ *
+ * @param[out]    table - lookup table that is filled in.
+ * @param[in]     amount - contrast change from -255 to 255, 0 leaves the
+ *                         image unchanged.
+ *
+ * @par Example
+ * @verbatim
+   lookupTable table;
+   contrastTable(table, 64); // darks get darker and lights get lighter
+   @endverbatim
+ *****************************************************************************/
+
+void contrastTable(lookupTable& table, int amount)
+{
+    int i;
+    double factor;
+
+    if (amount > 255)
+    {
+        amount = 255;
+    }
+    if (amount < -255)
+    {
+        amount = -255;
+    }
+
+    factor = (259.0 * (amount + 255)) / (255.0 * (259 - amount));
+
+    for (i = 0; i < 256; i++)
+    {
+        table.value[i] = clampPixel(int(round(factor * (i - 128) + 128)));
+    }
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * builds a lookup table that applies gamma correction.  Values of gamma
+ * above 1 brighten the midtones and values below 1 darken them.
+ *
+ * @param[out]    table - lookup table that is filled in.
+ * @param[in]     gamma - gamma value, must be greater than 0.
+ *
+ * @par Example
+ * @verbatim
+   lookupTable table;
+   gammaTable(table, 2.2); // brightens the midtones
+   @endverbatim
+ *****************************************************************************/
+
+void gammaTable(lookupTable& table, double gamma)
+{
+    int i;
+
+    for (i = 0; i < 256; i++)
+    {
+        table.value[i] = clampPixel(int(round(255.0 * pow(i / 255.0, 1.0 / gamma))));
+    }
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * builds a lookup table that turns every pixel value below the level
+ * black and every other pixel value white.
+ *
+ * @param[out]    table - lookup table that is filled in.
+ * @param[in]     level - first pixel value that becomes white.
+ *
+ * @par Example
+ * @verbatim
+   lookupTable table;
+   thresholdTable(table, 128); // table[127] is 0, table[128] is 255
+   @endverbatim
+ *****************************************************************************/
+
+void thresholdTable(lookupTable& table, int level)
+{
+    int i;
+
+    for (i = 0; i < 256; i++)
+    {
+        table.value[i] = (i >= level) ? 255 : 0;
+    }
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * builds a lookup table that reduces every channel to a number of evenly
+ * spaced levels.
+ *
+ * @param[out]    table - lookup table that is filled in.
+ * @param[in]     levels - number of levels kept, from 2 to 256.
+ *
+ * @par Example
+ * @verbatim
+   lookupTable table;
+   posterizeTable(table, 4); // only 0, 85, 170 and 255 remain
+   @endverbatim
+ *****************************************************************************/
+
+void posterizeTable(lookupTable& table, int levels)
+{
+    int i;
+    int step;
+
+    if (levels < 2)
+    {
+        levels = 2;
+    }
+    if (levels > 256)
+    {
+        levels = 256;
+    }
+
+    for (i = 0; i < 256; i++)
+    {
+        step = (i * (levels - 1) + 127) / 255;
+        table.value[i] = pixel((step * 255 + (levels - 1) / 2) / (levels - 1));
+    }
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * combines two lookup tables so that applying the result once gives the
+ * same image as applying first and then second.
+ *
+ * @param[in,out]     first - table applied first, replaced by the combined
+ *                            table.
+ * @param[in]         second - table applied second.
+ *
+ * @par Example
+ * @verbatim
+   lookupTable table = invertLut;
+   lookupTable bright;
+   brightnessTable(bright, 20);
+   composeTable(table, bright); // invert and then brighten in one table
+   @endverbatim
+ *****************************************************************************/
+
+void composeTable(lookupTable& first, const lookupTable& second)
+{
+    int i;
+
+    for (i = 0; i < 256; i++)
+    {
+        first.value[i] = second.value[first.value[i]];
+    }
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * builds the lookup table for one point operation.  The parameter is the
+ * text given after the option on the command line.
+ *
+ * @param[out]    table - lookup table that is filled in.
+ * @param[in]     name - option name such as "--gamma".
+ * @param[in]     param - parameter of the option, empty for --invert.
+ *
+ * @returns true if name is a point operation with a valid number and false
+ *          otherwise.
+ *
+ * @par Example
+ * @verbatim
+   lookupTable table;
+   buildTable(table, "--gamma", "2.2");     // table now holds a gamma curve
+   buildTable(table, "--flipX", "");        // returns false
+   buildTable(table, "--brightness", "");   // returns false
+   @endverbatim
+ *****************************************************************************/
+
+bool buildTable(lookupTable& table, string name, string param)
+{
+    char* end;
+    double gamma;
+    int value;
+
+    if (name == "--invert")
+    {
+        table = invertLut;
+        return true;
+    }
+
+    if (name == "--gamma")
+    {
+        gamma = strtod(param.c_str(), &end);
+
+        if (end == param.c_str() || *end != '\0' || gamma <= 0)
+        {
+            return false;
+        }
+        gammaTable(table, gamma);
+        return true;
+    }
+
+    if (!parseInteger(param, value))
+    {
+        return false;
+    }
+
+    if (name == "--brightness")
+    {
+        brightnessTable(table, value);
+    }
+    else if (name == "--contrast")
+    {
+        contrastTable(table, value);
+    }
+    else if (name == "--threshold")
+    {
+        thresholdTable(table, value);
+    }
+    else if (name == "--posterize")
+    {
+        posterizeTable(table, value);
+    }
+    else
+    {
+        return false;
+    }
+
+    return true;
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * replaces every red, green and blue pixel with its entry in the lookup
+ * table.  The whole image is visited only once no matter how many point
+ * operations were combined into the table.
+ *
+ * @param[in,out]     img - structure containing data of a ppm image.
+ * @param[in]         table - lookup table applied to every channel.
+ * @param[in]         outputType - aschii or binary format type.
+ *
+ * @par Example
+ * @verbatim
+   image img;
+   applyTable(img, invertLut, OUTPUT_BINARY); // negative image in binary format
+   @endverbatim
+ *****************************************************************************/
+
+void applyTable(image& img, const lookupTable& table, outputFormat outputType)
+{
+    TRACE_SCOPE("applyTable");
+
+    int i;
+    int j;
+
+    pixel* red;
+    pixel* green;
+    pixel* blue;
+
+    for (i = 0; i < img.rows; i++)
+    {
+        red = img.redGray[i];
+        green = img.green[i];
+        blue = img.blue[i];
+
+        for (j = 0; j < img.cols; j++)
+        {
+            red[j] = table.value[red[j]];
+            green[j] = table.value[green[j]];
+            blue[j] = table.value[blue[j]];
+        }
+    }
+
+    if (outputType == OUTPUT_ASCII)
+    {
+        img.magicNumber = "P3";
+    }
+
+    else if (outputType == OUTPUT_BINARY)
+    {
+        img.magicNumber = "P6";
+    }
+}
@@ -0,0 +1,434 @@
+/** ***************************************************************************
+ * @file
+ * @brief Contains --preview, which reads a smaller copy of the image
+ *
+ * A preview keeps every Nth row and column, so a P6 image only needs every
+ * Nth row read from the file and each row is jumped to with a seek.  The
+ * pixels kept are split out of the row with kernels().sampleRgb.  With box
+ * every row has to be read, the rows of each N by N cell are added up with
+ * kernels().sumRow and the cell becomes the average of its pixels.  A P3
+ * image has to be read in full to find where each number is, but the
+ * numbers that aren't kept are skipped without being converted.  Other
+ * formats are read in full and then shrunk.  The result is an ordinary
+ * image, so every option and writer works on it.
+ *****************************************************************************/
+
+
+#include "netPBM.h"
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * reads a preview written as N[,box].  N is 2 or more and box averages
+ * each N by N cell instead of keeping its top left pixel.
+ *
+ * @param[in]     param - parameter given after --preview.
+ * @param[out]    view - the preview.
+ *
+ * @returns true if param is a valid preview and false otherwise.
+ *
+ * @par Example
+ * @verbatim
+   previewMode view;
+   parsePreview("16", view);     // 1/16 of the width and height
+   parsePreview("4,box", view);  // each pixel is the average of 4x4
+   @endverbatim
+ *****************************************************************************/
+
+bool parsePreview(string param, previewMode& view)
+{
+    size_t comma = param.find(',');
+    char extra;
+
+    if (sscanf(param.substr(0, comma).c_str(), "%d%c", &view.step, &extra) != 1
+        || view.step < 2 || view.step > PREVIEW_MAX)
+    {
+        return false;
+    }
+
+    view.box = comma != string::npos;
+
+    return comma == string::npos || param.substr(comma + 1) == "box";
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * shrinks rows from row first to row last of one plane, keeping the top
+ * left pixel of each cell or the average of the cell.
+ *
+ * @param[in]     from - plane of the full image.
+ * @param[in]     rows - number of rows in from.
+ * @param[in]     cols - number of columns in from.
+ * @param[out]    to - plane of the preview.
+ * @param[in]     width - number of columns in to.
+ * @param[in]     first - first row of to to fill.
+ * @param[in]     last - one past the last row of to to fill.
+ * @param[in]     view - the preview.
+ *
+ * @par Example
+ * @verbatim
+   shrinkPlane(img.redGray, img.rows, img.cols, temp.redGray, temp.cols, 0,
+       temp.rows, view);
+   @endverbatim
+ *****************************************************************************/
+
+static void shrinkPlane(pixel** from, int rows, int cols, pixel** to, int width,
+    int first, int last, previewMode view)
+{
+    int i;
+    int j;
+    int r;
+    int c;
+    int bottom;
+    int right;
+    long long count;
+    long long total;
+
+    for (i = first; i < last; i++)
+    {
+        bottom = min(rows, (i + 1) * view.step);
+
+        for (j = 0; j < width; j++)
+        {
+            if (!view.box)
+            {
+                to[i][j] = from[i * view.step][j * view.step];
+                continue;
+            }
+
+            right = min(cols, (j + 1) * view.step);
+            count = (long long) (bottom - i * view.step) * (right - j * view.step);
+            total = 0;
+
+            for (r = i * view.step; r < bottom; r++)
+            {
+                for (c = j * view.step; c < right; c++)
+                {
+                    total += from[r][c];
+                }
+            }
+            to[i][j] = pixel((2 * total + count) / (2 * count));
+        }
+    }
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * replaces img with its preview.  The rows of the preview are split
+ * between threads.
+ *
+ * @param[in,out]     img - structure containing data of a ppm image.
+ * @param[in]         view - the preview.
+ *
+ * @returns IMAGE_OK or IMAGE_NO_MEMORY, in which case img is unchanged.
+ *
+ * @par Example
+ * @verbatim
+   previewMode view = { 4, false };
+   shrinkImage(img, view); // 640x480 becomes 160x120
+   @endverbatim
+ *****************************************************************************/
+
+imageError shrinkImage(image& img, previewMode view)
+{
+    TRACE_SCOPE("shrinkImage");
+
+    int rows = (img.rows + view.step - 1) / view.step;
+    int cols = (img.cols + view.step - 1) / view.step;
+    int threads;
+    int band;
+
+    image temp;
+
+    if (!allocImage(temp, rows, cols))
+    {
+        return IMAGE_NO_MEMORY;
+    }
+
+    if (img.alpha != nullptr && !allocAlpha(temp))
+    {
+        freeImage(temp);
+        return IMAGE_NO_MEMORY;
+    }
+
+    threads = threadCount(planeBytes(img.rows, img.cols));
+    band = (rows + threads - 1) / threads;
+
+    runParallel(threads, [&](int t)
+    {
+        int first = min(rows, t * band);
+        int last = min(rows, (t + 1) * band);
+
+        shrinkPlane(img.redGray, img.rows, img.cols, temp.redGray, cols, first, last, view);
+        shrinkPlane(img.green, img.rows, img.cols, temp.green, cols, first, last, view);
+        shrinkPlane(img.blue, img.rows, img.cols, temp.blue, cols, first, last, view);
+
+        if (img.alpha != nullptr)
+        {
+            shrinkPlane(img.alpha, img.rows, img.cols, temp.alpha, cols, first, last, view);
+        }
+    });
+
+    freeImage(img);
+
+    img.redGray = temp.redGray;
+    img.green = temp.green;
+    img.blue = temp.blue;
+    img.alpha = temp.alpha;
+    img.rows = rows;
+    img.cols = cols;
+
+    return IMAGE_OK;
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * reads every step-th pixel of every step-th row of the pixels of a P6
+ * image into img.  Each row kept is found with a seek and only the part of
+ * it up to the last pixel kept is read.
+ *
+ * @param[in,out]     fin - stream positioned at the first pixel.
+ * @param[in,out]     img - structure with the planes of the preview.
+ * @param[in]         cols - number of columns in the file.
+ * @param[in]         step - distance between the rows and columns kept.
+ *
+ * @returns IMAGE_OK, IMAGE_READ_FAILED or IMAGE_NO_MEMORY.
+ *
+ * @par Example
+ * @verbatim
+   sampleBinary(fin, img, 640, 4); // img is 160 columns wide
+   @endverbatim
+ *****************************************************************************/
+
+static imageError sampleBinary(istream& fin, image& img, int cols, int step)
+{
+    int i;
+    long long rowBytes = 3LL * cols;
+    long long used = 3LL * step * (img.cols - 1) + 3;
+    imageError result = IMAGE_OK;
+
+    streamoff start = fin.tellg();
+    pixel* row = new(nothrow) pixel[size_t(used)];
+
+    if (row == nullptr)
+    {
+        return IMAGE_NO_MEMORY;
+    }
+    countAlloc(used);
+
+    for (i = 0; i < img.rows; i++)
+    {
+        fin.seekg(start + streamoff(i) * step * rowBytes);
+        fin.read((char*) row, used);
+
+        if (fin.gcount() < used)
+        {
+            result = IMAGE_READ_FAILED;
+            break;
+        }
+        kernels().sampleRgb(row, img.redGray[i], img.green[i], img.blue[i], img.cols, step);
+    }
+
+    delete[] row;
+    countFree(used);
+
+    return result;
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * reads the pixels of a P6 image into img, each pixel of img being the
+ * average of a step by step cell.  The rows of a cell are added into a
+ * row of sums one at a time, so only one row of the file is held at once.
+ *
+ * @param[in,out]     fin - stream positioned at the first pixel.
+ * @param[in,out]     img - structure with the planes of the preview.
+ * @param[in]         rows - number of rows in the file.
+ * @param[in]         cols - number of columns in the file.
+ * @param[in]         step - width and height of a cell.
+ *
+ * @returns IMAGE_OK, IMAGE_READ_FAILED or IMAGE_NO_MEMORY.
+ *
+ * @par Example
+ * @verbatim
+   averageBinary(fin, img, 480, 640, 4); // img is 160x120
+   @endverbatim
+ *****************************************************************************/
+
+static imageError averageBinary(istream& fin, image& img, int rows, int cols, int step)
+{
+    int i;
+    int j;
+    int k;
+    int r;
+    int c;
+    int height;
+    int width;
+    long long total[3];
+    long long rowBytes = 3LL * cols;
+    pixel** planes[3] = { img.redGray, img.green, img.blue };
+
+    pixel* row = new(nothrow) pixel[size_t(rowBytes)];
+    unsigned* sums = new(nothrow) unsigned[size_t(rowBytes)];
+
+    if (row == nullptr || sums == nullptr)
+    {
+        delete[] row;
+        delete[] sums;
+        return IMAGE_NO_MEMORY;
+    }
+    countAlloc(rowBytes * (1 + (long long) sizeof(unsigned)));
+
+    for (i = 0; i < img.rows; i++)
+    {
+        height = min(step, rows - i * step);
+        memset(sums, 0, size_t(rowBytes) * sizeof(unsigned));
+
+        for (r = 0; r < height && fin; r++)
+        {
+            fin.read((char*) row, rowBytes);
+            kernels().sumRow(row, sums, int(rowBytes));
+        }
+
+        if (!fin)
+        {
+            break;
+        }
+
+        for (j = 0; j < img.cols; j++)
+        {
+            width = min(step, cols - j * step);
+            total[0] = 0;
+            total[1] = 0;
+            total[2] = 0;
+
+            for (c = j * step; c < j * step + width; c++)
+            {
+                total[0] += sums[3 * c];
+                total[1] += sums[3 * c + 1];
+                total[2] += sums[3 * c + 2];
+            }
+
+            for (k = 0; k < 3; k++)
+            {
+                planes[k][i][j] = pixel((2 * total[k] + height * width)
+                    / (2LL * height * width));
+            }
+        }
+    }
+
+    delete[] row;
+    delete[] sums;
+    countFree(rowBytes * (1 + (long long) sizeof(unsigned)));
+
+    return fin ? IMAGE_OK : IMAGE_READ_FAILED;
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * reads a preview of the image in fin, see the top of this file.
+ *
+ * @param[in,out]     fin - stream the image is read from.
+ * @param[out]        img - receives the preview.
+ * @param[in]         view - the preview.
+ *
+ * @returns IMAGE_OK if the preview was read, otherwise the reason it
+ *          wasn't.  img holds no memory when the read fails.
+ *
+ * @par Example
+ * @verbatim
+   previewMode view = { 16, false };
+   readPreview(fin, img, view); // a 12500x16000 scan becomes 782x1000
+   @endverbatim
+ *****************************************************************************/
+
+imageError readPreview(istream& fin, image& img, previewMode view)
+{
+    TRACE_SCOPE("readPreview");
+
+    int rows;
+    int cols;
+    imageError result;
+
+    if (fin.peek() == 'q' || fin.peek() == 't' || isPam(fin))
+    {
+        result = readImage(fin, img);
+
+        if (result == IMAGE_OK)
+        {
+            result = shrinkImage(img, view);
+        }
+        return result;
+    }
+
+    result = readHeader(fin, img);
+
+    if (result != IMAGE_OK)
+    {
+        return result;
+    }
+
+    rows = img.rows;
+    cols = img.cols;
+
+    // every number of an averaged P3 image is needed anyway
+    if (img.magicNumber == "P3" && view.box)
+    {
+        if (!allocImage(img, rows, cols))
+        {
+            return IMAGE_NO_MEMORY;
+        }
+
+        result = readAscii(fin, img);
+
+        if (result == IMAGE_OK)
+        {
+            result = shrinkImage(img, view);
+        }
+    }
+    else
+    {
+        if (!allocImage(img, (rows + view.step - 1) / view.step,
+            (cols + view.step - 1) / view.step))
+        {
+            return IMAGE_NO_MEMORY;
+        }
+
+        if (img.magicNumber == "P3")
+        {
+            result = sampleAscii(fin, img, rows, cols, view.step);
+        }
+        else if (view.box)
+        {
+            result = averageBinary(fin, img, rows, cols, view.step);
+        }
+        else
+        {
+            result = sampleBinary(fin, img, cols, view.step);
+        }
+    }
+
+    if (result != IMAGE_OK)
+    {
+        freeImage(img);
+    }
+
+    return result;
+}
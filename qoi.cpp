@@ -0,0 +1,527 @@
+/** ***************************************************************************
+ * @file
+ * @brief Contains functions to read and write images in the QOI format
+ *
+ * QOI (the "Quite OK Image" format) is a simple lossless format.  Each
+ * pixel is stored as one of a few short codes that refer to the pixel
+ * before it, to a table of 64 recently seen pixels, or to a run of equal
+ * pixels.  See https://qoiformat.org for the specification.
+ *****************************************************************************/
+
+
+#include "netPBM.h"
+
+
+/**
+ * @brief code for an index into the table of recently seen pixels
+ */
+
+const unsigned char QOI_OP_INDEX = 0x00;
+
+/**
+ * @brief code for a small difference from the previous pixel
+ */
+
+const unsigned char QOI_OP_DIFF = 0x40;
+
+/**
+ * @brief code for a difference based on the change in green
+ */
+
+const unsigned char QOI_OP_LUMA = 0x80;
+
+/**
+ * @brief code for a run of pixels equal to the previous pixel
+ */
+
+const unsigned char QOI_OP_RUN = 0xc0;
+
+/**
+ * @brief code for a pixel given in full as red, green and blue
+ */
+
+const unsigned char QOI_OP_RGB = 0xfe;
+
+/**
+ * @brief code for a pixel given in full with its alpha value
+ */
+
+const unsigned char QOI_OP_RGBA = 0xff;
+
+/**
+ * @brief mask for the two bit codes
+ */
+
+const unsigned char QOI_MASK = 0xc0;
+
+/**
+ * @brief size the output buffer may reach before it is written to the file
+ */
+
+const size_t QOI_BUFFER = 65536;
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * finds the position of a pixel in the table of recently seen pixels.
+ *
+ * @param[in]     r - red value.
+ * @param[in]     g - green value.
+ * @param[in]     b - blue value.
+ * @param[in]     a - alpha value.
+ *
+ * @returns position of the pixel in the table, from 0 to 63.
+ *
+ * @par Example
+ * @verbatim
+   int pos;
+   pos = qoiHash(0, 0, 0, 255); // pos is 53
+   @endverbatim
+ *****************************************************************************/
+
+int qoiHash(pixel r, pixel g, pixel b, pixel a)
+{
+    return (r * 3 + g * 5 + b * 7 + a * 11) % 64;
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * reads a QOI image from fin and stores it in structure image.  Four
+ * channel files get an alpha plane.
+ *
+ * @param[in,out]     fin - file opened for input conataining a QOI image.
+ * @param[in,out]    img - a struture that contains data for ppm image.
+ *
+ * @returns IMAGE_OK if the image was read, otherwise the reason it wasn't.
+ *
+ * @par Example
+ * @verbatim
+   image img;
+   ifstream fin;
+   readQoi(fin, img); // reads the QOI image in fin into img
+   @endverbatim
+ *****************************************************************************/
+
+imageError readQoi(istream& fin, image& img)
+{
+    TRACE_SCOPE("readQoi");
+
+    unsigned char header[14];
+    vector<unsigned char> data;
+    size_t pos = 0;
+
+    pixel table[64][4] = {};
+    pixel r = 0;
+    pixel g = 0;
+    pixel b = 0;
+    pixel a = 255;
+
+    int i;
+    int j;
+    int run = 0;
+    int index;
+    int code;
+    int dg;
+
+    fin.read((char*) header, 14);
+
+    if (!fin || memcmp(header, "qoif", 4) != 0)
+    {
+        return IMAGE_BAD_FORMAT;
+    }
+
+    img.magicNumber = "qoif";
+    img.comment = "";
+    img.cols = (header[4] << 24) | (header[5] << 16) | (header[6] << 8) | header[7];
+    img.rows = (header[8] << 24) | (header[9] << 16) | (header[10] << 8) | header[11];
+    img.maxval = 255;
+
+    if (img.cols <= 0 || img.rows <= 0)
+    {
+        return IMAGE_BAD_FORMAT;
+    }
+
+    data.assign(istreambuf_iterator<char>(fin), istreambuf_iterator<char>());
+    countAlloc(data.size());
+
+    if (!allocImage(img, img.rows, img.cols))
+    {
+        countFree(data.size());
+        return IMAGE_NO_MEMORY;
+    }
+
+    if (header[12] == 4 && !allocAlpha(img))
+    {
+        freeImage(img);
+        countFree(data.size());
+        return IMAGE_NO_MEMORY;
+    }
+
+    for (i = 0; i < img.rows; i++)
+    {
+        for (j = 0; j < img.cols; j++)
+        {
+            if (run > 0)
+            {
+                run--;
+            }
+            else if (pos < data.size())
+            {
+                code = data[pos++];
+
+                if (code == QOI_OP_RGB && pos + 3 <= data.size())
+                {
+                    r = data[pos++];
+                    g = data[pos++];
+                    b = data[pos++];
+                }
+                else if (code == QOI_OP_RGBA && pos + 4 <= data.size())
+                {
+                    r = data[pos++];
+                    g = data[pos++];
+                    b = data[pos++];
+                    a = data[pos++];
+                }
+                else if ((code & QOI_MASK) == QOI_OP_INDEX)
+                {
+                    index = code & 0x3f;
+                    r = table[index][0];
+                    g = table[index][1];
+                    b = table[index][2];
+                    a = table[index][3];
+                }
+                else if ((code & QOI_MASK) == QOI_OP_DIFF)
+                {
+                    r = pixel(r + ((code >> 4) & 0x03) - 2);
+                    g = pixel(g + ((code >> 2) & 0x03) - 2);
+                    b = pixel(b + (code & 0x03) - 2);
+                }
+                else if ((code & QOI_MASK) == QOI_OP_LUMA && pos < data.size())
+                {
+                    dg = (code & 0x3f) - 32;
+                    code = data[pos++];
+                    r = pixel(r + dg - 8 + ((code >> 4) & 0x0f));
+                    g = pixel(g + dg);
+                    b = pixel(b + dg - 8 + (code & 0x0f));
+                }
+                else if ((code & QOI_MASK) == QOI_OP_RUN)
+                {
+                    run = code & 0x3f;
+                }
+
+                index = qoiHash(r, g, b, a);
+                table[index][0] = r;
+                table[index][1] = g;
+                table[index][2] = b;
+                table[index][3] = a;
+            }
+
+            img.redGray[i][j] = r;
+            img.green[i][j] = g;
+            img.blue[i][j] = b;
+
+            if (img.alpha != nullptr)
+            {
+                img.alpha[i][j] = a;
+            }
+        }
+    }
+
+    countFree(data.size());
+
+    return IMAGE_OK;
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * starts a QOI image the size of header, with four channels when it has
+ * an alpha plane and three channels otherwise.  The header of the file
+ * is put in the buffer of enc, which is written out with the first rows.
+ *
+ * @param[out]    enc - state of the encoder.
+ * @param[in]     header - size of the image and whether it has alpha.
+ *
+ * @par Example
+ * @verbatim
+   qoiEncoder enc;
+   startQoi(enc, img);
+   @endverbatim
+ *****************************************************************************/
+
+void startQoi(qoiEncoder& enc, image& header)
+{
+    int k;
+
+    memset(enc.table, 0, sizeof(enc.table));
+    enc.pr = 0;
+    enc.pg = 0;
+    enc.pb = 0;
+    enc.pa = 255;
+    enc.run = 0;
+
+    enc.data.clear();
+    enc.data.reserve(size_t(qoiBufferBytes(header.cols)));
+    enc.bytes = enc.data.capacity();
+    countAlloc(enc.bytes);
+
+    enc.data.push_back('q');
+    enc.data.push_back('o');
+    enc.data.push_back('i');
+    enc.data.push_back('f');
+
+    for (k = 24; k >= 0; k -= 8)
+    {
+        enc.data.push_back((unsigned char) (header.cols >> k));
+    }
+    for (k = 24; k >= 0; k -= 8)
+    {
+        enc.data.push_back((unsigned char) (header.rows >> k));
+    }
+
+    enc.data.push_back(header.alpha != nullptr ? 4 : 3);
+    enc.data.push_back(0);
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * encodes every row of img as the next rows of the QOI image started in
+ * enc.  The codes are collected in a small buffer that is written out
+ * whenever it passes QOI_BUFFER bytes.
+ *
+ * @param[in,out]     fout - stream opened for output.
+ * @param[in,out]     enc - state of the encoder.
+ * @param[in]         img - rows to encode.
+ *
+ * @par Example
+ * @verbatim
+   encodeQoiRows(fout, enc, img); // all of img, or one row of a bigger image
+   @endverbatim
+ *****************************************************************************/
+
+void encodeQoiRows(ostream& fout, qoiEncoder& enc, image& img)
+{
+    vector<unsigned char>& data = enc.data;
+
+    pixel r;
+    pixel g;
+    pixel b;
+    pixel a = 255;
+
+    int i;
+    int j;
+    int index;
+    int dr;
+    int dg;
+    int db;
+    int dgr;
+    int dgb;
+
+    for (i = 0; i < img.rows; i++)
+    {
+        for (j = 0; j < img.cols; j++)
+        {
+            r = img.redGray[i][j];
+            g = img.green[i][j];
+            b = img.blue[i][j];
+
+            if (img.alpha != nullptr)
+            {
+                a = img.alpha[i][j];
+            }
+
+            if (r == enc.pr && g == enc.pg && b == enc.pb && a == enc.pa)
+            {
+                enc.run++;
+
+                if (enc.run == 62)
+                {
+                    data.push_back((unsigned char) (QOI_OP_RUN | (enc.run - 1)));
+                    enc.run = 0;
+                }
+                continue;
+            }
+
+            if (enc.run > 0)
+            {
+                data.push_back((unsigned char) (QOI_OP_RUN | (enc.run - 1)));
+                enc.run = 0;
+            }
+
+            index = qoiHash(r, g, b, a);
+
+            if (enc.table[index][0] == r && enc.table[index][1] == g
+                && enc.table[index][2] == b && enc.table[index][3] == a)
+            {
+                data.push_back((unsigned char) (QOI_OP_INDEX | index));
+            }
+            else
+            {
+                enc.table[index][0] = r;
+                enc.table[index][1] = g;
+                enc.table[index][2] = b;
+                enc.table[index][3] = a;
+
+                dr = (signed char) (r - enc.pr);
+                dg = (signed char) (g - enc.pg);
+                db = (signed char) (b - enc.pb);
+                dgr = dr - dg;
+                dgb = db - dg;
+
+                if (a != enc.pa)
+                {
+                    data.push_back(QOI_OP_RGBA);
+                    data.push_back(r);
+                    data.push_back(g);
+                    data.push_back(b);
+                    data.push_back(a);
+                }
+                else if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1)
+                {
+                    data.push_back((unsigned char) (QOI_OP_DIFF | ((dr + 2) << 4)
+                        | ((dg + 2) << 2) | (db + 2)));
+                }
+                else if (dg >= -32 && dg <= 31 && dgr >= -8 && dgr <= 7
+                    && dgb >= -8 && dgb <= 7)
+                {
+                    data.push_back((unsigned char) (QOI_OP_LUMA | (dg + 32)));
+                    data.push_back((unsigned char) (((dgr + 8) << 4) | (dgb + 8)));
+                }
+                else
+                {
+                    data.push_back(QOI_OP_RGB);
+                    data.push_back(r);
+                    data.push_back(g);
+                    data.push_back(b);
+                }
+            }
+
+            enc.pr = r;
+            enc.pg = g;
+            enc.pb = b;
+            enc.pa = a;
+        }
+
+        if (data.size() > QOI_BUFFER)
+        {
+            fout.write((char*) data.data(), data.size());
+            data.clear();
+        }
+    }
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * ends the QOI image in enc and writes what is left of its buffer.
+ *
+ * @param[in,out]     fout - stream opened for output.
+ * @param[in,out]     enc - state of the encoder, its buffer is released.
+ *
+ * @returns IMAGE_OK or IMAGE_WRITE_FAILED if fout could not be written.
+ *
+ * @par Example
+ * @verbatim
+   finishQoi(fout, enc); // the last run and the end marker
+   @endverbatim
+ *****************************************************************************/
+
+imageError finishQoi(ostream& fout, qoiEncoder& enc)
+{
+    int k;
+
+    if (enc.run > 0)
+    {
+        enc.data.push_back((unsigned char) (QOI_OP_RUN | (enc.run - 1)));
+        enc.run = 0;
+    }
+
+    for (k = 0; k < 7; k++)
+    {
+        enc.data.push_back(0);
+    }
+    enc.data.push_back(1);
+
+    fout.write((char*) enc.data.data(), enc.data.size());
+
+    vector<unsigned char>().swap(enc.data);
+    countFree(enc.bytes);
+
+    return fout ? IMAGE_OK : IMAGE_WRITE_FAILED;
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * writes the structure image to fout as a QOI image, with four channels
+ * when it has an alpha plane and three channels otherwise.  The
+ * codes are collected in a small buffer that is written out whenever it
+ * passes QOI_BUFFER bytes, so only a little memory is used beyond img.
+ *
+ * @param[in,out]     fout - ofstream file opened for output.
+ * @param[in,out]    img - structure conatining data about ppm image, it is
+ *                         freed after it is written.
+ *
+ * @returns IMAGE_OK or IMAGE_WRITE_FAILED if fout could not be written.
+ *
+ * @par Example
+ * @verbatim
+   image img;
+   ofstream fout;
+   openOutputFile("balloon", ".qoi", fout);
+   writeQoi(fout, img); // writes img to balloon.qoi
+   @endverbatim
+ *****************************************************************************/
+
+imageError writeQoi(ostream& fout, image& img)
+{
+    TRACE_SCOPE("writeQoi");
+
+    qoiEncoder enc;
+    imageError result;
+
+    startQoi(enc, img);
+    encodeQoiRows(fout, enc, img);
+    result = finishQoi(fout, enc);
+
+    freeImage(img);
+
+    return result;
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * returns the size of the buffer writeQoi uses for an image of the given
+ * width.
+ *
+ * @param[in]     cols - number of columns in the image.
+ *
+ * @returns size of the buffer in bytes.
+ *
+ * @par Example
+ * @verbatim
+   qoiBufferBytes(640); // 68112
+   @endverbatim
+ *****************************************************************************/
+
+long long qoiBufferBytes(int cols)
+{
+    return (long long) (QOI_BUFFER + 4 * size_t(cols) + 16);
+}
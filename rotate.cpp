@@ -0,0 +1,533 @@
+/** ***************************************************************************
+ * @file
+ * @brief Contains the functions that rotate an image by any angle
+ *
+ * Every pixel of the rotated image is mapped back to a point in the
+ * original image and the original is sampled there.  The rotated image
+ * is done in square tiles so the rows of the original that a tile reads
+ * stay in the cache, and bands of tiles are shared between threads.
+ * Along a row of a tile the point in the original moves by the same step
+ * for every pixel, so it is found by adding the step in 16.16 fixed point
+ * rather than by multiplying.  Interpolation uses integer weights.
+ *****************************************************************************/
+
+
+#include "netPBM.h"
+
+
+/**
+ * @brief 1.0 in the 16.16 fixed point used for positions in the original
+ */
+
+const long long FIXED_ONE = 1 << 16;
+
+/**
+ * @brief width and height of the tiles the rotated image is made in
+ */
+
+const int ROTATE_TILE = 64;
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * reads a rotation written as DEG[,sampling][,canvas][,fill].  DEG is in
+ * degrees clockwise.  sampling is nearest, bilinear or bicubic, canvas is
+ * expand, which makes the image big enough for all of the rotated image,
+ * or crop, which keeps the original size.  fill is the color of the
+ * corners uncovered by the rotation, either a gray value or R/G/B.  The
+ * defaults are bilinear, expand and black.
+ *
+ * @param[in]     param - parameter given after --rotate.
+ * @param[out]    rot - the rotation.
+ *
+ * @returns true if param is a valid rotation and false otherwise.
+ *
+ * @par Example
+ * @verbatim
+   rotation rot;
+   parseRotation("-2.5", rot);                    // bilinear, expand, black
+   parseRotation("3,bicubic,crop,255", rot);      // white corners
+   parseRotation("45,nearest,0/0/255", rot);      // blue corners
+   parseRotation("45,sideways", rot);             // returns false
+   @endverbatim
+ *****************************************************************************/
+
+bool parseRotation(string param, rotation& rot)
+{
+    size_t start = 0;
+    size_t end;
+    string word;
+    char* stop;
+    int r;
+    int g;
+    int b;
+    char extra;
+    bool first = true;
+
+    rot.degrees = 0;
+    rot.sampling = SAMPLE_BILINEAR;
+    rot.expand = true;
+    rot.fill[0] = rot.fill[1] = rot.fill[2] = 0;
+
+    while (start <= param.size())
+    {
+        end = param.find(',', start);
+
+        if (end == string::npos)
+        {
+            end = param.size();
+        }
+        word = param.substr(start, end - start);
+        start = end + 1;
+
+        if (first)
+        {
+            rot.degrees = strtod(word.c_str(), &stop);
+
+            if (word.empty() || *stop != '\0' || !isfinite(rot.degrees))
+            {
+                return false;
+            }
+            first = false;
+        }
+        else if (word == "nearest")
+        {
+            rot.sampling = SAMPLE_NEAREST;
+        }
+        else if (word == "bilinear")
+        {
+            rot.sampling = SAMPLE_BILINEAR;
+        }
+        else if (word == "bicubic")
+        {
+            rot.sampling = SAMPLE_BICUBIC;
+        }
+        else if (word == "expand" || word == "crop")
+        {
+            rot.expand = word == "expand";
+        }
+        else if (sscanf(word.c_str(), "%d/%d/%d%c", &r, &g, &b, &extra) == 3
+            && r >= 0 && r <= 255 && g >= 0 && g <= 255 && b >= 0 && b <= 255)
+        {
+            rot.fill[0] = pixel(r);
+            rot.fill[1] = pixel(g);
+            rot.fill[2] = pixel(b);
+        }
+        else if (sscanf(word.c_str(), "%d%c", &r, &extra) == 1 && r >= 0 && r <= 255)
+        {
+            rot.fill[0] = rot.fill[1] = rot.fill[2] = pixel(r);
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * finds the sine and cosine of a clockwise angle in degrees.  Multiples of
+ * 90 degrees are exact so those rotations match rotateCW and rotateCCW.
+ *
+ * @param[in]     degrees - angle in degrees.
+ * @param[out]    sine - sine of the angle.
+ * @param[out]    cosine - cosine of the angle.
+ *
+ * @par Example
+ * @verbatim
+   double s, c;
+   rotationAngle(90, s, c); // s is 1, c is 0
+   @endverbatim
+ *****************************************************************************/
+
+void rotationAngle(double degrees, double& sine, double& cosine)
+{
+    double turn = fmod(degrees, 360.0);
+
+    if (turn < 0)
+    {
+        turn = turn + 360;
+    }
+
+    if (turn == 0 || turn == 90 || turn == 180 || turn == 270)
+    {
+        sine = (turn == 90) ? 1 : (turn == 270) ? -1 : 0;
+        cosine = (turn == 0) ? 1 : (turn == 180) ? -1 : 0;
+        return;
+    }
+
+    sine = sin(turn * acos(-1.0) / 180);
+    cosine = cos(turn * acos(-1.0) / 180);
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * finds the size of an image after it is rotated.
+ *
+ * @param[in]     rows - number of rows before the rotation.
+ * @param[in]     cols - number of columns before the rotation.
+ * @param[in]     rot - the rotation.
+ * @param[out]    newRows - number of rows after the rotation.
+ * @param[out]    newCols - number of columns after the rotation.
+ *
+ * @par Example
+ * @verbatim
+   rotation rot;
+   parseRotation("90", rot);
+   rotatedSize(480, 640, rot, r, c); // r is 640, c is 480
+   @endverbatim
+ *****************************************************************************/
+
+void rotatedSize(int rows, int cols, rotation rot, int& newRows, int& newCols)
+{
+    double sine;
+    double cosine;
+
+    newRows = rows;
+    newCols = cols;
+
+    if (!rot.expand)
+    {
+        return;
+    }
+
+    rotationAngle(rot.degrees, sine, cosine);
+    sine = fabs(sine);
+    cosine = fabs(cosine);
+
+    newCols = max(1, int(ceil(cols * cosine + rows * sine - 1e-6)));
+    newRows = max(1, int(ceil(cols * sine + rows * cosine - 1e-6)));
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * returns one value of a plane, or the fill value when the position is
+ * outside of the image.
+ *
+ * @param[in]     plane - 2D array of one color.
+ * @param[in]     rows - number of rows in plane.
+ * @param[in]     cols - number of columns in plane.
+ * @param[in]     y - row to read.
+ * @param[in]     x - column to read.
+ * @param[in]     fill - value for positions outside of plane.
+ *
+ * @returns the value at row y and column x.
+ *
+ * @par Example
+ * @verbatim
+   samplePlane(img.red, img.rows, img.cols, -1, 0, 255); // 255
+   @endverbatim
+ *****************************************************************************/
+
+int samplePlane(pixel** plane, int rows, int cols, int y, int x, pixel fill)
+{
+    if (y < 0 || x < 0 || y >= rows || x >= cols)
+    {
+        return fill;
+    }
+
+    return plane[y][x];
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * fills in the Catmull-Rom weights used by bicubic sampling for each of
+ * 256 fractions of a pixel.  The four weights of a fraction add up to 256.
+ *
+ * @param[out]    weights - table of weights.
+ *
+ * @par Example
+ * @verbatim
+   int weights[256][4];
+   cubicWeights(weights); // weights[0] is 0, 256, 0, 0
+   @endverbatim
+ *****************************************************************************/
+
+void cubicWeights(int weights[256][4])
+{
+    int i;
+    double t;
+
+    for (i = 0; i < 256; i++)
+    {
+        t = i / 256.0;
+        weights[i][0] = int(lround(128 * (-t * t * t + 2 * t * t - t)));
+        weights[i][2] = int(lround(128 * (-3 * t * t * t + 4 * t * t + t)));
+        weights[i][3] = int(lround(128 * (t * t * t - t * t)));
+        weights[i][1] = 256 - weights[i][0] - weights[i][2] - weights[i][3];
+    }
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * finds one pixel of the rotated image by sampling the original at a
+ * point given in 16.16 fixed point.
+ *
+ * @param[in]     img - original image.
+ * @param[in]     rot - the rotation, for its sampling and fill.
+ * @param[in]     weights - table made by cubicWeights.
+ * @param[in]     sx - column in the original.
+ * @param[in]     sy - row in the original.
+ * @param[out]    out - red, green and blue of the pixel, and its alpha
+ *                        when img has an alpha plane.
+ *
+ * @par Example
+ * @verbatim
+   pixel out[4];
+   samplePixel(img, rot, weights, 10 * FIXED_ONE, 5 * FIXED_ONE, out);
+                                              // the pixel at row 5, column 10
+   @endverbatim
+ *****************************************************************************/
+
+void samplePixel(image& img, rotation& rot, const int weights[256][4],
+    long long sx, long long sy, pixel out[4])
+{
+    pixel** planes[4] = { img.redGray, img.green, img.blue, img.alpha };
+    pixel fill[4] = { rot.fill[0], rot.fill[1], rot.fill[2], 0 };
+    int count = img.alpha != nullptr ? 4 : 3;
+    int x;
+    int y;
+    int fx;
+    int fy;
+    int c;
+    int i;
+    int j;
+    int top;
+    int bottom;
+    int sum;
+    int line;
+
+    // far outside, every sampling gives the fill color
+    if (sx < -3 * FIXED_ONE || sy < -3 * FIXED_ONE
+        || sx > (img.cols + 2) * FIXED_ONE || sy > (img.rows + 2) * FIXED_ONE)
+    {
+        memcpy(out, fill, count);
+        return;
+    }
+
+    // move to positive values so the shifts round down
+    sx = sx + 4 * FIXED_ONE;
+    sy = sy + 4 * FIXED_ONE;
+
+    if (rot.sampling == SAMPLE_NEAREST)
+    {
+        x = int((sx + FIXED_ONE / 2) >> 16) - 4;
+        y = int((sy + FIXED_ONE / 2) >> 16) - 4;
+
+        for (c = 0; c < count; c++)
+        {
+            out[c] = pixel(samplePlane(planes[c], img.rows, img.cols, y, x, fill[c]));
+        }
+        return;
+    }
+
+    x = int(sx >> 16) - 4;
+    y = int(sy >> 16) - 4;
+    fx = int(sx >> 8) & 0xff;
+    fy = int(sy >> 8) & 0xff;
+
+    if (rot.sampling == SAMPLE_BILINEAR)
+    {
+        for (c = 0; c < count; c++)
+        {
+            if (x >= 0 && y >= 0 && x + 1 < img.cols && y + 1 < img.rows)
+            {
+                top = planes[c][y][x] * 256 + (planes[c][y][x + 1] - planes[c][y][x]) * fx;
+                bottom = planes[c][y + 1][x] * 256
+                    + (planes[c][y + 1][x + 1] - planes[c][y + 1][x]) * fx;
+            }
+            else
+            {
+                top = samplePlane(planes[c], img.rows, img.cols, y, x, fill[c]);
+                top = top * 256 + (samplePlane(planes[c], img.rows, img.cols, y, x + 1,
+                    fill[c]) - top) * fx;
+                bottom = samplePlane(planes[c], img.rows, img.cols, y + 1, x, fill[c]);
+                bottom = bottom * 256 + (samplePlane(planes[c], img.rows, img.cols,
+                    y + 1, x + 1, fill[c]) - bottom) * fx;
+            }
+            out[c] = pixel((top * 256 + (bottom - top) * fy + 32768) >> 16);
+        }
+        return;
+    }
+
+    for (c = 0; c < count; c++)
+    {
+        sum = 0;
+
+        for (i = 0; i < 4; i++)
+        {
+            line = 0;
+
+            if (x >= 1 && y + i >= 1 && x + 2 < img.cols && y + i <= img.rows)
+            {
+                for (j = 0; j < 4; j++)
+                {
+                    line += weights[fx][j] * planes[c][y + i - 1][x + j - 1];
+                }
+            }
+            else
+            {
+                for (j = 0; j < 4; j++)
+                {
+                    line += weights[fx][j] * samplePlane(planes[c], img.rows, img.cols,
+                        y + i - 1, x + j - 1, fill[c]);
+                }
+            }
+            sum += weights[fy][i] * line;
+        }
+        out[c] = (sum <= 0) ? 0 : clampPixel((sum + 32768) >> 16);
+    }
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * rotates the image by any angle about its center.  Each pixel of the
+ * result is mapped back into the original and sampled there, and pixels
+ * that map outside of the original get the fill color.  When the image
+ * has alpha those pixels are also transparent.
+ *
+ * @param[in,out]     img - structure containing data of a ppm image.
+ * @param[in]     rot - angle, sampling, canvas and fill, see parseRotation.
+ * @param[in]     outputType - aschii or binary format type.
+ *
+ * @returns IMAGE_OK or IMAGE_NO_MEMORY if the rotated image doesn't fit.
+ *
+ * @par Example
+ * @verbatim
+   rotation rot;
+   parseRotation("-3,bicubic,255", rot);
+   rotateImage(img, rot, OUTPUT_BINARY); // deskews a scanned page
+   @endverbatim
+ *****************************************************************************/
+
+imageError rotateImage(image& img, rotation rot, outputFormat outputType)
+{
+    TRACE_SCOPE("rotateImage");
+
+    image result;
+    int rows;
+    int cols;
+    int bands;
+    int threads;
+    int weights[256][4];
+
+    double sine;
+    double cosine;
+    long long originX;
+    long long originY;
+    long long stepX;
+    long long stepY;
+
+    rotationAngle(rot.degrees, sine, cosine);
+    rotatedSize(img.rows, img.cols, rot, rows, cols);
+    cubicWeights(weights);
+
+    if (!allocImage(result, rows, cols))
+    {
+        return IMAGE_NO_MEMORY;
+    }
+
+    if (img.alpha != nullptr && !allocAlpha(result))
+    {
+        freeImage(result);
+        return IMAGE_NO_MEMORY;
+    }
+
+    // position in the original of the center of pixel (0, 0) of the result
+    originX = llround(((0.5 - cols / 2.0) * cosine + (0.5 - rows / 2.0) * sine
+        + img.cols / 2.0 - 0.5) * FIXED_ONE);
+    originY = llround((-(0.5 - cols / 2.0) * sine + (0.5 - rows / 2.0) * cosine
+        + img.rows / 2.0 - 0.5) * FIXED_ONE);
+    stepX = llround(cosine * FIXED_ONE);
+    stepY = llround(-sine * FIXED_ONE);
+
+    bands = (rows + ROTATE_TILE - 1) / ROTATE_TILE;
+    threads = min(bands, threadCount((result.alpha != nullptr ? 4LL : 3LL) * rows * cols));
+
+    runParallel(threads, [&](int part)
+    {
+        int band;
+        int left;
+        int i;
+        int j;
+        long long sx;
+        long long sy;
+        long long downX = llround(sine * FIXED_ONE);
+        long long downY = llround(cosine * FIXED_ONE);
+        pixel out[4];
+
+        for (band = part; band < bands; band += threads)
+        {
+            for (left = 0; left < cols; left += ROTATE_TILE)
+            {
+                for (i = band * ROTATE_TILE; i < min(rows, (band + 1) * ROTATE_TILE); i++)
+                {
+                    sx = originX + left * stepX + i * downX;
+                    sy = originY + left * stepY + i * downY;
+
+                    for (j = left; j < min(cols, left + ROTATE_TILE); j++)
+                    {
+                        samplePixel(img, rot, weights, sx, sy, out);
+                        result.redGray[i][j] = out[0];
+                        result.green[i][j] = out[1];
+                        result.blue[i][j] = out[2];
+
+                        if (result.alpha != nullptr)
+                        {
+                            result.alpha[i][j] = out[3];
+                        }
+
+                        sx = sx + stepX;
+                        sy = sy + stepY;
+                    }
+                }
+            }
+        }
+    });
+
+    freeImage(img);
+
+    img.redGray = result.redGray;
+    img.green = result.green;
+    img.blue = result.blue;
+    img.alpha = result.alpha;
+    img.rows = rows;
+    img.cols = cols;
+
+    // the corners are filled with a color unless the fill is gray
+    img.gray = img.gray && rot.fill[0] == rot.fill[1] && rot.fill[1] == rot.fill[2];
+
+    if (outputType == OUTPUT_ASCII)
+    {
+        img.magicNumber = "P3";
+    }
+
+    else if (outputType == OUTPUT_BINARY)
+    {
+        img.magicNumber = "P6";
+    }
+
+    return IMAGE_OK;
+}
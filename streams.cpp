@@ -0,0 +1,466 @@
+/** ***************************************************************************
+ * @file
+ * @brief Contains the stream buffers used to read from standard input, write
+ * to standard output or throw output away, and the functions that pick the
+ * right stream for a file name
+ *
+ * The readers and writers work on any istream or ostream, so an image can
+ * come from a file (ifstream), a pipe (pipeBuffer), or memory
+ * (istringstream), and can go to a file, a pipe, memory (ostringstream)
+ * or nowhere (nullBuffer).
+ *****************************************************************************/
+
+
+#include "netPBM.h"
+
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <io.h>
+#include <fcntl.h>
+#endif
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * creates a buffer that reads from or writes to file in blocks of size
+ * bytes.
+ *
+ * @param[in]     file - stdin to read or stdout to write.
+ * @param[in]     size - number of bytes moved with each read or write.
+ *
+ * @par Example
+ * @verbatim
+   pipeBuffer buffer(stdin, PIPE_BLOCK);
+   istream in(&buffer); // in reads standard input a megabyte at a time
+   @endverbatim
+ *****************************************************************************/
+
+pipeBuffer::pipeBuffer(FILE* file, size_t size) : file(file), buffer(size), start(0)
+{
+#ifdef _WIN32
+    _setmode(_fileno(file), _O_BINARY);
+#endif
+
+    if (file == stdout)
+    {
+        setp(buffer.data(), buffer.data() + buffer.size());
+    }
+    else
+    {
+        setg(buffer.data(), buffer.data(), buffer.data());
+    }
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * writes anything still in the buffer before the buffer goes away.
+ *
+ * @par Example
+ * @verbatim
+   {
+       pipeBuffer buffer(stdout, PIPE_BLOCK);
+   }   // the last block is written here
+   @endverbatim
+ *****************************************************************************/
+
+pipeBuffer::~pipeBuffer()
+{
+    sync();
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * reads the next block from the file once the buffer has been used up.
+ *
+ * @returns the next character or eof if the file has ended.
+ *
+ * @par Example
+ * @verbatim
+   in.get(); // calls underflow when the buffer is empty
+   @endverbatim
+ *****************************************************************************/
+
+pipeBuffer::int_type pipeBuffer::underflow()
+{
+    size_t count;
+
+    if (gptr() < egptr())
+    {
+        return traits_type::to_int_type(*gptr());
+    }
+
+    start = start + (egptr() - eback());
+    count = fread(buffer.data(), 1, buffer.size(), file);
+
+    if (count == 0)
+    {
+        setg(buffer.data(), buffer.data(), buffer.data());
+        return traits_type::eof();
+    }
+
+    setg(buffer.data(), buffer.data(), buffer.data() + count);
+
+    return traits_type::to_int_type(*gptr());
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * writes the full buffer to the file and then stores ch.
+ *
+ * @param[in]     ch - character that did not fit in the buffer.
+ *
+ * @returns ch, or eof if the write failed.
+ *
+ * @par Example
+ * @verbatim
+   out.put('P'); // calls overflow when the buffer is full
+   @endverbatim
+ *****************************************************************************/
+
+pipeBuffer::int_type pipeBuffer::overflow(int_type ch)
+{
+    if (sync() != 0)
+    {
+        return traits_type::eof();
+    }
+
+    if (!traits_type::eq_int_type(ch, traits_type::eof()))
+    {
+        *pptr() = traits_type::to_char_type(ch);
+        pbump(1);
+    }
+
+    return traits_type::not_eof(ch);
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * writes whatever is in the output buffer to the file.
+ *
+ * @returns 0 on success and -1 if the write failed.
+ *
+ * @par Example
+ * @verbatim
+   out.flush(); // calls sync
+   @endverbatim
+ *****************************************************************************/
+
+int pipeBuffer::sync()
+{
+    size_t count;
+
+    if (file != stdout)
+    {
+        return 0;
+    }
+
+    count = pptr() - pbase();
+
+    if (count > 0 && fwrite(pbase(), 1, count, file) != count)
+    {
+        return -1;
+    }
+
+    setp(buffer.data(), buffer.data() + buffer.size());
+
+    return fflush(file) == 0 ? 0 : -1;
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * moves the read position.  A pipe can't go back, so the position may only
+ * move back inside the block in the buffer, which is enough to read a
+ * header twice.  Moving forward reads and throws away the bytes skipped.
+ *
+ * @param[in]     off - distance to move.
+ * @param[in]     dir - where off is measured from, the end is not allowed.
+ * @param[in]     which - must include reading.
+ *
+ * @returns the new position or -1 if the move isn't possible.
+ *
+ * @par Example
+ * @verbatim
+   in.tellg();   // position in standard input
+   in.seekg(0);  // back to the start while still in the first block
+   @endverbatim
+ *****************************************************************************/
+
+pipeBuffer::pos_type pipeBuffer::seekoff(off_type off, ios_base::seekdir dir,
+    ios_base::openmode which)
+{
+    if (dir == ios_base::cur)
+    {
+        return seekpos(pos_type(start + (gptr() - eback()) + off), which);
+    }
+
+    if (dir == ios_base::beg)
+    {
+        return seekpos(pos_type(off), which);
+    }
+
+    return pos_type(off_type(-1));
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * moves the read position to pos, see seekoff.
+ *
+ * @param[in]     pos - position to move to.
+ * @param[in]     which - must include reading.
+ *
+ * @returns pos or -1 if the move isn't possible.
+ *
+ * @par Example
+ * @verbatim
+   in.seekg(4096); // skips ahead to byte 4096
+   @endverbatim
+ *****************************************************************************/
+
+pipeBuffer::pos_type pipeBuffer::seekpos(pos_type pos, ios_base::openmode which)
+{
+    long long target = (long long) off_type(pos);
+
+    if (!(which & ios_base::in) || file == stdout || target < start)
+    {
+        return pos_type(off_type(-1));
+    }
+
+    while (target > start + (egptr() - eback()))
+    {
+        setg(eback(), egptr(), egptr());
+
+        if (traits_type::eq_int_type(underflow(), traits_type::eof()))
+        {
+            return pos_type(off_type(-1));
+        }
+    }
+
+    setg(eback(), eback() + (target - start), egptr());
+
+    return pos;
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * throws away a character written to the null sink.
+ *
+ * @param[in]     ch - character written.
+ *
+ * @returns ch so the write counts as a success.
+ *
+ * @par Example
+ * @verbatim
+   nullBuffer discard;
+   ostream out(&discard);
+   out << "gone"; // nothing is written anywhere
+   @endverbatim
+ *****************************************************************************/
+
+nullBuffer::int_type nullBuffer::overflow(int_type ch)
+{
+    return traits_type::not_eof(ch);
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * throws away a block of characters written to the null sink.
+ *
+ * @param[in]     s - characters written.
+ * @param[in]     n - number of characters.
+ *
+ * @returns n so the write counts as a success.
+ *
+ * @par Example
+ * @verbatim
+   out.write(data, 1000); // returns right away
+   @endverbatim
+ *****************************************************************************/
+
+streamsize nullBuffer::xsputn(const char* s, streamsize n)
+{
+    (void) s;
+    return n;
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * returns the stream to read the image from.  A name of "-" means standard
+ * input and anything else is opened as a file with fileopeninput.
+ *
+ * @param[in]        name - name given on the command line.
+ * @param[in,out]    fin - file stream used when name is a file.
+ *
+ * @returns the stream to read from, or nullptr if the file can't be opened.
+ *
+ * @par Example
+ * @verbatim
+   ifstream fin;
+   istream* in = openInput("-", fin);          // standard input
+   istream* in2 = openInput("balloon.ppm", fin); // fin, opened on the file
+   @endverbatim
+ *****************************************************************************/
+
+istream* openInput(string name, ifstream& fin)
+{
+    if (name == "-")
+    {
+        static pipeBuffer buffer(stdin, PIPE_BLOCK);
+        static istream pipe(&buffer);
+
+        return &pipe;
+    }
+
+    if (!fileopeninput(fin, name))
+    {
+        return nullptr;
+    }
+    return &fin;
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * returns the stream to write an image to.  A name of "-" means standard
+ * output, ":null" throws the image away, which is useful for timing, and
+ * anything else is opened as the file name plus extension.
+ *
+ * @param[in]        name - basename given on the command line.
+ * @param[in]        extension - ".ppm", ".pgm", ".pbm", ".qoi", ".tpx",
+ *                                ".raw" or ".pam".
+ * @param[in,out]    fout - file stream used when name is a file or :null.
+ *
+ * @returns the stream to write to, or nullptr if the file can't be opened.
+ *
+ * @par Example
+ * @verbatim
+   ofstream fout;
+   ostream* out = openOutput("-", ".ppm", fout);       // standard output
+   ostream* out2 = openOutput("balloonx", ".pgm", fout); // balloonx.pgm
+   @endverbatim
+ *****************************************************************************/
+
+ostream* openOutput(string name, string extension, ofstream& fout)
+{
+    bool opened;
+
+    if (name == "-")
+    {
+        static pipeBuffer buffer(stdout, PIPE_BLOCK);
+        static ostream pipe(&buffer);
+
+        return &pipe;
+    }
+
+    // fout itself is pointed at the buffer, so each caller, and each
+    // thread of --fanout, writes through its own stream.  The buffer keeps
+    // nothing, so one is shared by all of them.
+    if (name == ":null")
+    {
+        static nullBuffer discard;
+
+        fout.basic_ios<char>::rdbuf(&discard);
+
+        return &fout;
+    }
+
+    // put back the file buffer in case fout was used for :null before
+    fout.basic_ios<char>::rdbuf(fout.rdbuf());
+
+    if (extension == ".pgm")
+    {
+        opened = outputgray(fout, name);
+    }
+    else if (extension == ".ppm")
+    {
+        opened = fileopenoutput(fout, name);
+    }
+    else
+    {
+        opened = openOutputFile(name, extension, fout);
+    }
+
+    return opened ? &fout : nullptr;
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * makes the name of the spool file the tiled plan keeps the image in.
+ * The name holds the process id and a count, so programs and threads
+ * running at once never share a spool.  It is put next to the output
+ * file, which is on a disk with room for the image, or in the temporary
+ * directory when the output is standard output or is thrown away.
+ *
+ * @param[in]     target - basename the image is written to, - or :null.
+ *
+ * @returns the name of the spool file.
+ *
+ * @par Example
+ * @verbatim
+   spoolName("big");  // "big.4242.0.spool.tpx"
+   spoolName("-");    // "/tmp/thpe11.4242.1.spool.tpx"
+   @endverbatim
+ *****************************************************************************/
+
+string spoolName(string target)
+{
+    static atomic<int> count(0);
+    string unique = to_string(processId()) + "." + to_string(count++) + ".spool.tpx";
+    string dir;
+
+    if (target != "-" && target != ":null")
+    {
+        return target + "." + unique;
+    }
+
+#ifdef _WIN32
+    char path[MAX_PATH + 1];
+
+    // the path GetTempPath returns ends with a backslash
+    if (GetTempPathA(sizeof(path), path) > 0)
+    {
+        dir = path;
+    }
+#else
+    const char* path = getenv("TMPDIR");
+
+    dir = path != nullptr && *path != '\0' ? string(path) + "/" : "/tmp/";
+#endif
+
+    return dir + "thpe11." + unique;
+}
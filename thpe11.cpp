@@ -13,6 +13,679 @@
 
 const bool RUNCATCH = false;
 
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * Prints how the program is used along with every output type and option.
+ *
+ * @par Example
+ * @verbatim
+   usage(); // prints the usage statement to the screen
+   @endverbatim
+ *****************************************************************************/
+
+void usage()
+{
+    cout << "thpe11.exe [option ...] --outputtype basename image.ppm" << endl;
+    cout << "thpe11.exe --compare [limit ...] first.ppm second.ppm" << endl;
+    cout << "thpe11.exe --phash [--index FILE[,D]] image.ppm" << endl;
+    cout << "thpe11.exe --fanout image.ppm [option ...] --outputtype basename ..." << endl;
+    cout << endl;
+    cout << "Output Type      Output Description" << endl;
+    cout << "    --ascii      integer text numbers will be written for the data" << endl;
+    cout << "    --binary     integer numbers will be written in binary form" << endl;
+    cout << "    --qoi        lossless QOI compressed image written to basename.qoi" << endl;
+    cout << "    --tiled      tiled image with all of its smaller levels written to" << endl;
+    cout << "                 basename.tpx" << endl;
+    cout << "    --pam        PAM image written to basename.pam, which keeps the" << endl;
+    cout << "                 alpha of the input" << endl;
+    cout << endl;
+    cout << "Option Code      Option Description" << endl;
+    cout << "    --flipX      Flip the image on the X axis" << endl;
+    cout << "    --flipY      Flip the image on the Y axis" << endl;
+    cout << "    --rotateCW   Rotate the image clockwise" << endl;
+    cout << "    --rotateCCW  Rotate the image counter clockwise" << endl;
+    cout << "    --in-place   Rotate with --rotateCW and --rotateCCW in place, which" << endl;
+    cout << "                 needs about half the memory but is slower" << endl;
+    cout << "    --rotate DEG[,sampling][,canvas][,fill]" << endl;
+    cout << "                 Rotate the image DEG degrees clockwise.  sampling is" << endl;
+    cout << "                 nearest, bilinear (default) or bicubic, canvas is" << endl;
+    cout << "                 expand (default) or crop, and fill is the color of" << endl;
+    cout << "                 the uncovered corners as a gray value or R/G/B" << endl;
+    cout << "    --grayscale  Convert image to grayscale (must be last)" << endl;
+    cout << "    --colorspace SPACE[,option ...]" << endl;
+    cout << "                 Write the planes of the image in another color space" << endl;
+    cout << "                 as pgm images basename_Y.pgm, basename_Cb.pgm ..." << endl;
+    cout << "                 (must be last).  SPACE is ycbcr, hsv or lab.  ycbcr" << endl;
+    cout << "                 takes 601 (default) or 709 and 444 (default) or 420," << endl;
+    cout << "                 and raw writes every plane to basename.raw instead" << endl;
+    cout << "    --overlay FILE X,Y[,opacity][,tile]" << endl;
+    cout << "                 Lay the image in FILE, which may have alpha, over" << endl;
+    cout << "                 the image with its top left corner at column X, row" << endl;
+    cout << "                 Y.  opacity is 0 to 100 percent (default 100) and" << endl;
+    cout << "                 tile repeats it over the whole image" << endl;
+    cout << "    --bits N[,method]" << endl;
+    cout << "                 Keep only 2 to the power N (N is 1 to 8) levels per" << endl;
+    cout << "                 channel and write the image with a maxval of the" << endl;
+    cout << "                 levels less one, after every other option.  method" << endl;
+    cout << "                 is none (default), bayer, floyd or atkinson.  With" << endl;
+    cout << "                 --grayscale and N of 1 a bitmap is written to" << endl;
+    cout << "                 basename.pbm, P1 for ascii and P4 for binary" << endl;
+    cout << "    --preview N[,box]" << endl;
+    cout << "                 Read only every Nth row and column (N is 2 or more)" << endl;
+    cout << "                 for a quick look, before every other option.  box" << endl;
+    cout << "                 makes each pixel the average of its N by N cell" << endl;
+    cout << "    --skip-near FILE[,D]" << endl;
+    cout << "                 Skip the image, writing nothing, if the DCT hash of" << endl;
+    cout << "                 an image in the index FILE is within D bits (default" << endl;
+    cout << "                 8) of its own, otherwise add it to FILE once written" << endl;
+    cout << "    --median R   Replace each pixel with the median of the square of" << endl;
+    cout << "                 radius R (1 to 50) around it, which removes specks" << endl;
+    cout << "                 of noise and keeps edges" << endl;
+    cout << "    --bilateral S,R" << endl;
+    cout << "                 Smooth the image over about S pixels (1 to 64) but" << endl;
+    cout << "                 not across edges where the levels change by more" << endl;
+    cout << "                 than about R (1 to 255)" << endl;
+    cout << "    --sepia      Antique a color image" << endl;
+    cout << "    --brightness N  Add N (-255 to 255) to every pixel" << endl;
+    cout << "    --contrast N    Change contrast by N (-255 to 255)" << endl;
+    cout << "    --gamma G       Apply gamma correction G (greater than 0)" << endl;
+    cout << "    --invert        Produce the negative of the image" << endl;
+    cout << "    --threshold T   Pixels below T become 0, others 255" << endl;
+    cout << "    --posterize L   Keep only L (2 to 256) levels per channel" << endl;
+    cout << "    --roi x,y,w,h   Keep only the w by h region at column x, row y" << endl;
+    cout << "    --pyramid       Also write basename_1, basename_2 ... each half" << endl;
+    cout << "                    the size of the last (must be last)" << endl;
+    cout << "    --max-memory S  Use the fastest way of running that fits in S bytes" << endl;
+    cout << "                    (K, M and G suffixes allowed) and report it" << endl;
+    cout << "    --cache DIR     Keep finished images in DIR and copy them from" << endl;
+    cout << "                    there when the same image and options come again" << endl;
+    cout << "    --cache-size S  Most space the cache may use, 1G if not given" << endl;
+    cout << "    --level N       Read level N of a tiled image, each level is half" << endl;
+    cout << "                    the size of the one before" << endl;
+    cout << "    --trace FILE    Write a timeline of the reader, writer, memory and" << endl;
+    cout << "                    each operation on every thread to FILE as Chrome" << endl;
+    cout << "                    trace JSON (open in chrome://tracing or Perfetto)" << endl;
+    cout << "    --isa NAME      Run the pixel kernels built for NAME: scalar, sse4," << endl;
+    cout << "                    avx2 or avx512.  The best the CPU supports is used" << endl;
+    cout << "                    if not given" << endl;
+    cout << endl;
+    cout << "Options may be combined and are applied from left to right." << endl;
+    cout << "A basename of - writes to standard output and :null throws the" << endl;
+    cout << "output away.  An image name of - reads from standard input." << endl;
+    cout << endl;
+    cout << "Limit Code       Limit Description (for --compare)" << endl;
+    cout << "    --max-diff N    No value may differ by more than N" << endl;
+    cout << "    --min-psnr DB   The PSNR must be at least DB" << endl;
+    cout << "    --min-ssim S    The SSIM must be at least S" << endl;
+    cout << "Without limits the images must be equal.  The exit code is 0 if" << endl;
+    cout << "they are close enough, 1 if they aren't and 2 on an error." << endl;
+    cout << endl;
+    cout << "--phash prints the average, difference and DCT hashes of the image." << endl;
+    cout << "With --index it also lists the images in FILE whose DCT hash is within" << endl;
+    cout << "D bits (default 8) and adds the image to FILE if there are none.  The" << endl;
+    cout << "exit code is 0 for a new image, 1 for a near duplicate and 2 on an error." << endl;
+    cout << endl;
+    cout << "--fanout reads the image once and makes every output that follows it" << endl;
+    cout << "at the same time.  Each output is its own list of options ended by its" << endl;
+    cout << "output type and basename.  The exit code is 0 if every output was" << endl;
+    cout << "written, 1 if any wasn't and 2 on an error." << endl;
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * Checks if a command line arguement is an option and how many parameters
+ * follow it.
+ *
+ * @param[in]     arg - command line arguement.
+ * @param[out]    params - number of parameters the option takes.
+ *
+ * @returns true if arg is an option and false otherwise.
+ *
+ * @par Example
+ * @verbatim
+   int params;
+   isOption("--gamma", params); // returns true, params is 1
+   isOption("--ascii", params); // returns false
+   @endverbatim
+ *****************************************************************************/
+
+bool isOption(string arg, int& params)
+{
+    params = 0;
+
+    if (arg == "--flipX" || arg == "--flipY" || arg == "--rotateCW"
+        || arg == "--rotateCCW" || arg == "--grayscale" || arg == "--sepia"
+        || arg == "--invert" || arg == "--pyramid" || arg == "--in-place")
+    {
+        return true;
+    }
+
+    if (arg == "--brightness" || arg == "--contrast" || arg == "--gamma"
+        || arg == "--threshold" || arg == "--posterize" || arg == "--roi"
+        || arg == "--rotate" || arg == "--max-memory" || arg == "--cache"
+        || arg == "--cache-size" || arg == "--level" || arg == "--trace"
+        || arg == "--colorspace" || arg == "--bits" || arg == "--isa"
+        || arg == "--preview" || arg == "--skip-near" || arg == "--median"
+        || arg == "--bilateral")
+    {
+        params = 1;
+        return true;
+    }
+
+    if (arg == "--overlay")
+    {
+        params = 2;
+        return true;
+    }
+
+    return false;
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * Writes the trace started by --trace.  It is passed to atexit so the
+ * trace is written however the program ends.
+ *
+ * @par Example
+ * @verbatim
+   startTrace("run.json");
+   atexit(saveTrace); // run.json is written when the program ends
+   @endverbatim
+ *****************************************************************************/
+
+void saveTrace()
+{
+    if (!finishTrace())
+    {
+        cerr << "Unable to write the trace file" << endl;
+    }
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * Prints what happened while a job ran: the way of running chosen for
+ * --max-memory, why it failed, why the image was skipped and the cache
+ * counts.
+ *
+ * @param[in]     work - the job given on the command line.
+ * @param[in]     report - what happened, from runJob.
+ * @param[in]     error - value returned by runJob.
+ *
+ * @returns the exit code of the program.
+ *
+ * @par Example
+ * @verbatim
+   error = runJob(work, fin, report);
+   return reportJob(work, report, error); // Cache miss, 0 hits and 1 misses.
+   @endverbatim
+ *****************************************************************************/
+
+int reportJob(job& work, jobReport& report, imageError error)
+{
+    size_t i;
+
+    if (error == IMAGE_NO_PLAN)
+    {
+        cout << "No way of running fits in " << work.budget << " bytes." << endl;
+
+        for (i = 0; i < report.plans.size(); i++)
+        {
+            if (report.plans[i].possible)
+            {
+                cout << "    " << report.plans[i].name << " needs " << report.plans[i].bytes
+                    << " bytes" << endl;
+            }
+        }
+        return 1;
+    }
+
+    if (!report.choice.name.empty())
+    {
+        cout << "Running " << report.choice.name << ", estimated peak "
+            << report.choice.bytes << " bytes of " << work.budget << " bytes allowed."
+            << endl;
+    }
+
+    if (error == IMAGE_OPEN_FAILED && !report.failed.empty())
+    {
+        cout << "Unable to open file: " << report.failed << endl;
+        return report.cached ? 1 : 0;
+    }
+
+    if (error == IMAGE_CACHE_FAILED)
+    {
+        cout << "Unable to use cache " << report.failed << endl;
+        return 1;
+    }
+
+    if (error == IMAGE_INDEX_FAILED)
+    {
+        cout << "Unable to use index " << report.failed << endl;
+        return 1;
+    }
+
+    if (error != IMAGE_OK)
+    {
+        cout << errorMessage(error) << endl;
+        return 1;
+    }
+
+    if (!report.nearest.name.empty())
+    {
+        cout << "Skipped, " << work.inName << " is " << report.nearest.distance
+            << " bits from " << report.nearest.name << "." << endl;
+        return 0;
+    }
+
+    if (report.cached)
+    {
+        cout << "Cache " << (report.hit ? "hit" : "miss") << ", " << report.hits
+            << " hits and " << report.misses << " misses." << endl;
+    }
+
+    if (!work.nearIndex.empty() && !report.indexed)
+    {
+        cout << "Unable to add " << work.inName << " to index " << work.nearIndex << endl;
+    }
+
+    if (!report.choice.name.empty())
+    {
+        cout << "Measured peak " << peakMemory() << " bytes." << endl;
+    }
+
+    return 0;
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * Compares two images and prints how different they are for each color.
+ * The limits given before the images decide the exit code.
+ *
+ * @param[in]     argc - number of command line arguements passed in.
+ * @param[in]     argv - --compare, the limits and the two image names.
+ *
+ * @returns 0 if the images are within the limits, 1 if they aren't and 2
+ *          if they can't be compared.
+ *
+ * @par Example
+ * @verbatim
+   thpe11.exe --compare --min-psnr 40 out.ppm reference.ppm
+   @endverbatim
+ *****************************************************************************/
+
+int compareMode(int argc, char** argv)
+{
+    const char* names[4] = { "red", "green", "blue", "all" };
+    char line[100];
+    char* end;
+    double value;
+    bool given = false;
+    bool pass;
+    int i;
+    int c;
+
+    compareLimits limits;
+    comparison result;
+    imageError error;
+
+    if (argc < 4 || (argc - 4) % 2 != 0)
+    {
+        usage();
+        return 2;
+    }
+
+    for (i = 2; i < argc - 2; i += 2)
+    {
+        value = strtod(argv[i + 1], &end);
+
+        if (*end != '\0' || end == argv[i + 1])
+        {
+            cout << "Invalid parameter given for " << argv[i] << endl;
+            return 2;
+        }
+
+        // once any limit is given the others don't hold the images back
+        if (!given)
+        {
+            limits.maxDiff = 255;
+            given = true;
+        }
+
+        if (string(argv[i]) == "--max-diff")
+        {
+            limits.maxDiff = value;
+        }
+        else if (string(argv[i]) == "--min-psnr")
+        {
+            limits.minPsnr = value;
+        }
+        else if (string(argv[i]) == "--min-ssim")
+        {
+            limits.minSsim = value;
+        }
+        else
+        {
+            cout << "Invalid option given" << endl;
+            usage();
+            return 2;
+        }
+    }
+
+    error = compareFiles(argv[argc - 2], argv[argc - 1], result);
+
+    if (error == IMAGE_BAD_PARAMETER)
+    {
+        cout << "The images are different sizes." << endl;
+        return 2;
+    }
+
+    if (error != IMAGE_OK)
+    {
+        cout << errorMessage(error) << endl;
+        return 2;
+    }
+
+    cout << "color  max diff  mismatches      PSNR     SSIM" << endl;
+
+    for (c = 0; c < 4; c++)
+    {
+        snprintf(line, sizeof(line), "%-6s %9d %11lld %9.2f %8.5f", names[c],
+            result.maxDiff[c], result.mismatches[c], result.psnr[c], result.ssim[c]);
+        cout << line << endl;
+    }
+
+    pass = withinLimits(result, limits);
+
+    cout << (pass ? "The images match." : "The images do not match.") << endl;
+
+    return pass ? 0 : 1;
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * Prints the perceptual hashes of an image.  With an index it also lists
+ * the near duplicates already in the index, and adds the image when there
+ * are none.
+ *
+ * @param[in]     argc - number of command line arguements passed in.
+ * @param[in]     argv - --phash, the index if given and the image name.
+ *
+ * @returns 0 if the image is new, 1 if it is a near duplicate and 2 if it
+ *          can't be hashed.
+ *
+ * @par Example
+ * @verbatim
+   thpe11.exe --phash --index seen.phix,6 balloon.ppm
+   @endverbatim
+ *****************************************************************************/
+
+int phashMode(int argc, char** argv)
+{
+    char line[100];
+    string name;
+    string file;
+    int distance;
+    size_t i;
+
+    imageHash hash;
+    vector<hashMatch> matches;
+    imageError error;
+
+    if (argc == 5 && string(argv[2]) == "--index")
+    {
+        if (!parseNearIndex(argv[3], file, distance))
+        {
+            cout << "Invalid parameter given for --index" << endl;
+            return 2;
+        }
+    }
+    else if (argc != 3)
+    {
+        usage();
+        return 2;
+    }
+
+    name = argv[argc - 1];
+    error = hashImageFile(name, hash);
+
+    if (error != IMAGE_OK)
+    {
+        cout << errorMessage(error) << endl;
+        return 2;
+    }
+
+    snprintf(line, sizeof(line), "average     %016llx", hash.average);
+    cout << line << endl;
+    snprintf(line, sizeof(line), "difference  %016llx", hash.difference);
+    cout << line << endl;
+    snprintf(line, sizeof(line), "dct         %016llx", hash.dct);
+    cout << line << endl;
+
+    if (file.empty())
+    {
+        return 0;
+    }
+
+    if (!findNear(file, hash.dct, distance, matches))
+    {
+        cout << "Unable to use index " << file << endl;
+        return 2;
+    }
+
+    for (i = 0; i < matches.size(); i++)
+    {
+        cout << "Near duplicate of " << matches[i].name << ", " << matches[i].distance
+            << " bits apart." << endl;
+    }
+
+    if (!matches.empty())
+    {
+        return 1;
+    }
+
+    if (!addToIndex(file, hash.dct, name))
+    {
+        cout << "Unable to use index " << file << endl;
+        return 2;
+    }
+
+    cout << "Added to " << file << "." << endl;
+
+    return 0;
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * Reads an image once and makes several outputs from it at the same time,
+ * each with its own options, output type and basename.  The options of
+ * an output are the ones main takes, other than those that change how
+ * the image is read or how the whole run is done.  No two outputs may
+ * write the same file.
+ *
+ * @param[in]     argc - number of command line arguements passed in.
+ * @param[in]     argv - --fanout, the image name and the outputs.
+ *
+ * @returns 0 if every output was written, 1 if any wasn't and 2 if the
+ *          command line is wrong or the image can't be read.
+ *
+ * @par Example
+ * @verbatim
+   thpe11.exe --fanout balloon.ppm --binary full --grayscale --binary gray
+       --sepia --rotateCW --ascii sepia
+   @endverbatim
+ *****************************************************************************/
+
+int fanoutMode(int argc, char** argv)
+{
+    string arg;
+    int params;
+    int i;
+    size_t j;
+    bool inPlace = false;
+    bool failed = false;
+
+    operation op;
+    outputFormat outputType;
+    lastOption last;
+    rendition target;
+    vector<rendition> targets;
+    vector<imageError> results;
+    imageError error;
+
+    if (argc < 5)
+    {
+        usage();
+        return 2;
+    }
+
+    target.last = LAST_NONE;
+    target.bits = { 0, DITHER_NONE };
+    i = 3;
+
+    while (i < argc)
+    {
+        arg = argv[i];
+
+        if (parseOutputType(arg, outputType))
+        {
+            if (i + 1 >= argc || string(argv[i + 1]) == "-"
+                || !fitsOutput(target.last, target.bits, outputType))
+            {
+                cout << "Invalid output type specified" << endl;
+                usage();
+                return 2;
+            }
+
+            if (inPlace)
+            {
+                markInPlace(target.ops);
+            }
+
+            target.outputType = outputType;
+            target.name = argv[i + 1];
+
+            for (j = 0; j < targets.size(); j++)
+            {
+                if (sameOutput(targets[j], target))
+                {
+                    cout << "Two outputs would both write " << target.name << endl;
+                    return 2;
+                }
+            }
+            targets.push_back(target);
+
+            target = rendition();
+            target.last = LAST_NONE;
+            target.bits = { 0, DITHER_NONE };
+            inPlace = false;
+            i = i + 2;
+            continue;
+        }
+
+        // these read the image or set up the whole run, which is shared
+        if (!isOption(arg, params) || i + params >= argc || target.last != LAST_NONE
+            || arg == "--max-memory" || arg == "--cache" || arg == "--cache-size"
+            || arg == "--skip-near" || arg == "--level" || arg == "--preview"
+            || arg == "--trace" || arg == "--isa")
+        {
+            cout << "Invalid option given" << endl;
+            usage();
+            return 2;
+        }
+
+        op.name = arg;
+        op.param = (params >= 1) ? argv[i + 1] : "";
+
+        if (params == 2)
+        {
+            op.param = op.param + " " + argv[i + 2];
+        }
+
+        if (!validParam(op))
+        {
+            cout << "Invalid parameter given for " << op.name << endl;
+            usage();
+            return 2;
+        }
+
+        if (parseLastOption(op.name, last))
+        {
+            target.last = last;
+            parseColorSpace(op.param, target.space);
+
+            if (target.bits.bits > 0 && last != LAST_GRAYSCALE)
+            {
+                cout << "Invalid option given" << endl;
+                usage();
+                return 2;
+            }
+        }
+        else if (op.name == "--in-place")
+        {
+            inPlace = true;
+        }
+        else if (op.name == "--bits")
+        {
+            parseQuantizer(op.param, target.bits);
+        }
+        else
+        {
+            target.ops.push_back(op);
+        }
+
+        i = i + params + 1;
+    }
+
+    if (targets.empty() || !target.ops.empty() || target.last != LAST_NONE
+        || target.bits.bits > 0 || inPlace)
+    {
+        cout << "Invalid output type specified" << endl;
+        usage();
+        return 2;
+    }
+
+    error = runFanout(argv[2], targets, results);
+
+    if (error != IMAGE_OK)
+    {
+        cout << errorMessage(error) << endl;
+        return 2;
+    }
+
+    for (j = 0; j < targets.size(); j++)
+    {
+        if (results[j] != IMAGE_OK)
+        {
+            cout << "Unable to write " << targets[j].name << ": "
+                << errorMessage(results[j]) << endl;
+            failed = true;
+        }
+    }
+
+    return failed ? 1 : 0;
+}
+
+
 /** ***************************************************************************
  * @author Aryan Raval
  *
@@ -20,199 +693,1025 @@ const bool RUNCATCH = false;
  * Function main that is responsible for the execution of the program 
  * by calling various function to accomplish different tasks.
  *
- * @param[in]     argc - number of command line arguements passed in.
- * @param[out]    argv - contains values of commandline arguements passed in.
+ * @param[in]     argc - number of command line arguements passed in.
+ * @param[out]    argv - contains values of commandline arguements passed in.
+ *
+ * @return returns 0 on successful execution and non zero otherwise
+ * 
+ *****************************************************************************/
+
+int main(int argc, char** argv)
+{
+    Catch::Session session;
+    int result;
+
+    ifstream fin;
+    istream* in;
+
+    job work;
+    jobReport report;
+    operation op;
+    lastOption last;
+    isaLevel isa;
+    int params;
+    int i;
+    int level = 0;
+    bool inPlace = false;
+    imageError error;
+
+    if (RUNCATCH)
+    {
+        result = session.run(argc, argv);
+        if (result != 0)
+        {
+            cout << "Test cases didn't pass." << endl;
+            return result;
+        }
+    }
+
+    if (argc > 1 && string(argv[1]) == "--compare")
+    {
+        return compareMode(argc, argv);
+    }
+
+    if (argc > 1 && string(argv[1]) == "--phash")
+    {
+        return phashMode(argc, argv);
+    }
+
+    if (argc > 1 && string(argv[1]) == "--fanout")
+    {
+        return fanoutMode(argc, argv);
+    }
+
+    if (argc < 4)
+    {
+        usage();
+        exit(0);
+    }
+
+    i = 1;
+    while (i < argc - 3)
+    {
+        if (!isOption(argv[i], params) || i + params >= argc - 3
+            || work.last != LAST_NONE)
+        {
+            cout << "Invalid option given" << endl;
+            usage();
+            exit(0);
+        }
+
+        op.name = argv[i];
+        op.param = (params >= 1) ? argv[i + 1] : "";
+
+        // the file and the placement are kept together, split by a space
+        if (params == 2)
+        {
+            op.param = op.param + " " + argv[i + 2];
+        }
+
+        if (!validParam(op))
+        {
+            cout << "Invalid parameter given for " << op.name << endl;
+            usage();
+            exit(0);
+        }
+
+        if (parseLastOption(op.name, last))
+        {
+            work.last = last;
+            parseColorSpace(op.param, work.space);
+        }
+        else if (op.name == "--max-memory")
+        {
+            parseSize(op.param, work.budget);
+        }
+        else if (op.name == "--cache")
+        {
+            work.cacheDir = op.param;
+        }
+        else if (op.name == "--skip-near")
+        {
+            parseNearIndex(op.param, work.nearIndex, work.nearDistance);
+        }
+        else if (op.name == "--cache-size")
+        {
+            parseSize(op.param, work.cacheLimit);
+        }
+        else if (op.name == "--in-place")
+        {
+            inPlace = true;
+        }
+        else if (op.name == "--trace")
+        {
+            startTrace(op.param);
+            atexit(saveTrace);
+        }
+        else if (op.name == "--isa")
+        {
+            parseIsa(op.param, isa);
+
+            if (isa > detectIsa())
+            {
+                cout << "This CPU can't run " << op.param << ", the best it can run is "
+                    << isaName(detectIsa()) << endl;
+                exit(1);
+            }
+
+            if (!bindKernels(isa))
+            {
+                cout << "--isa must be given before the kernels are used" << endl;
+                exit(1);
+            }
+        }
+        else
+        {
+            // --bits, --preview and --level stay in the list so they are
+            // part of the cache key.  The preview is taken as the image is
+            // read, so it goes first.
+            if (op.name == "--bits")
+            {
+                parseQuantizer(op.param, work.bits);
+            }
+
+            if (op.name == "--preview")
+            {
+                parsePreview(op.param, work.view);
+            }
+
+            if (op.name == "--level")
+            {
+                parseInteger(op.param, level);
+            }
+            work.ops.insert(op.name == "--preview" ? work.ops.begin() : work.ops.end(), op);
+        }
+
+        i = i + params + 1;
+    }
+
+    if (inPlace)
+    {
+        markInPlace(work.ops);
+    }
+
+    if (work.bits.bits > 0 && (work.last == LAST_PYRAMID || work.last == LAST_COLORSPACE))
+    {
+        cout << "Invalid option given" << endl;
+        usage();
+        exit(0);
+    }
+
+    if (!parseOutputType(argv[argc - 3], work.outputType))
+    {
+        cout << "Invalid output type specified" << endl;
+        usage();
+        exit(0);
+    }
+
+    work.inName = argv[argc - 1];
+    work.outName = argv[argc - 2];
+
+    if (work.outName == "-")
+    {
+        cout.rdbuf(cerr.rdbuf());
+    }
+
+    in = openInput(work.inName, fin);
+
+    if (in == nullptr)
+    {
+        cout << "Unable to open file: " << work.inName << endl;
+        exit(0);
+    }
+
+    if (!fitsOutput(work.last, work.bits, work.outputType))
+    {
+        cout << "Invalid output type specified" << endl;
+        usage();
+        exit(0);
+    }
+
+    if (level > 0 && in->peek() != 't')
+    {
+        cout << "--level needs a tiled image" << endl;
+        exit(1);
+    }
+
+    error = runJob(work, *in, report);
+    filecloseinput(fin);
+
+    return reportJob(work, report, error);
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * Gives the lengths the kernel tests run on.  Each vector build has a loop
+ * over whole registers and a tail, so the lengths are every length up to
+ * a little more than the widest register, one either side of larger
+ * multiples of it, and a few random lengths.
+ *
+ * @returns the lengths to test.
+ *
+ * @par Example
+ * @verbatim
+   vector<int> sizes = kernelSizes(); // 1, 2, 3 ... 129, 255, 256 ...
+   @endverbatim
+ *****************************************************************************/
+
+vector<int> kernelSizes()
+{
+    int i;
+    vector<int> sizes;
+
+    for (i = 1; i <= 129; i++)
+    {
+        sizes.push_back(i);
+    }
+
+    for (i = 256; i <= 4096; i = i * 2)
+    {
+        sizes.push_back(i - 1);
+        sizes.push_back(i);
+        sizes.push_back(i + 1);
+    }
+
+    for (i = 0; i < 8; i++)
+    {
+        sizes.push_back(1 + rand() % 5000);
+    }
+
+    return sizes;
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * Fills count bytes with random values.
  *
- * @return returns 0 on successful execution and non zero otherwise
- * 
+ * @param[out]    data - bytes to fill.
+ * @param[in]     count - number of bytes.
+ *
+ * @par Example
+ * @verbatim
+   vector<pixel> row(300);
+   fillRandom(row.data(), 300);
+   @endverbatim
  *****************************************************************************/
 
-int main(int argc, char** argv)
+void fillRandom(void* data, size_t count)
 {
-    Catch::Session session;
-    int result;
+    size_t i;
+    unsigned char* bytes = (unsigned char*) data;
 
-    ifstream fin;
-    ofstream fout;
+    for (i = 0; i < count; i++)
+    {
+        bytes[i] = (unsigned char) (rand() & 255);
+    }
+}
 
-    ofstream foutgray;
 
-    image img;
-    bool ans;
+TEST_CASE("splitRgb, joinRgb and sampleRgb match the scalar kernels")
+{
+    int level;
+    int step;
+    int count;
+    const kernelTable& scalar = kernelVariants[ISA_SCALAR];
 
-    if (RUNCATCH)
+    srand(11);
+
+    for (level = ISA_SSE4; level <= detectIsa(); level++)
     {
-        result = session.run(argc, argv);
-        if (result != 0)
+        const kernelTable& variant = kernelVariants[level];
+
+        for (int size : kernelSizes())
         {
-            cout << "Test cases didn't pass." << endl;
-            return result;
+            // one past the start so the rows aren't aligned to a register
+            vector<pixel> rgb(12 * size + 1);
+            vector<pixel> want(3 * size + 1);
+            vector<pixel> got(3 * size + 1);
+            pixel* w = want.data() + 1;
+            pixel* g = got.data() + 1;
+
+            CAPTURE(isaName(isaLevel(level)), size);
+            fillRandom(rgb.data(), rgb.size());
+
+            scalar.splitRgb(rgb.data() + 1, w, w + size, w + 2 * size, size);
+            variant.splitRgb(rgb.data() + 1, g, g + size, g + 2 * size, size);
+            REQUIRE(want == got);
+
+            scalar.joinRgb(w, w + size, w + 2 * size, rgb.data(), size);
+            variant.joinRgb(w, w + size, w + 2 * size, rgb.data() + 3 * size, size);
+            REQUIRE(memcmp(rgb.data(), rgb.data() + 3 * size, 3 * size) == 0);
+
+            for (step = 2; step <= 4; step++)
+            {
+                count = (size + step - 1) / step;
+                scalar.sampleRgb(rgb.data() + 1, w, w + count, w + 2 * count, count,
+                    step);
+                variant.sampleRgb(rgb.data() + 1, g, g + count, g + 2 * count, count,
+                    step);
+                REQUIRE(want == got);
+            }
         }
     }
+}
+
+
+TEST_CASE("sumRow, sortPairs and histogramStep match the scalar kernels")
+{
+    int level;
+    const kernelTable& scalar = kernelVariants[ISA_SCALAR];
 
-    if (argc < 4 || argc > 5)
+    srand(12);
+
+    for (level = ISA_SSE4; level <= detectIsa(); level++)
     {
-        cout << "thpe11.exe [option] --outputtype basename image.ppm" << endl;
-        cout << endl;
-        cout << "Output Type      Output Description" << endl;
-        cout << "    --ascii      integer text numbers will be written for the data" << endl;
-        cout << "    --binary     integer numbers will be written in binary form" << endl;
-        cout << endl;
-        cout << "Option Code      Option Description" << endl;
-        cout << "    --flipX      Flip the image on the X axis" << endl;
-        cout << "    --flipY      Flip the image on the Y axis" << endl;
-        cout << "    --rotateCW   Rotate the image clockwise" << endl;
-        cout << "    --rotateCCW  Rotate the image counter clockwise" << endl;
-        cout << "    --grayscale  Convert image to grayscale" << endl;
-        cout << "    --sepia      Antique a color image" << endl;
-        exit(0);
+        const kernelTable& variant = kernelVariants[level];
+
+        for (int size : kernelSizes())
+        {
+            vector<pixel> row(size + 1);
+            vector<unsigned> wantSums(size);
+            vector<unsigned> gotSums;
+            vector<pixel> wantLow(size);
+            vector<pixel> wantHigh(size);
+            vector<pixel> gotLow;
+            vector<pixel> gotHigh;
+            vector<unsigned short> wantHist(size);
+            vector<unsigned short> gotHist;
+            vector<unsigned short> add(size);
+            vector<unsigned short> sub(size);
+
+            CAPTURE(isaName(isaLevel(level)), size);
+            fillRandom(row.data(), row.size());
+            fillRandom(wantSums.data(), size * sizeof(unsigned));
+            fillRandom(wantLow.data(), size);
+            fillRandom(wantHigh.data(), size);
+            fillRandom(wantHist.data(), size * sizeof(unsigned short));
+            fillRandom(add.data(), size * sizeof(unsigned short));
+            fillRandom(sub.data(), size * sizeof(unsigned short));
+            gotSums = wantSums;
+            gotLow = wantLow;
+            gotHigh = wantHigh;
+            gotHist = wantHist;
+
+            scalar.sumRow(row.data() + 1, wantSums.data(), size);
+            variant.sumRow(row.data() + 1, gotSums.data(), size);
+            REQUIRE(wantSums == gotSums);
+
+            scalar.sortPairs(wantLow.data(), wantHigh.data(), size);
+            variant.sortPairs(gotLow.data(), gotHigh.data(), size);
+            REQUIRE(wantLow == gotLow);
+            REQUIRE(wantHigh == gotHigh);
+
+            scalar.histogramStep(wantHist.data(), add.data(), sub.data(), size);
+            variant.histogramStep(gotHist.data(), add.data(), sub.data(), size);
+            REQUIRE(wantHist == gotHist);
+        }
     }
+}
+
+
+TEST_CASE("sepiaRow and grayRow match the scalar kernels")
+{
+    int level;
+    const kernelTable& scalar = kernelVariants[ISA_SCALAR];
+
+    srand(13);
 
-    if (argc == 4)
+    for (level = ISA_SSE4; level <= detectIsa(); level++)
     {
-        if (strcmp(argv[1], "--outputtype") != 0 && strcmp(argv[1], "--ascii") != 0
-            && strcmp(argv[1], "--binary") != 0)
+        const kernelTable& variant = kernelVariants[level];
+
+        for (int size : kernelSizes())
         {
-            cout << "Invalid output type specified" << endl;
+            vector<pixel> want(3 * size);
+            vector<pixel> got;
+            vector<pixel> wantGray(size);
+            vector<pixel> gotGray(size);
 
-            cout << "thpe11.exe [option] --outputtype basename image.ppm" << endl;
-            cout << endl;
-            cout << "Output Type      Output Description" << endl;
-            cout << "    --ascii      integer text numbers will be written for the data" << endl;
-            cout << "    --binary     integer numbers will be written in binary form" << endl;
-            cout << endl;
-            cout << "Option Code      Option Description" << endl;
-            cout << "    --flipX      Flip the image on the X axis" << endl;
-            cout << "    --flipY      Flip the image on the Y axis" << endl;
-            cout << "    --rotateCW   Rotate the image clockwise" << endl;
-            cout << "    --rotateCCW  Rotate the image counter clockwise" << endl;
-            cout << "    --grayscale  Convert image to grayscale" << endl;
-            cout << "    --sepia      Antique a color image" << endl;
-            exit(0);
+            CAPTURE(isaName(isaLevel(level)), size);
+            fillRandom(want.data(), want.size());
+            got = want;
+
+            scalar.grayRow(&want[0], &want[size], &want[2 * size], wantGray.data(), size);
+            variant.grayRow(&got[0], &got[size], &got[2 * size], gotGray.data(), size);
+            REQUIRE(wantGray == gotGray);
+
+            scalar.sepiaRow(&want[0], &want[size], &want[2 * size], size);
+            variant.sepiaRow(&got[0], &got[size], &got[2 * size], size);
+            REQUIRE(want == got);
         }
     }
+}
+
+
+TEST_CASE("transpose matches the scalar kernel")
+{
+    int level;
+    int rows;
+    int cols;
+    size_t i;
+    const kernelTable& scalar = kernelVariants[ISA_SCALAR];
+    vector<int> sizes = { 1, 2, 3, 15, 16, 17, 31, 32, 33, 47, 48, 49, 100 };
+
+    srand(14);
+
+    for (i = 0; i < 4; i++)
+    {
+        sizes.push_back(1 + rand() % 300);
+    }
 
-    if (argc == 5)
+    for (level = ISA_SSE4; level <= detectIsa(); level++)
     {
-        if (strcmp(argv[1], "--flipX") != 0 && strcmp(argv[1], "--flipY") != 0
-            && strcmp(argv[1], "--rotateCW") != 0 && strcmp(argv[1], "--rotateCCW") != 0
-            && strcmp(argv[1], "--grayscale") != 0 && strcmp(argv[1], "--sepia") != 0)
+        const kernelTable& variant = kernelVariants[level];
+
+        for (i = 0; i < sizes.size() * sizes.size(); i++)
         {
-            cout << "Invalid option given" << endl;
+            vector<pixel> src;
+            vector<pixel> want;
+            vector<pixel> got;
 
-            cout << "thpe11.exe [option] --outputtype basename image.ppm" << endl;
-            cout << endl;
-            cout << "Output Type      Output Description" << endl;
-            cout << "    --ascii      integer text numbers will be written for the data" << endl;
-            cout << "    --binary     integer numbers will be written in binary form" << endl;
-            cout << endl;
-            cout << "Option Code      Option Description" << endl;
-            cout << "    --flipX      Flip the image on the X axis" << endl;
-            cout << "    --flipY      Flip the image on the Y axis" << endl;
-            cout << "    --rotateCW   Rotate the image clockwise" << endl;
-            cout << "    --rotateCCW  Rotate the image counter clockwise" << endl;
-            cout << "    --grayscale  Convert image to grayscale" << endl;
-            cout << "    --sepia      Antique a color image" << endl;
-            exit(0);
-        }
+            rows = sizes[i / sizes.size()];
+            cols = sizes[i % sizes.size()];
+            src.resize(size_t(rows) * cols);
+            want.resize(src.size());
+            got.resize(src.size());
 
-        if (strcmp(argv[2], "--outputtype") != 0 && strcmp(argv[2], "--ascii") != 0
-           && strcmp(argv[2], "--binary") != 0)
-        {
-            cout << "Invalid output type specified" << endl;
-
-            cout << "thpe11.exe [option] --outputtype basename image.ppm" << endl;
-            cout << endl;
-            cout << "Output Type      Output Description" << endl;
-            cout << "    --ascii      integer text numbers will be written for the data" << endl;
-            cout << "    --binary     integer numbers will be written in binary form" << endl;
-            cout << endl;
-            cout << "Option Code      Option Description" << endl;
-            cout << "    --flipX      Flip the image on the X axis" << endl;
-            cout << "    --flipY      Flip the image on the Y axis" << endl;
-            cout << "    --rotateCW   Rotate the image clockwise" << endl;
-            cout << "    --rotateCCW  Rotate the image counter clockwise" << endl;
-            cout << "    --grayscale  Convert image to grayscale" << endl;
-            cout << "    --sepia      Antique a color image" << endl;
-            exit(0);
+            CAPTURE(isaName(isaLevel(level)), rows, cols);
+            fillRandom(src.data(), src.size());
+
+            scalar.transpose(src.data(), cols, want.data(), rows, rows, cols);
+            variant.transpose(src.data(), cols, got.data(), rows, rows, cols);
+            REQUIRE(want == got);
+
+            // the quarter turns walk the source backwards
+            scalar.transpose(&src[size_t(rows - 1) * cols], -cols, want.data(), rows,
+                rows, cols);
+            variant.transpose(&src[size_t(rows - 1) * cols], -cols, got.data(), rows,
+                rows, cols);
+            REQUIRE(want == got);
         }
     }
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * Allocates an image and fills it with random values, with a random alpha
+ * plane when asked for one.
+ *
+ * @param[out]    img - image to fill.
+ * @param[in]     rows - number of rows.
+ * @param[in]     cols - number of columns.
+ * @param[in]     alpha - true to give the image an alpha plane.
+ *
+ * @par Example
+ * @verbatim
+   image img;
+   randomImage(img, 300, 600, true);
+   @endverbatim
+ *****************************************************************************/
+
+void randomImage(image& img, int rows, int cols, bool alpha)
+{
+    int i;
 
-    fileopeninput(fin, argv[argc - 1]);
+    allocImage(img, rows, cols);
+    img.magicNumber = "P6";
 
-    if (strcmp(argv[1], "--grayscale") != 0)
+    if (alpha)
     {
-        fileopenoutput(fout, argv[argc - 2]);
+        allocAlpha(img);
     }
-   
-    ans = readImage(fin, img);
 
-    if (ans == false)
+    for (i = 0; i < rows; i++)
     {
-        exit(1);
+        fillRandom(img.redGray[i], cols);
+        fillRandom(img.green[i], cols);
+        fillRandom(img.blue[i], cols);
+
+        if (alpha)
+        {
+            fillRandom(img.alpha[i], cols);
+        }
+    }
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * Compares the size, the pixels and the alpha planes of two images.
+ *
+ * @param[in]     a - first image.
+ * @param[in]     b - second image.
+ *
+ * @returns true if every value is the same and both or neither have alpha.
+ *
+ * @par Example
+ * @verbatim
+   REQUIRE(sameImage(img, back));
+   @endverbatim
+ *****************************************************************************/
+
+bool sameImage(image& a, image& b)
+{
+    int i;
+    size_t bytes = size_t(a.cols) * sizeof(pixel);
+
+    if (a.rows != b.rows || a.cols != b.cols ||
+        (a.alpha == nullptr) != (b.alpha == nullptr))
+    {
+        return false;
     }
 
-    if (argc == 4)
+    for (i = 0; i < a.rows; i++)
     {
-        if (strcmp(argv[1], "--outputtype") == 0)
+        if (memcmp(a.redGray[i], b.redGray[i], bytes) != 0 ||
+            memcmp(a.green[i], b.green[i], bytes) != 0 ||
+            memcmp(a.blue[i], b.blue[i], bytes) != 0 ||
+            (a.alpha != nullptr && memcmp(a.alpha[i], b.alpha[i], bytes) != 0))
         {
-            writeImage(fout, img);
+            return false;
         }
+    }
+
+    return true;
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * Counts the chunks of each kind in a QOI stream, skipping the 14 byte
+ * header and the 8 byte end marker.
+ *
+ * @param[in]     data - the QOI stream.
+ *
+ * @returns the number of INDEX, DIFF, LUMA, RUN, RGB and RGBA chunks in
+ *          that order.
+ *
+ * @par Example
+ * @verbatim
+   vector<int> ops = qoiOps(out.str());
+   REQUIRE(ops[3] > 0); // there was a run
+   @endverbatim
+ *****************************************************************************/
+
+vector<int> qoiOps(const string& data)
+{
+    size_t pos = 14;
+    unsigned char code;
+    vector<int> ops(6, 0);
 
-        if (strcmp(argv[1], "--ascii") == 0)
+    while (pos + 8 < data.size())
+    {
+        code = (unsigned char) data[pos];
+
+        if (code == 0xfe)
         {
-            img.magicNumber = "P3";
-            writeImage(fout, img);
+            ops[4]++;
+            pos = pos + 4;
         }
-
-        if (strcmp(argv[1], "--binary") == 0)
+        else if (code == 0xff)
+        {
+            ops[5]++;
+            pos = pos + 5;
+        }
+        else
         {
-            img.magicNumber = "P6";
-            writeImage(fout, img);
+            // the top two bits are the chunk, only LUMA has a second byte
+            ops[code >> 6]++;
+            pos = pos + ((code >> 6) == 2 ? 2 : 1);
         }
     }
 
-    else if (argc == 5)
+    return ops;
+}
+
+
+TEST_CASE("QOI images round trip with and without alpha")
+{
+    int alpha;
+    size_t i;
+    vector<int> sizes = { 1, 2, 7, 64, 65 };
+
+    srand(15);
+
+    for (alpha = 0; alpha <= 1; alpha++)
     {
-        
-        if (strcmp(argv[1], "--grayscale") == 0)
+        for (i = 0; i < sizes.size() * sizes.size(); i++)
         {
-            outputgray(foutgray, argv[argc-2]);
-            grayScale(foutgray, img, argv[2]);
-            filecloseoutput(foutgray);
+            image img;
+            image copy;
+            image back;
+            stringstream data;
+            int rows = sizes[i / sizes.size()];
+            int cols = sizes[i % sizes.size()];
+
+            CAPTURE(alpha, rows, cols);
+            randomImage(img, rows, cols, alpha == 1);
+            copyImage(img, copy);
+
+            REQUIRE(writeQoi(data, copy) == IMAGE_OK);
+            REQUIRE(readQoi(data, back) == IMAGE_OK);
+            REQUIRE(sameImage(img, back));
+
+            freeImage(img);
+            freeImage(back);
         }
-        
-        if (strcmp(argv[1], "--flipX") == 0)
+    }
+}
+
+
+TEST_CASE("QOI encoder writes every kind of chunk")
+{
+    int alpha;
+    int j;
+    // RGB, RUN, DIFF, LUMA, then INDEX back to the first pixel
+    int start[5][3] = { { 10, 20, 30 }, { 10, 20, 30 }, { 11, 21, 29 },
+        { 20, 30, 38 }, { 10, 20, 30 } };
+
+    srand(16);
+
+    for (alpha = 0; alpha <= 1; alpha++)
+    {
+        image img;
+        image copy;
+        image back;
+        stringstream data;
+        vector<int> ops;
+
+        CAPTURE(alpha);
+        randomImage(img, 4, 16, alpha == 1);
+
+        for (j = 0; j < 5; j++)
         {
-            flipX(img, argv[2]);
-            writeImage(fout, img);
+            img.redGray[0][j] = (pixel) start[j][0];
+            img.green[0][j] = (pixel) start[j][1];
+            img.blue[0][j] = (pixel) start[j][2];
+
+            if (alpha == 1)
+            {
+                img.alpha[0][j] = 255;
+            }
         }
 
-        if (strcmp(argv[1], "--flipY") == 0)
+        copyImage(img, copy);
+        REQUIRE(writeQoi(data, copy) == IMAGE_OK);
+
+        ops = qoiOps(data.str());
+        CAPTURE(ops);
+        REQUIRE(ops[0] > 0);
+        REQUIRE(ops[1] > 0);
+        REQUIRE(ops[2] > 0);
+        REQUIRE(ops[3] > 0);
+        REQUIRE(ops[4] > 0);
+        REQUIRE((ops[5] > 0) == (alpha == 1));
+
+        REQUIRE(readQoi(data, back) == IMAGE_OK);
+        REQUIRE(sameImage(img, back));
+
+        freeImage(img);
+        freeImage(back);
+    }
+}
+
+
+TEST_CASE("tiled images round trip and read regions across tiles")
+{
+    size_t i;
+    image img;
+    image copy;
+    image back;
+    stringstream data;
+    region whole = { 0, 0, 0, 0 };
+    // inside one tile, across the tile edges and past the bottom right
+    vector<region> rois = { { 10, 10, 20, 20 }, { 200, 250, 150, 40 },
+        { 250, 0, 300, 300 }, { 500, 290, 100, 100 } };
+
+    srand(17);
+    randomImage(img, 300, 520, false);
+    copyImage(img, copy);
+
+    REQUIRE(writeTiled(data, copy) == IMAGE_OK);
+    REQUIRE(readTiled(data, back, whole, 0) == IMAGE_OK);
+    REQUIRE(sameImage(img, back));
+    freeImage(back);
+
+    for (i = 0; i < rois.size(); i++)
+    {
+        image crop;
+
+        CAPTURE(rois[i].x, rois[i].y, rois[i].w, rois[i].h);
+        copyImage(img, crop);
+        REQUIRE(cropImage(crop, rois[i], OUTPUT_SAME) == IMAGE_OK);
+
+        data.clear();
+        data.seekg(0);
+        REQUIRE(readTiled(data, back, rois[i], 0) == IMAGE_OK);
+        REQUIRE(sameImage(crop, back));
+
+        freeImage(crop);
+        freeImage(back);
+    }
+
+    freeImage(img);
+}
+
+
+TEST_CASE("readImageRegion matches a crop of the whole image")
+{
+    size_t i;
+    size_t k;
+    image img;
+    vector<string> magics = { "P3", "P6" };
+    vector<region> rois = { { 0, 0, 1, 1 }, { 3, 5, 10, 7 }, { 0, 12, 40, 3 },
+        { 30, 20, 50, 50 } };
+
+    srand(18);
+    randomImage(img, 25, 40, false);
+
+    for (k = 0; k < magics.size(); k++)
+    {
+        for (i = 0; i < rois.size(); i++)
         {
-            flipY(img, argv[2]);
-            writeImage(fout, img);
+            image copy;
+            image crop;
+            image back;
+            stringstream data;
+
+            CAPTURE(magics[k], rois[i].x, rois[i].y, rois[i].w, rois[i].h);
+            copyImage(img, copy);
+            copy.magicNumber = magics[k];
+            REQUIRE(writeImage(data, copy) == IMAGE_OK);
+
+            copyImage(img, crop);
+            REQUIRE(cropImage(crop, rois[i], OUTPUT_SAME) == IMAGE_OK);
+            REQUIRE(readImageRegion(data, back, rois[i]) == IMAGE_OK);
+            REQUIRE(sameImage(crop, back));
+
+            freeImage(crop);
+            freeImage(back);
         }
+    }
+
+    freeImage(img);
+}
+
+
+TEST_CASE("PAM images round trip in colour and gray, with and without alpha")
+{
+    int i;
+    int gray;
+    int alpha;
 
-        if (strcmp(argv[1], "--rotateCW") == 0)
+    srand(19);
+
+    for (gray = 0; gray <= 1; gray++)
+    {
+        for (alpha = 0; alpha <= 1; alpha++)
         {
-            rotateCW(img, argv[2]);
-            writeImage(fout, img);
+            image img;
+            image copy;
+            image back;
+            stringstream data;
+
+            CAPTURE(gray, alpha);
+            randomImage(img, 9, 14, alpha == 1);
+
+            if (gray == 1)
+            {
+                for (i = 0; i < img.rows; i++)
+                {
+                    memcpy(img.green[i], img.redGray[i], img.cols);
+                    memcpy(img.blue[i], img.redGray[i], img.cols);
+                }
+            }
+
+            copyImage(img, copy);
+            REQUIRE(writePam(data, copy, gray == 1) == IMAGE_OK);
+            REQUIRE(readPam(data, back) == IMAGE_OK);
+            REQUIRE(sameImage(img, back));
+            REQUIRE(back.gray == (gray == 1));
+
+            freeImage(img);
+            freeImage(back);
         }
+    }
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * Finds the median of the square of radius radius around one value by
+ * sorting it, repeating the edge values past the edges of the plane.
+ *
+ * @param[in]     plane - plane to take the values from.
+ * @param[in]     rows - number of rows in the plane.
+ * @param[in]     cols - number of columns in the plane.
+ * @param[in]     i - row of the value.
+ * @param[in]     j - column of the value.
+ * @param[in]     radius - radius of the window.
+ *
+ * @returns the median of the window.
+ *
+ * @par Example
+ * @verbatim
+   REQUIRE(out.green[i][j] == bruteMedian(img.green, img.rows, img.cols, i, j, 2));
+   @endverbatim
+ *****************************************************************************/
+
+pixel bruteMedian(pixel** plane, int rows, int cols, int i, int j, int radius)
+{
+    int y;
+    int x;
+    vector<pixel> window;
 
-        if (strcmp(argv[1], "--rotateCCW") == 0)
+    for (y = i - radius; y <= i + radius; y++)
+    {
+        for (x = j - radius; x <= j + radius; x++)
         {
-            rotateCCW(img, argv[2]);
-            writeImage(fout, img);
+            window.push_back(plane[min(max(y, 0), rows - 1)][min(max(x, 0), cols - 1)]);
         }
+    }
+
+    sort(window.begin(), window.end());
+
+    return window[window.size() / 2];
+}
+
+
+TEST_CASE("medianImage matches a sorted window for every radius")
+{
+    int i;
+    int j;
+    size_t k;
+    size_t r;
+    // the sorting networks, the histograms and a window wider than the image
+    vector<int> radii = { 1, 2, 3, 4, 7, MEDIAN_MAX };
+    // single rows and columns, and images narrower than the window
+    int sizes[6][2] = { { 1, 1 }, { 1, 37 }, { 37, 1 }, { 5, 3 }, { 2, 90 },
+        { 40, 30 } };
 
-        if (strcmp(argv[1], "--sepia") == 0)
+    srand(20);
+
+    for (r = 0; r < radii.size(); r++)
+    {
+        for (k = 0; k < 6; k++)
         {
-            sepia(img, argv[2]);
-            writeImage(fout, img);
+            image img;
+            image out;
+            int radius = radii[r];
+
+            CAPTURE(radius, sizes[k][0], sizes[k][1]);
+            randomImage(img, sizes[k][0], sizes[k][1], true);
+            copyImage(img, out);
+            REQUIRE(medianImage(out, radius) == IMAGE_OK);
+
+            for (i = 0; i < img.rows; i++)
+            {
+                for (j = 0; j < img.cols; j++)
+                {
+                    CAPTURE(i, j);
+                    REQUIRE(out.redGray[i][j] ==
+                        bruteMedian(img.redGray, img.rows, img.cols, i, j, radius));
+                    REQUIRE(out.green[i][j] ==
+                        bruteMedian(img.green, img.rows, img.cols, i, j, radius));
+                    REQUIRE(out.blue[i][j] ==
+                        bruteMedian(img.blue, img.rows, img.cols, i, j, radius));
+                    REQUIRE(out.alpha[i][j] == img.alpha[i][j]);
+                }
+            }
+
+            freeImage(img);
+            freeImage(out);
         }
+    }
+}
+
 
+TEST_CASE("compareImages reports equal images as equal")
+{
+    int c;
+    image a;
+    image b;
+    comparison result;
+
+    srand(21);
+    randomImage(a, 480, 400, false);
+    copyImage(a, b);
+
+    REQUIRE(compareImages(a, b, result) == IMAGE_OK);
+
+    for (c = 0; c < 4; c++)
+    {
+        CAPTURE(c);
+        REQUIRE(result.maxDiff[c] == 0);
+        REQUIRE(result.mismatches[c] == 0);
+        REQUIRE(isinf(result.psnr[c]));
+        REQUIRE(result.psnr[c] > 0);
+        REQUIRE(result.ssim[c] == Approx(1));
     }
-    filecloseinput(fin);
-    filecloseoutput(fout);
+
+    freeImage(a);
+    freeImage(b);
+}
+
+
+TEST_CASE("compareImages measures a single changed value exactly")
+{
+    int c;
+    int k;
+    size_t d;
+    image a;
+    double samples;
+    vector<int> diffs = { 1, 2, 37, 255 };
+
+    srand(22);
+    randomImage(a, 480, 400, false);
+    samples = double(a.rows) * a.cols;
+
+    for (c = 0; c < 3; c++)
+    {
+        for (d = 0; d < diffs.size(); d++)
+        {
+            image b;
+            comparison result;
+            pixel** planesA[3] = { a.redGray, a.green, a.blue };
+            pixel** planesB[3];
+
+            CAPTURE(c, diffs[d]);
+            copyImage(a, b);
+            planesB[0] = b.redGray;
+            planesB[1] = b.green;
+            planesB[2] = b.blue;
+
+            // low in the image so it falls to a thread other than the first
+            planesA[c][470][123] = 0;
+            planesB[c][470][123] = (pixel) diffs[d];
+
+            REQUIRE(compareImages(a, b, result) == IMAGE_OK);
+
+            for (k = 0; k < 3; k++)
+            {
+                CAPTURE(k);
+                REQUIRE(result.maxDiff[k] == (k == c ? diffs[d] : 0));
+                REQUIRE(result.mismatches[k] == (k == c ? 1 : 0));
+
+                if (k == c)
+                {
+                    REQUIRE(result.psnr[k] == Approx(10 * log10(255.0 * 255 * samples
+                        / (diffs[d] * diffs[d]))));
+                }
+                else
+                {
+                    REQUIRE(isinf(result.psnr[k]));
+                }
+            }
+
+            REQUIRE(result.maxDiff[3] == diffs[d]);
+            REQUIRE(result.mismatches[3] == 1);
+            REQUIRE(result.psnr[3] == Approx(10 * log10(255.0 * 255 * 3 * samples
+                / (diffs[d] * diffs[d]))));
+
+            freeImage(b);
+        }
+    }
+
+    freeImage(a);
+}
+
+
+TEST_CASE("compareImages refuses images of different sizes")
+{
+    image a;
+    image b;
+    image c;
+    comparison result;
+
+    srand(23);
+    randomImage(a, 20, 30, false);
+    randomImage(b, 30, 20, false);
+    randomImage(c, 20, 31, false);
+
+    REQUIRE(compareImages(a, b, result) == IMAGE_BAD_PARAMETER);
+    REQUIRE(compareImages(a, c, result) == IMAGE_BAD_PARAMETER);
+    REQUIRE(compareImages(c, a, result) == IMAGE_BAD_PARAMETER);
+
+    freeImage(a);
+    freeImage(b);
+    freeImage(c);
 }
@@ -0,0 +1,96 @@
+/** ***************************************************************************
+ * @file
+ * @brief Contains functions that split work between threads
+ *****************************************************************************/
+
+
+#include "netPBM.h"
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * picks how many threads to use for a job.  Every thread gets at least
+ * THREAD_MIN_BYTES of work, since starting a thread costs more than
+ * handling a small image, and no more threads are used than the machine
+ * has cores.
+ *
+ * @param[in]     bytes - size of the job in bytes.
+ *
+ * @returns number of threads to use, at least 1.
+ *
+ * @par Example
+ * @verbatim
+   threadCount(1000);      // 1
+   threadCount(100000000); // the number of cores
+   @endverbatim
+ *****************************************************************************/
+
+int threadCount(long long bytes)
+{
+    long long count = bytes / THREAD_MIN_BYTES;
+    long long cores = thread::hardware_concurrency();
+
+    if (cores < 1)
+    {
+        cores = 1;
+    }
+
+    return int(max(1LL, min(count, cores)));
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * runs task(0) to task(count - 1) at the same time and waits for all of
+ * them to finish.  task(0) runs on the calling thread.  Each task and the
+ * wait for the others are marked for --trace.  If a thread can't
+ * be started its task is run on the calling thread instead, so every task
+ * always runs exactly once.
+ *
+ * @param[in]     count - number of tasks.
+ * @param[in]     task - function that is given the number of its task.
+ *
+ * @par Example
+ * @verbatim
+   vector<long long> sums(4);
+   runParallel(4, [&](int t) { sums[t] = sumPart(t); }); // 4 parts at once
+   @endverbatim
+ *****************************************************************************/
+
+void runParallel(int count, const function<void(int)>& task)
+{
+    int i;
+    vector<thread> workers;
+
+    auto timed = [&task](int t)
+    {
+        TRACE_SCOPE("task");
+
+        task(t);
+    };
+
+    for (i = 1; i < count; i++)
+    {
+        try
+        {
+            workers.emplace_back(timed, i);
+        }
+        catch (const system_error&)
+        {
+            timed(i);
+        }
+    }
+
+    timed(0);
+
+    TRACE_SCOPE("join");
+
+    for (i = 0; i < int(workers.size()); i++)
+    {
+        workers[i].join();
+    }
+}
@@ -0,0 +1,815 @@
+/** ***************************************************************************
+ * @file
+ * @brief Contains functions to read and write the tiled image container
+ *
+ * A tiled image (.tpx) stores the image cut into TILE_SIZE by TILE_SIZE
+ * tiles followed by every smaller level of its pyramid, so a region or a
+ * small version of a huge image can be read without reading the rest of
+ * the file.  Each tile is stored as a QOI image, or as plain red, green
+ * and blue bytes when QOI would not make it smaller.
+ *
+ * All numbers are big endian, as in QOI.  The file is laid out as
+ * @verbatim
+   header   "tpix", version, 3 zero bytes, tile size, columns, rows and
+            number of levels, each 4 bytes
+   tiles    every tile of level 0 from left to right and top to bottom,
+            then the tiles of level 1 and so on
+   index    for each level its rows and columns (4 bytes each), then for
+            each of its tiles the offset (8 bytes), size (4 bytes) and
+            method (1 byte) of the tile
+   trailer  offset of the index (8 bytes) and "tpix"
+   @endverbatim
+ * The index is written last so the tiles can be written as soon as they
+ * are made.
+ *****************************************************************************/
+
+
+#include "netPBM.h"
+
+
+/**
+ * @brief tile stored as red, green and blue bytes
+ */
+
+const int TILE_RAW = 0;
+
+/**
+ * @brief tile stored as a QOI image
+ */
+
+const int TILE_QOI = 1;
+
+/**
+ * @brief version of the container written by writeTiled
+ */
+
+const int TILED_VERSION = 1;
+
+/**
+ * @brief size of the header at the start of the file
+ */
+
+const int TILED_HEADER = 24;
+
+/**
+ * @brief size of the trailer at the end of the file
+ */
+
+const int TILED_TRAILER = 12;
+
+/**
+ * @brief size of each tile in the index
+ */
+
+const int TILED_ENTRY = 13;
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * appends a number to data as bytes, most significant byte first.
+ *
+ * @param[in,out]     data - bytes the number is added to.
+ * @param[in]         value - number to add.
+ * @param[in]         bytes - number of bytes to use.
+ *
+ * @par Example
+ * @verbatim
+   string data;
+   putNumber(data, 256, 4); // data is 00 00 01 00
+   @endverbatim
+ *****************************************************************************/
+
+void putNumber(string& data, unsigned long long value, int bytes)
+{
+    int k;
+
+    for (k = bytes - 1; k >= 0; k--)
+    {
+        data.push_back(char((value >> (8 * k)) & 0xff));
+    }
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * reads a number stored most significant byte first.
+ *
+ * @param[in]     data - first byte of the number.
+ * @param[in]     bytes - number of bytes used.
+ *
+ * @returns the number.
+ *
+ * @par Example
+ * @verbatim
+   unsigned char data[4] = { 0, 0, 1, 0 };
+   getNumber(data, 4); // 256
+   @endverbatim
+ *****************************************************************************/
+
+unsigned long long getNumber(const unsigned char* data, int bytes)
+{
+    unsigned long long value = 0;
+    int k;
+
+    for (k = 0; k < bytes; k++)
+    {
+        value = (value << 8) | data[k];
+    }
+
+    return value;
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * stores one tile of img in data.  The tile is encoded as QOI and kept
+ * that way if it is smaller than the plain bytes.
+ *
+ * @param[in]     img - level the tile is taken from.
+ * @param[in]     top - first row of the tile.
+ * @param[in]     left - first column of the tile.
+ * @param[in]     rows - number of rows in the tile.
+ * @param[in]     cols - number of columns in the tile.
+ * @param[out]    data - the stored tile.
+ *
+ * @returns TILE_QOI or TILE_RAW, the way the tile was stored.
+ *
+ * @par Example
+ * @verbatim
+   string data;
+   encodeTile(img, 0, 256, 256, 256, data); // second tile of the first row
+   @endverbatim
+ *****************************************************************************/
+
+int encodeTile(image& img, int top, int left, int rows, int cols, string& data)
+{
+    TRACE_SCOPE("encodeTile");
+
+    int i;
+    int j;
+
+    image tile;
+    ostringstream packed;
+
+    data.clear();
+    data.reserve(size_t(3) * rows * cols);
+
+    for (i = top; i < top + rows; i++)
+    {
+        for (j = left; j < left + cols; j++)
+        {
+            data.push_back(char(img.redGray[i][j]));
+            data.push_back(char(img.green[i][j]));
+            data.push_back(char(img.blue[i][j]));
+        }
+    }
+
+    if (!allocImage(tile, rows, cols))
+    {
+        return TILE_RAW;
+    }
+
+    for (i = 0; i < rows; i++)
+    {
+        memcpy(tile.redGray[i], img.redGray[top + i] + left, cols);
+        memcpy(tile.green[i], img.green[top + i] + left, cols);
+        memcpy(tile.blue[i], img.blue[top + i] + left, cols);
+    }
+
+    if (writeQoi(packed, tile) != IMAGE_OK || packed.str().size() >= data.size())
+    {
+        return TILE_RAW;
+    }
+
+    data = packed.str();
+
+    return TILE_QOI;
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * copies the part of a stored tile that lies inside roi into img.
+ *
+ * @param[in]         data - the stored tile.
+ * @param[in]         method - TILE_QOI or TILE_RAW.
+ * @param[in]         top - row of the level the tile starts on.
+ * @param[in]         left - column of the level the tile starts on.
+ * @param[in]         rows - number of rows in the tile.
+ * @param[in]         cols - number of columns in the tile.
+ * @param[in]         roi - region of the level held by img.
+ * @param[in,out]     img - receives the pixels.
+ *
+ * @returns IMAGE_OK or IMAGE_READ_FAILED if the tile is damaged.
+ *
+ * @par Example
+ * @verbatim
+   decodeTile(data, TILE_QOI, 0, 256, 256, 256, roi, img);
+   @endverbatim
+ *****************************************************************************/
+
+imageError decodeTile(const string& data, int method, int top, int left, int rows,
+    int cols, region roi, image& img)
+{
+    TRACE_SCOPE("decodeTile");
+
+    int i;
+    int j;
+    int first = max(top, roi.y);
+    int last = min(top + rows, roi.y + img.rows);
+    int from = max(left, roi.x);
+    int to = min(left + cols, roi.x + img.cols);
+
+    image tile;
+    istringstream packed(data);
+    const unsigned char* raw = (const unsigned char*) data.data();
+
+    if (method == TILE_QOI)
+    {
+        if (readQoi(packed, tile) != IMAGE_OK || tile.rows != rows || tile.cols != cols)
+        {
+            freeImage(tile);
+            return IMAGE_READ_FAILED;
+        }
+
+        for (i = first; i < last; i++)
+        {
+            memcpy(img.redGray[i - roi.y] + from - roi.x, tile.redGray[i - top] + from - left,
+                to - from);
+            memcpy(img.green[i - roi.y] + from - roi.x, tile.green[i - top] + from - left,
+                to - from);
+            memcpy(img.blue[i - roi.y] + from - roi.x, tile.blue[i - top] + from - left,
+                to - from);
+        }
+        freeImage(tile);
+
+        return IMAGE_OK;
+    }
+
+    if (method != TILE_RAW || data.size() != size_t(3) * rows * cols)
+    {
+        return IMAGE_READ_FAILED;
+    }
+
+    for (i = first; i < last; i++)
+    {
+        for (j = from; j < to; j++)
+        {
+            img.redGray[i - roi.y][j - roi.x] = raw[3 * ((i - top) * cols + j - left)];
+            img.green[i - roi.y][j - roi.x] = raw[3 * ((i - top) * cols + j - left) + 1];
+            img.blue[i - roi.y][j - roi.x] = raw[3 * ((i - top) * cols + j - left) + 2];
+        }
+    }
+
+    return IMAGE_OK;
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * writes the header of a tiled image.
+ *
+ * @param[in,out]     fout - stream opened for output.
+ * @param[in]         rows - rows of level 0.
+ * @param[in]         cols - columns of level 0.
+ * @param[in]         levels - number of levels in the file.
+ *
+ * @par Example
+ * @verbatim
+   writeTiledHeader(fout, img.rows, img.cols, 1); // only the full size level
+   @endverbatim
+ *****************************************************************************/
+
+void writeTiledHeader(ostream& fout, int rows, int cols, int levels)
+{
+    string header = "tpix";
+
+    header.push_back(char(TILED_VERSION));
+    putNumber(header, 0, 3);
+    putNumber(header, TILE_SIZE, 4);
+    putNumber(header, cols, 4);
+    putNumber(header, rows, 4);
+    putNumber(header, levels, 4);
+    fout.write(header.data(), header.size());
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * writes one row of tiles, the TILE_SIZE rows of img starting at top, with
+ * the tiles split between threads, and adds their entries to the index.
+ *
+ * @param[in,out]     fout - stream opened for output.
+ * @param[in]         img - image the tiles are taken from.
+ * @param[in]         top - first row of the tiles.
+ * @param[in,out]     index - index the entries are added to.
+ * @param[in,out]     offset - position of the next tile in the file.
+ *
+ * @par Example
+ * @verbatim
+   writeTileRow(fout, img, 0, index, offset); // the first row of tiles
+   @endverbatim
+ *****************************************************************************/
+
+void writeTileRow(ostream& fout, image& img, int top, string& index, long long& offset)
+{
+    int j;
+    int across = (img.cols + TILE_SIZE - 1) / TILE_SIZE;
+    int threads = min(across, threadCount(3LL * TILE_SIZE * img.cols));
+
+    vector<string> data(across);
+    vector<int> methods(across, TILE_RAW);
+
+    runParallel(threads, [&](int t)
+    {
+        int k;
+
+        for (k = t; k < across; k += threads)
+        {
+            methods[k] = encodeTile(img, top, k * TILE_SIZE,
+                min(TILE_SIZE, img.rows - top),
+                min(TILE_SIZE, img.cols - k * TILE_SIZE), data[k]);
+        }
+    });
+
+    for (j = 0; j < across; j++)
+    {
+        fout.write(data[j].data(), data[j].size());
+        putNumber(index, offset, 8);
+        putNumber(index, data[j].size(), 4);
+        putNumber(index, methods[j], 1);
+        offset += data[j].size();
+    }
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * writes img as a tiled image with every level of its pyramid.  One row
+ * of tiles is encoded at a time with the tiles split between threads, and
+ * each level is freed as soon as the next one is made.
+ *
+ * @param[in,out]     fout - stream opened for output.
+ * @param[in,out]     img - structure conatining data about ppm image, it is
+ *                          freed after it is written.
+ *
+ * @returns IMAGE_OK, IMAGE_NO_MEMORY or IMAGE_WRITE_FAILED.
+ *
+ * @par Example
+ * @verbatim
+   image img;
+   ofstream fout;
+   openOutputFile("balloon", ".tpx", fout);
+   writeTiled(fout, img); // writes img to balloon.tpx
+   @endverbatim
+ *****************************************************************************/
+
+imageError writeTiled(ostream& fout, image& img)
+{
+    TRACE_SCOPE("writeTiled");
+
+    int i;
+    int levels = 1;
+    int rows = img.rows;
+    int cols = img.cols;
+    long long offset = TILED_HEADER;
+
+    string index;
+    image half;
+    imageError result;
+
+    while (rows > 1 || cols > 1)
+    {
+        rows = (rows + 1) / 2;
+        cols = (cols + 1) / 2;
+        levels++;
+    }
+
+    writeTiledHeader(fout, img.rows, img.cols, levels);
+
+    while (levels > 0)
+    {
+        putNumber(index, img.rows, 4);
+        putNumber(index, img.cols, 4);
+
+        for (i = 0; i < img.rows; i += TILE_SIZE)
+        {
+            writeTileRow(fout, img, i, index, offset);
+        }
+
+        levels--;
+
+        if (levels > 0)
+        {
+            result = halveImage(img, half);
+
+            if (result != IMAGE_OK)
+            {
+                freeImage(img);
+                return result;
+            }
+            freeImage(img);
+            img = half;
+        }
+    }
+
+    putNumber(index, offset, 8);
+    index += "tpix";
+    fout.write(index.data(), index.size());
+
+    freeImage(img);
+
+    return fout ? IMAGE_OK : IMAGE_WRITE_FAILED;
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * copies the pixels of a ppm image into a tiled image with only the full
+ * size level.  TILE_SIZE rows are read at a time and written as a row of
+ * tiles, so the image never has to be held whole.  This is how the tiled
+ * plan of --max-memory gets an image it can read any region of.
+ *
+ * @param[in,out]     fin - stream positioned at the pixels of a P3 or P6
+ *                          image.
+ * @param[in,out]     fout - stream opened for output, it must be binary.
+ * @param[in]         header - header of the image in fin.
+ *
+ * @returns IMAGE_OK, IMAGE_NO_MEMORY, IMAGE_READ_FAILED or
+ *          IMAGE_WRITE_FAILED.
+ *
+ * @par Example
+ * @verbatim
+   readHeader(fin, header);
+   spoolTiled(fin, spool, header); // spool now holds the image in tiles
+   @endverbatim
+ *****************************************************************************/
+
+imageError spoolTiled(istream& fin, ostream& fout, image& header)
+{
+    TRACE_SCOPE("spoolTiled");
+
+    int i;
+    int k;
+    long long offset = TILED_HEADER;
+    long long size = 3LL * header.cols;
+
+    string index;
+    image band;
+    image row;
+    pixel* buffer;
+
+    if (!allocImage(band, min(TILE_SIZE, header.rows), header.cols))
+    {
+        return IMAGE_NO_MEMORY;
+    }
+
+    buffer = new(nothrow) pixel[size_t(size)];
+
+    if (buffer == nullptr)
+    {
+        freeImage(band);
+        return IMAGE_NO_MEMORY;
+    }
+    countAlloc(size);
+
+    writeTiledHeader(fout, header.rows, header.cols, 1);
+    putNumber(index, header.rows, 4);
+    putNumber(index, header.cols, 4);
+
+    // row borrows one row of the band at a time for readRow
+    row = band;
+    row.rows = 1;
+    row.borrowed = true;
+
+    for (i = 0; i < header.rows && fin; i += TILE_SIZE)
+    {
+        band.rows = min(TILE_SIZE, header.rows - i);
+
+        for (k = 0; k < band.rows; k++)
+        {
+            row.redGray = band.redGray + k;
+            row.green = band.green + k;
+            row.blue = band.blue + k;
+            readRow(fin, row, header.magicNumber, buffer);
+        }
+        writeTileRow(fout, band, 0, index, offset);
+    }
+
+    putNumber(index, offset, 8);
+    index += "tpix";
+    fout.write(index.data(), index.size());
+
+    delete[] buffer;
+    countFree(size);
+
+    band.rows = min(TILE_SIZE, header.rows);
+    freeImage(band);
+
+    if (!fin)
+    {
+        return IMAGE_READ_FAILED;
+    }
+
+    return fout ? IMAGE_OK : IMAGE_WRITE_FAILED;
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * reads the header and the tile index of a tiled image.  fin must be able
+ * to seek since the index is at the end of the file.
+ *
+ * @param[in,out]     fin - stream positioned at the start of a tiled image.
+ * @param[out]        index - size and tiles of every level.
+ *
+ * @returns IMAGE_OK, IMAGE_BAD_FORMAT if fin doesn't hold a tiled image or
+ *          IMAGE_READ_FAILED if the index can't be read.
+ *
+ * @par Example
+ * @verbatim
+   tiledIndex index;
+   readTiledIndex(fin, index); // index.levels[0] is the full size image
+   @endverbatim
+ *****************************************************************************/
+
+imageError readTiledIndex(istream& fin, tiledIndex& index)
+{
+    int i;
+    int j;
+    int count;
+    int rows;
+    int cols;
+    long long start;
+    long long end;
+
+    unsigned char header[TILED_HEADER];
+    unsigned char entry[TILED_ENTRY];
+    tileLevel level;
+
+    start = (long long) fin.tellg();
+    fin.read((char*) header, TILED_HEADER);
+
+    if (!fin || memcmp(header, "tpix", 4) != 0 || header[4] != TILED_VERSION)
+    {
+        return IMAGE_BAD_FORMAT;
+    }
+
+    index.tileSize = int(getNumber(header + 8, 4));
+    cols = int(getNumber(header + 12, 4));
+    rows = int(getNumber(header + 16, 4));
+    count = int(getNumber(header + 20, 4));
+
+    if (index.tileSize <= 0 || rows <= 0 || cols <= 0 || count <= 0 || count > 64)
+    {
+        return IMAGE_BAD_FORMAT;
+    }
+
+    fin.seekg(-TILED_TRAILER, ios::end);
+    end = (long long) fin.tellg();
+    fin.read((char*) header, TILED_TRAILER);
+
+    if (!fin || memcmp(header + 8, "tpix", 4) != 0)
+    {
+        return IMAGE_READ_FAILED;
+    }
+
+    fin.seekg(start + (long long) getNumber(header, 8));
+    index.levels.clear();
+
+    for (i = 0; i < count; i++)
+    {
+        fin.read((char*) header, 8);
+        level.rows = int(getNumber(header, 4));
+        level.cols = int(getNumber(header + 4, 4));
+
+        if (!fin || level.rows != rows || level.cols != cols)
+        {
+            return IMAGE_READ_FAILED;
+        }
+        rows = (rows + 1) / 2;
+        cols = (cols + 1) / 2;
+
+        level.tiles.resize(size_t((level.rows + index.tileSize - 1) / index.tileSize)
+            * ((level.cols + index.tileSize - 1) / index.tileSize));
+
+        for (j = 0; j < int(level.tiles.size()); j++)
+        {
+            fin.read((char*) entry, TILED_ENTRY);
+            level.tiles[j].offset = start + (long long) getNumber(entry, 8);
+            level.tiles[j].bytes = int(getNumber(entry + 8, 4));
+            level.tiles[j].method = entry[12];
+
+            if (level.tiles[j].bytes < 0
+                || level.tiles[j].offset + level.tiles[j].bytes > end)
+            {
+                return IMAGE_READ_FAILED;
+            }
+        }
+        index.levels.push_back(level);
+    }
+
+    return fin ? IMAGE_OK : IMAGE_READ_FAILED;
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * reads a region of one level of a tiled image.  Only the tiles that
+ * overlap the region are read, one row of tiles at a time, and they are
+ * decoded by several threads.  A region with a width of 0 reads the whole
+ * level.  Standard input can't seek, so a piped tiled image is read into
+ * memory first.
+ *
+ * @param[in,out]     fin - stream opened for input containing a tiled image.
+ * @param[in,out]     img - receives the region.
+ * @param[in]         roi - region to read, it is cut down to fit the level.
+ * @param[in]         level - 0 for the full image, 1 for half size and so on.
+ *
+ * @returns IMAGE_OK if the region was read, otherwise the reason it
+ *          wasn't.
+ *
+ * @par Example
+ * @verbatim
+   region roi = { 1024, 512, 640, 480 };
+   readTiled(fin, img, roi, 0);  // the 640x480 block at (1024, 512)
+   roi.w = 0;
+   readTiled(fin, img, roi, 3);  // the whole image at an eighth of its size
+   @endverbatim
+ *****************************************************************************/
+
+imageError readTiled(istream& fin, image& img, region roi, int level)
+{
+    TRACE_SCOPE("readTiled");
+
+    int i;
+    int j;
+    int first;
+    int last;
+    int from;
+    int to;
+    int across;
+    int threads;
+    int size;
+
+    vector<char> text;
+    vector<string> data;
+    vector<imageError> results;
+    tiledIndex index;
+    imageError result;
+
+    fin.seekg(0, ios::end);
+
+    if (!fin)
+    {
+        fin.clear();
+
+        if (!readRest(fin, text))
+        {
+            return IMAGE_NO_MEMORY;
+        }
+
+        istringstream memory(string(text.begin(), text.end()));
+        text.clear();
+        text.shrink_to_fit();
+
+        return readTiled(memory, img, roi, level);
+    }
+    fin.seekg(0);
+
+    result = readTiledIndex(fin, index);
+
+    if (result != IMAGE_OK)
+    {
+        return result;
+    }
+
+    if (level < 0 || level >= int(index.levels.size()))
+    {
+        return IMAGE_BAD_PARAMETER;
+    }
+
+    tileLevel& tiles = index.levels[level];
+    size = index.tileSize;
+
+    if (roi.w == 0)
+    {
+        roi = { 0, 0, tiles.cols, tiles.rows };
+    }
+
+    if (roi.x < 0 || roi.y < 0 || roi.x >= tiles.cols || roi.y >= tiles.rows
+        || roi.w <= 0 || roi.h <= 0)
+    {
+        return IMAGE_BAD_REGION;
+    }
+
+    img.magicNumber = "tpix";
+    img.comment = "";
+    img.maxval = 255;
+
+    if (!allocImage(img, min(roi.h, tiles.rows - roi.y), min(roi.w, tiles.cols - roi.x)))
+    {
+        return IMAGE_NO_MEMORY;
+    }
+
+    first = roi.y / size;
+    last = (roi.y + img.rows - 1) / size;
+    from = roi.x / size;
+    to = (roi.x + img.cols - 1) / size;
+    across = (tiles.cols + size - 1) / size;
+
+    data.assign(to - from + 1, string());
+    results.assign(to - from + 1, IMAGE_OK);
+    threads = min(to - from + 1, threadCount(3LL * size * img.cols));
+
+    for (i = first; i <= last && result == IMAGE_OK; i++)
+    {
+        for (j = from; j <= to; j++)
+        {
+            tileEntry& tile = tiles.tiles[size_t(i) * across + j];
+
+            data[j - from].resize(tile.bytes);
+            fin.seekg(tile.offset);
+            fin.read(&data[j - from][0], tile.bytes);
+        }
+
+        if (!fin)
+        {
+            result = IMAGE_READ_FAILED;
+            break;
+        }
+
+        runParallel(threads, [&](int t)
+        {
+            int k;
+
+            for (k = from + t; k <= to; k += threads)
+            {
+                results[k - from] = decodeTile(data[k - from],
+                    tiles.tiles[size_t(i) * across + k].method, i * size, k * size,
+                    min(size, tiles.rows - i * size), min(size, tiles.cols - k * size),
+                    roi, img);
+            }
+        });
+
+        for (j = 0; j <= to - from; j++)
+        {
+            if (results[j] != IMAGE_OK)
+            {
+                result = results[j];
+            }
+        }
+    }
+
+    if (result != IMAGE_OK)
+    {
+        freeImage(img);
+    }
+
+    return result;
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * returns the memory readTiled and writeTiled use beyond the image for an
+ * image of the given width.
+ *
+ * @param[in]     cols - number of columns in the image.
+ *
+ * @returns size of the buffers in bytes.
+ *
+ * @par Example
+ * @verbatim
+   tiledBufferBytes(640); // a row of tiles and the tiles being encoded
+   @endverbatim
+ *****************************************************************************/
+
+long long tiledBufferBytes(int cols)
+{
+    long long tileRow = 3LL * TILE_SIZE * (cols + TILE_SIZE);
+
+    return 2 * tileRow + threadCount(tileRow) * 3 * planeBytes(TILE_SIZE, TILE_SIZE);
+}
@@ -0,0 +1,310 @@
+/** ***************************************************************************
+ * @file
+ * @brief Contains the timeline trace written by --trace
+ *
+ * TRACE_SCOPE marks a block of code.  While tracing is on, the time the
+ * block starts and how long it takes are stored in a ring buffer that
+ * belongs to the thread running it, so recording never waits on a lock.
+ * When the program ends the buffers are written as Chrome trace event
+ * JSON, which chrome://tracing and https://ui.perfetto.dev can show as
+ * one timeline per thread.  Building with IMAGE_TRACE set to 0 removes
+ * every marker.
+ *****************************************************************************/
+
+
+#include "netPBM.h"
+#include <chrono>
+#include <mutex>
+#include <memory>
+
+
+/**
+ * @brief one finished block of code
+ */
+
+struct traceEvent
+{
+    const char* name;      /**< name given to TRACE_SCOPE */
+    long long start;       /**< nanoseconds from the start of the trace */
+    long long duration;    /**< nanoseconds the block took */
+};
+
+/**
+ * @brief the events recorded by one thread.  It grows up to TRACE_EVENTS
+ * events and then the oldest are overwritten.
+ */
+
+struct traceBuffer
+{
+    int thread;                   /**< number shown for the thread */
+    bool main;                    /**< true for the thread that started the trace */
+    size_t count;                 /**< number of events ever recorded */
+    vector<traceEvent> events;    /**< ring of the latest events */
+};
+
+/**
+ * @brief true while events are being recorded
+ */
+
+static atomic<bool> traceOn(false);
+
+/**
+ * @brief file the trace is written to when the program ends
+ */
+
+static string traceFile;
+
+/**
+ * @brief time the trace started
+ */
+
+static chrono::steady_clock::time_point traceStart;
+
+/**
+ * @brief thread that started the trace
+ */
+
+static thread::id traceMain;
+
+/**
+ * @brief guards traceBuffers while a thread adds its buffer
+ */
+
+static mutex traceLock;
+
+/**
+ * @brief the buffer of every thread that has recorded an event, kept
+ * after the thread ends so its events can still be written
+ */
+
+static vector<unique_ptr<traceBuffer>> traceBuffers;
+
+/**
+ * @brief buffer of the calling thread, nullptr until it records an event
+ */
+
+static thread_local traceBuffer* threadBuffer = nullptr;
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * returns the nanoseconds since the trace started.
+ *
+ * @returns nanoseconds since startTrace was called.
+ *
+ * @par Example
+ * @verbatim
+   long long now = traceClock();
+   @endverbatim
+ *****************************************************************************/
+
+long long traceClock()
+{
+    return (long long) chrono::duration_cast<chrono::nanoseconds>(
+        chrono::steady_clock::now() - traceStart).count();
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * starts recording events.  The trace is written to file by finishTrace.
+ *
+ * @param[in]     file - name of the JSON file to write.
+ *
+ * @par Example
+ * @verbatim
+   startTrace("run.json");
+   ...
+   finishTrace(); // writes run.json
+   @endverbatim
+ *****************************************************************************/
+
+void startTrace(string file)
+{
+    traceFile = file;
+    traceStart = chrono::steady_clock::now();
+    traceMain = this_thread::get_id();
+    traceOn.store(true, memory_order_relaxed);
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * starts timing a block of code if tracing is on.  When tracing is off
+ * the only cost is reading one flag.
+ *
+ * @param[in]     name - name of the block, must be a string literal.
+ *
+ * @par Example
+ * @verbatim
+   {
+       traceScope marker("flipX"); // TRACE_SCOPE("flipX") does the same
+       ...
+   }   // the event is recorded here
+   @endverbatim
+ *****************************************************************************/
+
+traceScope::traceScope(const char* name) : name(name), start(-1)
+{
+    if (traceOn.load(memory_order_relaxed))
+    {
+        start = traceClock();
+    }
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * records the block in the ring buffer of the calling thread.  The first
+ * event of a thread adds its buffer to the list of buffers, which is the
+ * only time a lock is taken.
+ *
+ * @par Example
+ * @verbatim
+   {
+       TRACE_SCOPE("sepia");
+
+   }   // records "sepia"
+   @endverbatim
+ *****************************************************************************/
+
+traceScope::~traceScope()
+{
+    traceEvent event;
+
+    if (start < 0)
+    {
+        return;
+    }
+
+    event.name = name;
+    event.start = start;
+    event.duration = traceClock() - start;
+
+    if (threadBuffer == nullptr)
+    {
+        lock_guard<mutex> guard(traceLock);
+
+        traceBuffers.emplace_back(new(nothrow) traceBuffer);
+        threadBuffer = traceBuffers.back().get();
+
+        if (threadBuffer == nullptr)
+        {
+            traceBuffers.pop_back();
+            return;
+        }
+        threadBuffer->thread = int(traceBuffers.size());
+        threadBuffer->main = this_thread::get_id() == traceMain;
+        threadBuffer->count = 0;
+    }
+
+    if (threadBuffer->events.size() < size_t(TRACE_EVENTS))
+    {
+        threadBuffer->events.push_back(event);
+    }
+    else
+    {
+        threadBuffer->events[threadBuffer->count % TRACE_EVENTS] = event;
+    }
+    threadBuffer->count++;
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * writes every recorded event to fout as Chrome trace event JSON.  The
+ * threads that recorded the events must have finished.
+ *
+ * @param[in,out]     fout - stream opened for output.
+ *
+ * @returns true if fout was written and false otherwise.
+ *
+ * @par Example
+ * @verbatim
+   ofstream fout("run.json");
+   writeTrace(fout);
+   @endverbatim
+ *****************************************************************************/
+
+bool writeTrace(ostream& fout)
+{
+    size_t i;
+    size_t j;
+    size_t first;
+    const char* separator = "\n";
+    char line[256];
+
+    lock_guard<mutex> guard(traceLock);
+
+    fout << "{\"traceEvents\":[";
+
+    for (i = 0; i < traceBuffers.size(); i++)
+    {
+        traceBuffer& buffer = *traceBuffers[i];
+
+        snprintf(line, sizeof(line), "%s{\"name\":\"thread_name\",\"ph\":\"M\","
+            "\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s %d\"}}", separator,
+            buffer.thread, buffer.main ? "main" : "thread", buffer.thread);
+        fout << line;
+        separator = ",\n";
+
+        first = buffer.count > size_t(TRACE_EVENTS) ? buffer.count - TRACE_EVENTS : 0;
+
+        for (j = first; j < buffer.count; j++)
+        {
+            traceEvent& event = buffer.events[j % TRACE_EVENTS];
+
+            snprintf(line, sizeof(line), ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,"
+                "\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}", event.name, buffer.thread,
+                event.start / 1000.0, event.duration / 1000.0);
+            fout << line;
+        }
+    }
+
+    fout << "\n],\"displayTimeUnit\":\"ms\"}\n";
+
+    return bool(fout);
+}
+
+
+/** ***************************************************************************
+ * @author Aryan Raval
+ *
+ * @par Description
+ * stops recording and writes the trace to the file given to startTrace.
+ * Nothing is written if tracing was never started.
+ *
+ * @returns false if the file could not be written and true otherwise.
+ *
+ * @par Example
+ * @verbatim
+   if (!finishTrace())
+   {
+       cout << "Unable to write trace" << endl;
+   }
+   @endverbatim
+ *****************************************************************************/
+
+bool finishTrace()
+{
+    ofstream fout;
+
+    if (!traceOn.exchange(false))
+    {
+        return true;
+    }
+
+    fout.open(traceFile, ios::out | ios::trunc);
+
+    return fout.is_open() && writeTrace(fout);
+}